@@ -139,6 +139,7 @@ static void __idle_task( void *params )
 int main( void )
 {
     media_interface_t *mi_list = NULL;
+    fstream_t *playback_stream;
 
     cpu_disable_orphans();
 
@@ -155,6 +156,11 @@ int main( void )
     os_task_create( __idle_task, "Status", 550, NULL, 2, NULL );
 #endif
 
+    fstream_init( 2, malloc, free );
+    playback_stream = fstream_create( FSTREAM_PRIORITY__PLAYBACK );
+    media_flac_init( playback_stream );
+    media_mp3_init( playback_stream );
+
     mi_list = media_new();
 
     media_register_codec( mi_list, "flac", media_flac_play,
@@ -164,15 +170,14 @@ int main( void )
 
     led_init( 1 );
     device_status_init();
-    mc_init( pvPortMalloc );
+    mc_init( pvPortMalloc, malloc );
     dsp_init( 2 );
-    ri_init();
+    ri_init( playback_stream );
     ui_init();
     ui_t_init();
     //uid_init();
     playback_init( 1 );
     init_database( mi_list );
-    fstream_init( 2, malloc, free );
     system_time_init( 1 );
 #if (1 == ENABLE_SYSLOG_TO_DISC)
     system_log_init( 1, "/SYS-LOG.TXT" );
@@ -19,6 +19,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <sys/time.h>
 
 #include <ibus-radio-protocol/ibus-radio-protocol.h>
 #include <freertos/os.h>
@@ -27,6 +28,7 @@
 #include <memcard/memcard.h>
 #include <bsp/cpu.h>
 #include <playback/playback.h>
+#include <file-stream/file-stream.h>
 
 #include "radio-interface.h"
 #include "device-status.h"
@@ -50,6 +52,8 @@
 #define RI_DBASE_TASK_STACK_SIZE (900)
 
 #define RI_TASK_PRIORITY    1
+/* The card scan runs below the tasks that play what it has found. */
+#define RI_DBASE_TASK_PRIORITY  (RI_TASK_PRIORITY - 1)
 #define RI_POLL_TIMEOUT     15000   /* 15 seconds */
 
 #define _D1(...)
@@ -101,6 +105,10 @@ static queue_handle_t __ri_idle;
 static queue_handle_t __ri_active;
 static volatile bool __connected_to_radio;
 
+static struct timeval __mounted;
+static bool __waiting_for_audio;
+static fstream_t *__playback;
+
 /*----------------------------------------------------------------------------*/
 /*                             Function Prototypes                            */
 /*----------------------------------------------------------------------------*/
@@ -109,6 +117,7 @@ static void __blu_task( void *params );
 static void __ibus_task( void *params );
 static void __dbase_task( void *params );
 static void __card_status( const mc_card_status_t status );
+static void __database_playable( void );
 static void __database_populate( void );
 static void __database_purge( void );
 static void __send_state( ri_state_t *state );
@@ -120,16 +129,19 @@ static void __playback_cb( const pb_status_t status, const int32_t tx_id );
 static void __transition_db( ri_state_t *state );
 static void __no_discs_loop( ri_state_t *state );
 static void __command_loop( ri_state_t *state, song_node_t **song, void *user_data );
+static void __first_audio( void );
 
 /*----------------------------------------------------------------------------*/
 /*                             External Functions                             */
 /*----------------------------------------------------------------------------*/
 /* See radio-interface.h for details */
-bool ri_init( void )
+bool ri_init( fstream_t *playback )
 {
     int i;
     irp_init();
 
+    __playback = playback;
+
     __connected_to_radio = false;
 
      __poll_cmd = os_semaphore_create_binary();
@@ -169,8 +181,10 @@ bool ri_init( void )
     os_task_create( __ibus_task, "iBusMsg", RI_IBUS_TASK_STACK_SIZE,
                     NULL, RI_TASK_PRIORITY, NULL );
 
+    database_register_playable( &__database_playable );
+
     os_task_create( __dbase_task, "dbase", RI_DBASE_TASK_STACK_SIZE,
-                    NULL, RI_TASK_PRIORITY, NULL );
+                    NULL, RI_DBASE_TASK_PRIORITY, NULL );
 
     mc_register( &__card_status );
 
@@ -202,10 +216,27 @@ void ri_send_state( const irp_state_t device_status,
 /* See radio-interface.h for details */
 int32_t ri_playback_play( song_node_t *song )
 {
-    return playback_play( song->file_location, song->gain.track_gain,
+    /* Static to spare the stack, playback_play() makes its own copy. */
+    static char location[MAX_SHORT_FILENAME_PATH_W_NULL];
+
+    get_song_location( song, location );
+    return playback_play( location, song->gain.track_gain,
                           song->gain.track_peak, song->play_fn, &__playback_cb );
 }
 
+/* See radio-interface.h for details */
+bool ri_playback_queue_next( song_node_t *song )
+{
+    static char location[MAX_SHORT_FILENAME_PATH_W_NULL];
+
+    if( NULL == song ) {
+        return false;
+    }
+
+    get_song_location( song, location );
+    return fstream_queue_next( __playback, location );
+}
+
 /* See radio-interface.h for details */
 int32_t ri_playback_command( const pb_command_t command )
 {
@@ -368,7 +399,13 @@ static void __dbase_task( void *params )
         os_queue_receive( __ri_idle, &ri_msg, WAIT_FOREVER );
 
         if( DBASE__POPULATE == dbase_msg->cmd ) {
+            mc_cache_stats_t stats;
+
             ri_msg->d.dbase.success = populate_database( "/" );
+
+            mc_get_cache_stats( &stats );
+            fprintf( stderr, "Card scanned, sector cache: %lu hits %lu misses\n",
+                     (unsigned long) stats.hits, (unsigned long) stats.misses );
         } else {
             database_purge();
             ri_msg->d.dbase.success = true;
@@ -397,6 +434,21 @@ static void __card_status( const mc_card_status_t status )
     os_queue_send_to_back( __ri_active, &msg, WAIT_FOREVER );
 }
 
+/**
+ *  Called by the database (from the dbase task) when the first songs
+ *  found by a scan of the card can be played.
+ */
+static void __database_playable( void )
+{
+    ri_msg_t *msg;
+
+    os_queue_receive( __ri_idle, &msg, WAIT_FOREVER );
+    msg->type = RI_MSG_TYPE__DBASE_STATUS;
+    msg->d.dbase.cmd = DBASE__PLAYABLE;
+    msg->d.dbase.success = true;
+    os_queue_send_to_back( __ri_active, &msg, WAIT_FOREVER );
+}
+
 /**
  *  The database populate request helper function.
  */
@@ -563,6 +615,7 @@ static void __playback_cb( const pb_status_t status, const int32_t tx_id )
  */
 static void __transition_db( ri_state_t *state )
 {
+    struct timezone tz;
     bool keep_going;
 
     if( true == __connected_to_radio ) {
@@ -572,6 +625,9 @@ static void __transition_db( ri_state_t *state )
 
     device_status_set( DS__CARD_BEING_SCANNED );
 
+    /* The newlib glue fails gettimeofday() without a timezone. */
+    __waiting_for_audio = (0 == gettimeofday(&__mounted, &tz));
+
     __database_populate();
 
     keep_going = true;
@@ -580,8 +636,12 @@ static void __transition_db( ri_state_t *state )
 
         os_queue_receive( __ri_active, &msg, WAIT_FOREVER );
 
+        /* Playback starts with the first songs found if the card has
+         * to be scanned, the rest of the scan continues in the
+         * background. */
         if( (RI_MSG_TYPE__DBASE_STATUS == msg->type) &&
-            (DBASE__POPULATE == msg->d.dbase.cmd) )
+            ((DBASE__POPULATE == msg->d.dbase.cmd) ||
+             (DBASE__PLAYABLE == msg->d.dbase.cmd)) )
         {
             if( true == msg->d.dbase.success ) {
                 uint8_t map;
@@ -692,9 +752,28 @@ static void __command_loop( ri_state_t *state, song_node_t **song, void *user_da
 
         os_queue_receive( __ri_active, &msg, WAIT_FOREVER );
 
-        if( (RI_MSG_TYPE__PLAYBACK_STATUS == msg->type) ||
-            (RI_MSG_TYPE__IBUS_CMD == msg->type) )
+        if( (RI_MSG_TYPE__DBASE_STATUS == msg->type) &&
+            (DBASE__POPULATE == msg->d.dbase.cmd) )
+        {
+            /* The scan finished while the first songs were playing. */
+            _D1( "Card scan complete\n" );
+        } else if( (RI_MSG_TYPE__PLAYBACK_STATUS == msg->type) ||
+                   (RI_MSG_TYPE__IBUS_CMD == msg->type) )
         {
+            if( (RI_MSG_TYPE__PLAYBACK_STATUS == msg->type) &&
+                (PB_STATUS__PLAYING == msg->d.song.status) )
+            {
+                __first_audio();
+            }
+
+            /* Once a song, so a stutter can be put down to the card or
+             * not from the log. */
+            if( (RI_MSG_TYPE__PLAYBACK_STATUS == msg->type) &&
+                (PB_STATUS__END_OF_SONG == msg->d.song.status) )
+            {
+                fstream_log_stats( __playback, "Playback" );
+            }
+
             if( (RI_MSG_TYPE__IBUS_CMD == msg->type) &&
                 (IRP_CMD__GET_STATUS == msg->d.ibus.command) )
             {
@@ -716,3 +795,24 @@ static void __command_loop( ri_state_t *state, song_node_t **song, void *user_da
         os_queue_send_to_back( __ri_idle, &msg, WAIT_FOREVER );
     }
 }
+
+/**
+ *  Reports the time from the card being mounted to the first song
+ *  playing, once per card, to the system log.
+ */
+static void __first_audio( void )
+{
+    struct timeval now;
+    struct timezone tz;
+    uint32_t ms;
+
+    if( true == __waiting_for_audio ) {
+        __waiting_for_audio = false;
+
+        if( 0 == gettimeofday(&now, &tz) ) {
+            ms = (now.tv_sec - __mounted.tv_sec) * 1000 +
+                 (now.tv_usec - __mounted.tv_usec) / 1000;
+            fprintf( stderr, "Card mounted to first audio: %lu ms\n", (unsigned long) ms );
+        }
+    }
+}
@@ -22,12 +22,14 @@
 #include <stdint.h>
 
 #include <playback/playback.h>
+#include <file-stream/file-stream.h>
 #include <memcard/memcard.h>
 #include <ibus-radio-protocol/ibus-radio-protocol.h>
 
 typedef enum {
     DBASE__POPULATE,
-    DBASE__PURGE
+    DBASE__PURGE,
+    DBASE__PLAYABLE     /* Status only: songs found so far can be played */
 } dbase_cmd_t;
 
 typedef struct {
@@ -60,9 +62,11 @@ typedef struct {
 /**
  *  Used to initialize the radio interface subsystem.
  *
+ *  @param playback the stream the songs are played from
+ *
  *  @return true on success, false otherwise.
  */
-bool ri_init( void );
+bool ri_init( fstream_t *playback );
 
 /**
  *  Used to send state from the user interface implementations.
@@ -90,6 +94,17 @@ void ri_send_state( const irp_state_t device_status,
  */
 int32_t ri_playback_play( song_node_t *song );
 
+/**
+ *  Used to have the song that is expected to play next buffered as soon
+ *  as the current song has been read, so the change of song is gapless.
+ *  If a different song is played next, nothing is lost.
+ *
+ *  @param song the song expected to play next
+ *
+ *  @return true if the song was queued, false otherwise
+ */
+bool ri_playback_queue_next( song_node_t *song );
+
 /**
  *  Used to control a song's playback from a user interface implementation.
  *
@@ -90,6 +90,12 @@ static bool __is_valid_cd(uint8_t cd);
 static uint8_t __map_get( void );
 static uint8_t __find_display_number( song_node_t *song, const uint8_t disc );
 static bool __find_song( song_node_t **song, irp_cmd_t cmd, const uint8_t disc );
+static db_status_t __step_song( song_node_t **song, next_song_fct fn,
+                                const db_traverse_t direction,
+                                const uint8_t disc );
+static song_node_t* __peek_next_song( song_node_t *song, const uint8_t disc );
+static void __play( song_node_t *song );
+static bool __in_song( const song_node_t *song, const irp_state_t status );
 static void __update_song_display_info( song_node_t *song, const uint8_t disc );
 static void update_text_display_state( irp_state_t *device_status,
                                        const irp_mode_t device_mode,
@@ -126,6 +132,10 @@ static bool display_text_state = false;
 static bool random_state;
 static bool scan_state;
 
+/* The PB_STATUS__PLAYING with this id is the start of a new song, the
+ * others are the acks of RESUME & fast play. */
+static int32_t __play_tx_id = -1;
+
 /*----------------------------------------------------------------------------*/
 /*                             External Functions                             */
 /*----------------------------------------------------------------------------*/
@@ -260,11 +270,11 @@ static void __process_command( irp_state_t *device_status,
                         /* Not in the random mode */
                         next_song( song, DT_NEXT, DL_SONG );
                     }
-                    ri_playback_play( *song );
+                    __play( *song );
                 } else if( (IRP_CMD__SEEK__PREV == last) ||
                            (IRP_CMD__SEEK__NEXT == last) )
                 {
-                    ri_playback_play( *song );
+                    __play( *song );
                 } else {
                     ri_playback_command( PB_CMD__RESUME );
                 }
@@ -273,9 +283,14 @@ static void __process_command( irp_state_t *device_status,
 
             case IRP_CMD__FAST_PLAY__FORWARD:
                 if( IRP_STATE__FAST_PLAYING__FORWARD != *device_status ) {
+                    bool in_song = __in_song( *song, *device_status );
+
                     *device_status = IRP_STATE__FAST_PLAYING__FORWARD;
-                    if( __find_song( song, msg->d.ibus.command, *current_disc ) ) {
-                        ri_playback_play( *song );
+                    if( true == in_song ) {
+                        /* Skips through the song until IRP_CMD__PLAY. */
+                        ri_playback_command( PB_CMD__FAST_FORWARD );
+                    } else if( __find_song( song, msg->d.ibus.command, *current_disc ) ) {
+                        __play( *song );
                     } else {
                         update_text_display_state(device_status, *device_mode, disc_map, *current_disc, current_track);
                     }
@@ -284,9 +299,13 @@ static void __process_command( irp_state_t *device_status,
 
             case IRP_CMD__FAST_PLAY__REVERSE:
                 if( IRP_STATE__FAST_PLAYING__REVERSE != *device_status ) {
+                    bool in_song = __in_song( *song, *device_status );
+
                     *device_status = IRP_STATE__FAST_PLAYING__REVERSE;
-                    if( __find_song(song, msg->d.ibus.command, *current_disc) ) {
-                        ri_playback_play( *song );
+                    if( true == in_song ) {
+                        ri_playback_command( PB_CMD__FAST_REVERSE );
+                    } else if( __find_song(song, msg->d.ibus.command, *current_disc) ) {
+                        __play( *song );
                     } else {
                         update_text_display_state(device_status, *device_mode, disc_map, *current_disc, current_track);
                     }
@@ -308,7 +327,7 @@ static void __process_command( irp_state_t *device_status,
                 if( !__find_song(song, msg->d.ibus.command, *current_disc) ) {
                     update_text_display_state(device_status, *device_mode, disc_map, *current_disc, current_track);
                 }
-                ri_playback_play( *song );
+                __play( *song );
                 send_status = false;
                 break;
 
@@ -327,7 +346,7 @@ static void __process_command( irp_state_t *device_status,
                 if( !__find_song(song, msg->d.ibus.command, *current_disc) ) {
                     update_text_display_state(device_status, *device_mode, disc_map, *current_disc, current_track);
                 }
-                ri_playback_play( *song );
+                __play( *song );
                 send_status = false;
                 break;
 
@@ -359,6 +378,17 @@ static void __process_command( irp_state_t *device_status,
                 *current_track = __find_display_number( *song, *current_disc );
                 *device_status = IRP_STATE__PLAYING;
                 shouldSendText = DISPLAY_UPDATE;
+
+                /* The song after this one at PB_STATUS__END_OF_SONG. */
+                if( __play_tx_id == msg->d.song.tx_id ) {
+                    ri_playback_queue_next( __peek_next_song(*song, *current_disc) );
+                }
+                break;
+
+            case PB_STATUS__FAST_PLAYING:
+                _D2( "RI_MSG_TYPE__PLAYBACK_STATUS:PB_STATUS__FAST_PLAYING\n" );
+                /* The state was sent with the command. */
+                send_status = false;
                 break;
 
             case PB_STATUS__PAUSED:
@@ -404,7 +434,7 @@ static void __process_command( irp_state_t *device_status,
                 } else {
                     __find_song( song, IRP_CMD__SEEK__NEXT, (uint8_t)DM_SONG );
                 }
-                ri_playback_play( *song );
+                __play( *song );
                 shouldSendText = DISPLAY_UPDATE;
                 break;
 //            case PB_STATUS__SCAN_NEXT_SONG:
@@ -541,7 +571,6 @@ static uint8_t __find_display_number( song_node_t *song, const uint8_t disc )
  */
 static bool __find_song( song_node_t **song, irp_cmd_t cmd, const uint8_t disc )
 {
-    db_status_t rv;
     bool isNewSong = true;
     db_traverse_t direction;
     uint8_t disc_temp = disc;
@@ -580,19 +609,9 @@ static bool __find_song( song_node_t **song, irp_cmd_t cmd, const uint8_t disc )
 
     switch( disc_temp ) {
         case DM_SONG:
-            rv = get_next_song_fct( song, direction, DL_SONG );
-            if( DS_END_OF_LIST != rv ) {
-                break;
-            }
-            /* no break */
         case DM_ALBUM:
-            rv = get_next_song_fct( song, direction, DL_ALBUM );
-            if( DS_END_OF_LIST != rv ) {
-                break;
-            }
-            /* no break */
         case DM_ARTIST:
-            get_next_song_fct( song, direction, DL_ARTIST );
+            __step_song( song, get_next_song_fct, direction, disc_temp );
             break;
         case DM_TEXT_DISPLAY:
             set_display_state( !is_display_enabled());
@@ -608,6 +627,94 @@ static bool __find_song( song_node_t **song, irp_cmd_t cmd, const uint8_t disc )
     return isNewSong;
 }
 
+/**
+ * Moves to the next or previous song within the group of the disc, moving
+ * on to the next bigger group at the end of it.
+ *
+ * @param fn next_song or one of the shuffles
+ *
+ * @return the status of the last fn call, DS_FAILURE for a disc without
+ *         songs
+ */
+static db_status_t __step_song( song_node_t **song, next_song_fct fn,
+                                const db_traverse_t direction,
+                                const uint8_t disc )
+{
+    db_status_t rv = DS_FAILURE;
+
+    switch( disc ) {
+        case DM_SONG:
+            rv = (*fn)( song, direction, DL_SONG );
+            if( DS_END_OF_LIST != rv ) {
+                break;
+            }
+            /* no break */
+        case DM_ALBUM:
+            rv = (*fn)( song, direction, DL_ALBUM );
+            if( DS_END_OF_LIST != rv ) {
+                break;
+            }
+            /* no break */
+        case DM_ARTIST:
+            rv = (*fn)( song, direction, DL_ARTIST );
+            break;
+        default:
+            break;
+    }
+    return rv;
+}
+
+/**
+ * Finds the song PB_STATUS__END_OF_SONG will play after this one, without
+ * moving the shuffle on.
+ *
+ * @return the song, NULL if there isn't one to get ready
+ */
+static song_node_t* __peek_next_song( song_node_t *song, const uint8_t disc )
+{
+    if( is_random_enabled() ) {
+        if( DS_FAILURE == __step_song(&song, queued_peek_next_song, DT_NEXT, disc) ) {
+            return NULL;
+        }
+    } else {
+        __step_song( &song, next_song, DT_NEXT, DM_SONG );
+    }
+    return song;
+}
+
+/**
+ * Playback only takes the fast play commands in the middle of a song.  Idle
+ * it answers them with PB_STATUS__ERROR, which skips to the next song.
+ *
+ * @return true if the song is being played, paused or fast played
+ */
+static bool __in_song( const song_node_t *song, const irp_state_t status )
+{
+    if( NULL == song ) {
+        return false;
+    }
+
+    switch( status ) {
+        case IRP_STATE__PLAYING:
+        case IRP_STATE__PAUSED:
+        case IRP_STATE__FAST_PLAYING__FORWARD:
+        case IRP_STATE__FAST_PLAYING__REVERSE:
+            return true;
+        default:
+            break;
+    }
+    return false;
+}
+
+/**
+ * Plays the song & remembers the command, so its PB_STATUS__PLAYING can be
+ * told apart from the acks of the other commands.
+ */
+static void __play( song_node_t *song )
+{
+    __play_tx_id = ri_playback_play( song );
+}
+
 /**
  * Helper function which should be how we send enable text for this song to
  * be sent to the display library.
@@ -759,8 +866,8 @@ static uint8_t get_random_track( bool random_state )
 /**
  * Helper function which enables or disables the random
  * state.  When we enable random, we reseed the random
- * number generator with the current tick count since
- * boot.
+ * number generator & the shuffle with the current tick
+ * count since boot.
  * 
  * @param new_state true - enable the random next song
  *        false - disable the random next song
@@ -771,6 +878,7 @@ static void set_random_state( bool new_state )
         random_state = new_state;
         if( true == random_state ) {
             srand( cpu_get_sys_count() );
+            shuffle_set_seed( cpu_get_sys_count() );
         }
     }
 }
@@ -832,13 +940,16 @@ static void history_push( void *history_list, const ri_msg_t *msg )
                     break;
                 case IRP_CMD__PLAY:
                     break;
-                case IRP_CMD__SEEK__ALT_NEXT:
+                /* Kept, so IRP_CMD__PLAY carries on from the place the
+                 * fast play got to rather than starting the song over. */
                 case IRP_CMD__FAST_PLAY__FORWARD:
+                case IRP_CMD__FAST_PLAY__REVERSE:
+                    break;
+                case IRP_CMD__SEEK__ALT_NEXT:
                 case IRP_CMD__SEEK__NEXT:
                     cmd = IRP_CMD__SEEK__NEXT;
                     break;
                 case IRP_CMD__SEEK__ALT_PREV:
-                case IRP_CMD__FAST_PLAY__REVERSE:
                 case IRP_CMD__SEEK__PREV:
                     cmd = IRP_CMD__SEEK__PREV;
                     break;
@@ -7,6 +7,10 @@
 #include "generic.h"
 #include "song.h"
 
+static void __remove_song( song_node_t * song,
+        void (*deleter)(bt_node_t *node, void *user_data) );
+static void __keep_node( bt_node_t *node, void *user_data );
+
 song_node_t * add_song_to_root( generic_node_t * root,
         media_metadata_t * metadata,
         media_play_fn_t play_fn,
@@ -51,3 +55,40 @@ song_node_t * add_song_to_root( generic_node_t * root,
 
     return NULL;
 }
+
+void remove_song_from_root( song_node_t * song )
+{
+    __remove_song( song, delete_generic );
+}
+
+void detach_song_from_root( song_node_t * song )
+{
+    __remove_song( song, __keep_node );
+}
+
+static void __remove_song( song_node_t * song,
+        void (*deleter)(bt_node_t *node, void *user_data) )
+{
+    generic_node_t * album_n;
+    generic_node_t * artist_n;
+
+    if( NULL == song ) {
+        return;
+    }
+
+    album_n = song->d.parent;
+    artist_n = album_n->parent;
+
+    bt_remove( &album_n->list.children, (void*)song, deleter, NULL );
+    if( NULL == album_n->list.children.root ) {
+        bt_remove( &artist_n->list.children, (void*)album_n, deleter, NULL );
+        if( NULL == artist_n->list.children.root ) {
+            bt_remove( &artist_n->parent->list.children, (void*)artist_n, deleter, NULL );
+        }
+    }
+}
+
+/* The node stays in the arena until database_purge(). */
+static void __keep_node( bt_node_t *node, void *user_data )
+{
+}
@@ -27,4 +27,25 @@ song_node_t * add_song_to_root( generic_node_t * group,
         media_play_fn_t play_fn,
         char * file_location );
 
+/**
+ * Removes a song from the database.  The album & artist of the song are
+ * removed as well if they have no songs left.
+ *
+ * @note Must not be called once the database has been indexed.
+ *
+ * @param song the song to remove & free
+ */
+void remove_song_from_root( song_node_t * song );
+
+/**
+ * Takes a song out of the database like remove_song_from_root(), but the
+ * song, & its album & artist if they go too, are left in the arena until
+ * database_purge().  A song already handed out to be played stays valid.
+ *
+ * @note Must not be called once the database has been indexed.
+ *
+ * @param song the song to take out
+ */
+void detach_song_from_root( song_node_t * song );
+
 #endif /* __ADD_SONG_H__ */
@@ -0,0 +1,165 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "w_malloc.h"
+
+/*----------------------------------------------------------------------------*/
+/*                                 Constants                                  */
+/*----------------------------------------------------------------------------*/
+#define ALIGNMENT   8
+#define ALIGN( x )  (((x) + (ALIGNMENT - 1)) & ~((size_t) (ALIGNMENT - 1)))
+
+/*----------------------------------------------------------------------------*/
+/*                                Data Structures                             */
+/*----------------------------------------------------------------------------*/
+typedef struct __block {
+    struct __block *next;
+    /* Keeps data aligned for any node */
+    union {
+        double d;
+        void *p;
+        char data[ARENA_BLOCK_SIZE];
+    } u;
+} __block_t;
+
+/*----------------------------------------------------------------------------*/
+/*                            File Scoped Variables                           */
+/*----------------------------------------------------------------------------*/
+static __block_t *__first = NULL;
+static __block_t *__current = NULL;
+static size_t __current_used = 0;
+
+static arena_slab_t *__slabs = NULL;
+
+static size_t __reserved = 0;
+static size_t __used = 0;
+static size_t __high_water = 0;
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+
+/* See arena.h for information */
+void * arena_alloc( size_t size )
+{
+    void *ptr;
+
+    size = ALIGN( size );
+    if( (0 == size) || (ARENA_BLOCK_SIZE < size) ) {
+        return NULL;
+    }
+
+    if( (NULL == __current) || (ARENA_BLOCK_SIZE < __current_used + size) ) {
+        __block_t *next = (NULL == __current) ? __first : __current->next;
+
+        if( NULL == next ) {
+            next = (__block_t *) w_malloc( sizeof(__block_t) );
+            if( NULL == next ) {
+                return NULL;
+            }
+            __reserved += sizeof(__block_t);
+            if( NULL == __current ) {
+                __first = next;
+            } else {
+                __current->next = next;
+            }
+        }
+        /* The tail of the previous block is wasted. */
+        if( NULL != __current ) {
+            __used += ARENA_BLOCK_SIZE - __current_used;
+        }
+        __current = next;
+        __current_used = 0;
+    }
+
+    ptr = &__current->u.data[__current_used];
+    memset( ptr, 0, size );
+    __current_used += size;
+    __used += size;
+    if( __high_water < __used ) {
+        __high_water = __used;
+    }
+
+    return ptr;
+}
+
+/* See arena.h for information */
+void * arena_slab_alloc( arena_slab_t *slab )
+{
+    void *object;
+
+    if( NULL == slab ) {
+        return NULL;
+    }
+
+    if( false == slab->registered ) {
+        /* Remember the slab so arena_reset() can empty its free list. */
+        slab->next = __slabs;
+        __slabs = slab;
+        slab->registered = true;
+        if( slab->size < sizeof(void *) ) {
+            slab->size = sizeof(void *);
+        }
+    }
+
+    object = slab->free;
+    if( NULL == object ) {
+        return arena_alloc( slab->size );
+    }
+
+    slab->free = *(void **) object;
+    memset( object, 0, slab->size );
+    return object;
+}
+
+/* See arena.h for information */
+void arena_slab_free( arena_slab_t *slab, void *object )
+{
+    if( (NULL == slab) || (NULL == object) ) {
+        return;
+    }
+
+    *(void **) object = slab->free;
+    slab->free = object;
+}
+
+/* See arena.h for information */
+void arena_reset( void )
+{
+    arena_slab_t *slab;
+
+    for( slab = __slabs; NULL != slab; slab = slab->next ) {
+        slab->free = NULL;
+    }
+
+    __current = NULL;
+    __current_used = 0;
+    __used = 0;
+}
+
+/* See arena.h for information */
+void arena_get_stats( arena_stats_t *stats )
+{
+    if( NULL != stats ) {
+        stats->reserved = __reserved;
+        stats->used = __used;
+        stats->high_water = __high_water;
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * The database memory is taken from the heap in blocks of this size and
+ * handed out contiguously.  The blocks are never returned to the heap,
+ * arena_reset() makes them available for the next database instead, so
+ * rebuilding the database does not grow the heap (the target heap never
+ * frees anything).
+ */
+#define ARENA_BLOCK_SIZE    16384
+
+/**
+ * A slab of equally sized objects (nodes) carved from the arena.  Freed
+ * objects are kept on a free list and handed out again by
+ * arena_slab_alloc().  The arena remembers every slab used, so they
+ * must be static.
+ */
+typedef struct arena_slab {
+    size_t size;
+    void *free;
+    struct arena_slab *next;    /* Internal */
+    bool registered;            /* Internal */
+} arena_slab_t;
+
+#define ARENA_SLAB_INIT( object_size )  { (object_size), NULL, NULL, false }
+
+typedef struct {
+    size_t reserved;    /* Bytes of blocks taken from the heap */
+    size_t used;        /* Bytes handed out since the last reset */
+    size_t high_water;  /* The most bytes ever handed out */
+} arena_stats_t;
+
+/**
+ * Allocates zeroed memory from the arena.
+ *
+ * @param size the number of bytes needed, at most ARENA_BLOCK_SIZE
+ *
+ * @return the memory on success, NULL on failure
+ */
+void * arena_alloc( size_t size );
+
+/**
+ * Allocates a zeroed object from the slab.
+ *
+ * @param slab the slab to allocate from
+ *
+ * @return the object on success, NULL on failure
+ */
+void * arena_slab_alloc( arena_slab_t *slab );
+
+/**
+ * Returns an object to the slab so it can be used again.
+ *
+ * @param slab the slab the object was allocated from
+ * @param object the object to free
+ */
+void arena_slab_free( arena_slab_t *slab, void *object );
+
+/**
+ * Releases everything allocated from the arena & the slabs in one step.
+ * The blocks are kept for reuse.
+ */
+void arena_reset( void );
+
+/**
+ * Gets the usage of the arena.
+ *
+ * @param stats the structure to fill in
+ */
+void arena_get_stats( arena_stats_t *stats );
+
+#endif /* __ARENA_H__ */
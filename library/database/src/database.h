@@ -38,30 +38,60 @@ typedef enum {
     GNT_SONG = 3
 } generic_node_types_t;
 
+/* The names are kept in the string arena at their real length. */
+typedef union {
+    const char *root;
+    const char *artist;
+    const char *album;
+    const char *song;
+} node_name_t;
+
 typedef struct generic_node {
     generic_node_types_t type;
-    union {
-        char root[MAX_ROOT_NAME_W_NULL];
-        char artist[MAX_ARTIST_NAME_W_NULL];
-        char album[MAX_ALBUM_TITLE_W_NULL];
-        char song[MAX_SONG_TITLE_W_NULL];
-    } name;
+    node_name_t name;
     bt_node_t node;
-    index_song_node_t list; // Used when group/artist/album node
 
     // Parent -- Could be group, artist, album
     struct generic_node * parent;
     uint32_t index; // The index number of this element in the list
+
+    index_song_node_t list; // Used when group/artist/album node -- must be last
 } generic_node_t;
 
+/* Songs have no children, so they only carry the members of
+ * generic_node_t which come before the list.  The two must match. */
+typedef struct {
+    generic_node_types_t type;
+    node_name_t name;
+    bt_node_t node;
+    struct generic_node * parent;
+    uint32_t index;
+} leaf_node_t;
+
+/* The replay gain of a song, single precision is plenty. */
+typedef struct {
+    float track_gain;
+    float track_peak;
+    float album_gain;
+    float album_peak;
+} song_gain_t;
+
 typedef struct {
-    generic_node_t d;
-    char file_location[MAX_SHORT_FILENAME_PATH_W_NULL];
-    media_gain_t gain;
+    leaf_node_t d;
+
+    /* The file is directory + '/' + file_name.  The directory is shared by
+     * all the songs in it.  If the file name is not 8.3, the whole path is
+     * in directory and file_name is empty. */
+    const char *directory;
+    char file_name[MAX_SHORT_FILENAME_W_NULL];
 
     uint16_t track_number;
-    media_command_fn_t command_fn;
+    song_gain_t gain;
     media_play_fn_t play_fn;
+
+    /* The directory entry of the file when it was scanned. */
+    uint32_t file_size;
+    uint32_t file_mtime;
 } song_node_t;
 
 typedef enum {
@@ -83,7 +113,8 @@ typedef enum {
 } db_status_t;
 
 /**
- * Sets up the database function pointers for use.
+ * Sets up the database function pointers for use & starts the tasks which
+ * read the tags of the files while populating the database.
  *
  * @param mi the media interface to associate with the database
  * 
@@ -147,25 +178,63 @@ uint32_t get_song_number( song_node_t * song,
                           const db_level_t level );
 
 /**
- * Using this function will keep a playlist queue such that
- * a DT_PREVIOUS will result in the previous song being played.
- * If no previous song is available, the @next_song rules will be
- * followed with a supplied DT_RANDOM.
+ * Gets the full path of the file associated with this song
  *
- * @param operation if not DT_PREVIOUS, a DT_RANDOM will be used
- *        for the @next_song call
+ * @param song pointer to the song structure
+ * @param location the buffer to write the path into, it must hold at
+ *        least MAX_SHORT_FILENAME_PATH_W_NULL characters
+ */
+void get_song_location( const song_node_t * song, char * location );
+
+/**
+ * Shuffles through the songs of the level's group (the album for DL_SONG,
+ * the artist for DL_ALBUM & everything for DL_ARTIST) without repeating
+ * a song until all of them were played.  DT_PREVIOUS steps back through
+ * the same order, as far back as wanted.  If the current song was not
+ * picked by this function (or is in a different group), the shuffle
+ * starts over from it.
+ *
+ * @param operation DT_PREVIOUS for the previous song, anything else for
+ *        the next one
  *
- * @note Songs collected via next_song interface will not be placed
- *       into the play queue
+ * @return DS_SUCCESS when a new song is found, DS_END_OF_LIST when all the
+ *         songs of the group were played and a new order was started,
+ *         DS_FAILURE otherwise
  */
 db_status_t queued_next_song( song_node_t ** current_song,
                              const db_traverse_t operation,
                              const db_level_t level );
 
+/**
+ * Finds the song queued_next_song() would, without moving the shuffle on,
+ * so the song after the current one can be got ready ahead of time.
+ *
+ * @return the same as queued_next_song()
+ */
+db_status_t queued_peek_next_song( song_node_t ** current_song,
+                                   const db_traverse_t operation,
+                                   const db_level_t level );
+
+/**
+ * Sets the seed of the queued_next_song() shuffles.  The same seed & the
+ * same current song always give the same order, so saving the seed keeps
+ * the order across power cycles.
+ *
+ * @param seed the new seed
+ */
+void shuffle_set_seed( const uint32_t seed );
+
+/**
+ * @return the seed of the queued_next_song() shuffles
+ */
+uint32_t shuffle_get_seed( void );
+
 typedef db_status_t (*next_song_fct)( song_node_t **, const db_traverse_t, const db_level_t );
 
 /**
- * Cleans up all the Group/Artist/Album/Song nodes.
+ * Cleans up all the Group/Artist/Album/Song nodes in one step.  The
+ * memory is kept for the next database instead of being returned to
+ * the heap.
  */
 void database_purge( void );
 
@@ -189,14 +258,37 @@ void database_purge( void );
  * Searches all directories for supported file types which can be played
  * and places the metadata of the files into the database.
  * 
- * ** WARNING ** this call will take a long time.
+ * The database is saved to an index file on the card so the next call
+ * loads it instead of reading every file's tags, & only reads the tags
+ * of the files which changed since.
+ * 
+ * ** WARNING ** this call will take a long time without an index.
  * 
  * @param RootDirectory the identifier which is the location of the root
  *        filesystem.  NULL terminated string.
  *        
- * @return true if the database was properly created and setup.  False
- *         otherwise.
+ * @return true if the database was properly created and setup, or if
+ *         the scan failed after songs were already playable (the songs
+ *         found are kept).  False otherwise.
  */
 bool populate_database( const char * RootDirectory );
 
+/**
+ * Called from populate_database() when the songs loaded from the index,
+ * or the first song found while scanning the card, can be played.
+ */
+typedef void (*db_playable_fn_t)( void );
+
+/**
+ * Registers the function to call when the index or a scan of the card
+ * makes the first song playable.  From then on, until populate_database()
+ * returns, the database holds the songs loaded & found so far in that
+ * order and next_song() & queued_next_song() step through all of them at
+ * every level.  The songs handed out stay valid once the scan is done,
+ * even those of files found to be gone.
+ *
+ * @param fn the function to call, NULL for none
+ */
+void database_register_playable( db_playable_fn_t fn );
+
 #endif /* __DATABASE_H__ */
@@ -0,0 +1,76 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stddef.h>
+
+#include "database_lock.h"
+
+#ifndef UNIT_TEST
+#include <freertos/os.h>
+
+/*----------------------------------------------------------------------------*/
+/*                            File Scoped Variables                           */
+/*----------------------------------------------------------------------------*/
+static mutex_handle_t __lock = NULL;
+#endif
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+#ifndef UNIT_TEST
+
+/* See database_lock.h for information */
+bool database_lock_init( void )
+{
+    if( NULL == __lock ) {
+        __lock = os_mutex_create();
+    }
+    return (NULL != __lock);
+}
+
+/* See database_lock.h for information */
+void database_lock( void )
+{
+    if( NULL != __lock ) {
+        os_mutex_take( __lock, WAIT_FOREVER );
+    }
+}
+
+/* See database_lock.h for information */
+void database_unlock( void )
+{
+    if( NULL != __lock ) {
+        os_mutex_give( __lock );
+    }
+}
+
+#else
+
+/* The unit tests run the scan & the navigation from the same thread. */
+bool database_lock_init( void )
+{
+    return true;
+}
+
+void database_lock( void )
+{
+}
+
+void database_unlock( void )
+{
+}
+
+#endif
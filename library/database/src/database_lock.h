@@ -0,0 +1,25 @@
+#ifndef __DATABASE_LOCK_H__
+#define __DATABASE_LOCK_H__
+
+#include <stdbool.h>
+
+/**
+ * The database lock keeps the song table consistent between the task
+ * populating the database & the tasks navigating it while the card is
+ * still being scanned.  It is not recursive.
+ *
+ * @return true on success, false otherwise
+ */
+bool database_lock_init( void );
+
+/**
+ * Takes the database lock, waiting as long as needed.
+ */
+void database_lock( void );
+
+/**
+ * Gives the database lock back.
+ */
+void database_unlock( void );
+
+#endif /* __DATABASE_LOCK_H__ */
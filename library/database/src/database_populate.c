@@ -18,17 +18,24 @@
 #include <stdint.h>
 #include <media-interface/media-interface.h>
 #include <stdlib.h>
+#include <string.h>
 #include <binary-tree-avl/binary-tree-avl.h>
 
 #include "database.h"
 #include "internal_database.h"
 #include "indexer.h"
 #include "add_song.h"
+#include "database_lock.h"
 #include "database_print.h"
 #include "file_os_wrapper.h"
 #include "mi_interface.h"
 #include "generic.h"
 #include "file_helper.h"
+#include "directory_walker.h"
+#include "index_file.h"
+#include "queued_next_song.h"
+#include "scan_pipeline.h"
+#include "w_malloc.h"
 
 #define DEBUG_DUMP_LIST 1
 #define PRINT_DB_INDEX_TIME 0
@@ -38,8 +45,49 @@ typedef uint32_t portTickType;
 extern portTickType xTaskGetTickCount(void);
 #endif
 
-static bool __put_songs_into_root( const char * RootDirectory );
+typedef struct {
+    song_node_t **songs;    /* Sorted by location */
+    uint8_t *seen;          /* One bit per song */
+    uint32_t count;
+    const char *index_file;
+    uint32_t signature;     /* Of the files walked so far */
+} __rescan_t;
 
+static bool __put_songs_into_root( const char * RootDirectory,
+                                   const char * index_file,
+                                   uint32_t *signature );
+static void __add_file_to_root( const char *full_path,
+                                const file_info_t *file_info,
+                                media_metadata_t *metadata,
+                                media_play_fn_t play_fn,
+                                void *user_data );
+static void __append_song( song_node_t *song, const char *full_path );
+static void __scan_done( void );
+static bool __rescan_songs_into_root( const char * RootDirectory,
+                                      const char * index_file,
+                                      uint32_t *signature );
+static bool __rescan_file( const char *full_path,
+                           const file_info_t *file_info,
+                           void *user_data );
+static song_node_t * __add_file( const char *full_path,
+                                 const file_info_t *file_info );
+static song_node_t * __insert_song( const char *full_path,
+                                    const file_info_t *file_info,
+                                    media_metadata_t *metadata,
+                                    media_play_fn_t play_fn );
+static bt_ir_t __collect_songs( bt_node_t *node, void *user_data );
+static int __song_location_compare( const song_node_t *song,
+                                    const char *location );
+static int __compare_location( const void *a, const void *b );
+static int __find_location( const void *key, const void *b );
+
+static db_playable_fn_t __playable_fn = NULL;
+
+/* See database.h for information */
+void database_register_playable( db_playable_fn_t fn )
+{
+    __playable_fn = fn;
+}
 
 /**
  * The structure of the pools are:
@@ -61,7 +109,16 @@ static bool __put_songs_into_root( const char * RootDirectory );
  * Searches all directories for supported file types which can be played
  * and places the metadata of the files into the database.
  * 
- * ** WARNING ** this call will take a long time.
+ * The database is loaded from the index file (INDEX_FILE_NAME) in
+ * RootDirectory and is playable at once, see database_register_playable().
+ * The card is then walked to check the index against it: only the new or
+ * changed files (by name, size & timestamp) are read and merged into the
+ * loaded database, and the index file is rewritten if anything changed.
+ * 
+ * Without a usable index every file is read.  The songs are playable as
+ * they are found.
+ * 
+ * ** WARNING ** this call will take a long time without an index.
  * 
  * @param RootDirectory the identifier which is the location of the root
  *        filesystem.  NULL terminated string.
@@ -72,22 +129,72 @@ static bool __put_songs_into_root( const char * RootDirectory );
 bool populate_database( const char * RootDirectory )
 {
     bt_node_t * root;
+    char index_file[MAX_SHORT_FILENAME_PATH_W_NULL];
+    size_t index_file_size;
+    uint32_t signature;
+    uint32_t saved_signature;
+    bool walked;
     
     database_purge();
     
-    if( NULL != RootDirectory ) {
+    if(    ( NULL != RootDirectory )
+        && ( strlen(RootDirectory) + MAX_SHORT_FILENAME_W_NULL < MAX_SHORT_FILENAME_PATH ) )
+    {
 #if ( 0 != PRINT_DB_INDEX_TIME )
         portTickType begin = xTaskGetTickCount();
         portTickType end;
 #endif
+        strcpy( index_file, RootDirectory );
+        index_file_size = strlen( index_file );
+        append_to_path( index_file, &index_file_size, INDEX_FILE_NAME );
+
         root = get_new_generic_node(GNT_ROOT, "root");
         if( NULL != root ) {
             rdn.root = (generic_node_t *)(root->data);
-            if( __put_songs_into_root(RootDirectory) ) {
-                index_root(&(rdn.root->node));
+
+            /* The saved index is played from right away.  The walk which
+             * only re-reads the tags of the files that changed works out
+             * the signature that says if the index is still good. */
+            if( true == index_file_load(rdn.root, index_file, &saved_signature) ) {
+                walked = __rescan_songs_into_root( RootDirectory, index_file, &signature );
+
+                /* Once songs were handed out they have to stay. */
+                if( (true == walked) || (0 != rdn.songs.count) ) {
+                    __scan_done();
+                    if( (true == walked) && (saved_signature != signature) ) {
+                        index_file_save( rdn.root, index_file, signature );
+                    }
+#if ( 0 != PRINT_DB_INDEX_TIME )
+                    end = xTaskGetTickCount();
+                    printf("DB Load Time took: %u\n", end - begin);
+#endif
+                    return true;
+                }
+            }
+
+            /* The index is missing, corrupt or could not be checked -
+             * start over. */
+            database_purge();
+            root = get_new_generic_node(GNT_ROOT, "root");
+        }
+        if( NULL != root ) {
+            rdn.root = (generic_node_t *)(root->data);
+            database_lock();
+            rdn.scanning = true;
+            database_unlock();
+
+            walked = __put_songs_into_root( RootDirectory, index_file, &signature );
+
+            /* Once songs were handed out they have to stay, so keep
+             * whatever was found even if the walk failed part way. */
+            if( (true == walked) || (0 != rdn.songs.count) ) {
+                __scan_done();
 #if (0 != DEBUG_DUMP_LIST)
                 database_print();
 #endif
+                if( true == walked ) {
+                    index_file_save( rdn.root, index_file, signature );
+                }
 #if ( 0 != PRINT_DB_INDEX_TIME )
                 end = xTaskGetTickCount();
                 printf("DB Time took: %u\n", end - begin);
@@ -100,78 +207,269 @@ bool populate_database( const char * RootDirectory )
     return false;
 }
 
-static bool __put_songs_into_root( const char * RootDirectory )
+/**
+ * Reads the tags of every file on the card.  The walk & the tag reading
+ * run in the scan pipeline tasks, this task only adds the songs.
+ *
+ * @param RootDirectory the directory to walk
+ * @param index_file the index file, left out of the signature
+ * @param signature the card signature, only set if true is returned
+ *
+ * @return true if the whole card was walked, false otherwise
+ */
+static bool __put_songs_into_root( const char * RootDirectory,
+                                   const char * index_file,
+                                   uint32_t *signature )
+{
+    return scan_pipeline_run( RootDirectory, __add_file_to_root, NULL,
+                              index_file, signature );
+}
+
+static void __add_file_to_root( const char *full_path,
+                                const file_info_t *file_info,
+                                media_metadata_t *metadata,
+                                media_play_fn_t play_fn,
+                                void *user_data )
+{
+    __append_song( __insert_song(full_path, file_info, metadata, play_fn),
+                   full_path );
+}
+
+/**
+ * Adds a song found while scanning to the scan snapshot, so it can be
+ * played before the scan is done.
+ *
+ * @param song the song added for full_path, may be NULL
+ * @param full_path the file the song was found in
+ */
+static void __append_song( song_node_t *song, const char *full_path )
+{
+    bool first = false;
+
+    /* Only new songs, a duplicate is already in the snapshot. */
+    if( (NULL != song) && (0 == __song_location_compare(song, full_path)) ) {
+        database_lock();
+        if( true == index_append_song(song) ) {
+            first = (1 == rdn.songs.count);
+        }
+        database_unlock();
+    }
+
+    if( (true == first) && (NULL != __playable_fn) ) {
+        (*__playable_fn)();
+    }
+}
+
+/* Numbers the songs, which ends the scan snapshot. */
+static void __scan_done( void )
+{
+    database_lock();
+    rdn.scanning = false;
+    index_root(&(rdn.root->node));
+    queued_song_clear();
+    database_unlock();
+}
+
+/**
+ * Merges the changes on the card into the (un-indexed) database loaded
+ * from the index file.  The loaded songs are playable while the card is
+ * walked, as if they had been found by a scan.  Only new or changed files
+ * have their tags read, songs for files which are gone are taken out.
+ *
+ * @param RootDirectory the directory to walk
+ * @param index_file the index file, left out of the signature
+ * @param signature the card signature, only set if true is returned
+ *
+ * @return true if the whole card was walked, false otherwise
+ */
+static bool __rescan_songs_into_root( const char * RootDirectory,
+                                      const char * index_file,
+                                      uint32_t *signature )
+{
+    __rescan_t rescan;
+    uint32_t i;
+    bool rv = false;
+
+    rescan.songs = NULL;
+    rescan.seen = NULL;
+    rescan.count = 0;
+    rescan.index_file = index_file;
+    rescan.signature = INDEX_FILE_SIGNATURE_START;
+    bt_iterate( &rdn.root->list.children, __collect_songs, NULL, &rescan );
+
+    if( 0 < rescan.count ) {
+        rescan.songs = (song_node_t **) w_malloc( rescan.count * sizeof(song_node_t *) );
+        rescan.seen = (uint8_t *) w_malloc( (rescan.count + 7) / 8 );
+        if( (NULL == rescan.songs) || (NULL == rescan.seen) ) {
+            goto done;
+        }
+
+        rescan.count = 0;
+        bt_iterate( &rdn.root->list.children, __collect_songs, NULL, &rescan );
+    }
+
+    /* In the order of the index, so play starts with the first artist. */
+    database_lock();
+    rdn.scanning = true;
+    for( i = 0; i < rescan.count; i++ ) {
+        index_append_song( rescan.songs[i] );
+    }
+    database_unlock();
+
+    if( (0 != rdn.songs.count) && (NULL != __playable_fn) ) {
+        (*__playable_fn)();
+    }
+
+    if( 0 < rescan.count ) {
+        qsort( rescan.songs, rescan.count, sizeof(song_node_t *), __compare_location );
+    }
+
+    if( true == dir_walk(RootDirectory, __rescan_file, &rescan) ) {
+        /* Anything not seen on the card anymore was deleted.  The song
+         * may have been handed out already, so it is only taken out of
+         * the tree. */
+        for( i = 0; i < rescan.count; i++ ) {
+            if( 0 == (rescan.seen[i >> 3] & (1 << (i & 7))) ) {
+                detach_song_from_root( rescan.songs[i] );
+            }
+        }
+        *signature = rescan.signature;
+        rv = true;
+    }
+
+done:
+    if( NULL != rescan.songs ) {
+        free( rescan.songs );
+    }
+    if( NULL != rescan.seen ) {
+        free( rescan.seen );
+    }
+    return rv;
+}
+
+static bool __rescan_file( const char *full_path,
+                           const file_info_t *file_info,
+                           void *user_data )
+{
+    __rescan_t *rescan = (__rescan_t *) user_data;
+    song_node_t **found = NULL;
+    song_node_t *song;
+
+    rescan->signature = index_file_signature_add( rescan->signature,
+                                                  rescan->index_file,
+                                                  full_path, file_info );
+
+    if( 0 < rescan->count ) {
+        found = (song_node_t **) bsearch( full_path, rescan->songs, rescan->count,
+                                          sizeof(song_node_t *), __find_location );
+    }
+
+    if( NULL != found ) {
+        uint32_t i = found - rescan->songs;
+
+        if(    ( (*found)->file_size == file_info->size )
+            && ( (*found)->file_mtime == file_info->mtime ) )
+        {
+            /* Unchanged, keep the song as is. */
+            rescan->seen[i >> 3] |= (1 << (i & 7));
+            return true;
+        }
+
+        /* Changed - the old song is removed after the walk unless
+         * the new tags land on the very same song. */
+        song = __add_file( full_path, file_info );
+        if( song == *found ) {
+            rescan->seen[i >> 3] |= (1 << (i & 7));
+        } else {
+            __append_song( song, full_path );
+        }
+        return true;
+    }
+
+    /* New file. */
+    __append_song( __add_file(full_path, file_info), full_path );
+    return true;
+}
+
+static song_node_t * __add_file( const char *full_path,
+                                 const file_info_t *file_info )
 {
-    char full_path[MAX_SHORT_FILENAME_PATH_W_NULL];
-    size_t full_path_size;
-    long last_dir_next_read_loc[260];
-    int16_t last_dir_index = -1;
-    
     /* Song structures */
     media_metadata_t metadata;
     media_play_fn_t play_fn;
 
-    if( NULL == RootDirectory ) {
-        return false;
+    if( MI_RETURN_OK ==
+            mi_get_information(full_path, &metadata, &play_fn) ) {
+        return __insert_song( full_path, file_info, &metadata, play_fn );
     }
-    
-    strcpy( full_path, RootDirectory );
-    full_path_size = strlen(full_path);
-    if( FRV_RETURN_GOOD != open_directory( full_path ) ) {
-        return false;
-    }
-    while( 1 ) {
-        file_info_t file_info;
-        /* Open the next element in this directory */
-        file_return_value rv = get_next_element_in_directory( &file_info );
-        if( FRV_END_OF_ENTRIES == rv ) {
-            /* We don't have any more files in this directory.
-             */
-            if( -1 == last_dir_index ) {
-                /* This is the base directory which was passed in.  We
-                 * don't want to search folders below this.
-                 */
-                return true;
-            }
-            /* Go up a directory and continue searching for files
-             */
-            /* Open the parent directory */
-            if(    ( false == remove_last_dir_name( full_path, &full_path_size ) )
-                || ( FRV_RETURN_GOOD != open_directory( full_path ) )
-                || ( FRV_RETURN_GOOD !=
-                        seek_to_index_in_directory(last_dir_next_read_loc[last_dir_index--]) ) )
-            {
-                return false;
-            }
-        } else if( FRV_RETURN_GOOD == rv ) {
-            append_to_path(full_path, &full_path_size, file_info.short_filename );
-            if( true == file_info.is_dir ) {
-                /* Open the found directory for searching.
-                 * But first mark where we are in this directory
-                 */
-                if(    ( FRV_RETURN_GOOD !=
-                             get_index_in_directory(&last_dir_next_read_loc[++last_dir_index]) )
-                    || ( FRV_RETURN_GOOD != open_directory( full_path ) ) )
-                {
-                    return false;
-                }
+    return NULL;
+}
 
-            } else { /* This is a file */
-                if( MI_RETURN_OK ==
-                        mi_get_information(full_path, &metadata, &play_fn) ) {
-                    if( 0 < metadata.disc_number ) {
-                        metadata.track_number += 1000 * (metadata.disc_number - 1);
-                    }
-                    add_song_to_root( rdn.root, &metadata,
-                            play_fn, full_path );
-                }
-                if( false == remove_last_dir_name( full_path, &full_path_size ) ) {
-                    return false;
-                }
-            }
-        } else {
-            /* We ran into some sort of error, bail. */
-            return false;
+static song_node_t * __insert_song( const char *full_path,
+                                    const file_info_t *file_info,
+                                    media_metadata_t *metadata,
+                                    media_play_fn_t play_fn )
+{
+    song_node_t *song;
+
+    if( 0 < metadata->disc_number ) {
+        metadata->track_number += 1000 * (metadata->disc_number - 1);
+    }
+    song = add_song_to_root( rdn.root, metadata,
+                             play_fn, (char *) full_path );
+    if( NULL != song ) {
+        song->file_size = file_info->size;
+        song->file_mtime = file_info->mtime;
+    }
+    return song;
+}
+
+static bt_ir_t __collect_songs( bt_node_t *node, void *user_data )
+{
+    __rescan_t *rescan = (__rescan_t *) user_data;
+    generic_node_t *gn = (generic_node_t *) node->data;
+
+    if( GNT_SONG == gn->type ) {
+        if( NULL != rescan->songs ) {
+            rescan->songs[rescan->count] = (song_node_t *) gn;
         }
+        rescan->count++;
+    } else {
+        bt_iterate( &gn->list.children, __collect_songs, NULL, rescan );
     }
+    return BT_IR__CONTINUE;
+}
+
+/* Same result as a strcmp() of the song's location against location,
+ * without having to build the song's location. */
+static int __song_location_compare( const song_node_t *song,
+                                    const char *location )
+{
+    size_t length = strlen( song->directory );
+    int rv = strncmp( song->directory, location, length );
+
+    if( 0 != rv ) {
+        return rv;
+    }
+    location += length;
+    if( '\0' == song->file_name[0] ) {
+        return -((unsigned char) *location);
+    }
+    if( '/' != *location ) {
+        return '/' - (unsigned char) *location;
+    }
+    return strcmp( song->file_name, location + 1 );
+}
+
+static int __compare_location( const void *a, const void *b )
+{
+    char location[MAX_SHORT_FILENAME_PATH_W_NULL];
+
+    get_song_location( *(song_node_t **) a, location );
+    return -__song_location_compare( *(song_node_t **) b, location );
+}
+
+static int __find_location( const void *key, const void *b )
+{
+    return -__song_location_compare( *(song_node_t **) b, (const char *) key );
 }
@@ -19,6 +19,7 @@
 #include "database.h"
 #include "internal_database.h"
 #include "database_print.h"
+#include "arena.h"
 
 #define DISPLAY_OFFSET          2
 #define MAX_DISPLAY_ARTIST_LEN  20
@@ -33,8 +34,13 @@
 
 void database_print( void )
 {
-    
+    arena_stats_t stats;
+
+    arena_get_stats( &stats );
     fprintf(stderr, "==== Database ==========================\n");
+    fprintf(stderr, " memory: %lu used, %lu high water, %lu reserved\n",
+            (unsigned long) stats.used, (unsigned long) stats.high_water,
+            (unsigned long) stats.reserved);
     if( NULL != rdn.root )
     {
         fprintf(stderr,
@@ -93,6 +99,9 @@ bt_ir_t song_print(bt_node_t *node, void *user_data)
 {
     song_node_t *song = (song_node_t*) node->data;
     int spaces = (int) user_data;
+    char location[MAX_SHORT_FILENAME_PATH_W_NULL];
+
+    get_song_location( song, location );
     fprintf(stderr,
 #ifdef INT32_STANDARD_INT_SIZE
            "%*.*s %*.*u %u) %-*.*s  [% 3.3f:% 3.3f|% 3.3f:% 3.3f] -- %-*.*s\n",
@@ -105,6 +114,6 @@ bt_ir_t song_print(bt_node_t *node, void *user_data)
            MAX_DISPLAY_SONG_LEN, MAX_DISPLAY_SONG_LEN, song->d.name.song,
            song->gain.album_gain, song->gain.album_peak,
            song->gain.track_gain, song->gain.track_peak,
-           MAX_FILE_NAME, MAX_FILE_NAME, song->file_location );
+           MAX_FILE_NAME, MAX_FILE_NAME, location );
     return BT_IR__CONTINUE;
 }
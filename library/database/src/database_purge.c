@@ -14,18 +14,27 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
  */
 
+#include <string.h>
+
 #include "database.h"
 #include "internal_database.h"
-#include "generic.h"
+#include "arena.h"
+#include "database_lock.h"
 #include "queued_next_song.h"
+#include "string_arena.h"
 
 /* See database.h for information */
 void database_purge( void )
 {
-    if( NULL != rdn.root ) {
-        delete_generic(&(rdn.root->node), NULL);
-        rdn.root = NULL;
-    }
+    /* All the nodes & names live in the arena, so there is no need to
+     * walk the tree to free them one by one. */
+    database_lock();
+    rdn.root = NULL;
+    rdn.scanning = false;
+    memset( &rdn.songs, 0, sizeof(song_table_t) );
+    string_arena_purge();
+    arena_reset();
 
     queued_song_clear();
+    database_unlock();
 }
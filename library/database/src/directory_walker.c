@@ -0,0 +1,90 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "database.h"
+#include "directory_walker.h"
+#include "file_os_wrapper.h"
+#include "file_helper.h"
+
+/* See directory_walker.h for information */
+bool dir_walk( const char *RootDirectory, dir_walk_fn_t file_fn, void *user_data )
+{
+    char full_path[MAX_SHORT_FILENAME_PATH_W_NULL];
+    size_t full_path_size;
+    int32_t depth = 0;
+    bool walked = false;
+
+    if( (NULL == RootDirectory) || (NULL == file_fn) ) {
+        return false;
+    }
+
+    strcpy( full_path, RootDirectory );
+    full_path_size = strlen(full_path);
+    if( FRV_RETURN_GOOD != open_directory( full_path ) ) {
+        return false;
+    }
+    while( 1 ) {
+        file_info_t file_info;
+        /* Open the next element in this directory */
+        file_return_value rv = get_next_element_in_directory( &file_info );
+        if( FRV_END_OF_ENTRIES == rv ) {
+            /* We don't have any more files in this directory.
+             */
+            if( 0 == depth ) {
+                /* This is the base directory which was passed in.  We
+                 * don't want to search folders below this.
+                 */
+                walked = true;
+                break;
+            }
+            /* Go up a directory and continue searching for files
+             * where we left off.
+             */
+            if(    ( false == remove_last_dir_name( full_path, &full_path_size ) )
+                || ( FRV_RETURN_GOOD != leave_directory( full_path ) ) )
+            {
+                break;
+            }
+            depth--;
+        } else if( FRV_RETURN_GOOD == rv ) {
+            append_to_path(full_path, &full_path_size, file_info.short_filename );
+            if( true == file_info.is_dir ) {
+                /* Open the found directory for searching. */
+                if( FRV_RETURN_GOOD != enter_directory( full_path ) ) {
+                    break;
+                }
+                depth++;
+            } else { /* This is a file */
+                if(    ( false == file_fn(full_path, &file_info, user_data) )
+                    || ( false == remove_last_dir_name( full_path, &full_path_size ) ) )
+                {
+                    break;
+                }
+            }
+        } else {
+            /* We ran into some sort of error, bail. */
+            break;
+        }
+    }
+
+    /* The directories are held by the walking task, let them go. */
+    close_directories();
+    return walked;
+}
@@ -0,0 +1,32 @@
+#ifndef __DIRECTORY_WALKER_H__
+#define __DIRECTORY_WALKER_H__
+
+#include <stdbool.h>
+#include "file_os_wrapper.h"
+
+/**
+ * Called for every file (not directory) found while walking.
+ *
+ * @param full_path NULL terminated path to the file
+ * @param file_info the directory entry information of the file
+ * @param user_data the user_data passed to dir_walk()
+ *
+ * @return true to continue walking, false to stop the walk with an error
+ */
+typedef bool (*dir_walk_fn_t)( const char *full_path,
+                               const file_info_t *file_info,
+                               void *user_data );
+
+/**
+ * Walks the directory tree below RootDirectory depth first, calling
+ * file_fn for each file found.
+ *
+ * @param RootDirectory NULL terminated path of the directory to walk
+ * @param file_fn the function to call for each file
+ * @param user_data passed to file_fn
+ *
+ * @return true if the whole tree was walked, false otherwise
+ */
+bool dir_walk( const char *RootDirectory, dir_walk_fn_t file_fn, void *user_data );
+
+#endif /* __DIRECTORY_WALKER_H__ */
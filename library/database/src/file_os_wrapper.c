@@ -5,7 +5,19 @@
 #include <memcard/dirent.h>
 #include "file_os_wrapper.h"
 
-DIR *cur_dir = NULL;
+/* Each open directory takes one of the newlib file slots of the walking
+ * task (REENT_GLUE_MAX_FILES), one is left for the file being walked. */
+#define FOS_MAX_OPEN_DIRS   5
+
+/* The directories entered, [__depth] is the one being read.  A directory
+ * which had to be closed to free a slot is NULL & is opened again & read
+ * up to where it was left (__next) when it is gone back to. */
+static DIR *__dirs[FOS_MAX_DIR_DEPTH + 1];
+static long __next[FOS_MAX_DIR_DEPTH + 1];
+static int32_t __depth = -1;
+static uint32_t __open = 0;
+
+static void __close_top( void );
 
 file_return_value open_directory( char * path )
 {
@@ -13,20 +25,97 @@ file_return_value open_directory( char * path )
         return FRV_INVALID_PARAMETER;
     }
 
-    if( NULL != cur_dir ) {
-        closedir( cur_dir );
-        cur_dir = NULL;
+    close_directories();
+
+    __dirs[0] = opendir( path );
+    if( NULL == __dirs[0] ) {
+        return FRV_ERROR;
+    }
+    __depth = 0;
+    __open = 1;
+
+    return FRV_RETURN_GOOD;
+}
+
+file_return_value enter_directory( char * path )
+{
+    DIR *parent;
+    DIR *dir;
+    int old_errno;
+
+    if( NULL == path ) {
+        return FRV_INVALID_PARAMETER;
     }
 
-    cur_dir = opendir( path );
+    if(    ( __depth < 0 ) || ( FOS_MAX_DIR_DEPTH <= __depth )
+        || ( NULL == __dirs[__depth] ) )
+    {
+        return FRV_ERROR;
+    }
 
-    if( NULL == cur_dir ) {
+    parent = __dirs[__depth];
+    old_errno = errno;
+    __next[__depth] = telldir( parent );
+    if( (-1 == __next[__depth]) || (old_errno != errno) ) {
         return FRV_ERROR;
     }
 
+    dir = NULL;
+    if( __open < FOS_MAX_OPEN_DIRS ) {
+        dir = opendir( path );
+    }
+    if( NULL == dir ) {
+        /* Out of slots - the parent is read again instead. */
+        closedir( parent );
+        __dirs[__depth] = NULL;
+        __open--;
+
+        dir = opendir( path );
+        if( NULL == dir ) {
+            return FRV_ERROR;
+        }
+    }
+
+    __dirs[++__depth] = dir;
+    __open++;
+
     return FRV_RETURN_GOOD;
 }
 
+file_return_value leave_directory( char * path )
+{
+    DIR *dir;
+
+    if( NULL == path ) {
+        return FRV_INVALID_PARAMETER;
+    }
+
+    if( __depth < 1 ) {
+        return FRV_ERROR;
+    }
+
+    __close_top();
+
+    if( NULL == __dirs[__depth] ) {
+        dir = opendir( path );
+        if( NULL == dir ) {
+            return FRV_ERROR;
+        }
+        seekdir( dir, __next[__depth] );
+        __dirs[__depth] = dir;
+        __open++;
+    }
+
+    return FRV_RETURN_GOOD;
+}
+
+void close_directories( void )
+{
+    while( 0 <= __depth ) {
+        __close_top();
+    }
+}
+
 file_return_value get_next_element_in_directory( file_info_t * f_info )
 {
     struct dirent file_info;
@@ -37,11 +126,13 @@ file_return_value get_next_element_in_directory( file_info_t * f_info )
         return FRV_INVALID_PARAMETER;
     }
 
+    if( (__depth < 0) || (NULL == __dirs[__depth]) ) {
+        return FRV_ERROR;
+    }
+
     old_errno = errno;
-    out = readdir( cur_dir, &file_info );
+    out = readdir( __dirs[__depth], &file_info );
     if( NULL == out ) {
-        closedir( cur_dir );
-        cur_dir = NULL;
         if( old_errno != errno ) {
             return FRV_ERROR;
         } else {
@@ -57,6 +148,8 @@ file_return_value get_next_element_in_directory( file_info_t * f_info )
      */
     strcpy(f_info->short_filename, file_info.d_name );
     f_info->is_dir = ( file_info.d_attr & DT_DIR );
+    f_info->size = file_info.d_size;
+    f_info->mtime = file_info.d_mtime;
     /* If the file attributes are anything but DIR, then we don't want
      * to pass this file entry back.  Otherwise we want to send the file
      * information back.
@@ -64,29 +157,12 @@ file_return_value get_next_element_in_directory( file_info_t * f_info )
     return FRV_RETURN_GOOD;
 }
 
-file_return_value seek_to_index_in_directory( long index )
+static void __close_top( void )
 {
-    if( NULL == cur_dir ) {
-        return FRV_ERROR;
+    if( NULL != __dirs[__depth] ) {
+        closedir( __dirs[__depth] );
+        __dirs[__depth] = NULL;
+        __open--;
     }
-
-    seekdir( cur_dir, index );
-
-    return FRV_RETURN_GOOD;
-}
-
-file_return_value get_index_in_directory( long *index )
-{
-    int old_errno;
-    if( NULL == index ) {
-        return FRV_ERROR;
-    }
-
-    old_errno = errno;
-    *index = telldir(cur_dir);
-    if(    (-1 == *index)
-        || (old_errno != errno) ) {
-        return FRV_ERROR;
-    }
-    return FRV_RETURN_GOOD;
+    __depth--;
 }
@@ -2,6 +2,7 @@
 #define __FILE_OS_WRAPPER_H__
 
 #include <stdbool.h>
+#include <stdint.h>
 #include "database.h"
 
 typedef enum {
@@ -14,11 +15,49 @@ typedef enum {
 typedef struct {
     char short_filename[MAX_SHORT_FILENAME_W_NULL];
     bool is_dir;
+    uint32_t size;
+    uint32_t mtime;
 } file_info_t;
 
+/* Directories deeper than this can't be entered. */
+#define FOS_MAX_DIR_DEPTH   (MAX_SHORT_FILENAME_PATH / 2)
+
 file_return_value get_next_element_in_directory( file_info_t * f_info );
+
+/**
+ * Closes any directories being read & opens path to be read.
+ *
+ * @param path NULL terminated path of the directory
+ *
+ * @return FRV_RETURN_GOOD on success, an error otherwise
+ */
 file_return_value open_directory( char * path );
-file_return_value seek_to_index_in_directory( long index );
-file_return_value get_index_in_directory( long *index );
+
+/**
+ * Opens path, a directory found in the directory being read, to be read.
+ * The directory being read stays open where possible so reading it can
+ * continue after leave_directory() without reading it again.
+ *
+ * @param path NULL terminated path of the directory
+ *
+ * @return FRV_RETURN_GOOD on success, an error otherwise
+ */
+file_return_value enter_directory( char * path );
+
+/**
+ * Closes the directory being read & continues reading the directory it was
+ * entered from.
+ *
+ * @param path NULL terminated path of the directory to go back to, used if
+ *        it had to be closed
+ *
+ * @return FRV_RETURN_GOOD on success, an error otherwise
+ */
+file_return_value leave_directory( char * path );
+
+/**
+ * Closes every directory opened by open_directory() & enter_directory().
+ */
+void close_directories( void );
 
 #endif /* __FILE_OS_WRAPPER_H__ */
@@ -18,20 +18,25 @@
 #include <string.h>
 #include <binary-tree-avl/binary-tree-avl.h>
 #include "database.h"
-#include "w_malloc.h"
+#include "arena.h"
 #include "generic.h"
 #include "song.h"
+#include "string_arena.h"
 
 #define COMPARE_TWO_VALUES( x, y ) \
     ((x)==(y)?0:               \
       ((x)>(y)?1:-1))
 
+static arena_slab_t __generic_slab = ARENA_SLAB_INIT( sizeof(generic_node_t) );
+static arena_slab_t __song_slab = ARENA_SLAB_INIT( sizeof(song_node_t) );
+
 int8_t __generic_compare_to_generic_create( const generic_holder_t* holder, const generic_node_t *node );
 int8_t __generic_compare( const generic_node_t* node1, const generic_node_t *node2 );
 int8_t __song_compare_to_song_create( const song_create_t * sc, const song_node_t * sn );
 int8_t __song_compare( const song_node_t * sn1, const song_node_t * sn2 );
-int8_t __song_compare_gain( const media_gain_t *g1,
-                            const media_gain_t *g2 );
+int8_t __song_compare_gain( const song_gain_t *g1,
+                            const song_gain_t *g2 );
+void __to_song_gain( const media_gain_t *media_gain, song_gain_t *gain );
 
 generic_node_t * find_or_create_generic( generic_node_t * generic,
         void * element,
@@ -107,7 +112,9 @@ int8_t __song_compare_to_song_create( const song_create_t * sc, const song_node_
     if( 0 == result ) {
         result = strcasecmp(sc->metadata->title, sn->d.name.song);
         if( 0 == result ) {
-            result = __song_compare_gain( &sc->metadata->gain, &sn->gain );
+            song_gain_t gain;
+            __to_song_gain( &sc->metadata->gain, &gain );
+            result = __song_compare_gain( &gain, &sn->gain );
         }
     }
     return result;
@@ -125,22 +132,27 @@ int8_t __song_compare( const song_node_t * sn1, const song_node_t * sn2 )
     return result;
 }
 
-int8_t __song_compare_gain( const media_gain_t *g1,
-                            const media_gain_t *g2 )
+int8_t __song_compare_gain( const song_gain_t *g1,
+                            const song_gain_t *g2 )
 {
-    int compare_rslt = memcmp( g1, g2, sizeof(media_gain_t) );
+    int compare_rslt = memcmp( g1, g2, sizeof(song_gain_t) );
     return COMPARE_TWO_VALUES( compare_rslt, 0 );
 }
 
+void __to_song_gain( const media_gain_t *media_gain, song_gain_t *gain )
+{
+    gain->track_gain = (float) media_gain->track_gain;
+    gain->track_peak = (float) media_gain->track_peak;
+    gain->album_gain = (float) media_gain->album_gain;
+    gain->album_peak = (float) media_gain->album_peak;
+}
+
 bool __init_generic_node( generic_node_t *node, const char *element ) {
     size_t name_size;
-    char * name_loc;
 
     bt_init_list( &(node->list.children), generic_compare );
     /* Artist and album share the same size */
     name_size = MAX_ALBUM_TITLE;
-    /* Root, Artist, and Album share the same name location */
-    name_loc = node->name.album;
     switch(node->type) {
         case GNT_ALBUM:
             bt_set_compare(&(node->list.children), song_compare);
@@ -151,29 +163,54 @@ bool __init_generic_node( generic_node_t *node, const char *element ) {
         default:
             break;
     }
-    strncpy( name_loc, element, sizeof(char) * name_size);
-    name_loc[name_size] = '\0';
-    return true;
+    /* Root, Artist, and Album share the same name location */
+    node->name.album = string_arena_intern( element, name_size );
+    return (NULL != node->name.album);
 }
 
 bool __init_song_node( song_node_t *sn, const song_create_t *meta ) {
+    const char *file_name;
+
     if(    ( NULL == meta->metadata )
         || ( NULL == meta->file_location )
         || ( NULL == meta->metadata->title )
-        || ( NULL == meta->play_fn ) )
+        || ( NULL == meta->play_fn )
+        || ( MAX_SHORT_FILENAME_PATH < strlen(meta->file_location) ) )
     {
         return false;
     }
-    strncpy( sn->d.name.song, meta->metadata->title, MAX_SONG_TITLE );
-    sn->d.name.song[MAX_SONG_TITLE] = '\0';
+    /* Titles are nearly always unique, so don't bother interning them. */
+    sn->d.name.song = string_arena_add( meta->metadata->title, MAX_SONG_TITLE );
+
+    file_name = strrchr( meta->file_location, '/' );
+    if( (NULL != file_name) && (MAX_SHORT_FILENAME >= strlen(file_name + 1)) ) {
+        sn->directory = string_arena_intern( meta->file_location,
+                                             file_name - meta->file_location );
+        strcpy( sn->file_name, file_name + 1 );
+    } else {
+        sn->directory = string_arena_intern( meta->file_location,
+                                             MAX_SHORT_FILENAME_PATH );
+    }
+    if( (NULL == sn->d.name.song) || (NULL == sn->directory) ) {
+        return false;
+    }
 
     sn->track_number = meta->metadata->track_number;
-    memcpy( &sn->gain, &meta->metadata->gain, sizeof(media_gain_t) );
+    __to_song_gain( &meta->metadata->gain, &sn->gain );
     sn->play_fn = meta->play_fn;
-    strcpy(sn->file_location, meta->file_location);
     return true;
 }
 
+/* See database.h for information */
+void get_song_location( const song_node_t * song, char * location )
+{
+    strcpy( location, song->directory );
+    if( '\0' != song->file_name[0] ) {
+        strcat( location, "/" );
+        strcat( location, song->file_name );
+    }
+}
+
 typedef bool (*__init_generic_ptr)( generic_node_t*, const void *element );
 
 bt_node_t * get_new_generic_node( const generic_node_types_t type, const void * element )
@@ -186,10 +223,10 @@ bt_node_t * get_new_generic_node( const generic_node_types_t type, const void *
     }
 
     if( GNT_SONG == type ) {
-        generic_n = (generic_node_t *) w_malloc( sizeof(song_node_t) );
+        generic_n = (generic_node_t *) arena_slab_alloc( &__song_slab );
         init_fct = __init_song_node;
     } else {
-        generic_n = (generic_node_t *) w_malloc( sizeof(generic_node_t) );
+        generic_n = (generic_node_t *) arena_slab_alloc( &__generic_slab );
         init_fct = __init_generic_node;
     }
     if( generic_n == NULL ) {
@@ -212,6 +249,8 @@ void delete_generic(bt_node_t *node, void *user_data)
     generic_n = (generic_node_t *)node->data;
     if( GNT_SONG != generic_n->type ) {
         bt_delete_list(&(generic_n->list.children), delete_generic, NULL);
+        arena_slab_free(&__generic_slab, generic_n);
+    } else {
+        arena_slab_free(&__song_slab, generic_n);
     }
-    free(generic_n);
 }
@@ -64,7 +64,8 @@ int8_t song_compare( const void * element1, const void * element2 );
 
 /**
  * Deletion function which should be referenced when using
- * the list deleter function.
+ * the list deleter function.  The nodes are returned to their slab,
+ * database_purge() releases everything at once instead.
  */
 void delete_generic(bt_node_t *node, void *user_data);
 
@@ -0,0 +1,443 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <binary-tree-avl/binary-tree-avl.h>
+#include <media-interface/media-interface.h>
+
+#include "database.h"
+#include "add_song.h"
+#include "directory_walker.h"
+#include "index_file.h"
+#include "mi_interface.h"
+
+/* The index file layout is:
+ *
+ *  header (__index_header_t)
+ *  records:
+ *      IFR_ARTIST  u8 length, name
+ *      IFR_ALBUM   u8 length, name
+ *      IFR_SONG    u8 length, title, i32 track, media_gain_t, u16 length, path,
+ *                  u32 file size, u32 file timestamp
+ *  IFR_END u32 checksum of everything before it
+ *
+ * Albums belong to the last artist and songs to the last album seen.
+ * All values are stored in the native byte order since the file is
+ * only ever read back by the same firmware.
+ */
+#define INDEX_FILE_MAGIC        0x43524958  /* 'CRIX' */
+#define INDEX_FILE_BUFFER_SIZE  512
+
+#define IFR_ARTIST  'A'
+#define IFR_ALBUM   'L'
+#define IFR_SONG    'S'
+#define IFR_END     'E'
+
+#define FNV_OFFSET_BASIS    2166136261UL
+#define FNV_PRIME           16777619UL
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t signature;
+    uint32_t song_count;
+} __index_header_t;
+
+typedef struct {
+    int fd;
+    size_t used;
+    size_t offset;
+    uint32_t checksum;
+    bool error;
+} __index_io_t;
+
+typedef struct {
+    const char *skip;
+    uint32_t hash;
+} __signature_t;
+
+static uint8_t __buffer[INDEX_FILE_BUFFER_SIZE];
+
+static uint32_t __fnv1a( uint32_t hash, const void *data, size_t length );
+static bool __signature_file( const char *full_path,
+                              const file_info_t *file_info,
+                              void *user_data );
+static void __write( __index_io_t *io, const void *data, size_t length );
+static void __write_string( __index_io_t *io, const char *string, size_t length_size );
+static void __flush( __index_io_t *io );
+static bt_ir_t __save_artist( bt_node_t *node, void *user_data );
+static bt_ir_t __save_album( bt_node_t *node, void *user_data );
+static bt_ir_t __save_song( bt_node_t *node, void *user_data );
+static bool __read( __index_io_t *io, void *data, size_t length );
+static bool __read_string( __index_io_t *io, char *string,
+                           size_t length_size, size_t max_length );
+
+/* See index_file.h for information */
+bool index_file_signature( const char *RootDirectory,
+                           const char *index_file,
+                           uint32_t *signature )
+{
+    __signature_t s;
+
+    if( (NULL == index_file) || (NULL == signature) ) {
+        return false;
+    }
+
+    s.skip = index_file;
+    s.hash = INDEX_FILE_SIGNATURE_START;
+
+    if( false == dir_walk(RootDirectory, __signature_file, &s) ) {
+        return false;
+    }
+
+    *signature = s.hash;
+    return true;
+}
+
+/* See index_file.h for information */
+uint32_t index_file_signature_add( uint32_t signature,
+                                   const char *index_file,
+                                   const char *full_path,
+                                   const file_info_t *file_info )
+{
+    if( 0 != strcasecmp(full_path, index_file) ) {
+        signature = __fnv1a( signature, full_path, strlen(full_path) + 1 );
+        signature = __fnv1a( signature, &file_info->size, sizeof(file_info->size) );
+        signature = __fnv1a( signature, &file_info->mtime, sizeof(file_info->mtime) );
+    }
+    return signature;
+}
+
+/* See index_file.h for information */
+bool index_file_save( generic_node_t *root,
+                      const char *index_file,
+                      uint32_t signature )
+{
+    __index_io_t io;
+    __index_header_t header;
+    uint8_t type;
+    uint32_t checksum;
+
+    if( (NULL == root) || (NULL == index_file) ) {
+        return false;
+    }
+
+    io.fd = open( index_file, O_WRONLY | O_CREAT | O_TRUNC, 0666 );
+    if( io.fd < 0 ) {
+        return false;
+    }
+    io.used = 0;
+    io.offset = 0;
+    io.checksum = FNV_OFFSET_BASIS;
+    io.error = false;
+
+    header.magic = INDEX_FILE_MAGIC;
+    header.version = INDEX_FILE_VERSION;
+    header.signature = signature;
+    header.song_count = root->list.index_songs_stop - root->list.index_songs_start + 1;
+    __write( &io, &header, sizeof(header) );
+
+    bt_iterate( &root->list.children, __save_artist, NULL, &io );
+
+    type = IFR_END;
+    __write( &io, &type, sizeof(type) );
+    checksum = io.checksum;
+    __write( &io, &checksum, sizeof(checksum) );
+    __flush( &io );
+
+    if( 0 != close(io.fd) ) {
+        io.error = true;
+    }
+
+    /* A partially written index fails the checksum when it is loaded,
+     * so there is nothing to clean up on error. */
+    return (false == io.error);
+}
+
+/* See index_file.h for information */
+bool index_file_load( generic_node_t *root,
+                      const char *index_file,
+                      uint32_t *signature )
+{
+    __index_io_t io;
+    __index_header_t header;
+    media_metadata_t metadata;
+    char path[MAX_SHORT_FILENAME_PATH_W_NULL];
+    uint32_t songs = 0;
+    bool rv = false;
+
+    if( (NULL == root) || (NULL == index_file) || (NULL == signature) ) {
+        return false;
+    }
+
+    io.fd = open( index_file, O_RDONLY );
+    if( io.fd < 0 ) {
+        return false;
+    }
+    io.used = 0;
+    io.offset = 0;
+    io.checksum = FNV_OFFSET_BASIS;
+    io.error = false;
+
+    if(    ( true == __read(&io, &header, sizeof(header)) )
+        && ( INDEX_FILE_MAGIC == header.magic )
+        && ( INDEX_FILE_VERSION == header.version ) )
+    {
+        memset( &metadata, 0, sizeof(media_metadata_t) );
+
+        while( 1 ) {
+            uint8_t type;
+
+            if( false == __read(&io, &type, sizeof(type)) ) {
+                break;
+            }
+
+            if( IFR_ARTIST == type ) {
+                if( false == __read_string(&io, metadata.artist, sizeof(uint8_t), MAX_ARTIST_NAME) ) {
+                    break;
+                }
+            } else if( IFR_ALBUM == type ) {
+                if( false == __read_string(&io, metadata.album, sizeof(uint8_t), MAX_ALBUM_TITLE) ) {
+                    break;
+                }
+            } else if( IFR_SONG == type ) {
+                media_play_fn_t play_fn;
+                song_node_t *song;
+                uint32_t file[2];
+
+                if(    ( false == __read_string(&io, metadata.title, sizeof(uint8_t), MAX_SONG_TITLE) )
+                    || ( false == __read(&io, &metadata.track_number, sizeof(int32_t)) )
+                    || ( false == __read(&io, &metadata.gain, sizeof(media_gain_t)) )
+                    || ( false == __read_string(&io, path, sizeof(uint16_t), MAX_SHORT_FILENAME_PATH) )
+                    || ( false == __read(&io, file, sizeof(file)) )
+                    || ( MI_RETURN_OK != mi_get_information(path, NULL, &play_fn) ) )
+                {
+                    break;
+                }
+                song = add_song_to_root( root, &metadata, play_fn, path );
+                if( NULL == song ) {
+                    break;
+                }
+                song->file_size = file[0];
+                song->file_mtime = file[1];
+                songs++;
+            } else if( IFR_END == type ) {
+                uint32_t expected = io.checksum;
+                uint32_t checksum;
+
+                if(    ( true == __read(&io, &checksum, sizeof(checksum)) )
+                    && ( expected == checksum )
+                    && ( header.song_count == songs ) )
+                {
+                    *signature = header.signature;
+                    rv = true;
+                }
+                break;
+            } else {
+                /* Unknown record - the file is corrupt. */
+                break;
+            }
+        }
+    }
+
+    close( io.fd );
+    return rv;
+}
+
+static uint32_t __fnv1a( uint32_t hash, const void *data, size_t length )
+{
+    const uint8_t *d = (const uint8_t *) data;
+
+    while( 0 < length-- ) {
+        hash ^= *d++;
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+static bool __signature_file( const char *full_path,
+                              const file_info_t *file_info,
+                              void *user_data )
+{
+    __signature_t *s = (__signature_t *) user_data;
+
+    s->hash = index_file_signature_add( s->hash, s->skip, full_path, file_info );
+    return true;
+}
+
+static void __write( __index_io_t *io, const void *data, size_t length )
+{
+    const uint8_t *d = (const uint8_t *) data;
+
+    io->checksum = __fnv1a( io->checksum, data, length );
+
+    while( (0 < length) && (false == io->error) ) {
+        size_t n = INDEX_FILE_BUFFER_SIZE - io->used;
+
+        if( length < n ) {
+            n = length;
+        }
+        memcpy( &__buffer[io->used], d, n );
+        io->used += n;
+        d += n;
+        length -= n;
+
+        if( INDEX_FILE_BUFFER_SIZE == io->used ) {
+            __flush( io );
+        }
+    }
+}
+
+static void __write_string( __index_io_t *io, const char *string, size_t length_size )
+{
+    size_t length = strlen( string );
+
+    if( sizeof(uint8_t) == length_size ) {
+        uint8_t l = (uint8_t) length;
+        __write( io, &l, sizeof(l) );
+    } else {
+        uint16_t l = (uint16_t) length;
+        __write( io, &l, sizeof(l) );
+    }
+    __write( io, string, length );
+}
+
+static void __flush( __index_io_t *io )
+{
+    if( (0 < io->used) && (false == io->error) ) {
+        if( (int) io->used != write(io->fd, __buffer, io->used) ) {
+            io->error = true;
+        }
+    }
+    io->used = 0;
+}
+
+static bt_ir_t __save_artist( bt_node_t *node, void *user_data )
+{
+    __index_io_t *io = (__index_io_t *) user_data;
+    generic_node_t *artist = (generic_node_t *) node->data;
+    uint8_t type = IFR_ARTIST;
+
+    __write( io, &type, sizeof(type) );
+    __write_string( io, artist->name.artist, sizeof(uint8_t) );
+    bt_iterate( &artist->list.children, __save_album, NULL, io );
+
+    return (true == io->error) ? BT_IR__STOP : BT_IR__CONTINUE;
+}
+
+static bt_ir_t __save_album( bt_node_t *node, void *user_data )
+{
+    __index_io_t *io = (__index_io_t *) user_data;
+    generic_node_t *album = (generic_node_t *) node->data;
+    uint8_t type = IFR_ALBUM;
+
+    __write( io, &type, sizeof(type) );
+    __write_string( io, album->name.album, sizeof(uint8_t) );
+    bt_iterate( &album->list.children, __save_song, NULL, io );
+
+    return (true == io->error) ? BT_IR__STOP : BT_IR__CONTINUE;
+}
+
+static bt_ir_t __save_song( bt_node_t *node, void *user_data )
+{
+    __index_io_t *io = (__index_io_t *) user_data;
+    song_node_t *song = (song_node_t *) node->data;
+    uint8_t type = IFR_SONG;
+    int32_t track_number = song->track_number;
+    media_gain_t gain;
+    char location[MAX_SHORT_FILENAME_PATH_W_NULL];
+
+    gain.track_gain = song->gain.track_gain;
+    gain.track_peak = song->gain.track_peak;
+    gain.album_gain = song->gain.album_gain;
+    gain.album_peak = song->gain.album_peak;
+    get_song_location( song, location );
+
+    __write( io, &type, sizeof(type) );
+    __write_string( io, song->d.name.song, sizeof(uint8_t) );
+    __write( io, &track_number, sizeof(track_number) );
+    __write( io, &gain, sizeof(media_gain_t) );
+    __write_string( io, location, sizeof(uint16_t) );
+    __write( io, &song->file_size, sizeof(song->file_size) );
+    __write( io, &song->file_mtime, sizeof(song->file_mtime) );
+
+    return (true == io->error) ? BT_IR__STOP : BT_IR__CONTINUE;
+}
+
+static bool __read( __index_io_t *io, void *data, size_t length )
+{
+    uint8_t *d = (uint8_t *) data;
+    size_t left = length;
+
+    while( 0 < left ) {
+        size_t n;
+
+        if( io->offset == io->used ) {
+            int rc = read( io->fd, __buffer, INDEX_FILE_BUFFER_SIZE );
+            if( rc <= 0 ) {
+                return false;
+            }
+            io->used = rc;
+            io->offset = 0;
+        }
+
+        n = io->used - io->offset;
+        if( left < n ) {
+            n = left;
+        }
+        memcpy( d, &__buffer[io->offset], n );
+        io->offset += n;
+        d += n;
+        left -= n;
+    }
+
+    io->checksum = __fnv1a( io->checksum, data, length );
+    return true;
+}
+
+static bool __read_string( __index_io_t *io, char *string,
+                           size_t length_size, size_t max_length )
+{
+    size_t length;
+
+    if( sizeof(uint8_t) == length_size ) {
+        uint8_t l;
+        if( false == __read(io, &l, sizeof(l)) ) {
+            return false;
+        }
+        length = l;
+    } else {
+        uint16_t l;
+        if( false == __read(io, &l, sizeof(l)) ) {
+            return false;
+        }
+        length = l;
+    }
+
+    if(    ( max_length < length )
+        || ( false == __read(io, string, length) ) )
+    {
+        return false;
+    }
+    string[length] = '\0';
+    return true;
+}
@@ -0,0 +1,84 @@
+#ifndef __INDEX_FILE_H__
+#define __INDEX_FILE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "database.h"
+#include "file_os_wrapper.h"
+
+#define INDEX_FILE_NAME     "CROONER.IDX"
+#define INDEX_FILE_VERSION  2
+
+/* The signature before any file is added, see index_file_signature_add(). */
+#define INDEX_FILE_SIGNATURE_START  2166136261UL
+
+/**
+ * Computes a signature of the card contents by walking all the directories
+ * below RootDirectory and hashing each file's path, size and timestamp.
+ * No files are opened, so this is much cheaper than reading the tags.
+ *
+ * @param RootDirectory NULL terminated path of the directory to walk
+ * @param index_file the index file path, which is skipped so saving
+ *        the index does not change the signature
+ * @param signature the resulting signature on success
+ *
+ * @return true on success, false otherwise
+ */
+bool index_file_signature( const char *RootDirectory,
+                           const char *index_file,
+                           uint32_t *signature );
+
+/**
+ * Adds a file to a signature the way index_file_signature() does, so a
+ * directory walk done for something else can compute it as it goes.
+ *
+ * @param signature the signature so far, INDEX_FILE_SIGNATURE_START
+ *        before the first file
+ * @param index_file the index file path, which is skipped
+ * @param full_path the path of the file found
+ * @param file_info the directory entry of the file found
+ *
+ * @return the new signature
+ */
+uint32_t index_file_signature_add( uint32_t signature,
+                                   const char *index_file,
+                                   const char *full_path,
+                                   const file_info_t *file_info );
+
+/**
+ * Writes the artist/album/song tree below root to the index file.
+ *
+ * @note root must already be indexed via index_root()
+ *
+ * @param root the root node of the database to save
+ * @param index_file the path of the index file to (re)create
+ * @param signature the card signature to store with the index
+ *
+ * @return true on success, false otherwise
+ */
+bool index_file_save( generic_node_t *root,
+                      const char *index_file,
+                      uint32_t signature );
+
+/**
+ * Reads the index file and adds the songs in it to root.
+ *
+ * @note The database is not indexed, so songs can still be added or
+ *       removed before calling index_root().
+ * @note If false is returned root may be partially populated and
+ *       should be purged.
+ *
+ * @param root the (empty) root node to add the songs to
+ * @param index_file the path of the index file to read
+ * @param signature the card signature stored in the index file on
+ *        success.  If it does not match the current card signature
+ *        the database is stale.
+ *
+ * @return true if the index was valid & loaded, false if it is missing
+ *         or corrupt
+ */
+bool index_file_load( generic_node_t *root,
+                      const char *index_file,
+                      uint32_t *signature );
+
+#endif /* __INDEX_FILE_H__ */
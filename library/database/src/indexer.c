@@ -1,7 +1,10 @@
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "database.h"
+#include "internal_database.h"
+#include "arena.h"
 #include "indexer.h"
 #include "next_song.h"
 
@@ -11,6 +14,8 @@ typedef struct {
 } __indexer_t;
 
 bt_ir_t __index_generic( bt_node_t *node, void *user_data );
+static void __build_song_table( generic_node_t *root, uint32_t count );
+static bt_ir_t __fill_song_table( bt_node_t *node, void *user_data );
 
 void index_root( bt_node_t * root )
 {
@@ -24,6 +29,54 @@ void index_root( bt_node_t * root )
     bt_iterate( &root_node->list.children, __index_generic, NULL, &indexer);
     root_node->list.index_songs_stop = song_index - 1;
     bt_set_compare( &root_node->list.children, compare_indexed_general );
+
+    if( root_node == rdn.root ) {
+        __build_song_table( root_node, song_index );
+    }
+}
+
+/* See indexer.h for information */
+bool index_append_song( song_node_t * song )
+{
+    song_table_t *table = &rdn.songs;
+    uint32_t page = table->count / SONG_TABLE_PAGE_SIZE;
+    uint32_t slot = table->count % SONG_TABLE_PAGE_SIZE;
+
+    if( 0 == slot ) {
+        if( page == table->page_slots ) {
+            /* The old page list is left in the arena. */
+            uint32_t slots = (0 == page) ? 4 : (2 * page);
+            song_node_t ***pages;
+
+            pages = (song_node_t ***) arena_alloc( slots * sizeof(song_node_t **) );
+            if( NULL == pages ) {
+                return false;
+            }
+            if( 0 != page ) {
+                memcpy( pages, table->pages, page * sizeof(song_node_t **) );
+            }
+            table->pages = pages;
+            table->page_slots = slots;
+        }
+        table->pages[page] = (song_node_t **) arena_alloc( SONG_TABLE_PAGE_SIZE * sizeof(song_node_t *) );
+        if( NULL == table->pages[page] ) {
+            return false;
+        }
+    }
+
+    table->pages[page][slot] = song;
+    song->d.index = table->count;
+    table->count++;
+    return true;
+}
+
+/* See indexer.h for information */
+song_node_t * get_indexed_song( uint32_t index )
+{
+    if( index >= rdn.songs.count ) {
+        return NULL;
+    }
+    return rdn.songs.pages[index / SONG_TABLE_PAGE_SIZE][index % SONG_TABLE_PAGE_SIZE];
 }
 
 bt_ir_t __index_generic( bt_node_t *node, void *user_data )
@@ -50,3 +103,49 @@ bt_ir_t __index_generic( bt_node_t *node, void *user_data )
     }
     return BT_IR__CONTINUE;
 }
+
+static void __build_song_table( generic_node_t *root, uint32_t count )
+{
+    uint32_t pages = (count + SONG_TABLE_PAGE_SIZE - 1) / SONG_TABLE_PAGE_SIZE;
+    uint32_t i;
+
+    rdn.songs.pages = NULL;
+    rdn.songs.count = 0;
+    rdn.songs.page_slots = 0;
+    if( 0 == count ) {
+        return;
+    }
+
+    rdn.songs.pages = (song_node_t ***) arena_alloc( pages * sizeof(song_node_t **) );
+    if( NULL == rdn.songs.pages ) {
+        return;
+    }
+    for( i = 0; i < pages; i++ ) {
+        uint32_t size = count - i * SONG_TABLE_PAGE_SIZE;
+        if( SONG_TABLE_PAGE_SIZE < size ) {
+            size = SONG_TABLE_PAGE_SIZE;
+        }
+        rdn.songs.pages[i] = (song_node_t **) arena_alloc( size * sizeof(song_node_t *) );
+        if( NULL == rdn.songs.pages[i] ) {
+            /* Navigation falls back to walking the tree. */
+            rdn.songs.pages = NULL;
+            return;
+        }
+    }
+
+    bt_iterate( &root->list.children, __fill_song_table, NULL, NULL );
+    rdn.songs.count = count;
+}
+
+static bt_ir_t __fill_song_table( bt_node_t *node, void *user_data )
+{
+    generic_node_t *gn = (generic_node_t *)node->data;
+
+    if( GNT_SONG == gn->type ) {
+        rdn.songs.pages[gn->index / SONG_TABLE_PAGE_SIZE][gn->index % SONG_TABLE_PAGE_SIZE] =
+                (song_node_t *) gn;
+    } else {
+        bt_iterate( &gn->list.children, __fill_song_table, NULL, NULL );
+    }
+    return BT_IR__CONTINUE;
+}
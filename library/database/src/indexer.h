@@ -1,8 +1,42 @@
 #ifndef __INDEXER_H__
 #define __INDEXER_H__
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <binary-tree-avl/binary-tree-avl.h>
+#include "database.h"
 
+/**
+ * Numbers the songs, albums & artists below root and switches the lists
+ * over to the index comparers.  If root is the database root, the song
+ * table used for navigation is built as well.
+ *
+ * @note No songs can be added or removed afterwards.
+ *
+ * @param root the root node of the database
+ */
 void index_root( bt_node_t * root );
 
+/**
+ * Adds a song found while scanning the card to the end of the song table,
+ * so it can be played before index_root() runs.  The song's index is its
+ * position in the table until index_root() numbers the songs for real.
+ *
+ * @note The caller must hold the database lock.
+ *
+ * @param song the song to add
+ *
+ * @return true on success, false on failure
+ */
+bool index_append_song( song_node_t * song );
+
+/**
+ * Looks up a song in the song table.
+ *
+ * @param index the index of the song
+ *
+ * @return the song, or NULL if index is out of range or there is no table
+ */
+song_node_t * get_indexed_song( uint32_t index );
+
 #endif /* __INDEXER_H__ */
@@ -16,8 +16,10 @@
 
 #include "database.h"
 #include "internal_database.h"
+#include "database_lock.h"
 #include "mi_interface.h"
 #include "queued_next_song.h"
+#include "scan_pipeline.h"
 
 root_database_node_t rdn;
 
@@ -27,6 +29,12 @@ bool init_database( media_interface_t *mi )
     mi_init( mi );
     queued_song_init();
     rdn.initialized = true;
-    
+
+    if( false == database_lock_init() ) {
+        return false;
+    }
+
+    /* Without the scan tasks the tags are read by the populating task. */
+    scan_pipeline_init( SCAN_PARSER_TASKS, SCAN_TASK_PRIORITY );
     return true;
 }
@@ -3,10 +3,29 @@
 
 #include <stdbool.h>
 #include "database.h"
+#include "arena.h"
+
+/* The number of songs in each page of the song table. */
+#define SONG_TABLE_PAGE_SIZE    (ARENA_BLOCK_SIZE / sizeof(song_node_t *))
+
+/**
+ * The frozen, read only layout of the indexed database: every song in
+ * index order.  The table is split into arena block sized pages.
+ *
+ * While the card is being scanned the table holds the songs found so
+ * far in the order they were found instead, see index_append_song().
+ */
+typedef struct {
+    song_node_t ***pages;
+    uint32_t count;
+    uint32_t page_slots;    /* Only used while scanning */
+} song_table_t;
 
 typedef struct {
     generic_node_t *root;
     bool initialized;
+    bool scanning;          /* songs is the growing scan snapshot */
+    song_table_t songs;     /* Built by index_root() */
 } root_database_node_t;
 
 /**
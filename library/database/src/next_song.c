@@ -19,6 +19,8 @@
 #include <stdlib.h>
 #include "database.h"
 #include "internal_database.h"
+#include "database_lock.h"
+#include "indexer.h"
 #include "next_song.h"
 
 #define NEXT_SONG_DEBUG 0
@@ -42,6 +44,12 @@ int8_t __compare_indexed_general_song_search( __song_index_t* si, generic_node_t
 int8_t __compare_indexed_general( generic_node_t *node1, generic_node_t *node2 );
 generic_node_t * find_random_song_from_generic( generic_node_t * generic, uint32_t first_song_index, uint32_t last_song_index );
 uint32_t random_number_in_range( uint32_t start, uint32_t stop );
+static db_status_t __next_song_flat( song_node_t ** current_song,
+                                     const db_traverse_t operation,
+                                     const db_level_t level );
+static generic_node_t * __level_node( song_node_t *song, const db_level_t level );
+static uint32_t __level_start( uint32_t index, const db_level_t level );
+static song_node_t * __group_start( song_node_t *song );
 
 static generic_node_t *__ns_get_head( bt_list_t *list ) {
     bt_node_t * node = bt_get_head(list);
@@ -109,12 +117,34 @@ uint32_t get_song_number( song_node_t * song,
 db_status_t next_song( song_node_t ** current_song,
                        const db_traverse_t operation,
                        const db_level_t level )
+{
+    db_status_t rv;
+
+    database_lock();
+    rv = find_next_song( current_song, operation, level );
+    database_unlock();
+
+    return rv;
+}
+
+/* See next_song.h for information */
+db_status_t find_next_song( song_node_t ** current_song,
+                            const db_traverse_t operation,
+                            const db_level_t level )
 {
     generic_node_t *generic_n;
     db_status_t rv = DS_FAILURE;
     
-    if(    ( false == rdn.initialized )
-        || ( NULL == current_song )
+    if( (false == rdn.initialized) || (NULL == current_song) ) {
+        return DS_FAILURE;
+    }
+
+    /* While scanning, the tree is being changed by the scan. */
+    if( (true == rdn.scanning) || (0 != rdn.songs.count) ) {
+        return __next_song_flat( current_song, operation, level );
+    }
+
+    if(    ( NULL == rdn.root )
         || ( NULL == bt_get_head(&rdn.root->list.children) ) )
     {
         return DS_FAILURE;
@@ -198,6 +228,145 @@ db_status_t next_song( song_node_t ** current_song,
     return rv;
 }
 
+/**
+ * The same as next_song(), using the song table instead of the trees.
+ * Songs at every level are contiguous in the table, so the neighbours
+ * of an album or artist are right before & after its song range.
+ *
+ * While scanning, the songs found so far are in the order they were
+ * found, so every level steps through all of them one song at a time.
+ */
+static db_status_t __next_song_flat( song_node_t ** current_song,
+                                     const db_traverse_t operation,
+                                     const db_level_t level )
+{
+    generic_node_t *node;
+    uint32_t first, last, start, stop, target;
+    db_status_t rv = DS_SUCCESS;
+
+    if( NULL == *current_song ) {
+        *current_song = get_indexed_song( 0 );
+        if( NULL == *current_song ) {
+            return DS_FAILURE;
+        }
+        if( DT_NEXT == operation ) {
+            return DS_SUCCESS;
+        }
+    }
+
+    /* A song a rescan took out of the database keeps its old index, so
+     * it goes on from the start of what is left of its group instead. */
+    if( get_indexed_song((*current_song)->d.index) != *current_song ) {
+        *current_song = __group_start( *current_song );
+        if( NULL == *current_song ) {
+            return DS_FAILURE;
+        }
+        if( DT_RANDOM != operation ) {
+            return DS_SUCCESS;
+        }
+    }
+
+    /* The songs of the current song/album/artist & the group it is in */
+    if( true == rdn.scanning ) {
+        first = (*current_song)->d.index;
+        last = first;
+        start = 0;
+        stop = rdn.songs.count - 1;
+    } else {
+        node = __level_node( *current_song, level );
+        if( NULL == node ) {
+            first = (*current_song)->d.index;
+            last = first;
+            node = (*current_song)->d.parent;
+        } else {
+            first = node->list.index_songs_start;
+            last = node->list.index_songs_stop;
+            node = node->parent;
+        }
+        start = node->list.index_songs_start;
+        stop = node->list.index_songs_stop;
+    }
+
+    switch( operation ) {
+        case DT_NEXT:
+            if( last < stop ) {
+                target = last + 1;
+            } else {
+                target = start;
+                rv = DS_END_OF_LIST;
+            }
+            break;
+        case DT_PREVIOUS:
+            if( first > start ) {
+                target = __level_start( first - 1, level );
+            } else {
+                target = __level_start( stop, level );
+                rv = DS_END_OF_LIST;
+            }
+            break;
+        default:
+            /* DT_RANDOM */
+            target = random_number_in_range( start, stop );
+            break;
+    }
+
+    *current_song = get_indexed_song( target );
+    if( NULL == *current_song ) {
+        return DS_FAILURE;
+    }
+    return rv;
+}
+
+static generic_node_t * __level_node( song_node_t *song, const db_level_t level )
+{
+    switch( level ) {
+        case DL_ARTIST:
+            return song->d.parent->parent;
+        case DL_ALBUM:
+            return song->d.parent;
+        default:
+            /* DL_SONG */
+            return NULL;
+    }
+}
+
+/* The first song of the song/album/artist the song at index is in. */
+static uint32_t __level_start( uint32_t index, const db_level_t level )
+{
+    generic_node_t *node;
+
+    if( true == rdn.scanning ) {
+        return index;
+    }
+
+    node = __level_node( get_indexed_song(index), level );
+    if( NULL == node ) {
+        return index;
+    }
+    return node->list.index_songs_start;
+}
+
+/* The first song of the song's album, or else artist, which is still in
+ * the song table, or else the first song. */
+static song_node_t * __group_start( song_node_t *song )
+{
+    generic_node_t *group;
+    generic_node_t *node;
+    song_node_t *first;
+
+    for( group = song->d.parent; (NULL != group) && (rdn.root != group); group = group->parent ) {
+        first = get_indexed_song( group->list.index_songs_start );
+        if( NULL != first ) {
+            for( node = first->d.parent; NULL != node; node = node->parent ) {
+                if( node == group ) {
+                    return first;
+                }
+            }
+        }
+    }
+    return get_indexed_song( 0 );
+}
+
 generic_node_t * find_random_song_from_generic( generic_node_t * generic,
         uint32_t first_song_index, uint32_t last_song_index )
 {
@@ -289,7 +458,6 @@ uint32_t random_number_in_range( uint32_t start, uint32_t stop )
         return start;
     }
     
-    rv = rand()/((float)INT32_MAX) * range;
-    rv += start;
+    rv = start + (uint32_t) rand() % range;
     return rv;
 }
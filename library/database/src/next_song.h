@@ -2,6 +2,14 @@
 #define __NEXT_SONG_H__
 
 #include <stdint.h>
+#include "database.h"
+
+/**
+ * The same as next_song(), for callers already holding the database lock.
+ */
+db_status_t find_next_song( song_node_t ** current_song,
+                            const db_traverse_t operation,
+                            const db_level_t level );
 
 int8_t compare_indexed_song( void * data1, void * data2 );
 int8_t compare_indexed_general( void * data1, void * data2 );
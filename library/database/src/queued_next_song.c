@@ -13,62 +13,299 @@
  * along with this program; if not, write to the Free Software
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
  */
-#include "database.h"
-#include "queued_next_song.h"
-#include <circular-buffer/circular-buffer.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
-#define MAX_QUEUED_LINKED_LIST 100
+#include "database.h"
+#include "database_lock.h"
+#include "indexer.h"
+#include "internal_database.h"
+#include "next_song.h"
+#include "queued_next_song.h"
+
+/*----------------------------------------------------------------------------*/
+/*                                 Constants                                  */
+/*----------------------------------------------------------------------------*/
+#define SHUFFLE_ROUNDS  4
+#define SHUFFLE_LEVELS  3   /* DL_SONG, DL_ALBUM & DL_ARTIST */
 
-void * queued_song_list = NULL;
+#define DEFAULT_SEED    0x2545f491
 
-typedef struct  {
-    song_node_t * song_info;
-} queued_node_t;
+/*----------------------------------------------------------------------------*/
+/*                                Data Structures                             */
+/*----------------------------------------------------------------------------*/
+/**
+ * The shuffle of one level.  Each pass through the group plays the songs
+ * in the order of a keyed permutation of their indexes, which is worked
+ * out on the fly, so no list of the songs is ever built or stored.
+ */
+typedef struct {
+    uint32_t start;     /* The first song index of the group */
+    uint32_t count;     /* The number of songs in the group, 0 if unused */
+    uint32_t pass;      /* Each pass has its own permutation */
+    uint32_t position;  /* Where in the pass the current song is */
+    uint32_t offset;    /* Rotates the passes so they start at the anchor */
+    uint32_t half_bits;
+    uint32_t keys[SHUFFLE_ROUNDS];
+} __shuffle_t;
+
+/*----------------------------------------------------------------------------*/
+/*                            File Scoped Variables                           */
+/*----------------------------------------------------------------------------*/
+extern root_database_node_t rdn;
+
+static __shuffle_t __shuffle[SHUFFLE_LEVELS];
+static uint32_t __seed = DEFAULT_SEED;
 
+/*----------------------------------------------------------------------------*/
+/*                             Internal Functions                             */
+/*----------------------------------------------------------------------------*/
+static uint32_t __mix( uint32_t x );
+static void __set_pass( __shuffle_t *shuffle, const uint32_t pass );
+static uint32_t __encrypt( const __shuffle_t *shuffle, uint32_t x );
+static uint32_t __decrypt( const __shuffle_t *shuffle, uint32_t x );
+static uint32_t __permute( const __shuffle_t *shuffle, uint32_t position );
+static uint32_t __unpermute( const __shuffle_t *shuffle, uint32_t index );
+static song_node_t * __shuffle_song( const __shuffle_t *shuffle );
+static db_status_t __queued_next_song( song_node_t ** current_song,
+                                       const db_traverse_t operation,
+                                       const db_level_t level );
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
 bool queued_song_init()
 {
-    if( NULL == queued_song_list ) {
-        queued_song_list = cb_create_list(sizeof(queued_node_t), MAX_QUEUED_LINKED_LIST);
-    } else {
-        queued_song_clear();
-    }
+    queued_song_clear();
     return true;
 }
 
 void queued_song_clear()
 {
-    cb_clear_list(queued_song_list);
+    memset( __shuffle, 0, sizeof(__shuffle) );
+}
+
+/* See database.h for information */
+void shuffle_set_seed( const uint32_t seed )
+{
+    __seed = seed;
+    queued_song_clear();
+}
+
+/* See database.h for information */
+uint32_t shuffle_get_seed( void )
+{
+    return __seed;
 }
 
+/* See database.h for information */
 db_status_t queued_next_song( song_node_t ** current_song,
                              const db_traverse_t operation,
                              const db_level_t level )
 {
-    queued_node_t node;
     db_status_t rv;
-    if( DT_PREVIOUS == operation ) {
-        /* Because we put the last played song on the queue, if we
-         * want to go to the previous song, we need to remove the
-         * last song, and the next song will be our song of interest
-         */
-        if( cb_pop(queued_song_list, NULL) ) {
-            queued_node_t *tmp = (queued_node_t *)cb_peek_tail(queued_song_list);
-            if( NULL != tmp ) {
-                (*current_song) = tmp->song_info;
-                return DS_SUCCESS;
+
+    database_lock();
+    rv = __queued_next_song( current_song, operation, level );
+    database_unlock();
+
+    return rv;
+}
+
+/* See database.h for information */
+db_status_t queued_peek_next_song( song_node_t ** current_song,
+                                   const db_traverse_t operation,
+                                   const db_level_t level )
+{
+    __shuffle_t saved;
+    db_status_t rv;
+
+    if( SHUFFLE_LEVELS <= (uint32_t) level ) {
+        return DS_FAILURE;
+    }
+
+    database_lock();
+    saved = __shuffle[level];
+    rv = __queued_next_song( current_song, operation, level );
+    __shuffle[level] = saved;
+    database_unlock();
+
+    return rv;
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             Internal Functions                             */
+/*----------------------------------------------------------------------------*/
+static db_status_t __queued_next_song( song_node_t ** current_song,
+                                       const db_traverse_t operation,
+                                       const db_level_t level )
+{
+    __shuffle_t *shuffle;
+    generic_node_t *group;
+    uint32_t start, count;
+    db_status_t rv = DS_SUCCESS;
+
+    if( (NULL == current_song) || (SHUFFLE_LEVELS <= (uint32_t) level) ) {
+        return DS_FAILURE;
+    }
+
+    /* Without a song to start from or a song table, just pick one. */
+    if( (NULL == *current_song) || (0 == rdn.songs.count) ) {
+        return find_next_song( current_song, DT_RANDOM, level );
+    }
+
+    if( true == rdn.scanning ) {
+        /* Everything found so far, the shuffle restarts as it grows. */
+        start = 0;
+        count = rdn.songs.count;
+    } else {
+        group = (*current_song)->d.parent;
+        if( DL_SONG != level ) {
+            group = group->parent;
+            if( DL_ARTIST == level ) {
+                group = group->parent;
             }
         }
+        start = group->list.index_songs_start;
+        count = group->list.index_songs_stop - start + 1;
     }
 
-    /* Failed to get the previous song from the list */
-    rv = next_song(current_song, DT_RANDOM, level);
-    if(    ( DS_SUCCESS == rv )
-        || ( DS_END_OF_LIST == rv ) ) {
-        node.song_info = *current_song;
-        cb_push(queued_song_list, &node);
+    /* Start over from the current song if it moved to a different group
+     * or was picked by something else than this shuffle. */
+    shuffle = &__shuffle[level];
+    if(    (start != shuffle->start)
+        || (count != shuffle->count)
+        || (*current_song != __shuffle_song(shuffle)) )
+    {
+        uint32_t bits = 1;
+
+        while( (bits < 32) && ((count - 1) >> bits) ) {
+            bits++;
+        }
+        shuffle->start = start;
+        shuffle->count = count;
+        shuffle->half_bits = (bits + 1) / 2;
+        shuffle->position = 0;
+        __set_pass( shuffle, 0 );
+        shuffle->offset = __unpermute( shuffle, (*current_song)->d.index - start );
+    }
+
+    if( DT_PREVIOUS == operation ) {
+        if( 0 == shuffle->position ) {
+            __set_pass( shuffle, shuffle->pass - 1 );
+            shuffle->position = count;
+            rv = DS_END_OF_LIST;
+        }
+        shuffle->position--;
+    } else {
+        shuffle->position++;
+        if( count == shuffle->position ) {
+            __set_pass( shuffle, shuffle->pass + 1 );
+            shuffle->position = 0;
+            rv = DS_END_OF_LIST;
+        }
+    }
+
+    *current_song = __shuffle_song( shuffle );
+    if( NULL == *current_song ) {
+        shuffle->count = 0;
+        return DS_FAILURE;
     }
     return rv;
 }
 
+/* A cheap 32 bit hash with good avalanche. */
+static uint32_t __mix( uint32_t x )
+{
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+/* Derives the round keys of a pass from the seed & the group. */
+static void __set_pass( __shuffle_t *shuffle, const uint32_t pass )
+{
+    uint32_t key;
+    int i;
+
+    shuffle->pass = pass;
+    key = __mix( __seed ^ __mix(shuffle->start ^ __mix(shuffle->count + __mix(pass))) );
+    for( i = 0; i < SHUFFLE_ROUNDS; i++ ) {
+        key = __mix( key + i );
+        shuffle->keys[i] = key;
+    }
+}
+
+/**
+ * A balanced Feistel network over 2 * half_bits bits, so it is a
+ * permutation of [0, 4^half_bits) whatever the round function is.
+ */
+static uint32_t __encrypt( const __shuffle_t *shuffle, uint32_t x )
+{
+    uint32_t mask = (1 << shuffle->half_bits) - 1;
+    uint32_t left = x >> shuffle->half_bits;
+    uint32_t right = x & mask;
+    uint32_t tmp;
+    int i;
+
+    for( i = 0; i < SHUFFLE_ROUNDS; i++ ) {
+        tmp = right;
+        right = left ^ (__mix(right ^ shuffle->keys[i]) & mask);
+        left = tmp;
+    }
+    return (left << shuffle->half_bits) | right;
+}
+
+static uint32_t __decrypt( const __shuffle_t *shuffle, uint32_t x )
+{
+    uint32_t mask = (1 << shuffle->half_bits) - 1;
+    uint32_t left = x >> shuffle->half_bits;
+    uint32_t right = x & mask;
+    uint32_t tmp;
+    int i;
+
+    for( i = SHUFFLE_ROUNDS - 1; 0 <= i; i-- ) {
+        tmp = left;
+        left = right ^ (__mix(left ^ shuffle->keys[i]) & mask);
+        right = tmp;
+    }
+    return (left << shuffle->half_bits) | right;
+}
+
+/**
+ * Narrows the permutation down to [0, count) by cycle walking: values
+ * past the end are encrypted again until they land in range.  The
+ * domain is less than 4 times count, so this takes a few steps at most
+ * on average.
+ */
+static uint32_t __permute( const __shuffle_t *shuffle, uint32_t position )
+{
+    do {
+        position = __encrypt( shuffle, position );
+    } while( shuffle->count <= position );
+    return position;
+}
+
+static uint32_t __unpermute( const __shuffle_t *shuffle, uint32_t index )
+{
+    do {
+        index = __decrypt( shuffle, index );
+    } while( shuffle->count <= index );
+    return index;
+}
+
+/* The song at the current position of the shuffle, NULL if unused. */
+static song_node_t * __shuffle_song( const __shuffle_t *shuffle )
+{
+    uint32_t position;
+
+    if( 0 == shuffle->count ) {
+        return NULL;
+    }
+    position = (shuffle->position + shuffle->offset) % shuffle->count;
+    return get_indexed_song( shuffle->start + __permute(shuffle, position) );
+}
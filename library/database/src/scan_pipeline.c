@@ -0,0 +1,303 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <freertos/os.h>
+
+#include "database.h"
+#include "directory_walker.h"
+#include "index_file.h"
+#include "mi_interface.h"
+#include "scan_pipeline.h"
+
+/*----------------------------------------------------------------------------*/
+/*                                 Constants                                  */
+/*----------------------------------------------------------------------------*/
+#define SCAN_WALKER_STACK_SIZE  600
+#define SCAN_PARSER_STACK_SIZE  900
+
+/*----------------------------------------------------------------------------*/
+/*                               Data Structures                              */
+/*----------------------------------------------------------------------------*/
+typedef enum {
+    SJT_FILE,
+    SJT_END
+} __job_type_t;
+
+/* A file on its way from the walker, through a parser to the inserter.
+ * The walker ends each walk with a SJT_END job. */
+typedef struct {
+    __job_type_t type;
+    char full_path[MAX_SHORT_FILENAME_PATH_W_NULL];
+    file_info_t file_info;
+    media_metadata_t metadata;
+    media_play_fn_t play_fn;
+    media_status_t status;
+
+    /* SJT_END only */
+    bool walked;
+} __job_t;
+
+/* A walk of the tree, the files found are counted & signed as it goes. */
+typedef struct {
+    const char *root;
+    const char *index_file;
+    uint32_t *signature;    /* NULL - not signed */
+    uint32_t files;
+} __walk_t;
+
+typedef struct {
+    __walk_t walk;
+    scan_insert_fn_t insert_fn;
+    void *user_data;
+} __inline_t;
+
+/*----------------------------------------------------------------------------*/
+/*                            File Scoped Variables                           */
+/*----------------------------------------------------------------------------*/
+static __job_t __jobs[SCAN_PIPELINE_JOBS];
+
+/* Every job is always in exactly one of these queues or being worked on,
+ * so sending to them never blocks. */
+static queue_handle_t __idle = NULL;
+static queue_handle_t __parse = NULL;
+static queue_handle_t __insert = NULL;
+
+/* The next walk. */
+static queue_handle_t __walk = NULL;
+
+static bool __walker = false;
+static uint32_t __parsers = 0;
+
+/*----------------------------------------------------------------------------*/
+/*                             Internal Functions                             */
+/*----------------------------------------------------------------------------*/
+static void __walker_task( void *params );
+static void __parser_task( void *params );
+static bool __queue_file( const char *full_path,
+                          const file_info_t *file_info,
+                          void *user_data );
+static bool __parse_inline( const char *full_path,
+                            const file_info_t *file_info,
+                            void *user_data );
+static void __sign_file( __walk_t *walk,
+                         const char *full_path,
+                         const file_info_t *file_info );
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+/* See scan_pipeline.h for information */
+bool scan_pipeline_init( const uint32_t parsers, const uint32_t priority )
+{
+    uint32_t i;
+
+    if( NULL == __idle ) {
+        __idle = os_queue_create( SCAN_PIPELINE_JOBS, sizeof(__job_t *) );
+        for( i = 0; (NULL != __idle) && (i < SCAN_PIPELINE_JOBS); i++ ) {
+            __job_t *job = &__jobs[i];
+            os_queue_send_to_back( __idle, &job, NO_WAIT );
+        }
+    }
+    if( NULL == __parse ) {
+        __parse = os_queue_create( SCAN_PIPELINE_JOBS, sizeof(__job_t *) );
+    }
+    if( NULL == __insert ) {
+        __insert = os_queue_create( SCAN_PIPELINE_JOBS, sizeof(__job_t *) );
+    }
+    if( NULL == __walk ) {
+        __walk = os_queue_create( 1, sizeof(__walk_t *) );
+    }
+    if(    ( NULL == __idle ) || ( NULL == __parse )
+        || ( NULL == __insert ) || ( NULL == __walk ) )
+    {
+        return false;
+    }
+
+    if( false == __walker ) {
+        __walker = os_task_create( __walker_task, "dbWalk",
+                                   SCAN_WALKER_STACK_SIZE, NULL,
+                                   priority, NULL );
+    }
+
+    while( (true == __walker) && (__parsers < parsers) ) {
+        if( false == os_task_create(__parser_task, "dbParse",
+                                    SCAN_PARSER_STACK_SIZE, NULL,
+                                    priority, NULL) )
+        {
+            break;
+        }
+        __parsers++;
+    }
+
+    return ( (true == __walker) && (parsers <= __parsers) );
+}
+
+/* See scan_pipeline.h for information */
+bool scan_pipeline_run( const char *RootDirectory,
+                        scan_insert_fn_t insert_fn,
+                        void *user_data,
+                        const char *index_file,
+                        uint32_t *signature )
+{
+    __walk_t walk;
+    __walk_t *w;
+    __job_t *job;
+    uint32_t expected;
+    uint32_t done;
+    bool ended;
+    bool walked;
+
+    if(    ( NULL == RootDirectory ) || ( NULL == insert_fn )
+        || ( (NULL != signature) && (NULL == index_file) ) )
+    {
+        return false;
+    }
+
+    walk.root = RootDirectory;
+    walk.index_file = index_file;
+    walk.signature = signature;
+    walk.files = 0;
+    if( NULL != signature ) {
+        *signature = INDEX_FILE_SIGNATURE_START;
+    }
+
+    if( 0 == __parsers ) {
+        __inline_t in;
+
+        in.walk = walk;
+        in.insert_fn = insert_fn;
+        in.user_data = user_data;
+        return dir_walk( RootDirectory, __parse_inline, &in );
+    }
+
+    w = &walk;
+    os_queue_send_to_back( __walk, &w, WAIT_FOREVER );
+
+    expected = 0;
+    done = 0;
+    ended = false;
+    walked = false;
+
+    /* The end of the walk can pass files still being parsed. */
+    while( (false == ended) || (done < expected) ) {
+        if( true == os_queue_receive(__insert, &job, WAIT_FOREVER) ) {
+            if( SJT_END == job->type ) {
+                ended = true;
+                expected = walk.files;
+                walked = job->walked;
+            } else {
+                if( MI_RETURN_OK == job->status ) {
+                    (*insert_fn)( job->full_path, &job->file_info,
+                                  &job->metadata, job->play_fn, user_data );
+                }
+                done++;
+            }
+            os_queue_send_to_back( __idle, &job, WAIT_FOREVER );
+        }
+    }
+
+    return walked;
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             Internal Functions                             */
+/*----------------------------------------------------------------------------*/
+static void __walker_task( void *params )
+{
+    __walk_t *walk;
+    __job_t *job;
+    bool walked;
+
+    while( 1 ) {
+        if( true == os_queue_receive(__walk, &walk, WAIT_FOREVER) ) {
+            walked = dir_walk( walk->root, __queue_file, walk );
+
+            /* The walk is on the stack of scan_pipeline_run(), which
+             * returns once it has the end. */
+            os_queue_receive( __idle, &job, WAIT_FOREVER );
+            job->type = SJT_END;
+            job->walked = walked;
+            os_queue_send_to_back( __insert, &job, WAIT_FOREVER );
+        }
+    }
+}
+
+static void __parser_task( void *params )
+{
+    __job_t *job;
+
+    while( 1 ) {
+        if( true == os_queue_receive(__parse, &job, WAIT_FOREVER) ) {
+            /* The codecs take the card for each read of the tags, so
+             * playback gets it between them. */
+            job->status = mi_get_information( job->full_path, &job->metadata,
+                                              &job->play_fn );
+            os_queue_send_to_back( __insert, &job, WAIT_FOREVER );
+        }
+    }
+}
+
+static bool __queue_file( const char *full_path,
+                          const file_info_t *file_info,
+                          void *user_data )
+{
+    __walk_t *walk = (__walk_t *) user_data;
+    __job_t *job;
+
+    /* Blocks while every job is in flight, which keeps the walker from
+     * running away from the parsers. */
+    os_queue_receive( __idle, &job, WAIT_FOREVER );
+
+    job->type = SJT_FILE;
+    strcpy( job->full_path, full_path );
+    memcpy( &job->file_info, file_info, sizeof(file_info_t) );
+    walk->files++;
+    __sign_file( walk, full_path, file_info );
+
+    os_queue_send_to_back( __parse, &job, WAIT_FOREVER );
+    return true;
+}
+
+static bool __parse_inline( const char *full_path,
+                            const file_info_t *file_info,
+                            void *user_data )
+{
+    __inline_t *in = (__inline_t *) user_data;
+    media_metadata_t metadata;
+    media_play_fn_t play_fn;
+
+    __sign_file( &in->walk, full_path, file_info );
+
+    if( MI_RETURN_OK == mi_get_information(full_path, &metadata, &play_fn) ) {
+        (*in->insert_fn)( full_path, file_info, &metadata, play_fn, in->user_data );
+    }
+    return true;
+}
+
+static void __sign_file( __walk_t *walk,
+                         const char *full_path,
+                         const file_info_t *file_info )
+{
+    if( NULL != walk->signature ) {
+        *walk->signature = index_file_signature_add( *walk->signature,
+                                                     walk->index_file,
+                                                     full_path, file_info );
+    }
+}
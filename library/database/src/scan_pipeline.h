@@ -0,0 +1,76 @@
+#ifndef __SCAN_PIPELINE_H__
+#define __SCAN_PIPELINE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <media-interface/media-interface.h>
+
+#include "file_os_wrapper.h"
+
+/* Each parser has a file open, the player needs one more (_FS_SHARE). */
+#ifndef SCAN_PARSER_TASKS
+#define SCAN_PARSER_TASKS       2
+#endif
+
+#ifndef SCAN_TASK_PRIORITY
+#define SCAN_TASK_PRIORITY      0
+#endif
+
+/* The number of files in flight between the walker & the inserter. */
+#define SCAN_PIPELINE_JOBS      8
+
+/**
+ * Called by the task running scan_pipeline_run() for each file which has
+ * had its tags read.  This is the only place the tree is changed from.
+ *
+ * @param full_path the path of the file
+ * @param file_info the directory entry of the file
+ * @param metadata the tags of the file, may be changed by the callee
+ * @param play_fn the function used to play the file
+ * @param user_data the user_data passed to scan_pipeline_run()
+ */
+typedef void (*scan_insert_fn_t)( const char *full_path,
+                                  const file_info_t *file_info,
+                                  media_metadata_t *metadata,
+                                  media_play_fn_t play_fn,
+                                  void *user_data );
+
+/**
+ * Starts the directory walker task & the tag parser tasks.  The tasks are
+ * never deleted, so calling this again can only add parsers.
+ *
+ * @param parsers the number of tag parser tasks
+ * @param priority the priority of the walker & parser tasks
+ *
+ * @return true on success, false otherwise
+ */
+bool scan_pipeline_init( const uint32_t parsers, const uint32_t priority );
+
+/**
+ * Walks the directory tree below RootDirectory while the parser tasks read
+ * the tags of the files found.  insert_fn is called from the calling task
+ * for every file with usable tags, in no particular order.
+ *
+ * If scan_pipeline_init() has not succeeded the tags are read inline by
+ * the calling task.
+ *
+ * The card signature (see index_file_signature()) is worked out by the
+ * same walk, so the card is only walked once.
+ *
+ * @param RootDirectory NULL terminated path of the directory to walk
+ * @param insert_fn the function to call for each file with usable tags
+ * @param user_data passed to insert_fn
+ * @param index_file the index file path, skipped by the signature
+ * @param signature the card signature, only good if true is returned.
+ *        NULL for none.
+ *
+ * @return true if the whole tree was walked, false otherwise.  The files
+ *         found before a failure are still passed to insert_fn.
+ */
+bool scan_pipeline_run( const char *RootDirectory,
+                        scan_insert_fn_t insert_fn,
+                        void *user_data,
+                        const char *index_file,
+                        uint32_t *signature );
+
+#endif /* __SCAN_PIPELINE_H__ */
@@ -0,0 +1,199 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "string_arena.h"
+#include "w_malloc.h"
+
+/*----------------------------------------------------------------------------*/
+/*                                 Constants                                  */
+/*----------------------------------------------------------------------------*/
+/* Must be a power of 2 */
+#define INITIAL_TABLE_SIZE  256
+
+/*----------------------------------------------------------------------------*/
+/*                            File Scoped Variables                           */
+/*----------------------------------------------------------------------------*/
+static char *__block = NULL;
+static size_t __block_used = 0;
+
+/* Open addressed hash table of the interned strings. */
+static const char **__table = NULL;
+static size_t __table_size = 0;
+static size_t __table_used = 0;
+
+static size_t __blocks_size = 0;
+
+/*----------------------------------------------------------------------------*/
+/*                             Internal Functions                             */
+/*----------------------------------------------------------------------------*/
+static size_t __length( const char *string, size_t max_length );
+static uint32_t __hash( const char *string, size_t length );
+static const char * __copy( const char *string, size_t length );
+static bool __grow_table( void );
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+
+/* See string_arena.h for information */
+const char * string_arena_add( const char *string, size_t max_length )
+{
+    if( NULL == string ) {
+        return NULL;
+    }
+
+    return __copy( string, __length(string, max_length) );
+}
+
+/* See string_arena.h for information */
+const char * string_arena_intern( const char *string, size_t max_length )
+{
+    size_t length;
+    size_t i;
+
+    if( NULL == string ) {
+        return NULL;
+    }
+
+    /* Keep the table at most 3/4 full so the probe runs stay short. */
+    if( (__table_used + 1) * 4 > __table_size * 3 ) {
+        if( false == __grow_table() ) {
+            return NULL;
+        }
+    }
+
+    length = __length( string, max_length );
+    i = __hash( string, length ) & (__table_size - 1);
+    while( NULL != __table[i] ) {
+        if(    ( 0 == strncmp(__table[i], string, length) )
+            && ( '\0' == __table[i][length] ) )
+        {
+            return __table[i];
+        }
+        i = (i + 1) & (__table_size - 1);
+    }
+
+    __table[i] = __copy( string, length );
+    if( NULL != __table[i] ) {
+        __table_used++;
+    }
+    return __table[i];
+}
+
+/* See string_arena.h for information */
+void string_arena_purge( void )
+{
+    __block = NULL;
+    __block_used = 0;
+    __blocks_size = 0;
+
+    if( NULL != __table ) {
+        memset( __table, 0, __table_size * sizeof(const char *) );
+    }
+    __table_used = 0;
+}
+
+/* See string_arena.h for information */
+size_t string_arena_size( void )
+{
+    return __blocks_size + __table_size * sizeof(const char *);
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             Internal Functions                             */
+/*----------------------------------------------------------------------------*/
+static size_t __length( const char *string, size_t max_length )
+{
+    size_t length = 0;
+
+    while( (length < max_length) && ('\0' != string[length]) ) {
+        length++;
+    }
+    return length;
+}
+
+static uint32_t __hash( const char *string, size_t length )
+{
+    uint32_t hash = 2166136261U;
+
+    while( 0 < length-- ) {
+        hash ^= (uint8_t) *string++;
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+static const char * __copy( const char *string, size_t length )
+{
+    char *copy;
+
+    if( STRING_ARENA_BLOCK_SIZE <= length ) {
+        return NULL;
+    }
+
+    if( (NULL == __block) || (STRING_ARENA_BLOCK_SIZE < __block_used + length + 1) ) {
+        __block = (char *) arena_alloc( STRING_ARENA_BLOCK_SIZE );
+        if( NULL == __block ) {
+            return NULL;
+        }
+        __block_used = 0;
+        __blocks_size += STRING_ARENA_BLOCK_SIZE;
+    }
+
+    copy = &__block[__block_used];
+    memcpy( copy, string, length );
+    copy[length] = '\0';
+    __block_used += length + 1;
+
+    return copy;
+}
+
+static bool __grow_table( void )
+{
+    const char **table;
+    size_t size;
+    size_t i;
+
+    size = (0 == __table_size) ? INITIAL_TABLE_SIZE : (__table_size * 2);
+    table = (const char **) w_malloc( size * sizeof(const char *) );
+    if( NULL == table ) {
+        return false;
+    }
+
+    for( i = 0; i < __table_size; i++ ) {
+        if( NULL != __table[i] ) {
+            size_t j = __hash( __table[i], strlen(__table[i]) ) & (size - 1);
+            while( NULL != table[j] ) {
+                j = (j + 1) & (size - 1);
+            }
+            table[j] = __table[i];
+        }
+    }
+
+    if( NULL != __table ) {
+        free( __table );
+    }
+    __table = table;
+    __table_size = size;
+
+    return true;
+}
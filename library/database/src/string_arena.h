@@ -0,0 +1,53 @@
+#ifndef __STRING_ARENA_H__
+#define __STRING_ARENA_H__
+
+#include <stddef.h>
+
+/**
+ * The strings are packed back to back at their real length into blocks
+ * of this size taken from the database arena, so there is no per string
+ * allocation overhead.
+ */
+#define STRING_ARENA_BLOCK_SIZE     1024
+
+/**
+ * Copies the string into the arena without checking if it is already
+ * present.  Used for strings which are nearly always unique, like song
+ * titles, so they do not take up room in the lookup table.
+ *
+ * @param string the NULL terminated string to copy
+ * @param max_length the maximum number of characters to copy, excluding
+ *        the NULL terminator
+ *
+ * @return the copy on success, NULL on failure
+ */
+const char * string_arena_add( const char *string, size_t max_length );
+
+/**
+ * Returns the arena copy of the string, adding the string to the arena
+ * only if an identical (case sensitive) string is not already present.
+ *
+ * @param string the string to intern, does not need to be NULL terminated
+ *        if it is longer than max_length
+ * @param max_length the maximum number of characters to use, excluding
+ *        the NULL terminator
+ *
+ * @return the shared copy on success, NULL on failure
+ */
+const char * string_arena_intern( const char *string, size_t max_length );
+
+/**
+ * Forgets all the strings in the arena.  Every pointer previously
+ * returned is invalid afterwards.  The blocks themselves belong to the
+ * database arena and are released by arena_reset(), the lookup table
+ * is kept for the next database.
+ */
+void string_arena_purge( void );
+
+/**
+ * @return the number of bytes of heap used by the arena, including the
+ *         lookup table
+ */
+size_t string_arena_size( void );
+
+#endif /* __STRING_ARENA_H__ */
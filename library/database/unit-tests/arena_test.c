@@ -0,0 +1,199 @@
+#include <CUnit/Basic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "database.h"
+#include "internal_database.h"
+#include "add_song.h"
+#include "arena.h"
+#include "generic.h"
+#include "indexer.h"
+#include "db_testing.h"
+#include "large_db.h"
+
+#define DEBUG 0
+
+#define _D1(...)
+
+#if DEBUG > 0
+#undef  _D1
+#define _D1(...) printf( __VA_ARGS__ )
+#endif
+
+#define REINSERTS   50
+
+/* Everything the database takes from the heap goes through w_malloc(). */
+static size_t heap_used;
+
+root_database_node_t rdn;
+
+void * w_malloc( size_t size )
+{
+    void *ptr = malloc( size );
+
+    if( NULL != ptr ) {
+        memset( ptr, 0, size );
+        heap_used += size;
+    }
+    return ptr;
+}
+
+void test_alloc( void )
+{
+    arena_stats_t stats;
+    uint8_t *a, *b;
+    size_t i;
+
+    database_purge();
+    a = (uint8_t *) arena_alloc( 3 );
+    b = (uint8_t *) arena_alloc( 20 );
+    CU_ASSERT_FATAL( (NULL != a) && (NULL != b) );
+    CU_ASSERT( 0 == ((uintptr_t) a & 7) );
+    CU_ASSERT( 0 == ((uintptr_t) b & 7) );
+    CU_ASSERT( 8 == (b - a) );
+    for( i = 0; i < 20; i++ ) {
+        CU_ASSERT( 0 == b[i] );
+    }
+
+    arena_get_stats( &stats );
+    CU_ASSERT( 32 == stats.used );
+    CU_ASSERT( ARENA_BLOCK_SIZE <= stats.reserved );
+
+    CU_ASSERT( NULL == arena_alloc(0) );
+    CU_ASSERT( NULL == arena_alloc(ARENA_BLOCK_SIZE + 1) );
+
+    /* Dirty memory is cleared when it is handed out again. */
+    memset( a, 0xff, 32 );
+    database_purge();
+    a = (uint8_t *) arena_alloc( 32 );
+    CU_ASSERT_FATAL( NULL != a );
+    for( i = 0; i < 32; i++ ) {
+        CU_ASSERT( 0 == a[i] );
+    }
+    database_purge();
+}
+
+void test_slab( void )
+{
+    static arena_slab_t slab = ARENA_SLAB_INIT( 24 );
+    arena_stats_t stats;
+    void *a, *b, *c;
+
+    database_purge();
+    a = arena_slab_alloc( &slab );
+    b = arena_slab_alloc( &slab );
+    CU_ASSERT_FATAL( (NULL != a) && (NULL != b) && (a != b) );
+
+    arena_slab_free( &slab, a );
+    arena_get_stats( &stats );
+    c = arena_slab_alloc( &slab );
+    CU_ASSERT( a == c );
+    CU_ASSERT( 0 == *(uint32_t *) c );
+    arena_get_stats( &stats );
+    CU_ASSERT( 48 == stats.used );
+
+    /* A reset empties the free list as well. */
+    arena_slab_free( &slab, b );
+    database_purge();
+    CU_ASSERT( NULL == slab.free );
+    a = arena_slab_alloc( &slab );
+    arena_get_stats( &stats );
+    CU_ASSERT( 24 == stats.used );
+    database_purge();
+}
+
+void test_remove_reuses_nodes( void )
+{
+    media_metadata_t metadata;
+    song_node_t *a, *b;
+    arena_stats_t before, after;
+
+    database_purge();
+    rdn.root = (generic_node_t *) get_new_generic_node(GNT_ROOT, "root")->data;
+    memset( &metadata, 0, sizeof(media_metadata_t) );
+    strcpy( metadata.artist, "Cake" );
+    strcpy( metadata.album, "Fashion Nugget" );
+    strcpy( metadata.title, "Daria" );
+
+    a = add_song_to_root( rdn.root, &metadata, fake_play, "/CAKE/05.FLA" );
+    CU_ASSERT_FATAL( NULL != a );
+    remove_song_from_root( a );
+    arena_get_stats( &before );
+
+    b = add_song_to_root( rdn.root, &metadata, fake_play, "/CAKE/05.FLA" );
+    CU_ASSERT( a == b );
+    arena_get_stats( &after );
+    CU_ASSERT( before.reserved == after.reserved );
+
+    database_purge();
+}
+
+void test_reinsert( void )
+{
+    arena_stats_t first, stats;
+    size_t heap;
+    int i;
+
+    create_database_in( large_db, sizeof(large_db)/sizeof(ut_song_t),
+                        "/MUSIC/D%04u", 12, NULL );
+    arena_get_stats( &first );
+    heap = heap_used;
+    _D1( "\nfirst: %u used, %u high water, %u reserved, %u heap\n",
+         (unsigned int) first.used, (unsigned int) first.high_water,
+         (unsigned int) first.reserved, (unsigned int) heap );
+
+    for( i = 0; i < REINSERTS; i++ ) {
+        create_database_in( large_db, sizeof(large_db)/sizeof(ut_song_t),
+                            "/MUSIC/D%04u", 12, NULL );
+    }
+
+    arena_get_stats( &stats );
+    _D1( "last:  %u used, %u high water, %u reserved, %u heap\n",
+         (unsigned int) stats.used, (unsigned int) stats.high_water,
+         (unsigned int) stats.reserved, (unsigned int) heap_used );
+    CU_ASSERT( first.used == stats.used );
+    CU_ASSERT( first.high_water == stats.high_water );
+    CU_ASSERT( first.reserved == stats.reserved );
+    CU_ASSERT( heap == heap_used );
+
+    database_purge();
+    arena_get_stats( &stats );
+    CU_ASSERT( 0 == stats.used );
+    CU_ASSERT( first.high_water == stats.high_water );
+}
+
+void add_suites( CU_pSuite *suite )
+{
+    *suite = CU_add_suite( "Arena Test", NULL, NULL );
+    CU_add_test( *suite, "Test Alloc            ", test_alloc );
+    CU_add_test( *suite, "Test Slab             ", test_slab );
+    CU_add_test( *suite, "Test Remove Reuses    ", test_remove_reuses_nodes );
+    CU_add_test( *suite, "Test 50 Reinserts     ", test_reinsert );
+}
+
+int main( int argc, char *argv[] )
+{
+    int rv = 1;
+    CU_pSuite suite = NULL;
+
+    if( CUE_SUCCESS == CU_initialize_registry() ) {
+        add_suites( &suite );
+
+        if( NULL != suite ) {
+            CU_basic_set_mode( CU_BRM_VERBOSE );
+            CU_basic_run_tests();
+            printf( "\n" );
+            CU_basic_show_failures( CU_get_failure_list() );
+            printf( "\n\n" );
+            rv = CU_get_number_of_tests_failed();
+        }
+
+        CU_cleanup_registry();
+    }
+
+    if( 0 != rv ) {
+        return 1;
+    }
+    return CU_get_error();
+}
@@ -0,0 +1,332 @@
+/*
+ * Database benchmark - not a unit test, run it with "make bench".
+ *
+ * Builds synthetic libraries of 1k to 100k tracks (plus large_db.h) and
+ * times the insert, index_root(), navigation & purge of each.  The heap
+ * is measured through w_malloc() & free().  Each library is run in its
+ * own process, as a purge keeps the arena pages for the next scan.  The
+ * results are written to stdout as JSON so runs can be compared.
+ */
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "database.h"
+#include "internal_database.h"
+#include "add_song.h"
+#include "generic.h"
+#include "indexer.h"
+#include "queued_next_song.h"
+#include "db_testing.h"
+#include "large_db.h"
+
+#define NAVIGATE_OPERATIONS 1000000
+#define MIN_ALBUMS          1
+#define MAX_ALBUMS          8
+#define MIN_TRACKS          6
+#define MAX_TRACKS          18
+#define MAX_DISCS           2
+
+typedef struct {
+    const char *name;
+    db_traverse_t operation;
+    db_level_t level;
+} nav_case_t;
+
+static const nav_case_t nav_cases[] = {
+    { "next_song",   DT_NEXT,     DL_SONG   },
+    { "next_album",  DT_NEXT,     DL_ALBUM  },
+    { "prev_album",  DT_PREVIOUS, DL_ALBUM  },
+    { "next_artist", DT_NEXT,     DL_ARTIST },
+    { "random",      DT_RANDOM,   DL_ARTIST },
+};
+
+static const uint32_t synthetic_sizes[] = { 1000, 3000, 10000, 30000, 100000 };
+
+static const char *words[] = {
+    "Love", "Night", "The", "Blue", "Fire", "Dream", "Heart", "Road", "City",
+    "Summer", "Rain", "Light", "Dark", "Home", "Star", "River", "Golden",
+    "Broken", "Wild", "Electric", "Dance", "Moon", "Shadow", "Song"
+};
+
+/* Everything the database takes from the heap goes through w_malloc() &
+ * comes back through free(), which is wrapped by the linker. */
+static size_t heap_used;
+static size_t heap_peak;
+
+static uint32_t random_state;
+
+root_database_node_t rdn;
+
+void __real_free( void *ptr );
+
+void * w_malloc( size_t size )
+{
+    void *ptr = malloc( size );
+
+    if( NULL != ptr ) {
+        memset( ptr, 0, size );
+        heap_used += malloc_usable_size( ptr );
+        if( heap_peak < heap_used ) {
+            heap_peak = heap_used;
+        }
+    }
+    return ptr;
+}
+
+void __wrap_free( void *ptr )
+{
+    if( NULL != ptr ) {
+        heap_used -= malloc_usable_size( ptr );
+    }
+    __real_free( ptr );
+}
+
+media_status_t fake_play(
+    const char *filename,
+    const double gain,
+    const double peak,
+    queue_handle_t idle,
+    const size_t queue_size,
+    media_malloc_fn_t malloc_fn,
+    media_free_fn_t free_fn,
+    media_command_fn_t command_fn )
+{
+    return MI_RETURN_OK;
+}
+
+static uint64_t now_ns( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* xorshift32, so every run builds the same libraries. */
+static uint32_t random_next( void )
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+static uint32_t random_range( uint32_t min, uint32_t max )
+{
+    return min + random_next() % (max - min + 1);
+}
+
+static void random_words( char *out, uint32_t count )
+{
+    uint32_t i;
+
+    out[0] = '\0';
+    for( i = 0; i < count; i++ ) {
+        if( 0 != i ) {
+            strcat( out, " " );
+        }
+        strcat( out, words[random_next() % (sizeof(words) / sizeof(words[0]))] );
+    }
+}
+
+/* Artists have a few albums of a dozen or so tracks, some over 2 discs. */
+static ut_song_t * create_synthetic( uint32_t tracks )
+{
+    ut_song_t *db;
+    char text[MEDIA_TITLE_LENGTH + 1];
+    uint32_t artists = 0;
+    uint32_t albums = 0;
+    uint32_t i = 0;
+
+    db = (ut_song_t *) malloc( tracks * sizeof(ut_song_t) );
+    random_state = 0x2545f491 ^ tracks;
+
+    while( i < tracks ) {
+        uint32_t album_count = random_range( MIN_ALBUMS, MAX_ALBUMS );
+        char *artist;
+
+        random_words( text, random_range(1, 3) );
+        sprintf( text + strlen(text), " %u", artists++ );
+        artist = strdup( text );
+
+        while( (0 < album_count--) && (i < tracks) ) {
+            uint32_t track_count = random_range( MIN_TRACKS, MAX_TRACKS );
+            uint32_t disc_tracks = track_count * random_range( 1, MAX_DISCS );
+            uint32_t track;
+            char *album;
+
+            random_words( text, random_range(1, 4) );
+            sprintf( text + strlen(text), " %u", albums++ );
+            album = strdup( text );
+
+            for( track = 0; (track < disc_tracks) && (i < tracks); track++, i++ ) {
+                random_words( text, random_range(1, 6) );
+                db[i].artist = artist;
+                db[i].album = album;
+                db[i].title = strdup( text );
+                db[i].track = 1000 * (track / track_count) + track % track_count + 1;
+            }
+        }
+    }
+    return db;
+}
+
+/* Only the titles are unique, the artists & albums are shared. */
+static void destroy_synthetic( ut_song_t *db, uint32_t tracks )
+{
+    uint32_t i;
+
+    for( i = 0; i < tracks; i++ ) {
+        if( (0 == i) || (db[i].album != db[i - 1].album) ) {
+            __real_free( db[i].album );
+        }
+        if( (0 == i) || (db[i].artist != db[i - 1].artist) ) {
+            __real_free( db[i].artist );
+        }
+        __real_free( db[i].title );
+    }
+    __real_free( db );
+}
+
+static double navigate( const nav_case_t *nav, next_song_fct fn )
+{
+    song_node_t *song = NULL;
+    uint64_t begin;
+    uint32_t i;
+
+    begin = now_ns();
+    for( i = 0; i < NAVIGATE_OPERATIONS; i++ ) {
+        if( DS_FAILURE == (*fn)(&song, nav->operation, nav->level) ) {
+            fprintf( stderr, "%s failed\n", nav->name );
+            exit( 1 );
+        }
+    }
+    return (double) (now_ns() - begin) / NAVIGATE_OPERATIONS;
+}
+
+static void run( const char *name, ut_song_t *db, uint32_t tracks, bool last )
+{
+    media_metadata_t metadata;
+    char location[MAX_SHORT_FILENAME_PATH_W_NULL];
+    bt_node_t *node;
+    uint64_t begin;
+    uint64_t insert_ns;
+    uint64_t index_ns;
+    uint64_t purge_ns;
+    size_t heap_base;
+    uint32_t artists = 0;
+    uint32_t albums = 0;
+    uint32_t i;
+
+    heap_base = heap_used;
+    heap_peak = heap_used;
+
+    begin = now_ns();
+    node = get_new_generic_node( GNT_ROOT, "root" );
+    rdn.root = (generic_node_t *) node->data;
+    for( i = 0; i < tracks; i++ ) {
+        memset( &metadata, 0, sizeof(media_metadata_t) );
+        strcpy( metadata.artist, db[i].artist );
+        strcpy( metadata.album, db[i].album );
+        strcpy( metadata.title, db[i].title );
+        metadata.track_number = db[i].track;
+        sprintf( location, "/MUSIC/A%04u/B%05u/%08u.FLA",
+                 i / 200, i / 12, i );
+        add_song_to_root( rdn.root, &metadata, fake_play, location );
+    }
+    insert_ns = now_ns() - begin;
+
+    begin = now_ns();
+    index_root( &(rdn.root->node) );
+    index_ns = now_ns() - begin;
+
+    /* The song table is grouped by artist & album. */
+    for( i = 0; i < rdn.songs.count; i++ ) {
+        song_node_t *song = get_indexed_song( i );
+        song_node_t *prev = (0 == i) ? NULL : get_indexed_song( i - 1 );
+
+        if( (NULL == prev) || (prev->d.parent != song->d.parent) ) {
+            albums++;
+            if( (NULL == prev) || (prev->d.parent->parent != song->d.parent->parent) ) {
+                artists++;
+            }
+        }
+    }
+
+    printf( "    {\n" );
+    printf( "      \"library\": \"%s\",\n", name );
+    printf( "      \"tracks\": %u,\n", tracks );
+    printf( "      \"artists\": %u,\n", artists );
+    printf( "      \"albums\": %u,\n", albums );
+    printf( "      \"insert_ns_per_op\": %.1f,\n", (double) insert_ns / tracks );
+    printf( "      \"index_root_ns\": %llu,\n", (unsigned long long) index_ns );
+    printf( "      \"index_root_ns_per_track\": %.1f,\n", (double) index_ns / tracks );
+
+    printf( "      \"next_song_ns_per_op\": {\n" );
+    for( i = 0; i < sizeof(nav_cases) / sizeof(nav_cases[0]); i++ ) {
+        printf( "        \"%s\": %.1f,\n", nav_cases[i].name,
+                navigate(&nav_cases[i], next_song) );
+    }
+    printf( "        \"shuffle\": %.1f\n", navigate(&nav_cases[0], queued_next_song) );
+    printf( "      },\n" );
+
+    printf( "      \"peak_heap_bytes\": %lu,\n", (unsigned long) (heap_peak - heap_base) );
+    printf( "      \"heap_bytes_per_track\": %.1f,\n",
+            (double) (heap_peak - heap_base) / tracks );
+
+    begin = now_ns();
+    database_purge();
+    purge_ns = now_ns() - begin;
+    printf( "      \"purge_ns\": %llu\n", (unsigned long long) purge_ns );
+    printf( "    }%s\n", (true == last) ? "" : "," );
+    fflush( stdout );
+}
+
+/* Runs one library in a child process so it starts with an empty heap. */
+static void run_alone( const char *name, ut_song_t *db, uint32_t tracks, bool last )
+{
+    pid_t pid;
+    int status;
+
+    fflush( stdout );
+    pid = fork();
+    if( 0 == pid ) {
+        run( name, db, tracks, last );
+        exit( 0 );
+    }
+    if( (pid < 0) || (pid != waitpid(pid, &status, 0)) || (0 != status) ) {
+        fprintf( stderr, "%s failed\n", name );
+        exit( 1 );
+    }
+}
+
+int main( int argc, char *argv[] )
+{
+    uint32_t sizes = sizeof(synthetic_sizes) / sizeof(synthetic_sizes[0]);
+    uint32_t i;
+
+    rdn.initialized = true;
+    queued_song_init();
+
+    printf( "{\n  \"benchmarks\": [\n" );
+
+    run_alone( "large_db", large_db, sizeof(large_db) / sizeof(ut_song_t), false );
+
+    for( i = 0; i < sizes; i++ ) {
+        char name[32];
+        ut_song_t *db;
+
+        db = create_synthetic( synthetic_sizes[i] );
+        sprintf( name, "synthetic-%u", synthetic_sizes[i] );
+        run_alone( name, db, synthetic_sizes[i], (sizes - 1) == i );
+        destroy_synthetic( db, synthetic_sizes[i] );
+    }
+
+    printf( "  ]\n}\n" );
+    return 0;
+}
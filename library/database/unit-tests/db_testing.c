@@ -0,0 +1,103 @@
+/*
+ * db_testing.c
+ *
+ * The database every unit test that needs one starts from.
+ */
+
+#include <CUnit/Basic.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <file-stream/file-stream.h>
+#include "database.h"
+#include "internal_database.h"
+#include "add_song.h"
+#include "generic.h"
+#include "indexer.h"
+#include "db_testing.h"
+
+media_status_t fake_play(
+    const char *filename,
+    const double gain,
+    const double peak,
+    queue_handle_t idle,
+    const size_t queue_size,
+    media_malloc_fn_t malloc_fn,
+    media_free_fn_t free_fn,
+    media_command_fn_t command_fn )
+{
+    return MI_RETURN_OK;
+}
+
+void create_root( void )
+{
+    bt_node_t * node;
+
+    database_purge();
+    node = get_new_generic_node(GNT_ROOT, "root");
+    CU_ASSERT_FATAL( NULL != node );
+    rdn.initialized = true;
+    rdn.root = (generic_node_t*)node->data;
+}
+
+void create_database( ut_song_t *db, size_t size_db )
+{
+    create_database_in( db, size_db, "/MUSIC", 0, NULL );
+}
+
+void create_database_in( ut_song_t *db, size_t size_db,
+                         const char *directory, size_t songs_per_directory,
+                         ut_metadata_fn_t metadata_fn )
+{
+    size_t i;
+    media_metadata_t metadata;
+    song_node_t * so_n;
+    char location[MAX_SHORT_FILENAME_PATH_W_NULL];
+
+    create_root();
+    for( i = 0; i < size_db; i++ ) {
+        memset( &metadata, 0, sizeof(media_metadata_t) );
+        strcpy( metadata.artist, db[i].artist );
+        strcpy( metadata.album, db[i].album );
+        strcpy( metadata.title, db[i].title );
+        metadata.track_number = db[i].track;
+        if( NULL != metadata_fn ) {
+            metadata_fn( &metadata, i );
+        }
+        if( 0 == songs_per_directory ) {
+            strcpy( location, directory );
+        } else {
+            sprintf( location, directory,
+                     (unsigned int) (i / songs_per_directory) );
+        }
+        sprintf( location + strlen(location), "/%08u.FLA", (unsigned int) i );
+        so_n = add_song_to_root( rdn.root, &metadata, fake_play, location );
+        CU_ASSERT_FATAL( NULL != so_n );
+    }
+    index_root( &(rdn.root->node) );
+}
+
+/* One card for every thread, like the one for every task on the board. */
+static pthread_mutex_t __card = PTHREAD_MUTEX_INITIALIZER;
+static __thread int __card_taken;
+
+void fstream_card_take( const fstream_priority_t priority )
+{
+    CU_ASSERT( FSTREAM_PRIORITY__BACKGROUND == priority );
+    CU_ASSERT( 0 == __card_taken );
+    pthread_mutex_lock( &__card );
+    __card_taken++;
+}
+
+void fstream_card_give( void )
+{
+    CU_ASSERT( 1 == __card_taken );
+    __card_taken--;
+    pthread_mutex_unlock( &__card );
+}
+
+bool ut_card_taken( void )
+{
+    return (0 < __card_taken);
+}
@@ -9,6 +9,8 @@
 #define DB_TESTING_H_
 
 #include <stdint.h>
+#include <stddef.h>
+#include "database.h"
 
 typedef struct {
     char * artist;
@@ -17,5 +19,52 @@ typedef struct {
     uint32_t track;
 } ut_song_t;
 
+/* Called with the metadata of each song create_database_in() adds & its
+   place in db, before the song is added. */
+typedef void (*ut_metadata_fn_t)( media_metadata_t *metadata, size_t i );
+
+/**
+ * The play function the test songs are added with, it's never called.
+ */
+media_status_t fake_play(
+    const char *filename,
+    const double gain,
+    const double peak,
+    queue_handle_t idle,
+    const size_t queue_size,
+    media_malloc_fn_t malloc_fn,
+    media_free_fn_t free_fn,
+    media_command_fn_t command_fn );
+
+/**
+ * Purges the database & leaves an empty root in rdn.
+ */
+void create_root( void );
+
+/**
+ * Purges the database, adds the songs of db as /MUSIC/<i>.FLA & indexes it.
+ */
+void create_database( ut_song_t *db, size_t size_db );
+
+/**
+ * Like create_database(), but the songs are put songs_per_directory at a
+ * time into directories named by the printf() format directory from the
+ * directory number.  With songs_per_directory 0 they all go in directory.
+ *
+ * @param metadata_fn if not NULL, can change the metadata of every song
+ */
+void create_database_in( ut_song_t *db, size_t size_db,
+                         const char *directory, size_t songs_per_directory,
+                         ut_metadata_fn_t metadata_fn );
+
+/**
+ * The codecs take the card from file-stream, which isn't linked into the
+ * tests, for each call they make to read the tags.  Its fstream_card_take()
+ * & fstream_card_give() are a mutex shared by the threads, so the fake
+ * tag reads of the parsers wait for each other as they do on the board.
+ *
+ * @return true if the calling thread has the card
+ */
+bool ut_card_taken( void );
 
 #endif /* DB_TESTING_H_ */
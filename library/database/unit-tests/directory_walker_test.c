@@ -0,0 +1,353 @@
+#include <CUnit/Basic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memcard/dirent.h>
+#include "database.h"
+#include "directory_walker.h"
+#include "file_os_wrapper.h"
+
+#define TEST_ROOT           "/"
+#define LEVELS              5
+#define MAX_ENTRIES         12000
+#define MAX_DIRS            2000
+#define MAX_HANDLES         8
+#define ENTRIES_PER_SECTOR  16      /* 512 byte sectors, 32 byte entries */
+#define NO_FAILURE          0xffffffff
+
+/* Files & then sub directories at each level, the last level only has
+ * files.  1555 directories & 10362 files. */
+static const uint32_t level_dirs[LEVELS]  = {  6,  6,  6,  6, 0 };
+static const uint32_t level_files[LEVELS] = { 30, 30, 30, 30, 2 };
+
+typedef struct {
+    char name[DT_NAME_MAX + 1];
+    int32_t dir;            /* The directory, -1 for a file */
+    uint32_t visits;
+} fake_entry_t;
+
+typedef struct {
+    uint32_t first;         /* Index into entries */
+    uint32_t count;
+} fake_dir_t;
+
+typedef struct {
+    bool used;
+    uint32_t dir;
+    uint32_t index;
+    int end;
+} fake_handle_t;
+
+/* A fake FAT card - the memcard dirent functions are backed by this. */
+static fake_entry_t entries[MAX_ENTRIES];
+static uint32_t entry_count;
+static fake_dir_t dirs[MAX_DIRS];
+static uint32_t dir_count;
+static uint32_t file_count;
+
+static fake_handle_t handles[MAX_HANDLES];
+static uint32_t handle_limit;
+static uint32_t handles_open;
+
+/* Like the FatFs window, the last sector read is cached. */
+static uint32_t window_dir;
+static uint32_t window_sector;
+static uint32_t sector_reads;
+
+static uint32_t fail_open_dir;
+static uint32_t files_walked;
+static uint32_t stop_after;
+
+/*----------------------------------------------------------------------------*/
+/*                           Fake memcard dirent                              */
+/*----------------------------------------------------------------------------*/
+DIR* opendir( const char *dirname )
+{
+    char name[DT_NAME_MAX + 1];
+    uint32_t dir = 0;
+    uint32_t i;
+
+    while( '\0' != *dirname ) {
+        size_t length;
+
+        while( '/' == *dirname ) {
+            dirname++;
+        }
+        length = strcspn( dirname, "/" );
+        if( 0 == length ) {
+            break;
+        }
+        if( DT_NAME_MAX < length ) {
+            return NULL;
+        }
+        memcpy( name, dirname, length );
+        name[length] = '\0';
+        dirname += length;
+
+        for( i = 0; i < dirs[dir].count; i++ ) {
+            fake_entry_t *e = &entries[dirs[dir].first + i];
+            if( (0 <= e->dir) && (0 == strcmp(e->name, name)) ) {
+                break;
+            }
+        }
+        if( dirs[dir].count == i ) {
+            return NULL;
+        }
+        dir = entries[dirs[dir].first + i].dir;
+    }
+
+    if( (fail_open_dir == dir) || (handle_limit <= handles_open) ) {
+        return NULL;
+    }
+
+    for( i = 0; i < MAX_HANDLES; i++ ) {
+        if( false == handles[i].used ) {
+            handles[i].used = true;
+            handles[i].dir = dir;
+            handles[i].index = 0;
+            handles[i].end = 0;
+            handles_open++;
+            return (DIR *) &handles[i];
+        }
+    }
+    return NULL;
+}
+
+int closedir( DIR *dirp )
+{
+    fake_handle_t *h = (fake_handle_t *) dirp;
+
+    CU_ASSERT_FATAL( true == h->used );
+    h->used = false;
+    handles_open--;
+    return 0;
+}
+
+struct dirent* readdir( DIR *dirp, struct dirent *_user_provided )
+{
+    fake_handle_t *h = (fake_handle_t *) dirp;
+    fake_entry_t *e;
+    uint32_t sector;
+
+    CU_ASSERT_FATAL( true == h->used );
+    if( 0 != h->end ) {
+        return NULL;
+    }
+
+    sector = h->index / ENTRIES_PER_SECTOR;
+    if( (window_dir != h->dir) || (window_sector != sector) ) {
+        window_dir = h->dir;
+        window_sector = sector;
+        sector_reads++;
+    }
+
+    if( dirs[h->dir].count <= h->index ) {
+        h->end = 1;
+        return NULL;
+    }
+
+    e = &entries[dirs[h->dir].first + h->index];
+    h->index++;
+
+    memset( _user_provided, 0, sizeof(struct dirent) );
+    strcpy( _user_provided->d_name, e->name );
+    _user_provided->d_attr = (0 <= e->dir) ? DT_DIR : 0;
+    _user_provided->d_size = 1000;
+    return _user_provided;
+}
+
+void rewinddir( DIR *dirp )
+{
+    fake_handle_t *h = (fake_handle_t *) dirp;
+
+    h->index = 0;
+    h->end = 0;
+}
+
+/* Like the memcard seekdir(), reads up to loc. */
+void seekdir( DIR *dirp, long loc )
+{
+    fake_handle_t *h = (fake_handle_t *) dirp;
+
+    while( (0 == h->end) && (h->index < loc) ) {
+        struct dirent ignore;
+        readdir( dirp, &ignore );
+    }
+}
+
+long telldir( DIR *dirp )
+{
+    return ((fake_handle_t *) dirp)->index;
+}
+
+/*----------------------------------------------------------------------------*/
+/*                                  Helpers                                   */
+/*----------------------------------------------------------------------------*/
+static void build_dir( uint32_t dir, uint32_t level )
+{
+    uint32_t i;
+    uint32_t first;
+
+    first = entry_count;
+    dirs[dir].first = first;
+    dirs[dir].count = level_files[level] + level_dirs[level];
+    entry_count += dirs[dir].count;
+
+    for( i = 0; i < level_files[level]; i++ ) {
+        sprintf( entries[first + i].name, "%08u.FLA", file_count++ );
+        entries[first + i].dir = -1;
+    }
+    for( i = 0; i < level_dirs[level]; i++ ) {
+        fake_entry_t *e = &entries[first + level_files[level] + i];
+
+        /* Both are below 256, which keeps the name 8.3. */
+        snprintf( e->name, sizeof(e->name), "L%uD%u", (uint8_t) level, (uint8_t) i );
+        e->dir = dir_count++;
+        build_dir( e->dir, level + 1 );
+    }
+}
+
+static void build_card( void )
+{
+    entry_count = 0;
+    file_count = 0;
+    dir_count = 1;
+    build_dir( 0, 0 );
+}
+
+/* Every sector of every directory, including the end marker. */
+static uint32_t card_sectors( void )
+{
+    uint32_t i;
+    uint32_t sectors = 0;
+
+    for( i = 0; i < dir_count; i++ ) {
+        sectors += dirs[i].count / ENTRIES_PER_SECTOR + 1;
+    }
+    return sectors;
+}
+
+static bool count_file( const char *full_path,
+                        const file_info_t *file_info,
+                        void *user_data )
+{
+    uint32_t file;
+
+    if( stop_after == files_walked ) {
+        return false;
+    }
+    CU_ASSERT_FATAL( false == file_info->is_dir );
+    CU_ASSERT_FATAL( 1 == sscanf(strrchr(full_path, '/'), "/%08u.FLA", &file) );
+
+    /* The entries are numbered depth first as the walk finds them. */
+    CU_ASSERT( files_walked == file );
+    files_walked++;
+    return true;
+}
+
+static uint32_t walk( uint32_t limit )
+{
+    handle_limit = limit;
+    window_dir = MAX_DIRS;
+    sector_reads = 0;
+    files_walked = 0;
+    fail_open_dir = NO_FAILURE;
+    stop_after = NO_FAILURE;
+
+    CU_ASSERT( true == dir_walk(TEST_ROOT, count_file, NULL) );
+    CU_ASSERT( file_count == files_walked );
+    CU_ASSERT( 0 == handles_open );
+    return sector_reads;
+}
+
+/*----------------------------------------------------------------------------*/
+/*                                   Tests                                    */
+/*----------------------------------------------------------------------------*/
+void test_walk_reads( void )
+{
+    uint32_t sectors = card_sectors();
+    uint32_t reopen;
+    uint32_t some;
+    uint32_t all;
+
+    /* One handle at a time is the same as reopening & seeking the
+     * parent on the way back up. */
+    reopen = walk( 1 );
+    some = walk( 3 );
+    all = walk( MAX_HANDLES );
+
+    printf( "\n    %u files in %u directories, %u directory sectors\n",
+            file_count, dir_count, sectors );
+    printf( "    sector reads: reopen %u, 3 handles %u, %u handles %u\n",
+            reopen, some, MAX_HANDLES, all );
+
+    /* Each directory is read once, plus the sector it was left on for
+     * every sub directory it has. */
+    CU_ASSERT( all <= sectors + dir_count );
+    CU_ASSERT( some < reopen );
+    CU_ASSERT( all <= some );
+}
+
+void test_walk_failures( void )
+{
+    handle_limit = MAX_HANDLES;
+
+    /* A directory which can't be opened stops the walk. */
+    files_walked = 0;
+    stop_after = NO_FAILURE;
+    fail_open_dir = 3;
+    CU_ASSERT( false == dir_walk(TEST_ROOT, count_file, NULL) );
+    CU_ASSERT( 0 < files_walked );
+    CU_ASSERT( files_walked < file_count );
+    CU_ASSERT( 0 == handles_open );
+
+    /* So does the file function. */
+    files_walked = 0;
+    stop_after = 100;
+    fail_open_dir = NO_FAILURE;
+    CU_ASSERT( false == dir_walk(TEST_ROOT, count_file, NULL) );
+    CU_ASSERT( 100 == files_walked );
+    CU_ASSERT( 0 == handles_open );
+
+    /* Nothing gets out of a directory that isn't there. */
+    CU_ASSERT( false == dir_walk("/NOPE", count_file, NULL) );
+    CU_ASSERT( FRV_ERROR == leave_directory(TEST_ROOT) );
+    CU_ASSERT( FRV_ERROR == enter_directory(TEST_ROOT) );
+    CU_ASSERT( FRV_INVALID_PARAMETER == open_directory(NULL) );
+    CU_ASSERT( 0 == handles_open );
+}
+
+void add_suites( CU_pSuite *suite )
+{
+    *suite = CU_add_suite( "Directory Walker Test", NULL, NULL );
+    CU_add_test( *suite, "Test Walk Reads   ", test_walk_reads );
+    CU_add_test( *suite, "Test Walk Failures", test_walk_failures );
+}
+
+int main( int argc, char *argv[] )
+{
+    int rv = 1;
+    CU_pSuite suite = NULL;
+
+    build_card();
+
+    if( CUE_SUCCESS == CU_initialize_registry() ) {
+        add_suites( &suite );
+
+        if( NULL != suite ) {
+            CU_basic_set_mode( CU_BRM_VERBOSE );
+            CU_basic_run_tests();
+            printf( "\n" );
+            CU_basic_show_failures( CU_get_failure_list() );
+            printf( "\n\n" );
+            rv = CU_get_number_of_tests_failed();
+        }
+
+        CU_cleanup_registry();
+    }
+
+    if( 0 != rv ) {
+        return 1;
+    }
+    return CU_get_error();
+}
@@ -0,0 +1,200 @@
+#include <CUnit/Basic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "database.h"
+#include "internal_database.h"
+#include "add_song.h"
+#include "directory_walker.h"
+#include "generic.h"
+#include "index_file.h"
+#include "indexer.h"
+#include "mi_interface.h"
+#include "db_testing.h"
+#include "large_db.h"
+
+#define TEST_INDEX_FILE "index_file_test.idx"
+
+root_database_node_t rdn;
+
+media_status_t mi_get_information( const char *filename,
+                                   media_metadata_t *metadata,
+                                   media_play_fn_t *play_fn )
+{
+    *play_fn = fake_play;
+    return MI_RETURN_OK;
+}
+
+bool dir_walk( const char *RootDirectory, dir_walk_fn_t file_fn, void *user_data )
+{
+    return false;
+}
+
+/* Gives every song its own gain to be saved & loaded. */
+static void set_gain( media_metadata_t *metadata, size_t i )
+{
+    metadata->gain.track_gain = (double) i;
+}
+
+static bt_ir_t collect_songs( bt_node_t *node, void *user_data )
+{
+    song_node_t ***next = (song_node_t ***) user_data;
+    generic_node_t *gn = (generic_node_t *) node->data;
+
+    if( GNT_SONG == gn->type ) {
+        **next = (song_node_t *) gn;
+        (*next)++;
+    } else {
+        bt_iterate( &gn->list.children, collect_songs, NULL, user_data );
+    }
+    return BT_IR__CONTINUE;
+}
+
+void get_songs( song_node_t **songs )
+{
+    bt_iterate( &rdn.root->list.children, collect_songs, NULL, &songs );
+}
+
+typedef struct {
+    char artist[MAX_ARTIST_NAME_W_NULL];
+    char album[MAX_ALBUM_TITLE_W_NULL];
+    char title[MAX_SONG_TITLE_W_NULL];
+    char location[MAX_SHORT_FILENAME_PATH_W_NULL];
+    song_node_t song;
+} saved_song_t;
+
+void test_save_and_load( void )
+{
+    size_t count = sizeof(large_db)/sizeof(ut_song_t);
+    song_node_t **loaded;
+    saved_song_t *songs;
+    char location[MAX_SHORT_FILENAME_PATH_W_NULL];
+    uint32_t signature;
+    size_t i;
+
+    create_database_in( large_db, count, "/MUSIC", 0, set_gain );
+    count = rdn.root->list.index_songs_stop + 1;
+    songs = (saved_song_t *) malloc( count * sizeof(saved_song_t) );
+    loaded = (song_node_t **) malloc( count * sizeof(song_node_t *) );
+    CU_ASSERT_FATAL( (NULL != songs) && (NULL != loaded) );
+    get_songs( loaded );
+    for( i = 0; i < count; i++ ) {
+        loaded[i]->file_size = 1000 + i;
+        loaded[i]->file_mtime = 2000 + i;
+    }
+    CU_ASSERT( true == index_file_save(rdn.root, TEST_INDEX_FILE, 0x1234) );
+
+    /* Keep a copy of the database to compare against, the names are
+     * released with the database. */
+    for( i = 0; i < count; i++ ) {
+        memcpy( &songs[i].song, loaded[i], sizeof(song_node_t) );
+        strcpy( songs[i].title, loaded[i]->d.name.song );
+        strcpy( songs[i].album, loaded[i]->d.parent->name.album );
+        strcpy( songs[i].artist, loaded[i]->d.parent->parent->name.artist );
+        get_song_location( loaded[i], songs[i].location );
+    }
+
+    create_root();
+    CU_ASSERT( true == index_file_load(rdn.root, TEST_INDEX_FILE, &signature) );
+    CU_ASSERT( 0x1234 == signature );
+    index_root( &(rdn.root->node) );
+
+    CU_ASSERT_FATAL( count == rdn.root->list.index_songs_stop + 1 );
+    get_songs( loaded );
+    for( i = 0; i < count; i++ ) {
+        CU_ASSERT( 0 == strcmp(songs[i].title, loaded[i]->d.name.song) );
+        CU_ASSERT( 0 == strcmp(songs[i].album, loaded[i]->d.parent->name.album) );
+        CU_ASSERT( 0 == strcmp(songs[i].artist, loaded[i]->d.parent->parent->name.artist) );
+        get_song_location( loaded[i], location );
+        CU_ASSERT( 0 == strcmp(songs[i].location, location) );
+        CU_ASSERT( songs[i].song.d.index == loaded[i]->d.index );
+        CU_ASSERT( songs[i].song.track_number == loaded[i]->track_number );
+        CU_ASSERT( songs[i].song.gain.track_gain == loaded[i]->gain.track_gain );
+        CU_ASSERT( songs[i].song.file_size == loaded[i]->file_size );
+        CU_ASSERT( songs[i].song.file_mtime == loaded[i]->file_mtime );
+        CU_ASSERT( fake_play == loaded[i]->play_fn );
+    }
+    free( songs );
+    free( loaded );
+    database_purge();
+    unlink( TEST_INDEX_FILE );
+}
+
+void test_missing_index( void )
+{
+    uint32_t signature;
+
+    create_root();
+    CU_ASSERT( false == index_file_load(rdn.root, "missing.idx", &signature) );
+    CU_ASSERT( NULL == rdn.root->list.children.root );
+
+    database_purge();
+}
+
+void test_corrupt_index( void )
+{
+    int fd;
+    off_t size;
+    char c;
+    uint32_t signature;
+
+    create_database_in( large_db, sizeof(large_db)/sizeof(ut_song_t),
+                        "/MUSIC", 0, set_gain );
+    CU_ASSERT( true == index_file_save(rdn.root, TEST_INDEX_FILE, 0x1234) );
+
+    /* Flip a byte in the middle of the file. */
+    fd = open( TEST_INDEX_FILE, O_RDWR );
+    CU_ASSERT_FATAL( 0 <= fd );
+    size = lseek( fd, 0, SEEK_END );
+    lseek( fd, size / 2, SEEK_SET );
+    CU_ASSERT( 1 == read(fd, &c, 1) );
+    c ^= 0x01;
+    lseek( fd, size / 2, SEEK_SET );
+    CU_ASSERT( 1 == write(fd, &c, 1) );
+
+    /* Then truncate it as if the power was lost while saving. */
+    CU_ASSERT( 0 == ftruncate(fd, size / 2) );
+    close( fd );
+
+    create_root();
+    CU_ASSERT( false == index_file_load(rdn.root, TEST_INDEX_FILE, &signature) );
+
+    database_purge();
+    unlink( TEST_INDEX_FILE );
+}
+
+void add_suites( CU_pSuite *suite )
+{
+    *suite = CU_add_suite( "Index File Test", NULL, NULL );
+    CU_add_test( *suite, "Test Save and Load    ", test_save_and_load );
+    CU_add_test( *suite, "Test Missing Index    ", test_missing_index );
+    CU_add_test( *suite, "Test Corrupt Index    ", test_corrupt_index );
+}
+
+int main( int argc, char *argv[] )
+{
+    int rv = 1;
+    CU_pSuite suite = NULL;
+
+    if( CUE_SUCCESS == CU_initialize_registry() ) {
+        add_suites( &suite );
+
+        if( NULL != suite ) {
+            CU_basic_set_mode( CU_BRM_VERBOSE );
+            CU_basic_run_tests();
+            printf( "\n" );
+            CU_basic_show_failures( CU_get_failure_list() );
+            printf( "\n\n" );
+            rv = CU_get_number_of_tests_failed();
+        }
+
+        CU_cleanup_registry();
+    }
+
+    if( 0 != rv ) {
+        return 1;
+    }
+    return CU_get_error();
+}
@@ -235,20 +235,20 @@ void test_queued_song( void )
     backup2_n = so_n;
     print_song_info( so_n );
 
-    CU_ASSERT( DS_FAILURE != queued_next_song(&so_n, DT_NEXT, DL_SONG) );
+    CU_ASSERT( DS_FAILURE != queued_next_song(&so_n, DT_NEXT, DL_ARTIST) );
     backup3_n = so_n;
     print_song_info( so_n );
 
-    CU_ASSERT( DS_FAILURE != queued_next_song(&so_n, DT_NEXT, DL_SONG) );
+    CU_ASSERT( DS_FAILURE != queued_next_song(&so_n, DT_NEXT, DL_ARTIST) );
     backup4_n = so_n;
     print_song_info( so_n );
 
-    CU_ASSERT( DS_FAILURE != queued_next_song(&so_n, DT_NEXT, DL_SONG) );
+    CU_ASSERT( DS_FAILURE != queued_next_song(&so_n, DT_NEXT, DL_ARTIST) );
     backup5_n = so_n;
     print_song_info( so_n );
 
 
-    CU_ASSERT( DS_FAILURE != queued_next_song(&so_n, DT_NEXT, DL_SONG) );
+    CU_ASSERT( DS_FAILURE != queued_next_song(&so_n, DT_NEXT, DL_ARTIST) );
     print_song_info( so_n );
 
     CU_ASSERT( backup2_n != backup1_n );
@@ -280,6 +280,41 @@ void test_queued_song( void )
     database_purge();
 }
 
+void test_queued_song_levels( void )
+{
+    song_node_t * so_n = NULL;
+    song_node_t * start_n;
+    uint32_t i;
+
+    queued_song_init();
+    create_simple_database();
+    _D1("\n");
+
+    CU_ASSERT( DS_SUCCESS == next_song(&so_n, DT_NEXT, DL_SONG) );
+    start_n = so_n;
+
+    /* Each level shuffles its own group, starting from the current song. */
+    for( i = 0; i < 10; i++ ) {
+        CU_ASSERT( DS_FAILURE != queued_next_song(&so_n, DT_NEXT, DL_SONG) );
+        CU_ASSERT( so_n->d.parent == start_n->d.parent );
+        print_song_info( so_n );
+    }
+    for( i = 0; i < 10; i++ ) {
+        CU_ASSERT( DS_FAILURE != queued_next_song(&so_n, DT_NEXT, DL_ALBUM) );
+        CU_ASSERT( so_n->d.parent->parent == start_n->d.parent->parent );
+        print_song_info( so_n );
+    }
+
+    /* Back at the song level, previous undoes next. */
+    start_n = so_n;
+    CU_ASSERT( DS_FAILURE != queued_next_song(&so_n, DT_NEXT, DL_SONG) );
+    CU_ASSERT( so_n->d.parent == start_n->d.parent );
+    CU_ASSERT( DS_FAILURE != queued_next_song(&so_n, DT_PREVIOUS, DL_SONG) );
+    CU_ASSERT( so_n == start_n );
+
+    database_purge();
+}
+
 void add_suites( CU_pSuite *suite )
 {
     *suite = CU_add_suite( "Print Test", NULL, NULL );
@@ -288,6 +323,7 @@ void add_suites( CU_pSuite *suite )
     CU_add_test( *suite, "Test Prev Song Print", test_previous_song );
     CU_add_test( *suite, "Test Rand Song Print", test_random_song );
     CU_add_test( *suite, "Test Queued Song", test_queued_song );
+    CU_add_test( *suite, "Test Queued Song Levels", test_queued_song_levels );
     CU_add_test( *suite, "Test indexing a large Sized DB", test_build_large_database);
 
     database_purge();
@@ -0,0 +1,367 @@
+#include <CUnit/Basic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "database.h"
+#include "internal_database.h"
+#include "directory_walker.h"
+#include "index_file.h"
+#include "indexer.h"
+#include "mi_interface.h"
+#include "db_testing.h"
+
+#define TEST_ROOT           "."
+#define TEST_INDEX_FILE     "./" INDEX_FILE_NAME
+#define MAX_FAKE_FILES      300
+#define SONGS_PER_ALBUM     10
+#define ALBUMS_PER_ARTIST   4
+#define CHECK_EVERY         37
+#define HELD_SONG           10
+#define NO_FAILURE          0xffffffff
+
+typedef struct {
+    char path[MAX_SHORT_FILENAME_PATH_W_NULL];
+    char title[MAX_SONG_TITLE_W_NULL];
+} fake_file_t;
+
+/* A fake card - dir_walk() & mi_get_information() are backed by this. */
+static fake_file_t fake_card[MAX_FAKE_FILES];
+static uint32_t fake_card_size;
+static uint32_t tags_read;
+
+/* The scan walk fails when it gets to this file. */
+static uint32_t fail_at;
+
+static uint32_t playable_calls;
+static uint32_t playable_count;
+static uint32_t playable_tags;
+static song_node_t *held_song;
+
+/* The song held while the index is checked, its file is gone. */
+static char held_path[MAX_SHORT_FILENAME_PATH_W_NULL];
+
+root_database_node_t rdn;
+
+media_status_t mi_get_information( const char *filename,
+                                   media_metadata_t *metadata,
+                                   media_play_fn_t *play_fn )
+{
+    uint32_t i;
+
+    *play_fn = fake_play;
+
+    if( NULL != metadata ) {
+        /* The codecs take the card for each read, the scan doesn't
+         * hold it for the whole tag. */
+        CU_ASSERT( false == ut_card_taken() );
+        for( i = 0; i < fake_card_size; i++ ) {
+            if( 0 == strcmp(filename, fake_card[i].path) ) {
+                break;
+            }
+        }
+        if( fake_card_size == i ) {
+            return MI_ERROR_NOT_SUPPORTED;
+        }
+        tags_read++;
+        memset( metadata, 0, sizeof(media_metadata_t) );
+        /* Found in a different order than the artists sort. */
+        sprintf( metadata->artist, "Artist %u",
+                 (fake_card_size - i) / (SONGS_PER_ALBUM * ALBUMS_PER_ARTIST) );
+        sprintf( metadata->album, "Album %u", i / SONGS_PER_ALBUM );
+        strcpy( metadata->title, fake_card[i].title );
+        metadata->track_number = i % SONGS_PER_ALBUM + 1;
+    }
+    return MI_RETURN_OK;
+}
+
+/* Plays through every song found so far, like the UI would. */
+static void check_snapshot( uint32_t found )
+{
+    song_node_t *song = NULL;
+    uint32_t i;
+
+    CU_ASSERT_FATAL( found == rdn.songs.count );
+    CU_ASSERT( DS_SUCCESS == next_song(&song, DT_NEXT, DL_ALBUM) );
+    CU_ASSERT_FATAL( get_indexed_song(0) == song );
+
+    for( i = 1; i < found; i++ ) {
+        CU_ASSERT_FATAL( DS_SUCCESS == next_song(&song, DT_NEXT, DL_ARTIST) );
+        CU_ASSERT_FATAL( song == get_indexed_song(i) );
+    }
+    CU_ASSERT( DS_END_OF_LIST == next_song(&song, DT_NEXT, DL_SONG) );
+    CU_ASSERT( get_indexed_song(0) == song );
+    CU_ASSERT( DS_END_OF_LIST == next_song(&song, DT_PREVIOUS, DL_SONG) );
+    CU_ASSERT( get_indexed_song(found - 1) == song );
+
+    /* The shuffle covers everything found so far without repeats. */
+    song = get_indexed_song( found / 2 );
+    for( i = 1; i < found; i++ ) {
+        CU_ASSERT_FATAL( DS_SUCCESS == queued_next_song(&song, DT_NEXT, DL_SONG) );
+        CU_ASSERT_FATAL( song->d.index < found );
+    }
+    CU_ASSERT( DS_END_OF_LIST == queued_next_song(&song, DT_NEXT, DL_SONG) );
+}
+
+bool dir_walk( const char *RootDirectory, dir_walk_fn_t file_fn, void *user_data )
+{
+    uint32_t loaded = rdn.songs.count;
+    uint32_t i;
+
+    /* The songs loaded from the index are playable during the walk. */
+    if( (true == rdn.scanning) && (0 < loaded) ) {
+        for( i = 0; i < loaded; i++ ) {
+            char location[MAX_SHORT_FILENAME_PATH_W_NULL];
+
+            get_song_location( get_indexed_song(i), location );
+            if( 0 == strcmp(held_path, location) ) {
+                held_song = get_indexed_song( i );
+            }
+        }
+        check_snapshot( loaded );
+    }
+
+    for( i = 0; i < fake_card_size; i++ ) {
+        file_info_t info;
+
+        if( (true == rdn.scanning) && (fail_at == i) ) {
+            return false;
+        }
+
+        memset( &info, 0, sizeof(file_info_t) );
+        info.size = 1000000 + i;
+        info.mtime = 0x40000000 + i;
+        if( false == file_fn(fake_card[i].path, &info, user_data) ) {
+            return false;
+        }
+
+        if( (true == rdn.scanning) && (0 == loaded) ) {
+            if( HELD_SONG == i ) {
+                held_song = get_indexed_song( i );
+            }
+            if( 0 == (i % CHECK_EVERY) ) {
+                check_snapshot( i + 1 );
+            }
+        }
+    }
+    return true;
+}
+
+void database_print( void )
+{
+}
+
+static void playable( void )
+{
+    playable_calls++;
+    playable_count = rdn.songs.count;
+    playable_tags = tags_read;
+}
+
+static void create_fake_card( uint32_t count )
+{
+    uint32_t i;
+
+    for( i = 0; i < count; i++ ) {
+        sprintf( fake_card[i].path, "/A%03u/B%03u/%08u.FLA",
+                 i / (SONGS_PER_ALBUM * ALBUMS_PER_ARTIST), i / SONGS_PER_ALBUM, i );
+        sprintf( fake_card[i].title, "Song %u", i );
+    }
+    fake_card_size = count;
+}
+
+static void start_scan( uint32_t count, uint32_t fail )
+{
+    unlink( TEST_INDEX_FILE );
+    create_fake_card( count );
+    fail_at = fail;
+    tags_read = 0;
+    playable_calls = 0;
+    playable_count = 0;
+    held_song = NULL;
+    held_path[0] = '\0';
+}
+
+static uint32_t song_count( void )
+{
+    return rdn.root->list.index_songs_stop - rdn.root->list.index_songs_start + 1;
+}
+
+void test_playable_while_scanning( void )
+{
+    char location[MAX_SHORT_FILENAME_PATH_W_NULL];
+    uint32_t i;
+
+    start_scan( MAX_FAKE_FILES, NO_FAILURE );
+    CU_ASSERT( true == populate_database(TEST_ROOT) );
+    CU_ASSERT( false == rdn.scanning );
+    CU_ASSERT( 1 == playable_calls );
+    CU_ASSERT( 1 == playable_count );
+    CU_ASSERT( MAX_FAKE_FILES == song_count() );
+    CU_ASSERT( MAX_FAKE_FILES == rdn.songs.count );
+
+    /* A song handed out during the scan is still good & indexed. */
+    CU_ASSERT_FATAL( NULL != held_song );
+    get_song_location( held_song, location );
+    CU_ASSERT( 0 == strcmp(fake_card[HELD_SONG].path, location) );
+    CU_ASSERT( held_song == get_indexed_song(held_song->d.index) );
+
+    /* The final table is in artist, album & track order again. */
+    for( i = 1; i < rdn.songs.count; i++ ) {
+        song_node_t *a = get_indexed_song( i - 1 );
+        song_node_t *b = get_indexed_song( i );
+        if( (a->d.parent == b->d.parent) && (a->track_number >= b->track_number) ) {
+            CU_FAIL( "The songs are out of order" );
+            break;
+        }
+    }
+
+    /* The index saved after a full walk is used the next time, & is
+     * playable before the card is walked. */
+    tags_read = 0;
+    playable_calls = 0;
+    CU_ASSERT( true == populate_database(TEST_ROOT) );
+    CU_ASSERT( 0 == tags_read );
+    CU_ASSERT( 1 == playable_calls );
+    CU_ASSERT( MAX_FAKE_FILES == playable_count );
+    CU_ASSERT( MAX_FAKE_FILES == rdn.songs.count );
+
+    database_purge();
+    unlink( TEST_INDEX_FILE );
+}
+
+void test_stale_index( void )
+{
+    char location[MAX_SHORT_FILENAME_PATH_W_NULL];
+    song_node_t *song;
+    uint32_t i;
+
+    start_scan( 100, NO_FAILURE );
+    CU_ASSERT( true == populate_database(TEST_ROOT) );
+
+    /* Ten files deleted & one replaced by a new one. */
+    strcpy( held_path, fake_card[95].path );
+    fake_card_size = 90;
+    sprintf( fake_card[89].path, "/NEW/%08u.FLA", 89 );
+    strcpy( fake_card[89].title, "New" );
+
+    tags_read = 0;
+    playable_calls = 0;
+    CU_ASSERT( true == populate_database(TEST_ROOT) );
+    CU_ASSERT( 1 == playable_calls );
+    CU_ASSERT( 100 == playable_count );
+    CU_ASSERT( 0 == playable_tags );
+    CU_ASSERT( 1 == tags_read );
+    CU_ASSERT( 90 == song_count() );
+    CU_ASSERT( 90 == rdn.songs.count );
+
+    /* The song of a deleted file was handed out, so it is still good but
+     * is not in the database anymore. */
+    CU_ASSERT_FATAL( NULL != held_song );
+    get_song_location( held_song, location );
+    CU_ASSERT( 0 == strcmp(held_path, location) );
+    for( i = 0; i < rdn.songs.count; i++ ) {
+        CU_ASSERT_FATAL( held_song != get_indexed_song(i) );
+    }
+
+    /* Its album is gone too, so the next song is the first of its artist,
+     * which is still there. */
+    song = held_song;
+    CU_ASSERT( DS_SUCCESS == next_song(&song, DT_NEXT, DL_SONG) );
+    CU_ASSERT_FATAL( NULL != song );
+    CU_ASSERT( held_song->d.parent->parent == song->d.parent->parent );
+    CU_ASSERT( song->d.parent->parent->list.index_songs_start == song->d.index );
+    song = held_song;
+    CU_ASSERT( DS_SUCCESS == next_song(&song, DT_RANDOM, DL_SONG) );
+    CU_ASSERT( song == get_indexed_song(song->d.index) );
+
+    /* The index was rewritten. */
+    tags_read = 0;
+    playable_calls = 0;
+    CU_ASSERT( true == populate_database(TEST_ROOT) );
+    CU_ASSERT( 0 == tags_read );
+    CU_ASSERT( 90 == playable_count );
+    CU_ASSERT( 90 == song_count() );
+
+    /* A walk that fails keeps the index songs, as they were handed out,
+     * & the index as it is. */
+    fake_card_size = 80;
+    fail_at = 50;
+    playable_calls = 0;
+    CU_ASSERT( true == populate_database(TEST_ROOT) );
+    CU_ASSERT( 1 == playable_calls );
+    CU_ASSERT( 90 == song_count() );
+
+    fail_at = NO_FAILURE;
+    tags_read = 0;
+    CU_ASSERT( true == populate_database(TEST_ROOT) );
+    CU_ASSERT( 0 == tags_read );
+    CU_ASSERT( 80 == song_count() );
+
+    database_purge();
+    unlink( TEST_INDEX_FILE );
+}
+
+void test_failed_scan( void )
+{
+    /* Songs were playable, so what was found is kept... */
+    start_scan( 100, 50 );
+    CU_ASSERT( true == populate_database(TEST_ROOT) );
+    CU_ASSERT( 1 == playable_calls );
+    CU_ASSERT( 50 == song_count() );
+    CU_ASSERT( 50 == rdn.songs.count );
+
+    /* ...but not saved as the index of the card. */
+    fail_at = NO_FAILURE;
+    tags_read = 0;
+    CU_ASSERT( true == populate_database(TEST_ROOT) );
+    CU_ASSERT( 100 == tags_read );
+    CU_ASSERT( 100 == song_count() );
+
+    /* Nothing was playable yet. */
+    start_scan( 100, 0 );
+    CU_ASSERT( false == populate_database(TEST_ROOT) );
+    CU_ASSERT( 0 == playable_calls );
+    CU_ASSERT( NULL == rdn.root );
+    CU_ASSERT( false == rdn.scanning );
+
+    database_purge();
+    unlink( TEST_INDEX_FILE );
+}
+
+void add_suites( CU_pSuite *suite )
+{
+    *suite = CU_add_suite( "Progressive Test", NULL, NULL );
+    CU_add_test( *suite, "Test Playable Scanning", test_playable_while_scanning );
+    CU_add_test( *suite, "Test Stale Index      ", test_stale_index );
+    CU_add_test( *suite, "Test Failed Scan      ", test_failed_scan );
+}
+
+int main( int argc, char *argv[] )
+{
+    int rv = 1;
+    CU_pSuite suite = NULL;
+
+    rdn.initialized = true;
+    database_register_playable( playable );
+
+    if( CUE_SUCCESS == CU_initialize_registry() ) {
+        add_suites( &suite );
+
+        if( NULL != suite ) {
+            CU_basic_set_mode( CU_BRM_VERBOSE );
+            CU_basic_run_tests();
+            printf( "\n" );
+            CU_basic_show_failures( CU_get_failure_list() );
+            printf( "\n\n" );
+            rv = CU_get_number_of_tests_failed();
+        }
+
+        CU_cleanup_registry();
+    }
+
+    if( 0 != rv ) {
+        return 1;
+    }
+    return CU_get_error();
+}
@@ -0,0 +1,302 @@
+#include <CUnit/Basic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "database.h"
+#include "internal_database.h"
+#include "directory_walker.h"
+#include "index_file.h"
+#include "mi_interface.h"
+#include "db_testing.h"
+
+#define DEBUG 0
+
+#define _D1(...)
+
+#if DEBUG > 0
+#undef  _D1
+#define _D1(...) printf( __VA_ARGS__ )
+#endif
+
+#define TEST_ROOT           "."
+#define TEST_INDEX_FILE     "./" INDEX_FILE_NAME
+#define MAX_FAKE_FILES      2000
+#define SONGS_PER_ALBUM     10
+#define ALBUMS_PER_ARTIST   4
+
+typedef struct {
+    char path[MAX_SHORT_FILENAME_PATH_W_NULL];
+    uint32_t size;
+    uint32_t mtime;
+    char title[MAX_SONG_TITLE_W_NULL];
+    bool present;
+} fake_file_t;
+
+/* A fake card - dir_walk() & mi_get_information() are backed by this. */
+static fake_file_t fake_card[MAX_FAKE_FILES];
+static uint32_t fake_card_size;
+static uint32_t tags_read;
+static uint32_t walks;
+
+root_database_node_t rdn;
+
+static fake_file_t * find_fake_file( const char *path )
+{
+    uint32_t i;
+
+    for( i = 0; i < fake_card_size; i++ ) {
+        if( (true == fake_card[i].present) && (0 == strcmp(path, fake_card[i].path)) ) {
+            return &fake_card[i];
+        }
+    }
+    return NULL;
+}
+
+media_status_t mi_get_information( const char *filename,
+                                   media_metadata_t *metadata,
+                                   media_play_fn_t *play_fn )
+{
+    fake_file_t *f;
+    uint32_t i;
+
+    /* Like the real codecs, the play function only depends on the name. */
+    *play_fn = fake_play;
+
+    if( NULL != metadata ) {
+        /* The codecs take the card for each read, the scan doesn't
+         * hold it for the whole tag. */
+        CU_ASSERT( false == ut_card_taken() );
+        f = find_fake_file( filename );
+        if( NULL == f ) {
+            return MI_ERROR_NOT_SUPPORTED;
+        }
+        i = f - fake_card;
+        tags_read++;
+        memset( metadata, 0, sizeof(media_metadata_t) );
+        sprintf( metadata->artist, "Artist %u", i / (SONGS_PER_ALBUM * ALBUMS_PER_ARTIST) );
+        sprintf( metadata->album, "Album %u", i / SONGS_PER_ALBUM );
+        strcpy( metadata->title, f->title );
+        metadata->track_number = i % SONGS_PER_ALBUM + 1;
+    }
+    return MI_RETURN_OK;
+}
+
+bool dir_walk( const char *RootDirectory, dir_walk_fn_t file_fn, void *user_data )
+{
+    uint32_t i;
+
+    walks++;
+    for( i = 0; i < fake_card_size; i++ ) {
+        if( true == fake_card[i].present ) {
+            file_info_t info;
+
+            memset( &info, 0, sizeof(file_info_t) );
+            info.size = fake_card[i].size;
+            info.mtime = fake_card[i].mtime;
+            if( false == file_fn(fake_card[i].path, &info, user_data) ) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void database_print( void )
+{
+}
+
+static void create_fake_card( uint32_t count )
+{
+    uint32_t i;
+
+    for( i = 0; i < count; i++ ) {
+        sprintf( fake_card[i].path, "/A%03u/B%03u/%08u.FLA",
+                 i / (SONGS_PER_ALBUM * ALBUMS_PER_ARTIST), i / SONGS_PER_ALBUM, i );
+        sprintf( fake_card[i].title, "Song %u", i );
+        fake_card[i].size = 1000000 + i;
+        fake_card[i].mtime = 0x40000000 + i;
+        fake_card[i].present = true;
+    }
+    fake_card_size = count;
+}
+
+static uint32_t song_count( void )
+{
+    return rdn.root->list.index_songs_stop - rdn.root->list.index_songs_start + 1;
+}
+
+typedef struct {
+    const char *location;
+    song_node_t *found;
+} find_song_t;
+
+static bt_ir_t find_song_iterator( bt_node_t *node, void *user_data )
+{
+    find_song_t *find = (find_song_t *) user_data;
+    generic_node_t *gn = (generic_node_t *) node->data;
+
+    if( GNT_SONG == gn->type ) {
+        char location[MAX_SHORT_FILENAME_PATH_W_NULL];
+
+        get_song_location( (song_node_t *) gn, location );
+        if( 0 == strcmp(location, find->location) ) {
+            find->found = (song_node_t *) gn;
+            return BT_IR__STOP;
+        }
+    } else {
+        bt_iterate( &gn->list.children, find_song_iterator, NULL, user_data );
+    }
+    return BT_IR__CONTINUE;
+}
+
+static song_node_t * find_song( uint32_t i )
+{
+    find_song_t find;
+
+    find.location = fake_card[i].path;
+    find.found = NULL;
+    bt_iterate( &rdn.root->list.children, find_song_iterator, NULL, &find );
+    return find.found;
+}
+
+void test_unchanged_card( void )
+{
+    unlink( TEST_INDEX_FILE );
+    create_fake_card( 100 );
+
+    tags_read = 0;
+    CU_ASSERT( true == populate_database(TEST_ROOT) );
+    CU_ASSERT( 100 == tags_read );
+    CU_ASSERT( 100 == song_count() );
+
+    /* The index is checked by a single walk of the card. */
+    tags_read = 0;
+    walks = 0;
+    CU_ASSERT( true == populate_database(TEST_ROOT) );
+    CU_ASSERT( 0 == tags_read );
+    CU_ASSERT( 1 == walks );
+    CU_ASSERT( 100 == song_count() );
+
+    database_purge();
+    unlink( TEST_INDEX_FILE );
+}
+
+void test_changed_card( void )
+{
+    song_node_t *so_n;
+    uint32_t i;
+
+    unlink( TEST_INDEX_FILE );
+    create_fake_card( 100 );
+    CU_ASSERT( true == populate_database(TEST_ROOT) );
+
+    /* Add two songs, retag one, touch another & delete a whole album. */
+    create_fake_card( 102 );
+    strcpy( fake_card[5].title, "Retagged" );
+    fake_card[5].mtime++;
+    fake_card[6].size++;
+    for( i = 20; i < 30; i++ ) {
+        fake_card[i].present = false;
+    }
+
+    tags_read = 0;
+    walks = 0;
+    CU_ASSERT( true == populate_database(TEST_ROOT) );
+    CU_ASSERT( 4 == tags_read );
+    CU_ASSERT( 1 == walks );
+    CU_ASSERT( 92 == song_count() );
+
+    so_n = find_song( 5 );
+    CU_ASSERT_FATAL( NULL != so_n );
+    CU_ASSERT( 0 == strcmp("Retagged", so_n->d.name.song) );
+    CU_ASSERT( fake_card[5].mtime == so_n->file_mtime );
+    so_n = find_song( 6 );
+    CU_ASSERT_FATAL( NULL != so_n );
+    CU_ASSERT( fake_card[6].size == so_n->file_size );
+    CU_ASSERT( NULL != find_song(101) );
+
+    fake_card[20].present = true;
+    CU_ASSERT( NULL == find_song(20) );
+    fake_card[20].present = false;
+
+    /* The merged database was saved as well. */
+    tags_read = 0;
+    CU_ASSERT( true == populate_database(TEST_ROOT) );
+    CU_ASSERT( 0 == tags_read );
+    CU_ASSERT( 92 == song_count() );
+
+    database_purge();
+    unlink( TEST_INDEX_FILE );
+}
+
+void test_rescan_cost( void )
+{
+    uint32_t changes[] = { 0, 1, 10, 100, 1000 };
+    uint32_t i, j;
+
+    for( i = 0; i < sizeof(changes)/sizeof(uint32_t); i++ ) {
+#if DEBUG > 0
+        clock_t begin;
+#endif
+
+        unlink( TEST_INDEX_FILE );
+        create_fake_card( MAX_FAKE_FILES );
+        CU_ASSERT( true == populate_database(TEST_ROOT) );
+
+        for( j = 0; j < changes[i]; j++ ) {
+            fake_card[j * (MAX_FAKE_FILES / changes[i])].mtime++;
+        }
+
+        tags_read = 0;
+#if DEBUG > 0
+        begin = clock();
+#endif
+        CU_ASSERT( true == populate_database(TEST_ROOT) );
+        CU_ASSERT( changes[i] == tags_read );
+        CU_ASSERT( MAX_FAKE_FILES == song_count() );
+        _D1( "%u tracks, %4u changed: %4u tags read, %ld us\n",
+             MAX_FAKE_FILES, changes[i], tags_read,
+             (long) ((clock() - begin) * 1000000 / CLOCKS_PER_SEC) );
+    }
+
+    database_purge();
+    unlink( TEST_INDEX_FILE );
+}
+
+void add_suites( CU_pSuite *suite )
+{
+    *suite = CU_add_suite( "Rescan Test", NULL, NULL );
+    CU_add_test( *suite, "Test Unchanged Card   ", test_unchanged_card );
+    CU_add_test( *suite, "Test Changed Card     ", test_changed_card );
+    CU_add_test( *suite, "Test Rescan Cost      ", test_rescan_cost );
+}
+
+int main( int argc, char *argv[] )
+{
+    int rv = 1;
+    CU_pSuite suite = NULL;
+
+    rdn.initialized = true;
+
+    if( CUE_SUCCESS == CU_initialize_registry() ) {
+        add_suites( &suite );
+
+        if( NULL != suite ) {
+            CU_basic_set_mode( CU_BRM_VERBOSE );
+            CU_basic_run_tests();
+            printf( "\n" );
+            CU_basic_show_failures( CU_get_failure_list() );
+            printf( "\n\n" );
+            rv = CU_get_number_of_tests_failed();
+        }
+
+        CU_cleanup_registry();
+    }
+
+    if( 0 != rv ) {
+        return 1;
+    }
+    return CU_get_error();
+}
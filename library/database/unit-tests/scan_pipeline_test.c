@@ -0,0 +1,415 @@
+#include <CUnit/Basic.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <file-stream/file-stream.h>
+#include <freertos/os-mock.h>
+#include "database.h"
+#include "internal_database.h"
+#include "directory_walker.h"
+#include "index_file.h"
+#include "indexer.h"
+#include "mi_interface.h"
+#include "scan_pipeline.h"
+#include "db_testing.h"
+
+#define TEST_ROOT           "./scan-lib"
+#define TEST_INDEX_FILE     TEST_ROOT "/" INDEX_FILE_NAME
+#define MAX_TEST_FILES      264
+#define FILES_PER_ALBUM     11      /* 10 songs & a text file */
+#define ALBUMS_PER_ARTIST   4
+#define OPEN_LATENCY_US     500     /* Finding the file on the card */
+#define READ_LATENCY_US     250     /* Each read of the tags */
+#define PARSE_US            1000    /* Going through the tags, off the card */
+#define TAG_READS           4       /* Artist, album, title & track */
+#define CARD_US_PER_TAG     (OPEN_LATENCY_US + TAG_READS * READ_LATENCY_US)
+#define MAX_PARSERS         4
+#define NO_FAILURE          0xffffffff
+
+typedef struct {
+    char path[MAX_SHORT_FILENAME_PATH_W_NULL];
+} test_file_t;
+
+/* The test library lives on the disk - dir_walk() lists it &
+ * mi_get_information() reads the tags from the files. */
+static test_file_t library[MAX_TEST_FILES];
+static uint32_t library_size;
+static uint32_t library_songs;
+
+/* The walk fails when it gets to this file. */
+static uint32_t fail_at;
+
+static volatile uint32_t tags_read;
+static volatile uint32_t reading;
+static volatile uint32_t max_reading;
+static volatile uint32_t on_card;
+static volatile uint32_t max_on_card;
+
+/* The song locations in index order after a scan without the pipeline. */
+static char serial_locations[MAX_TEST_FILES][MAX_SHORT_FILENAME_PATH_W_NULL];
+static uint32_t serial_count;
+static double serial_ms;
+
+static pthread_t main_thread;
+static uint32_t inserted;
+static uint32_t wrong_thread;
+
+root_database_node_t rdn;
+
+static void read_line( FILE *f, char *line, size_t size )
+{
+    line[0] = '\0';
+    if( NULL != fgets(line, size, f) ) {
+        line[strcspn(line, "\n")] = '\0';
+    }
+}
+
+static void max_of( volatile uint32_t *max, const uint32_t now )
+{
+    while( *max < now ) {
+        __sync_bool_compare_and_swap( max, *max, now );
+    }
+}
+
+/* Takes the card for a call a codec makes to the file, the way the codecs
+ * do through file-stream, & holds it as long as the card would take. */
+static void card_take( void )
+{
+    fstream_card_take( FSTREAM_PRIORITY__BACKGROUND );
+    max_of( &max_on_card, __sync_add_and_fetch(&on_card, 1) );
+}
+
+static void card_give( const uint32_t us )
+{
+    usleep( us );
+    __sync_sub_and_fetch( &on_card, 1 );
+    fstream_card_give();
+}
+
+media_status_t mi_get_information( const char *filename,
+                                   media_metadata_t *metadata,
+                                   media_play_fn_t *play_fn )
+{
+    char line[32];
+    FILE *f;
+
+    /* The scan doesn't hold the card for the whole tag. */
+    CU_ASSERT( false == ut_card_taken() );
+
+    if( NULL == strstr(filename, ".FLA") ) {
+        return MI_ERROR_NOT_SUPPORTED;
+    }
+
+    card_take();
+    f = fopen( filename, "r" );
+    card_give( OPEN_LATENCY_US );
+    if( NULL == f ) {
+        return MI_ERROR_NOT_SUPPORTED;
+    }
+
+    max_of( &max_reading, __sync_add_and_fetch(&reading, 1) );
+
+    /* A read of the card for each tag, then the parsing while the other
+     * parsers have the card. */
+    memset( metadata, 0, sizeof(media_metadata_t) );
+    card_take();
+    read_line( f, metadata->artist, sizeof(metadata->artist) );
+    card_give( READ_LATENCY_US );
+    card_take();
+    read_line( f, metadata->album, sizeof(metadata->album) );
+    card_give( READ_LATENCY_US );
+    card_take();
+    read_line( f, metadata->title, sizeof(metadata->title) );
+    card_give( READ_LATENCY_US );
+    card_take();
+    read_line( f, line, sizeof(line) );
+    card_give( READ_LATENCY_US );
+    metadata->track_number = atoi( line );
+
+    card_take();
+    fclose( f );
+    card_give( 0 );
+    usleep( PARSE_US );
+
+    *play_fn = fake_play;
+    __sync_sub_and_fetch( &reading, 1 );
+    __sync_add_and_fetch( &tags_read, 1 );
+    return MI_RETURN_OK;
+}
+
+bool dir_walk( const char *RootDirectory, dir_walk_fn_t file_fn, void *user_data )
+{
+    uint32_t i;
+
+    for( i = 0; i < library_size; i++ ) {
+        file_info_t info;
+        struct stat st;
+
+        if( (fail_at == i) || (0 != stat(library[i].path, &st)) ) {
+            return false;
+        }
+
+        memset( &info, 0, sizeof(file_info_t) );
+        info.size = st.st_size;
+        info.mtime = st.st_mtime;
+        if( false == file_fn(library[i].path, &info, user_data) ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void database_print( void )
+{
+}
+
+static bool create_library( void )
+{
+    char dir[sizeof(TEST_ROOT "/A4294967295/B4294967295")];
+    uint32_t i;
+
+    mkdir( TEST_ROOT, 0755 );
+    for( i = 0; i < MAX_TEST_FILES; i++ ) {
+        uint32_t album = i / FILES_PER_ALBUM;
+        uint32_t artist = album / ALBUMS_PER_ARTIST;
+        uint32_t track = i % FILES_PER_ALBUM;
+        FILE *f;
+
+        sprintf( dir, TEST_ROOT "/A%03u", artist );
+        mkdir( dir, 0755 );
+        sprintf( dir, TEST_ROOT "/A%03u/B%03u", artist, album );
+        mkdir( dir, 0755 );
+
+        if( 0 == track ) {
+            sprintf( library[i].path, "%s/README.TXT", dir );
+        } else {
+            sprintf( library[i].path, "%s/%08u.FLA", dir, i );
+            library_songs++;
+        }
+
+        f = fopen( library[i].path, "w" );
+        if( NULL == f ) {
+            return false;
+        }
+        /* Found in a different order than the artists sort. */
+        fprintf( f, "Artist %u\nAlbum %u\nSong %u\n%u\n",
+                 MAX_TEST_FILES - artist, album, i, track );
+        fclose( f );
+        library_size = i + 1;
+    }
+    return true;
+}
+
+static void remove_library( void )
+{
+    char dir[sizeof(TEST_ROOT "/A4294967295/B4294967295")];
+    uint32_t i;
+
+    unlink( TEST_INDEX_FILE );
+    for( i = 0; i < library_size; i++ ) {
+        unlink( library[i].path );
+    }
+    for( i = library_size; 0 < i; i-- ) {
+        uint32_t album = (i - 1) / FILES_PER_ALBUM;
+
+        sprintf( dir, TEST_ROOT "/A%03u/B%03u", album / ALBUMS_PER_ARTIST, album );
+        rmdir( dir );
+        sprintf( dir, TEST_ROOT "/A%03u", album / ALBUMS_PER_ARTIST );
+        rmdir( dir );
+    }
+    rmdir( TEST_ROOT );
+}
+
+static double now_ms( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/* A full scan, without an index to fall back on. */
+static double timed_scan( void )
+{
+    double begin;
+
+    unlink( TEST_INDEX_FILE );
+    tags_read = 0;
+    max_reading = 0;
+    max_on_card = 0;
+    fail_at = NO_FAILURE;
+
+    begin = now_ms();
+    CU_ASSERT_FATAL( true == populate_database(TEST_ROOT) );
+    return now_ms() - begin;
+}
+
+static void count_insert( const char *full_path,
+                          const file_info_t *file_info,
+                          media_metadata_t *metadata,
+                          media_play_fn_t play_fn,
+                          void *user_data )
+{
+    if( 0 == pthread_equal(pthread_self(), main_thread) ) {
+        wrong_thread++;
+    }
+    if( fake_play != play_fn ) {
+        CU_FAIL( "Bad play function" );
+    }
+    inserted++;
+}
+
+void test_serial_scan( void )
+{
+    char location[MAX_SHORT_FILENAME_PATH_W_NULL];
+    uint32_t i;
+
+    /* Without the scan tasks the walk reads the tags itself. */
+    serial_ms = timed_scan();
+    CU_ASSERT( library_songs == tags_read );
+    CU_ASSERT( 1 == max_reading );
+    CU_ASSERT( 1 == max_on_card );
+    CU_ASSERT_FATAL( library_songs == rdn.songs.count );
+
+    for( i = 0; i < rdn.songs.count; i++ ) {
+        get_song_location( get_indexed_song(i), location );
+        strcpy( serial_locations[i], location );
+    }
+    serial_count = rdn.songs.count;
+
+    printf( "\n    inline:    %6.1f ms, %6.0f files/s\n",
+            serial_ms, library_size * 1000.0 / serial_ms );
+    database_purge();
+}
+
+void test_parsers_scale( void )
+{
+    char location[MAX_SHORT_FILENAME_PATH_W_NULL];
+    double single_ms = 0.0;
+    double ms;
+    uint32_t parsers;
+    uint32_t i;
+
+    printf( "\n" );
+    for( parsers = 1; parsers <= MAX_PARSERS; parsers *= 2 ) {
+        CU_ASSERT_FATAL( true == scan_pipeline_init(parsers, 0) );
+
+        ms = timed_scan();
+        CU_ASSERT( library_songs == tags_read );
+        CU_ASSERT( parsers >= max_reading );
+        CU_ASSERT( 1 == max_on_card );
+
+        /* The same database as reading the tags in line. */
+        CU_ASSERT_FATAL( serial_count == rdn.songs.count );
+        for( i = 0; i < rdn.songs.count; i++ ) {
+            get_song_location( get_indexed_song(i), location );
+            if( 0 != strcmp(serial_locations[i], location) ) {
+                CU_FAIL( "The database is different" );
+                break;
+            }
+        }
+
+        printf( "    %u parsers: %6.1f ms, %6.0f files/s, %u reading at once\n",
+                parsers, ms, library_size * 1000.0 / ms, max_reading );
+
+        if( 1 == parsers ) {
+            single_ms = ms;
+        } else {
+            CU_ASSERT( 1 < max_reading );
+        }
+        database_purge();
+    }
+
+    /* The parsers share the card, so only the parsing overlaps the reads of
+     * the others & the scan is never faster than the card. */
+    printf( "    the card:  %6.1f ms\n", library_songs * CARD_US_PER_TAG / 1000.0 );
+    CU_ASSERT( ms < single_ms * 0.9 );
+    CU_ASSERT( library_songs * CARD_US_PER_TAG / 1000.0 <= ms );
+}
+
+void test_walk_failure( void )
+{
+    uint32_t i;
+    uint32_t songs = 0;
+    uint32_t signature, expected;
+
+    CU_ASSERT( false == scan_pipeline_run(NULL, count_insert, NULL, NULL, NULL) );
+    CU_ASSERT( false == scan_pipeline_run(TEST_ROOT, NULL, NULL, NULL, NULL) );
+
+    /* The files found before the walk failed are still inserted, by
+     * the task which asked for the walk. */
+    fail_at = 100;
+    for( i = 0; i < fail_at; i++ ) {
+        if( NULL != strstr(library[i].path, ".FLA") ) {
+            songs++;
+        }
+    }
+    inserted = 0;
+    wrong_thread = 0;
+    CU_ASSERT( false == scan_pipeline_run(TEST_ROOT, count_insert, NULL, NULL, NULL) );
+    CU_ASSERT( songs == inserted );
+    CU_ASSERT( 0 == wrong_thread );
+
+    /* The pipeline is fine for the next walk, which signs the card like
+     * a walk of its own would. */
+    fail_at = NO_FAILURE;
+    inserted = 0;
+    CU_ASSERT( true == scan_pipeline_run(TEST_ROOT, count_insert, NULL,
+                                         library[1].path, &signature) );
+    CU_ASSERT( library_songs == inserted );
+    CU_ASSERT( 0 == wrong_thread );
+    CU_ASSERT( true == index_file_signature(TEST_ROOT, library[1].path, &expected) );
+    CU_ASSERT( expected == signature );
+
+    fail_at = 0;
+    inserted = 0;
+    CU_ASSERT( false == scan_pipeline_run(TEST_ROOT, count_insert, NULL, NULL, NULL) );
+    CU_ASSERT( 0 == inserted );
+}
+
+void add_suites( CU_pSuite *suite )
+{
+    *suite = CU_add_suite( "Scan Pipeline Test", NULL, NULL );
+    CU_add_test( *suite, "Test Serial Scan  ", test_serial_scan );
+    CU_add_test( *suite, "Test Parsers Scale", test_parsers_scale );
+    CU_add_test( *suite, "Test Walk Failure ", test_walk_failure );
+}
+
+int main( int argc, char *argv[] )
+{
+    int rv = 1;
+    CU_pSuite suite = NULL;
+
+    MOCK_os_init();
+    MOCK_reset__os();
+
+    rdn.initialized = true;
+    main_thread = pthread_self();
+
+    if( CUE_SUCCESS == CU_initialize_registry() ) {
+        add_suites( &suite );
+
+        if( (NULL != suite) && (true == create_library()) ) {
+            CU_basic_set_mode( CU_BRM_VERBOSE );
+            CU_basic_run_tests();
+            printf( "\n" );
+            CU_basic_show_failures( CU_get_failure_list() );
+            printf( "\n\n" );
+            rv = CU_get_number_of_tests_failed();
+        }
+
+        remove_library();
+        CU_cleanup_registry();
+    }
+
+    /* The scan tasks never exit, so the mock OS is left as is. */
+
+    if( 0 != rv ) {
+        return 1;
+    }
+    return CU_get_error();
+}
@@ -0,0 +1,232 @@
+#include <CUnit/Basic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "database.h"
+#include "internal_database.h"
+#include "add_song.h"
+#include "generic.h"
+#include "indexer.h"
+#include "queued_next_song.h"
+#include "db_testing.h"
+#include "large_db.h"
+
+#define BENCHMARK_OPERATIONS    1000000
+#define SAVED_ORDER             20
+
+root_database_node_t rdn;
+
+static generic_node_t * group_of( song_node_t *song, const db_level_t level )
+{
+    generic_node_t *group = song->d.parent;
+
+    if( DL_SONG != level ) {
+        group = group->parent;
+        if( DL_ARTIST == level ) {
+            group = group->parent;
+        }
+    }
+    return group;
+}
+
+/**
+ * Plays a whole pass through the group of the song & back again, checking
+ * that every song of the group is played exactly once.
+ */
+static void check_pass( song_node_t *first, const db_level_t level,
+                        uint8_t *played, song_node_t **order )
+{
+    generic_node_t *group = group_of( first, level );
+    uint32_t start = group->list.index_songs_start;
+    uint32_t count = group->list.index_songs_stop - start + 1;
+    song_node_t *song = first;
+    uint32_t i;
+
+    memset( played, 0, count );
+    played[first->d.index - start] = 1;
+    order[0] = first;
+
+    for( i = 1; i < count; i++ ) {
+        CU_ASSERT_FATAL( DS_SUCCESS == queued_next_song(&song, DT_NEXT, level) );
+        CU_ASSERT_FATAL( group == group_of(song, level) );
+        CU_ASSERT_FATAL( 0 == played[song->d.index - start] );
+        played[song->d.index - start] = 1;
+        order[i] = song;
+    }
+
+    /* Once they have all been played a new order is started. */
+    CU_ASSERT( DS_END_OF_LIST == queued_next_song(&song, DT_NEXT, level) );
+    CU_ASSERT( group == group_of(song, level) );
+
+    CU_ASSERT( DS_END_OF_LIST == queued_next_song(&song, DT_PREVIOUS, level) );
+    CU_ASSERT( order[count - 1] == song );
+    for( i = count - 1; 0 < i; i-- ) {
+        CU_ASSERT( DS_SUCCESS == queued_next_song(&song, DT_PREVIOUS, level) );
+        if( order[i - 1] != song ) {
+            CU_FAIL( "Previous did not retrace the order" );
+            break;
+        }
+    }
+}
+
+void test_no_repeats( void )
+{
+    db_level_t levels[] = { DL_SONG, DL_ALBUM, DL_ARTIST };
+    uint32_t count, i, l;
+    uint8_t *played;
+    song_node_t **order;
+
+    create_database( large_db, sizeof(large_db)/sizeof(ut_song_t) );
+    count = rdn.songs.count;
+    played = (uint8_t *) malloc( count );
+    order = (song_node_t **) malloc( count * sizeof(song_node_t *) );
+    CU_ASSERT_FATAL( (NULL != played) && (NULL != order) );
+
+    for( l = 0; l < 3; l++ ) {
+        for( i = 0; i < count; i += 251 ) {
+            check_pass( get_indexed_song(i), levels[l], played, order );
+        }
+    }
+
+    free( order );
+    free( played );
+    database_purge();
+}
+
+void test_seed( void )
+{
+    song_node_t *a[SAVED_ORDER], *b[SAVED_ORDER];
+    song_node_t *song;
+    uint32_t seed, i, same;
+
+    create_database( large_db, sizeof(large_db)/sizeof(ut_song_t) );
+    seed = shuffle_get_seed();
+
+    song = get_indexed_song( 100 );
+    for( i = 0; i < SAVED_ORDER; i++ ) {
+        queued_next_song( &song, DT_NEXT, DL_ARTIST );
+        a[i] = song;
+    }
+
+    /* A power cycle: the seed & the current song are all that is kept. */
+    song = a[SAVED_ORDER / 2];
+    queued_song_clear();
+    shuffle_set_seed( seed );
+    for( i = SAVED_ORDER / 2 + 1; i < SAVED_ORDER; i++ ) {
+        queued_next_song( &song, DT_NEXT, DL_ARTIST );
+        CU_ASSERT( a[i] == song );
+    }
+
+    /* A different seed gives a different order. */
+    shuffle_set_seed( seed + 1 );
+    CU_ASSERT( seed + 1 == shuffle_get_seed() );
+    song = get_indexed_song( 100 );
+    same = 0;
+    for( i = 0; i < SAVED_ORDER; i++ ) {
+        queued_next_song( &song, DT_NEXT, DL_ARTIST );
+        b[i] = song;
+        if( a[i] == b[i] ) {
+            same++;
+        }
+    }
+    CU_ASSERT( same < SAVED_ORDER / 2 );
+
+    shuffle_set_seed( seed );
+    database_purge();
+}
+
+void test_peek( void )
+{
+    db_level_t levels[] = { DL_SONG, DL_ALBUM, DL_ARTIST };
+    song_node_t *song, *peeked, *again;
+    db_status_t rv;
+    uint32_t i, l, passes;
+
+    create_database( large_db, sizeof(large_db)/sizeof(ut_song_t) );
+
+    /* Peeking never moves the shuffle on, even over the end of a pass. */
+    for( l = 0; l < 3; l++ ) {
+        song = get_indexed_song( 100 );
+        passes = 0;
+        for( i = 0; i < 3 * SAVED_ORDER; i++ ) {
+            peeked = song;
+            rv = queued_peek_next_song( &peeked, DT_NEXT, levels[l] );
+            again = song;
+            CU_ASSERT( rv == queued_peek_next_song(&again, DT_NEXT, levels[l]) );
+            CU_ASSERT( peeked == again );
+
+            CU_ASSERT( rv == queued_next_song(&song, DT_NEXT, levels[l]) );
+            if( peeked != song ) {
+                CU_FAIL( "The peeked song was not the next one" );
+                break;
+            }
+            if( DS_END_OF_LIST == rv ) {
+                passes++;
+            }
+        }
+        if( DL_SONG == levels[l] ) {
+            CU_ASSERT( 0 < passes );
+        }
+    }
+
+    CU_ASSERT( DS_FAILURE == queued_peek_next_song(&song, DT_NEXT, (db_level_t) 3) );
+    database_purge();
+}
+
+void test_benchmark( void )
+{
+    song_node_t *song = NULL;
+    clock_t begin;
+    uint32_t i;
+
+    create_database( large_db, sizeof(large_db)/sizeof(ut_song_t) );
+
+    begin = clock();
+    for( i = 0; i < BENCHMARK_OPERATIONS; i++ ) {
+        if( DS_FAILURE == queued_next_song(&song, DT_NEXT, DL_ARTIST) ) {
+            CU_FAIL( "queued_next_song() failed" );
+            break;
+        }
+    }
+    printf( "\n%u songs, queued_next_song(): %ld ns/op\n",
+            (unsigned int) rdn.songs.count,
+            (long) ((clock() - begin) * (1000000000 / BENCHMARK_OPERATIONS) / CLOCKS_PER_SEC) );
+
+    database_purge();
+}
+
+void add_suites( CU_pSuite *suite )
+{
+    *suite = CU_add_suite( "Shuffle Test", NULL, NULL );
+    CU_add_test( *suite, "Test No Repeats       ", test_no_repeats );
+    CU_add_test( *suite, "Test Seed             ", test_seed );
+    CU_add_test( *suite, "Test Peek             ", test_peek );
+    CU_add_test( *suite, "Test Benchmark        ", test_benchmark );
+}
+
+int main( int argc, char *argv[] )
+{
+    int rv = 1;
+    CU_pSuite suite = NULL;
+
+    if( CUE_SUCCESS == CU_initialize_registry() ) {
+        add_suites( &suite );
+
+        if( NULL != suite ) {
+            CU_basic_set_mode( CU_BRM_VERBOSE );
+            CU_basic_run_tests();
+            printf( "\n" );
+            CU_basic_show_failures( CU_get_failure_list() );
+            printf( "\n\n" );
+            rv = CU_get_number_of_tests_failed();
+        }
+
+        CU_cleanup_registry();
+    }
+
+    if( 0 != rv ) {
+        return 1;
+    }
+    return CU_get_error();
+}
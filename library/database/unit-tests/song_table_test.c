@@ -0,0 +1,187 @@
+#include <CUnit/Basic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "database.h"
+#include "internal_database.h"
+#include "add_song.h"
+#include "generic.h"
+#include "indexer.h"
+#include "db_testing.h"
+#include "large_db.h"
+
+#define BENCHMARK_OPERATIONS    1000000
+
+root_database_node_t rdn;
+
+/* Navigates with the trees, as if the song table could not be built. */
+static db_status_t tree_next_song( song_node_t ** current_song,
+                                   const db_traverse_t operation,
+                                   const db_level_t level )
+{
+    uint32_t count = rdn.songs.count;
+    db_status_t rv;
+
+    rdn.songs.count = 0;
+    rv = next_song( current_song, operation, level );
+    rdn.songs.count = count;
+    return rv;
+}
+
+static bt_ir_t check_table( bt_node_t *node, void *user_data )
+{
+    generic_node_t *gn = (generic_node_t *) node->data;
+
+    if( GNT_SONG == gn->type ) {
+        CU_ASSERT( (song_node_t *) gn == get_indexed_song(gn->index) );
+    } else {
+        bt_iterate( &gn->list.children, check_table, NULL, user_data );
+    }
+    return BT_IR__CONTINUE;
+}
+
+void test_song_table( void )
+{
+    uint32_t count;
+
+    create_database( large_db, sizeof(large_db)/sizeof(ut_song_t) );
+    count = rdn.root->list.index_songs_stop + 1;
+    CU_ASSERT_FATAL( count == rdn.songs.count );
+
+    bt_iterate( &rdn.root->list.children, check_table, NULL, NULL );
+    CU_ASSERT( NULL == get_indexed_song(count) );
+
+    database_purge();
+    CU_ASSERT( 0 == rdn.songs.count );
+    CU_ASSERT( NULL == get_indexed_song(0) );
+}
+
+void test_same_as_tree( void )
+{
+    db_traverse_t operations[] = { DT_NEXT, DT_PREVIOUS };
+    db_level_t levels[] = { DL_SONG, DL_ALBUM, DL_ARTIST };
+    uint32_t count, i, o, l;
+
+    create_database( large_db, sizeof(large_db)/sizeof(ut_song_t) );
+    count = rdn.songs.count;
+
+    for( o = 0; o < 2; o++ ) {
+        for( l = 0; l < 3; l++ ) {
+            song_node_t *flat = NULL;
+            song_node_t *tree = NULL;
+
+            CU_ASSERT( tree_next_song(&tree, operations[o], levels[l]) ==
+                       next_song(&flat, operations[o], levels[l]) );
+            CU_ASSERT( tree == flat );
+
+            for( i = 0; i < count; i++ ) {
+                db_status_t flat_rv, tree_rv;
+
+                flat = get_indexed_song( i );
+                tree = flat;
+                flat_rv = next_song( &flat, operations[o], levels[l] );
+                tree_rv = tree_next_song( &tree, operations[o], levels[l] );
+                if( (flat_rv != tree_rv) || (flat != tree) ) {
+                    CU_FAIL( "The song table & tree disagree" );
+                    break;
+                }
+            }
+        }
+    }
+
+    /* Random picks stay within the group. */
+    for( i = 0; i < count; i += 97 ) {
+        song_node_t *song = get_indexed_song( i );
+        generic_node_t *album = song->d.parent;
+        generic_node_t *artist = album->parent;
+
+        CU_ASSERT( DS_SUCCESS == next_song(&song, DT_RANDOM, DL_SONG) );
+        CU_ASSERT( album == song->d.parent );
+        CU_ASSERT( DS_SUCCESS == next_song(&song, DT_RANDOM, DL_ALBUM) );
+        CU_ASSERT( artist == song->d.parent->parent );
+        CU_ASSERT( DS_SUCCESS == next_song(&song, DT_RANDOM, DL_ARTIST) );
+        CU_ASSERT( NULL != song );
+    }
+
+    database_purge();
+}
+
+static long benchmark( next_song_fct fn, const db_traverse_t operation,
+                       const db_level_t level )
+{
+    song_node_t *song = NULL;
+    clock_t begin;
+    uint32_t i;
+
+    begin = clock();
+    for( i = 0; i < BENCHMARK_OPERATIONS; i++ ) {
+        if( DS_FAILURE == (*fn)(&song, operation, level) ) {
+            CU_FAIL( "next_song() failed" );
+            break;
+        }
+    }
+    /* ns per operation */
+    return (long) ((clock() - begin) * (1000000000 / BENCHMARK_OPERATIONS) / CLOCKS_PER_SEC);
+}
+
+void test_benchmark( void )
+{
+    struct {
+        const char *name;
+        db_traverse_t operation;
+        db_level_t level;
+    } cases[] = {
+        { "next song   ", DT_NEXT,     DL_SONG   },
+        { "next album  ", DT_NEXT,     DL_ALBUM  },
+        { "prev album  ", DT_PREVIOUS, DL_ALBUM  },
+        { "next artist ", DT_NEXT,     DL_ARTIST },
+        { "random      ", DT_RANDOM,   DL_ARTIST },
+    };
+    uint32_t i;
+
+    create_database( large_db, sizeof(large_db)/sizeof(ut_song_t) );
+
+    printf( "\n%u songs, ns/op:      tree   table\n", (unsigned int) rdn.songs.count );
+    for( i = 0; i < sizeof(cases)/sizeof(cases[0]); i++ ) {
+        long tree = benchmark( tree_next_song, cases[i].operation, cases[i].level );
+        long flat = benchmark( next_song, cases[i].operation, cases[i].level );
+        printf( "    %s        %7ld %7ld\n", cases[i].name, tree, flat );
+    }
+
+    database_purge();
+}
+
+void add_suites( CU_pSuite *suite )
+{
+    *suite = CU_add_suite( "Song Table Test", NULL, NULL );
+    CU_add_test( *suite, "Test Song Table       ", test_song_table );
+    CU_add_test( *suite, "Test Same as Tree     ", test_same_as_tree );
+    CU_add_test( *suite, "Test Benchmark        ", test_benchmark );
+}
+
+int main( int argc, char *argv[] )
+{
+    int rv = 1;
+    CU_pSuite suite = NULL;
+
+    if( CUE_SUCCESS == CU_initialize_registry() ) {
+        add_suites( &suite );
+
+        if( NULL != suite ) {
+            CU_basic_set_mode( CU_BRM_VERBOSE );
+            CU_basic_run_tests();
+            printf( "\n" );
+            CU_basic_show_failures( CU_get_failure_list() );
+            printf( "\n\n" );
+            rv = CU_get_number_of_tests_failed();
+        }
+
+        CU_cleanup_registry();
+    }
+
+    if( 0 != rv ) {
+        return 1;
+    }
+    return CU_get_error();
+}
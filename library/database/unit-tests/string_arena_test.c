@@ -0,0 +1,227 @@
+#include <CUnit/Basic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "database.h"
+#include "internal_database.h"
+#include "add_song.h"
+#include "generic.h"
+#include "indexer.h"
+#include "string_arena.h"
+#include "db_testing.h"
+#include "large_db.h"
+
+#define DEBUG 0
+
+#define _D1(...)
+
+#if DEBUG > 0
+#undef  _D1
+#define _D1(...) printf( __VA_ARGS__ )
+#endif
+
+#define SONGS_PER_DIRECTORY 12
+
+/* The target has 32 bit pointers.  On a 64 bit host every pointer doubles
+ * in size, which costs the compact nodes proportionally more. */
+#define MIN_REDUCTION       ((4 == sizeof(void *)) ? 4 : 3)
+
+/* The node layouts before the names & paths moved into the string arena. */
+typedef struct legacy_generic_node {
+    generic_node_types_t type;
+    union {
+        char root[MAX_ROOT_NAME_W_NULL];
+        char artist[MAX_ARTIST_NAME_W_NULL];
+        char album[MAX_ALBUM_TITLE_W_NULL];
+        char song[MAX_SONG_TITLE_W_NULL];
+    } name;
+    bt_node_t node;
+    index_song_node_t list;
+    struct legacy_generic_node * parent;
+    uint32_t index;
+} legacy_generic_node_t;
+
+typedef struct {
+    legacy_generic_node_t d;
+    char file_location[MAX_SHORT_FILENAME_PATH_W_NULL];
+    media_gain_t gain;
+    uint16_t track_number;
+    media_command_fn_t command_fn;
+    media_play_fn_t play_fn;
+    uint32_t file_size;
+    uint32_t file_mtime;
+} legacy_song_node_t;
+
+typedef struct {
+    size_t songs;
+    size_t others;
+} node_count_t;
+
+root_database_node_t rdn;
+
+static bt_ir_t count_nodes( bt_node_t *node, void *user_data )
+{
+    node_count_t *count = (node_count_t *) user_data;
+    generic_node_t *gn = (generic_node_t *) node->data;
+
+    if( GNT_SONG == gn->type ) {
+        count->songs++;
+    } else {
+        count->others++;
+        bt_iterate( &gn->list.children, count_nodes, NULL, user_data );
+    }
+    return BT_IR__CONTINUE;
+}
+
+void test_intern( void )
+{
+    const char *a, *b, *c;
+    size_t size;
+
+    database_purge();
+    CU_ASSERT( 0 == string_arena_size() );
+
+    a = string_arena_intern( "Fashion Nugget", MAX_ALBUM_TITLE );
+    b = string_arena_intern( "Fashion Nugget", MAX_ALBUM_TITLE );
+    c = string_arena_intern( "fashion nugget", MAX_ALBUM_TITLE );
+    CU_ASSERT_FATAL( (NULL != a) && (NULL != c) );
+    CU_ASSERT( a == b );
+    CU_ASSERT( a != c );
+    CU_ASSERT( 0 == strcmp("Fashion Nugget", a) );
+
+    /* Only max_length characters are used. */
+    b = string_arena_intern( "Fashion Nugget (Remastered)", 14 );
+    CU_ASSERT( a == b );
+    b = string_arena_intern( "Fashion", 14 );
+    CU_ASSERT( (NULL != b) && (a != b) && (0 == strcmp("Fashion", b)) );
+
+    /* Added strings are never shared. */
+    b = string_arena_add( "Fashion Nugget", MAX_SONG_TITLE );
+    CU_ASSERT( (NULL != b) && (a != b) && (0 == strcmp("Fashion Nugget", b)) );
+
+    size = string_arena_size();
+    CU_ASSERT( 0 < size );
+    database_purge();
+    CU_ASSERT( string_arena_size() < size );
+}
+
+void test_intern_many( void )
+{
+    const char **strings;
+    char buffer[20];
+    size_t i;
+
+    strings = (const char **) malloc( 10000 * sizeof(const char *) );
+    CU_ASSERT_FATAL( NULL != strings );
+
+    /* Enough strings to fill several blocks & grow the table a few times. */
+    for( i = 0; i < 10000; i++ ) {
+        sprintf( buffer, "String %u", (unsigned int) i );
+        strings[i] = string_arena_intern( buffer, MAX_ALBUM_TITLE );
+        CU_ASSERT_FATAL( NULL != strings[i] );
+    }
+    for( i = 0; i < 10000; i++ ) {
+        sprintf( buffer, "String %u", (unsigned int) i );
+        CU_ASSERT( strings[i] == string_arena_intern(buffer, MAX_ALBUM_TITLE) );
+        CU_ASSERT( 0 == strcmp(buffer, strings[i]) );
+    }
+
+    free( strings );
+    database_purge();
+}
+
+void test_song_location( void )
+{
+    media_metadata_t metadata;
+    song_node_t *a, *b, *c;
+    char location[MAX_SHORT_FILENAME_PATH_W_NULL];
+
+    create_root();
+    memset( &metadata, 0, sizeof(media_metadata_t) );
+    strcpy( metadata.artist, "Cake" );
+    strcpy( metadata.album, "Fashion Nugget" );
+
+    strcpy( metadata.title, "Frank Sinatra" );
+    a = add_song_to_root( rdn.root, &metadata, fake_play, "/CAKE/FASHIO~1/01.FLA" );
+    strcpy( metadata.title, "The Distance" );
+    b = add_song_to_root( rdn.root, &metadata, fake_play, "/CAKE/FASHIO~1/02.FLA" );
+    /* Not an 8.3 name, so it is kept whole. */
+    strcpy( metadata.title, "Daria" );
+    c = add_song_to_root( rdn.root, &metadata, fake_play, "/CAKE/FASHIO~1/05 - Daria.flac" );
+    CU_ASSERT_FATAL( (NULL != a) && (NULL != b) && (NULL != c) );
+
+    CU_ASSERT( a->directory == b->directory );
+    CU_ASSERT( 0 == strcmp("01.FLA", a->file_name) );
+    get_song_location( a, location );
+    CU_ASSERT( 0 == strcmp("/CAKE/FASHIO~1/01.FLA", location) );
+    get_song_location( b, location );
+    CU_ASSERT( 0 == strcmp("/CAKE/FASHIO~1/02.FLA", location) );
+    get_song_location( c, location );
+    CU_ASSERT( 0 == strcmp("/CAKE/FASHIO~1/05 - Daria.flac", location) );
+
+    database_purge();
+}
+
+void test_large_db_footprint( void )
+{
+    node_count_t count;
+    size_t legacy, compact;
+
+    create_database_in( large_db, sizeof(large_db)/sizeof(ut_song_t),
+                        "/MUSIC/COLLECTN/D%07u", SONGS_PER_DIRECTORY, NULL );
+
+    count.songs = 0;
+    count.others = 1;
+    bt_iterate( &rdn.root->list.children, count_nodes, NULL, &count );
+    CU_ASSERT( rdn.root->list.index_songs_stop + 1 == count.songs );
+
+    legacy =   count.songs * sizeof(legacy_song_node_t)
+             + count.others * sizeof(legacy_generic_node_t);
+    compact =   count.songs * sizeof(song_node_t)
+              + count.others * sizeof(generic_node_t)
+              + string_arena_size();
+
+    _D1( "\n%u songs, %u other nodes: %u -> %u bytes (%u -> %u per song)\n",
+         (unsigned int) count.songs, (unsigned int) count.others,
+         (unsigned int) legacy, (unsigned int) compact,
+         (unsigned int) (legacy / count.songs),
+         (unsigned int) (compact / count.songs) );
+    CU_ASSERT( compact * MIN_REDUCTION <= legacy );
+
+    database_purge();
+}
+
+void add_suites( CU_pSuite *suite )
+{
+    *suite = CU_add_suite( "String Arena Test", NULL, NULL );
+    CU_add_test( *suite, "Test Intern           ", test_intern );
+    CU_add_test( *suite, "Test Intern Many      ", test_intern_many );
+    CU_add_test( *suite, "Test Song Location    ", test_song_location );
+    CU_add_test( *suite, "Test Large DB Size    ", test_large_db_footprint );
+}
+
+int main( int argc, char *argv[] )
+{
+    int rv = 1;
+    CU_pSuite suite = NULL;
+
+    if( CUE_SUCCESS == CU_initialize_registry() ) {
+        add_suites( &suite );
+
+        if( NULL != suite ) {
+            CU_basic_set_mode( CU_BRM_VERBOSE );
+            CU_basic_run_tests();
+            printf( "\n" );
+            CU_basic_show_failures( CU_get_failure_list() );
+            printf( "\n\n" );
+            rv = CU_get_number_of_tests_failed();
+        }
+
+        CU_cleanup_registry();
+    }
+
+    if( 0 != rv ) {
+        return 1;
+    }
+    return CU_get_error();
+}
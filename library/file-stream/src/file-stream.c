@@ -21,6 +21,7 @@
 #include <stdio.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <freertos/os.h>
@@ -34,6 +35,14 @@
 #define FSTREAM_BIG_BUFFER_SIZE         (32*1024)
 #define FSTREAM_TOTAL_BUFFER_SIZE       (128*1024)
 #define FSTREAM_SMALL_BUFFER_SIZE       512
+#define FSTREAM_NODE_COUNT              (FSTREAM_TOTAL_BUFFER_SIZE / FSTREAM_SMALL_BUFFER_SIZE)
+#define FSTREAM_MAX_READ_SIZE           (16*1024)
+#define FSTREAM_MAX_READ_NODES          (FSTREAM_MAX_READ_SIZE / FSTREAM_SMALL_BUFFER_SIZE)
+
+/* The reader of the stream is catching up with the task below the low
+ * water mark, & is well behind it above the high water mark. */
+#define FSTREAM_LOW_WATER_NODES         (FSTREAM_NODE_COUNT / 4)
+#define FSTREAM_HIGH_WATER_NODES        (FSTREAM_NODE_COUNT * 3 / 4)
 
 #define MIN(a,b)    ((a) < (b)) ? (a) : (b)
 
@@ -53,40 +62,128 @@
 /*----------------------------------------------------------------------------*/
 /*                               Data Structures                              */
 /*----------------------------------------------------------------------------*/
+/* Each node is a fixed FSTREAM_SMALL_BUFFER_SIZE slice of the ring. */
 typedef struct {
     uint8_t *buffer;
     size_t valid_bytes;
+    uint32_t epoch;
     bool last;
 } fstream_buffer_t;
 
+/* The part of the ring the reader of the stream holds. */
+typedef struct {
+    size_t read;        /* Offset in the ring of the next byte */
+    size_t valid;       /* Bytes from read on which have been received */
+    size_t mirrored;    /* Bytes from the start of the ring copied past the end */
+    uint32_t held;      /* Nodes received & not yet released */
+    bool last;          /* The last node of the file has been received */
+} fstream_window_t;
+
 typedef enum {
     FSTS__IDLE,
-    FSTS__STREAMING
+    FSTS__STREAMING,
+    FSTS__PREFETCH
 } fs_task_state_t;
 
 typedef struct {
     fs_task_state_t cmd;
     char *name;
+    uint32_t offset;
+    uint32_t size;
+    uint32_t file;
 } fstream_command_t;
 
+/* What the task found when it opened a queued file. */
+typedef struct {
+    bool opened;
+    uint32_t size;
+    uint32_t file;
+} fstream_prefetch_t;
+
+/* A stream - each has its own task, nodes & ring. */
+struct fstream {
+    fstream_priority_t priority;
+    bool urgent;
+
+    volatile int filesize;
+    volatile fs_task_state_t state;
+
+    /* The nodes go around the ring in order, so the data handed out is
+     * contiguous except where it wraps.  A window which wraps gets the
+     * start of the ring copied into the FSTREAM_BIG_BUFFER_SIZE bytes past
+     * the end. */
+    uint8_t *ring;
+    fstream_buffer_t nodes[FSTREAM_NODE_COUNT];
+    fstream_window_t window;
+
+    fstream_stats_t stats;
+
+    /* Each read() ends on a multiple of align_nodes into the file, the
+     * cluster size where it is known, & is up to read_units of them
+     * long. */
+    uint32_t align_nodes;
+    uint32_t read_units;
+
+    /* The nodes a read() goes into, kept off the task's stack since the
+     * read() runs newlib & FatFs on it. */
+    fstream_buffer_t *read_nodes[FSTREAM_MAX_READ_NODES];
+
+    /* Data queues */
+    queue_handle_t data_active;
+    queue_handle_t data_idle;
+
+    /* Control queues */
+    queue_handle_t command_active;
+    queue_handle_t command_idle;
+
+    fstream_command_t command;
+
+    /* The file queued to be read once the current one has been.  The task
+     * is never told to stop a prefetch, it has no ack, so it has its own
+     * command & command_active has room for both.  The name belongs to
+     * the reader of the stream, prefetched gets the result once the task
+     * opens it. */
+    fstream_command_t prefetch_command;
+    queue_handle_t prefetched;
+    char *queued;
+
+    /* fstream_queue_next() may be called from a different task than the
+     * reader of the stream. */
+    mutex_handle_t lock;
+    bool is_open;
+
+    /* The reader of the stream is at position in the file it has open,
+     * which is called name & numbered file by the task. */
+    char *name;
+    uint32_t file;
+    uint32_t position;
+
+    /* A seek is passed to the task while it is still reading the file.
+     * The nodes read before it gets to the seek are stamped with the old
+     * epoch, so the reader of the stream can throw them away.  The task
+     * can't stop reading a file while a seek is pending, & reading is
+     * only changed, with seek_lock held. */
+    mutex_handle_t seek_lock;
+    uint32_t reading;
+    uint32_t files_opened;
+    uint32_t epoch;
+    bool seek_pending;
+    uint32_t seek_offset;
+};
+
 /*----------------------------------------------------------------------------*/
 /*                            File Scoped Variables                           */
 /*----------------------------------------------------------------------------*/
-static volatile int __filesize;
-
-static volatile fs_task_state_t __state;
+static uint32_t __priority;
 
-static fstream_buffer_t __big_buffer;
-
-/* Data queues */
-static queue_handle_t __data_active;
-static queue_handle_t __data_idle;
-
-/* Control queues */
-static queue_handle_t __command_active;
-static queue_handle_t __command_idle;
-
-static fstream_command_t __command;
+/* The card reads one thing at a time.  A background stream only gets it
+ * while no playback stream needs it - none is waiting for it or is below
+ * its low water mark.  The background readers wait on __card_free, which
+ * is given each time __playback_needs drops to 0. */
+static mutex_handle_t __card;
+static mutex_handle_t __card_lock;
+static semaphore_handle_t __card_free;
+static volatile uint32_t __playback_needs;
 
 static fstream_free_fct __free_fn;
 static fstream_malloc_fct __malloc_fn;
@@ -95,6 +192,30 @@ static fstream_malloc_fct __malloc_fn;
 /*                             Function Prototypes                            */
 /*----------------------------------------------------------------------------*/
 void __task( void *params );
+static bool __open_file( fstream_t *fs, const char *filename,
+                         const uint32_t offset, int *fd, uint32_t *size,
+                         uint32_t *file );
+static fstream_command_t* __stream_file( fstream_t *fs, int fd,
+                                         const uint32_t size,
+                                         const uint32_t offset, char **next );
+static void __seek_file( fstream_t *fs, int fd, const uint32_t size,
+                         uint32_t *epoch, uint32_t *bytes_left );
+static bool __reopen( fstream_t *fs, const uint32_t offset );
+static void __queue( fstream_t *fs, char *name );
+static void __close( fstream_t *fs );
+static void __stop( fstream_t *fs );
+static uint32_t __read_nodes( fstream_t *fs, int fd, uint32_t offset,
+                              uint32_t bytes_left, const uint32_t epoch );
+static void __take_card( const fstream_priority_t priority );
+static void __give_card( void );
+static void __playback_done( void );
+static void __set_urgent( fstream_t *fs, const bool urgent );
+static void __return_first_node( fstream_t *fs );
+static void __return_held_nodes( fstream_t *fs );
+static size_t __buffered( fstream_t *fs );
+static uint32_t __now_us( void );
+static void __record_level( fstream_t *fs, const size_t level );
+static void __record_latency( fstream_t *fs, const uint32_t us );
 
 /*----------------------------------------------------------------------------*/
 /*                             External Functions                             */
@@ -104,146 +225,303 @@ bool fstream_init( const uint32_t priority,
                    fstream_malloc_fct malloc_fn,
                    fstream_free_fct free_fn )
 {
-    int32_t i;
-    uint32_t queue_size;
-
     _D1( "%s( %lu, %p, %p )\n", __func__, priority, malloc_fn, free_fn );
 
     if( (NULL == malloc_fn) || (NULL == free_fn) ) {
         return false;
     }
 
-    __state = FSTS__IDLE;
-
+    __priority = priority;
     __free_fn = free_fn;
     __malloc_fn = malloc_fn;
 
-    queue_size = FSTREAM_TOTAL_BUFFER_SIZE / FSTREAM_SMALL_BUFFER_SIZE;
+    __card = os_mutex_create();
+    __card_lock = os_mutex_create();
+    __card_free = os_semaphore_create_binary();
+    os_semaphore_take( __card_free, NO_WAIT );
+    __playback_needs = 0;
 
-    __data_idle = os_queue_create( queue_size, sizeof(fstream_buffer_t*) );
-    __data_active = os_queue_create( queue_size, sizeof(fstream_buffer_t*) );
+    return true;
+}
 
-    __command_idle = os_queue_create( 1, sizeof(fstream_buffer_t*) );
-    __command_active = os_queue_create( 1, sizeof(fstream_buffer_t*) );
+/** Details in file-stream.h */
+fstream_t* fstream_create( const fstream_priority_t priority )
+{
+    fstream_t *fs;
+    int32_t i;
+    uint32_t queue_size;
+
+    _D1( "%s( %d )\n", __func__, priority );
 
+    if( (FSTREAM_PRIORITY__PLAYBACK != priority) &&
+        (FSTREAM_PRIORITY__BACKGROUND != priority) )
     {
-        fstream_command_t *cmd;
-        cmd = &__command;
-        os_queue_send_to_back( __command_idle, &cmd, NO_WAIT );
+        return NULL;
+    }
+
+    fs = (fstream_t *) (*__malloc_fn)( sizeof(fstream_t) );
+    if( NULL == fs ) {
+        return NULL;
+    }
+    memset( fs, 0, sizeof(fstream_t) );
+
+    fs->ring = (uint8_t *) (*__malloc_fn)( FSTREAM_TOTAL_BUFFER_SIZE + FSTREAM_BIG_BUFFER_SIZE );
+    if( NULL == fs->ring ) {
+        (*__free_fn)( fs );
+        return NULL;
     }
 
-    __big_buffer.valid_bytes = 0;
+    fs->priority = priority;
+    fs->state = FSTS__IDLE;
+    fs->stats.level_min = FSTREAM_TOTAL_BUFFER_SIZE;
+
+    queue_size = FSTREAM_TOTAL_BUFFER_SIZE / FSTREAM_SMALL_BUFFER_SIZE;
+
+    fs->data_idle = os_queue_create( queue_size, sizeof(fstream_buffer_t*) );
+    fs->data_active = os_queue_create( queue_size, sizeof(fstream_buffer_t*) );
 
-    __big_buffer.buffer = (uint8_t *)(*malloc_fn)( FSTREAM_BIG_BUFFER_SIZE + FSTREAM_SMALL_BUFFER_SIZE );
+    fs->command_idle = os_queue_create( 1, sizeof(fstream_buffer_t*) );
+    fs->command_active = os_queue_create( 2, sizeof(fstream_buffer_t*) );
+    fs->prefetched = os_queue_create( 1, sizeof(fstream_prefetch_t) );
+    fs->lock = os_mutex_create();
+    fs->seek_lock = os_mutex_create();
 
-    for( i = 0; i < FSTREAM_TOTAL_BUFFER_SIZE; i += FSTREAM_SMALL_BUFFER_SIZE ) {
+    {
+        fstream_command_t *cmd;
+        cmd = &fs->command;
+        os_queue_send_to_back( fs->command_idle, &cmd, NO_WAIT );
+    }
+
+    for( i = 0; i < FSTREAM_NODE_COUNT; i++ ) {
         fstream_buffer_t *n;
 
-        n = (fstream_buffer_t*) (*malloc_fn)( sizeof(fstream_buffer_t) );
-        n->buffer = (uint8_t *) (*malloc_fn)( FSTREAM_SMALL_BUFFER_SIZE );
+        n = &fs->nodes[i];
+        n->buffer = &fs->ring[i * FSTREAM_SMALL_BUFFER_SIZE];
         n->valid_bytes = 0;
 
-        os_queue_send_to_back( __data_idle, &n, NO_WAIT );
+        os_queue_send_to_back( fs->data_idle, &n, NO_WAIT );
     }
 
+    /* The card is shared by priority, the tasks can all run at the same
+     * one. */
     os_task_create( __task, "FileStrm", FSTREAM_TASK_STACK_SIZE,
-                    NULL, priority, NULL );
+                    fs, __priority, NULL );
 
-    return true;
+    return fs;
 }
 
 /** Details in file-stream.h */
-bool fstream_open( const char *filename )
+bool fstream_open( fstream_t *fs, const char *filename )
 {
-    fstream_command_t *cmd;
+    char *name;
 
     _D1( "%s( '%s' )\n", __func__, filename );
-    if( NULL == filename ) {
+    if( (NULL == fs) || (NULL == filename) ) {
         _D1( "%s( %p ) -> failure\n", __func__, filename );
         return false;
     }
 
-    fstream_close();
+    os_mutex_take( fs->lock, WAIT_FOREVER );
+
+    __close( fs );
 
-    os_queue_receive( __command_idle, &cmd, WAIT_FOREVER );
+    if( NULL != fs->queued ) {
+        if( 0 == strcmp(fs->queued, filename) ) {
+            fstream_prefetch_t result;
 
-    cmd->name = (char *) (*__malloc_fn)( strlen(filename) + 1 );
-    if( NULL == cmd->name ) {
-        os_queue_send_to_back( __command_idle, &cmd, NO_WAIT );
+            /* The task has read the file before it, so it opens this one
+             * without being asked - the data follows in data_active. */
+            os_queue_receive( fs->prefetched, &result, WAIT_FOREVER );
+
+            if( true == result.opened ) {
+                fs->name = fs->queued;
+                fs->file = result.file;
+                fs->filesize = result.size;
+                fs->position = 0;
+                fs->is_open = true;
+            } else {
+                (*__free_fn)( fs->queued );
+            }
+            fs->queued = NULL;
+            os_mutex_give( fs->lock );
+
+            _D2( "%s( %p ) -> prefetched %d\n", __func__, filename, result.opened );
+            return result.opened;
+        }
+
+        /* Not the file that was queued. */
+        __stop( fs );
+    }
+
+    name = (char *) (*__malloc_fn)( strlen(filename) + 1 );
+    if( NULL == name ) {
+        os_mutex_give( fs->lock );
         _D1( "%s( '%s' ) -> failure\n", __func__, filename );
         return false;
     }
-    strcpy( cmd->name, filename );
-    cmd->cmd = FSTS__STREAMING;
-
-    os_queue_send_to_back( __command_active, &cmd, NO_WAIT );
+    strcpy( name, filename );
+    fs->name = name;
 
-    /* Wait for the command to be processed. */
-    os_queue_peek( __command_idle, &cmd, WAIT_FOREVER );
-
-    if( FSTS__STREAMING == cmd->cmd ) {
+    if( true == __reopen(fs, 0) ) {
+        os_mutex_give( fs->lock );
         _D2( "%s( %p ) -> success\n", __func__, filename );
         return true;
     }
 
+    (*__free_fn)( fs->name );
+    fs->name = NULL;
+    os_mutex_give( fs->lock );
     _D1( "%s( %p ) -> failure\n", __func__, filename );
     return false;
 }
 
 /** Details in file-stream.h */
-void* fstream_get_buffer( const size_t wanted, size_t *got )
+bool fstream_queue_next( fstream_t *fs, const char *filename )
+{
+    char *name;
+
+    _D1( "%s( '%s' )\n", __func__, filename );
+    if( (NULL == fs) || (NULL == filename) ) {
+        return false;
+    }
+
+    os_mutex_take( fs->lock, WAIT_FOREVER );
+
+    if( NULL != fs->queued ) {
+        os_mutex_give( fs->lock );
+        _D1( "%s( '%s' ) -> already queued\n", __func__, filename );
+        return false;
+    }
+
+    name = (char *) (*__malloc_fn)( strlen(filename) + 1 );
+    if( NULL == name ) {
+        os_mutex_give( fs->lock );
+        return false;
+    }
+    strcpy( name, filename );
+    __queue( fs, name );
+
+    os_mutex_give( fs->lock );
+
+    return true;
+}
+
+/** Details in file-stream.h */
+void* fstream_get_buffer( fstream_t *fs, const size_t wanted, size_t *got )
 {
-    bool eof;
+    uint32_t waited_us;
+    bool blocked;
 
     _D1( "%s( %ld, %p ) -> ?\n", __func__, wanted, got );
-    if( (0 == wanted) || (NULL == got) || (FSTREAM_BIG_BUFFER_SIZE < wanted) ) {
+    if( (NULL == fs) || (0 == wanted) || (NULL == got) ||
+        (FSTREAM_BIG_BUFFER_SIZE < wanted) )
+    {
         _D1( "%s( %ld, %p ) -> NULL\n", __func__, wanted, got );
         return NULL;
     }
 
-    eof = false;
-    while( (__big_buffer.valid_bytes < wanted) && (false == eof) ) {
+    if( true == fs->is_open ) {
+        __record_level( fs, __buffered(fs) );
+    }
+
+    waited_us = 0;
+    blocked = false;
+    while( (fs->window.valid < wanted) && (false == fs->window.last) ) {
+        bool idle;
         bool rv;
         fstream_buffer_t *node;
 
-        if( FSTS__IDLE == __state ) {
-            rv = os_queue_receive( __data_active, &node, NO_WAIT );
-        } else {
-            rv = os_queue_receive( __data_active, &node, WAIT_FOREVER );
+        /* The task is idle once it has sent its last node. */
+        idle = (FSTS__IDLE == fs->state) ? true : false;
+        rv = os_queue_receive( fs->data_active, &node, NO_WAIT );
+        if( (false == rv) && (false == idle) ) {
+            /* Only the time spent waiting for the task is timed. */
+            uint32_t start;
+
+            start = __now_us();
+            rv = os_queue_receive( fs->data_active, &node, WAIT_FOREVER );
+            waited_us += __now_us() - start;
+            blocked = true;
         }
 
         if( false == rv ) {
-            eof = true;
-        } else {
-            memcpy( &__big_buffer.buffer[__big_buffer.valid_bytes],
-                        node->buffer, node->valid_bytes );
+            break;
+        }
 
-            __big_buffer.valid_bytes += node->valid_bytes;
+        if( fs->epoch != node->epoch ) {
+            /* Read before the last seek. */
+            os_queue_send_to_back( fs->data_idle, &node, NO_WAIT );
+            continue;
+        }
 
-            eof = node->last;
-            os_queue_send_to_back( __data_idle, &node, NO_WAIT );
+        if( 0 == fs->window.held ) {
+            /* The first data of a file starts where its node is. */
+            fs->window.read = node->buffer - fs->ring;
+            fs->window.mirrored = 0;
         }
+        fs->window.held++;
+        fs->window.valid += node->valid_bytes;
+        fs->window.last = node->last;
     }
 
-    *got = MIN( wanted, __big_buffer.valid_bytes );
-    _D2( "%s( %ld, %p ) -> %ld (max: %ld)\n", __func__, wanted, got, *got, __big_buffer.valid_bytes );
+    if( true == blocked ) {
+        fs->stats.blocked++;
+        fs->stats.blocked_us += waited_us;
+        if( fs->stats.blocked_max_us < waited_us ) {
+            fs->stats.blocked_max_us = waited_us;
+        }
+    }
 
-    return __big_buffer.buffer;
+    *got = MIN( wanted, fs->window.valid );
+
+    if( FSTREAM_TOTAL_BUFFER_SIZE < (fs->window.read + *got) ) {
+        size_t need = fs->window.read + *got - FSTREAM_TOTAL_BUFFER_SIZE;
+
+        if( fs->window.mirrored < need ) {
+            memcpy( &fs->ring[FSTREAM_TOTAL_BUFFER_SIZE + fs->window.mirrored],
+                    &fs->ring[fs->window.mirrored], need - fs->window.mirrored );
+            fs->stats.bytes_copied += need - fs->window.mirrored;
+            fs->window.mirrored = need;
+        }
+    }
+
+    _D2( "%s( %ld, %p ) -> %ld (max: %ld)\n", __func__, wanted, got, *got, fs->window.valid );
+
+    return &fs->ring[fs->window.read];
 }
 
 /** Details in file-stream.h */
-void fstream_release_buffer( const size_t consumed )
+void fstream_release_buffer( fstream_t *fs, const size_t consumed )
 {
+    size_t next;
+    uint32_t done;
+
     _D1( "%s( %ld )\n", __func__, consumed );
-    if( 0 < consumed ) {
-        if( consumed <= __big_buffer.valid_bytes ) {
+    if( (NULL != fs) && (0 < consumed) && (consumed <= fs->window.valid) ) {
+        fs->window.valid -= consumed;
+        fs->stats.bytes_released += consumed;
+        fs->position += consumed;
 
-            if( consumed < __big_buffer.valid_bytes ) {
-                memmove( __big_buffer.buffer, &__big_buffer.buffer[consumed],
-                         (__big_buffer.valid_bytes - consumed) );
-            }
+        next = fs->window.read + consumed;
 
-            __big_buffer.valid_bytes -= consumed;
+        /* Only the nodes which are completely used up go back. */
+        if( 0 == fs->window.valid ) {
+            done = fs->window.held;
+        } else {
+            done = next / FSTREAM_SMALL_BUFFER_SIZE
+                 - fs->window.read / FSTREAM_SMALL_BUFFER_SIZE;
+        }
+
+        if( FSTREAM_TOTAL_BUFFER_SIZE <= next ) {
+            next -= FSTREAM_TOTAL_BUFFER_SIZE;
+        }
+
+        while( 0 < done-- ) {
+            __return_first_node( fs );
+        }
+
+        if( 0 < fs->window.held ) {
+            fs->window.read = next;
         }
     }
 
@@ -251,54 +529,123 @@ void fstream_release_buffer( const size_t consumed )
 }
 
 /** Details in file-stream.h */
-void fstream_skip( const size_t skip )
+void fstream_skip( fstream_t *fs, const size_t skip )
 {
+    size_t left;
+    size_t buffered;
+
     _D1( "%s( %ld )\n", __func__, skip );
+    if( NULL == fs ) {
+        return;
+    }
 
-    if( skip < __big_buffer.valid_bytes ) {
-        fstream_release_buffer( skip );
-    } else {
-        size_t left = skip;
-        left -= __big_buffer.valid_bytes;
-        __big_buffer.valid_bytes = 0;
-        while( 0 < left ) {
-            size_t got, frame;
-
-            frame = MIN( left, FSTREAM_BIG_BUFFER_SIZE );
-            fstream_get_buffer( frame, &got );
-            fstream_release_buffer( frame );
-            left -= frame;
+    /* Past what has been read, a seek is cheaper than reading it all. */
+    buffered = __buffered( fs );
+    if( (buffered < skip) && (true == fs->is_open) ) {
+        fstream_seek( fs, MIN((uint64_t) fs->position + skip, (uint64_t) fs->filesize) );
+        _D2( "%s( %ld ) -> seek\n", __func__, skip );
+        return;
+    }
+
+    left = skip;
+    while( 0 < left ) {
+        size_t got;
+
+        if( 0 == fs->window.valid ) {
+            fstream_get_buffer( fs, MIN(left, FSTREAM_BIG_BUFFER_SIZE), &got );
+            if( 0 == got ) {
+                break;
+            }
         }
+
+        got = MIN( left, fs->window.valid );
+        fstream_release_buffer( fs, got );
+        left -= got;
     }
     _D2( "%s( %ld )\n", __func__, skip );
 }
 
 /** Details in file-stream.h */
-void fstream_close( void )
+bool fstream_seek( fstream_t *fs, const uint32_t offset )
 {
-    fstream_command_t *cmd;
-    fstream_buffer_t *node;
+    char *queued;
 
-    _D1( "%s()\n", __func__ );
-    os_queue_receive( __command_idle, &cmd, WAIT_FOREVER );
-    cmd->cmd = FSTS__IDLE;
-    cmd->name = NULL;
-    os_queue_send_to_back( __command_active, &cmd, NO_WAIT );
+    _D1( "%s( %lu )\n", __func__, offset );
 
-    /* Clear out any active data so we unblock the thread. */
-    while( true == os_queue_receive(__data_active, &node, NO_WAIT) ) {
-        os_queue_send_to_back( __data_idle, &node, NO_WAIT );
+    if( (NULL == fs) || (false == fs->is_open) || (fs->filesize < offset) ) {
+        return false;
     }
 
-    /* Wait for it to shut down. */
-    os_queue_peek( __command_idle, &cmd, WAIT_FOREVER );
+    /* Already buffered. */
+    if( (fs->position <= offset) && ((offset - fs->position) <= fs->window.valid) ) {
+        fstream_release_buffer( fs, offset - fs->position );
+        return true;
+    }
 
-    /* Clear out any active data. */
-    while( true == os_queue_receive(__data_active, &node, NO_WAIT) ) {
-        os_queue_send_to_back( __data_idle, &node, NO_WAIT );
+    __return_held_nodes( fs );
+    fs->position = offset;
+
+    os_mutex_take( fs->seek_lock, WAIT_FOREVER );
+    if( fs->file == fs->reading ) {
+        fs->epoch++;
+        fs->seek_offset = offset;
+        fs->seek_pending = true;
+        os_mutex_give( fs->seek_lock );
+        _D2( "%s( %lu ) -> passed to the task\n", __func__, offset );
+        return true;
+    }
+    os_mutex_give( fs->seek_lock );
+
+    /* The task is done with the file, so it opens it again.  The file
+     * queued after it is read after it again. */
+    os_mutex_take( fs->lock, WAIT_FOREVER );
+    queued = fs->queued;
+    fs->queued = NULL;
+    __stop( fs );
+
+    if( false == __reopen(fs, offset) ) {
+        (*__free_fn)( fs->name );
+        fs->name = NULL;
+        fs->filesize = 0;
+        fs->is_open = false;
     }
 
-    __big_buffer.valid_bytes = 0;
+    if( NULL != queued ) {
+        __queue( fs, queued );
+    }
+
+    if( false == fs->is_open ) {
+        os_mutex_give( fs->lock );
+        _D1( "%s( %lu ) -> failure\n", __func__, offset );
+        return false;
+    }
+    os_mutex_give( fs->lock );
+
+    _D2( "%s( %lu ) -> reopened\n", __func__, offset );
+    return true;
+}
+
+/** Details in file-stream.h */
+uint32_t fstream_tell( fstream_t *fs )
+{
+    if( NULL == fs ) {
+        return 0;
+    }
+    return fs->position;
+}
+
+/** Details in file-stream.h */
+void fstream_close( fstream_t *fs )
+{
+    _D1( "%s()\n", __func__ );
+    if( NULL == fs ) {
+        return;
+    }
+
+    os_mutex_take( fs->lock, WAIT_FOREVER );
+    __close( fs );
+    os_mutex_give( fs->lock );
+
     _D2( "%s()\n", __func__ );
 }
 
@@ -308,13 +655,166 @@ void fstream_destroy( void )
 }
 
 /** Details in file-stream.h */
-uint32_t fstream_get_filesize( void )
+void fstream_card_take( const fstream_priority_t priority )
+{
+    __take_card( priority );
+}
+
+/** Details in file-stream.h */
+void fstream_card_give( void )
+{
+    __give_card();
+}
+
+/** Details in file-stream.h */
+int fstream_card_open( const char *filename )
+{
+    int fd;
+
+    __take_card( FSTREAM_PRIORITY__BACKGROUND );
+    fd = open( filename, O_RDONLY );
+    __give_card();
+
+    return fd;
+}
+
+/** Details in file-stream.h */
+ssize_t fstream_card_read( int fd, void *buf, size_t count )
+{
+    ssize_t bytes_read;
+
+    __take_card( FSTREAM_PRIORITY__BACKGROUND );
+    bytes_read = read( fd, buf, count );
+    __give_card();
+
+    return bytes_read;
+}
+
+/** Details in file-stream.h */
+off_t fstream_card_lseek( int fd, off_t offset, int whence )
+{
+    off_t position;
+
+    __take_card( FSTREAM_PRIORITY__BACKGROUND );
+    position = lseek( fd, offset, whence );
+    __give_card();
+
+    return position;
+}
+
+/** Details in file-stream.h */
+int fstream_card_close( int fd )
+{
+    int rv;
+
+    __take_card( FSTREAM_PRIORITY__BACKGROUND );
+    rv = close( fd );
+    __give_card();
+
+    return rv;
+}
+
+/** Details in file-stream.h */
+void fstream_get_stats( fstream_t *fs, fstream_stats_t *stats )
 {
-    if( FSTS__STREAMING == __state ) {
-        return __filesize;
+    if( (NULL != fs) && (NULL != stats) ) {
+        *stats = fs->stats;
     }
+}
 
-    return 0;
+/** Details in file-stream.h */
+uint32_t fstream_get_filesize( fstream_t *fs )
+{
+    if( NULL == fs ) {
+        return 0;
+    }
+
+    /* The file is still open after the task has read all of it. */
+    return fs->filesize;
+}
+
+/** Details in file-stream.h */
+uint32_t fstream_stats_latency( const fstream_stats_t *stats,
+                                const uint32_t percent )
+{
+    uint64_t total;
+    uint64_t wanted;
+    uint64_t count;
+    uint32_t i;
+
+    if( (NULL == stats) || (0 == percent) || (100 < percent) ) {
+        return 0;
+    }
+
+    total = 0;
+    for( i = 0; i < FSTREAM_LATENCY_BUCKETS; i++ ) {
+        total += stats->latency_histogram[i];
+    }
+    if( 0 == total ) {
+        return 0;
+    }
+
+    /* The first bucket which gets the count up to the percentile. */
+    wanted = (total * percent + 99) / 100;
+    count = 0;
+    for( i = 0; i < (FSTREAM_LATENCY_BUCKETS - 1); i++ ) {
+        count += stats->latency_histogram[i];
+        if( wanted <= count ) {
+            return MIN( (uint32_t) FSTREAM_LATENCY_BASE_US << i, stats->latency_max_us );
+        }
+    }
+
+    return stats->latency_max_us;
+}
+
+/** Details in file-stream.h */
+void fstream_log_stats( fstream_t *fs, const char *name )
+{
+    fstream_stats_t stats;
+    char line[200];
+    int length;
+    uint32_t average;
+    uint32_t i;
+
+    if( (NULL == fs) || (NULL == name) ) {
+        return;
+    }
+
+    fstream_get_stats( fs, &stats );
+
+    average = 0;
+    if( 0 < stats.level_samples ) {
+        average = (uint32_t) (stats.level_total / stats.level_samples);
+    } else {
+        stats.level_min = 0;
+    }
+
+    /* One write, so the line isn't split up in the log. */
+    length = snprintf( line, sizeof(line), "%s stream: buffered min %lu avg %lu [",
+                       name, (unsigned long) stats.level_min,
+                       (unsigned long) average );
+    for( i = 0; i < FSTREAM_LEVEL_BUCKETS; i++ ) {
+        if( length < (int) sizeof(line) ) {
+            length += snprintf( &line[length], sizeof(line) - length,
+                                (0 == i) ? "%lu" : " %lu",
+                                (unsigned long) stats.level_histogram[i] );
+        }
+    }
+    if( length < (int) sizeof(line) ) {
+        snprintf( &line[length], sizeof(line) - length,
+                  "], blocked %lu for %lu ms (max %lu us), "
+                  "%lu reads p50 %lu p90 %lu p99 %lu max %lu us\n",
+                  (unsigned long) stats.blocked,
+                  (unsigned long) (stats.blocked_us / 1000),
+                  (unsigned long) stats.blocked_max_us,
+                  (unsigned long) stats.read_calls,
+                  (unsigned long) fstream_stats_latency(&stats, 50),
+                  (unsigned long) fstream_stats_latency(&stats, 90),
+                  (unsigned long) fstream_stats_latency(&stats, 99),
+                  (unsigned long) stats.latency_max_us );
+    }
+
+    fputs( line, stderr );
 }
 
 /*----------------------------------------------------------------------------*/
@@ -323,103 +823,620 @@ uint32_t fstream_get_filesize( void )
 
 void __task( void *params )
 {
+    fstream_t *fs;
+
+    fs = (fstream_t *) params;
+
     while( 1 ) {
         fstream_command_t *cmd;
+        char *next;
+        int fd;
 
         _D2( "Waiting on command\n" );
-        os_queue_receive( __command_active, &cmd, WAIT_FOREVER );
+        os_queue_receive( fs->command_active, &cmd, WAIT_FOREVER );
 
+        next = NULL;
         if( FSTS__STREAMING == cmd->cmd ) {
             char *filename;
-            int fd;
+            uint32_t size;
+            bool opened;
 
             filename = cmd->name;
             cmd->name = NULL;
 
             _D2( "Told to stream: '%s'\n", filename );
-            fd = open( filename, O_RDONLY );
-            if( -1 == fd ) {
-                _D2( "Failed to open file\n" );
+            opened = __open_file( fs, filename, cmd->offset, &fd, &size,
+                                  &cmd->file );
+            (*__free_fn)( filename );
+            filename = NULL;
+
+            if( false == opened ) {
                 /* Send the failure ack back. */
                 cmd->cmd = FSTS__IDLE;
-                os_queue_send_to_back( __command_idle, &cmd, NO_WAIT );
-            } else {
-                struct stat st;
-
-                _D2( "Opened file\n" );
-                if( 0 != fstat(fd, &st) ) {
-                    _D2( "Failed to fstat file\n" );
-                    /* Send the failure ack back. */
-                    cmd->cmd = FSTS__IDLE;
-                    os_queue_send_to_back( __command_idle, &cmd, NO_WAIT );
-                } else {
-                    uint32_t bytes_left;
-
-                    bytes_left = (uint32_t) st.st_size;
-
-                    _D2( "Got filesize: %ld\n", bytes_left );
-
-                    __big_buffer.valid_bytes = 0;
-                    __state = FSTS__STREAMING;
-
-                    /* Send the success ack back. */
-                    cmd->cmd = FSTS__STREAMING;
-                    os_queue_send_to_back( __command_idle, &cmd, NO_WAIT );
-                    cmd = NULL;
-
-                    _D2( "Streaming\n" );
-                    /* read the file */
-                    while( 0 < bytes_left ) {
-                        if( true == os_queue_receive(__command_active, &cmd, NO_WAIT) ) {
-                            /* we're done with this file, stop reading */
-                            bytes_left = 0;
-                            _D2( "Told to Stop\n" );
-                        } else {
-                            size_t requested;
-                            ssize_t bytes_read;
-                            fstream_buffer_t *node;
-
-                            os_queue_receive( __data_idle, &node, WAIT_FOREVER );
-
-                            requested = MIN( FSTREAM_SMALL_BUFFER_SIZE, bytes_left );
-                            bytes_read = read( fd, node->buffer, requested );
-                            if( -1 == bytes_read ) {
-                                bytes_left = 0;
-                            } else {
-                                if( bytes_read == requested ) {
-                                    node->valid_bytes = bytes_read;
-                                    bytes_left -= bytes_read;
-                                    node->last = (0 == bytes_left) ? true : false;
-                                    os_queue_send_to_back( __data_active, &node, NO_WAIT );
-                                } else {
-                                    bytes_left = 0;
-                                }
-                            }
-                        }
-                    }
-
-                    __state = FSTS__IDLE;
-                    close( fd );
-                    fd = -1;
-
-                    if( NULL == cmd ) {
-                        _D2( "End of the song\n" );
-                    } else {
-                        /* We were told to stop, ack. */
-                        cmd->cmd = FSTS__IDLE;
-                        os_queue_send_to_back( __command_idle, &cmd, NO_WAIT );
-                        _D2( "Stopping on command\n" );
-                    }
-                }
+                os_queue_send_to_back( fs->command_idle, &cmd, NO_WAIT );
+                continue;
             }
 
-            (*__free_fn)( filename );
-            filename = NULL;
+            /* Send the success ack back. */
+            cmd->size = size;
+            os_queue_send_to_back( fs->command_idle, &cmd, NO_WAIT );
+
+            cmd = __stream_file( fs, fd, size, cmd->offset, &next );
+        } else if( FSTS__PREFETCH == cmd->cmd ) {
+            /* The file before it has been read already. */
+            _D2( "Told to prefetch: '%s'\n", cmd->name );
+            next = cmd->name;
+            cmd = NULL;
+        }
+
+        /* Each queued file is read after the one before it, into the
+         * nodes that follow it. */
+        while( (NULL == cmd) && (NULL != next) ) {
+            fstream_prefetch_t result;
+
+            result.opened = __open_file( fs, next, 0, &fd, &result.size,
+                                         &result.file );
+            next = NULL;
+            os_queue_send_to_back( fs->prefetched, &result, NO_WAIT );
+
+            if( true == result.opened ) {
+                cmd = __stream_file( fs, fd, result.size, 0, &next );
+            }
+        }
+
+        if( NULL == cmd ) {
+            _D2( "End of the song\n" );
         } else {
-            /* We are idle. */
-            _D2( "Idle Ack\n" );
+            /* We were told to stop or we are idle, ack. */
             cmd->cmd = FSTS__IDLE;
-            os_queue_send_to_back( __command_idle, &cmd, NO_WAIT );
+            os_queue_send_to_back( fs->command_idle, &cmd, NO_WAIT );
+            _D2( "Stopping on command\n" );
+        }
+    }
+}
+
+/**
+ *  Opens a file for the task to read.
+ *
+ *  @param filename the name of the file to open
+ *  @param offset the offset in the file to start reading at
+ *  @param fd the file descriptor of the open file
+ *  @param size the size of the file in bytes
+ *  @param file set to the number the file is known by while it is read
+ *
+ *  @return true on success, false otherwise
+ */
+static bool __open_file( fstream_t *fs, const char *filename,
+                         const uint32_t offset, int *fd, uint32_t *size,
+                         uint32_t *file )
+{
+    struct stat st;
+    bool seeked;
+
+    __take_card( fs->priority );
+    *fd = open( filename, O_RDONLY );
+    __give_card();
+    if( -1 == *fd ) {
+        _D2( "Failed to open file\n" );
+        return false;
+    }
+
+    if( 0 != fstat(*fd, &st) ) {
+        _D2( "Failed to fstat file\n" );
+        close( *fd );
+        *fd = -1;
+        return false;
+    }
+
+    *size = (uint32_t) st.st_size;
+    _D2( "Got filesize: %ld\n", *size );
+
+    /* Following the cluster chain to the offset reads the FAT. */
+    seeked = (0 == offset) ? true : false;
+    if( (false == seeked) && (offset <= *size) ) {
+        __take_card( fs->priority );
+        seeked = ((off_t) offset == lseek(*fd, offset, SEEK_SET)) ? true : false;
+        __give_card();
+    }
+    if( false == seeked ) {
+        _D2( "Failed to seek to %ld\n", offset );
+        close( *fd );
+        *fd = -1;
+        return false;
+    }
+
+    fs->align_nodes = st.st_blksize / FSTREAM_SMALL_BUFFER_SIZE;
+    if( (0 == fs->align_nodes) || (FSTREAM_MAX_READ_NODES < fs->align_nodes) ) {
+        fs->align_nodes = FSTREAM_MAX_READ_NODES;
+    }
+    fs->read_units = 1;
+
+    /* Before the ack, so the reader of the stream waits for the data. */
+    fs->state = FSTS__STREAMING;
+
+    os_mutex_take( fs->seek_lock, WAIT_FOREVER );
+    fs->files_opened++;
+    if( 0 == fs->files_opened ) {
+        fs->files_opened++;
+    }
+    fs->reading = fs->files_opened;
+    *file = fs->reading;
+    os_mutex_give( fs->seek_lock );
+
+    return true;
+}
+
+/**
+ *  Reads an open file into the nodes until it ends or the task is told to
+ *  stop, & closes it.  A file queued meanwhile is passed back to be read
+ *  next.  The reader of the stream can seek until the file has ended.
+ *
+ *  @param fd the file to read
+ *  @param size the size of the file in bytes
+ *  @param offset the offset in the file the reading starts at
+ *  @param next set to the name of the file queued to be read next
+ *
+ *  @return the command which stopped the reading, NULL at the end of
+ *          the file
+ */
+static fstream_command_t* __stream_file( fstream_t *fs, int fd,
+                                         const uint32_t size,
+                                         const uint32_t offset, char **next )
+{
+    fstream_command_t *cmd;
+    uint32_t bytes_left;
+    uint32_t epoch;
+
+    _D2( "Streaming\n" );
+    /* read the file - even an empty one gets a last node, so the reader
+     * never waits for data that won't come */
+    cmd = NULL;
+    bytes_left = size - offset;
+    while( 1 ) {
+        fstream_command_t *c;
+        bool ended;
+
+        if( true == os_queue_receive(fs->command_active, &c, NO_WAIT) ) {
+            if( FSTS__PREFETCH == c->cmd ) {
+                *next = c->name;
+            } else {
+                /* we're done with this file, stop reading */
+                _D2( "Told to Stop\n" );
+                cmd = c;
+                break;
+            }
+        }
+
+        __seek_file( fs, fd, size, &epoch, &bytes_left );
+        bytes_left = __read_nodes( fs, fd, size - bytes_left, bytes_left, epoch );
+
+        if( 0 == bytes_left ) {
+            /* The file only ends if there is no seek to do. */
+            os_mutex_take( fs->seek_lock, WAIT_FOREVER );
+            ended = (false == fs->seek_pending) ? true : false;
+            if( true == ended ) {
+                fs->reading = 0;
+            }
+            os_mutex_give( fs->seek_lock );
+
+            if( true == ended ) {
+                break;
+            }
+        }
+    }
+
+    if( NULL != cmd ) {
+        os_mutex_take( fs->seek_lock, WAIT_FOREVER );
+        fs->reading = 0;
+        fs->seek_pending = false;
+        os_mutex_give( fs->seek_lock );
+    }
+
+    __set_urgent( fs, false );
+    fs->state = FSTS__IDLE;
+    close( fd );
+
+    return cmd;
+}
+
+/**
+ *  Moves the read position of the file if the reader of the stream has
+ *  asked for a seek since the last read.
+ *
+ *  @param fd the file being read
+ *  @param size the size of the file in bytes
+ *  @param epoch set to the epoch to stamp the nodes read next with
+ *  @param bytes_left the number of bytes left in the file, updated to
+ *         those after the new read position
+ */
+static void __seek_file( fstream_t *fs, int fd, const uint32_t size,
+                         uint32_t *epoch, uint32_t *bytes_left )
+{
+    uint32_t offset;
+    bool pending;
+
+    os_mutex_take( fs->seek_lock, WAIT_FOREVER );
+    *epoch = fs->epoch;
+    pending = fs->seek_pending;
+    offset = fs->seek_offset;
+    fs->seek_pending = false;
+    os_mutex_give( fs->seek_lock );
+
+    if( true == pending ) {
+        _D2( "Seeking to %ld\n", offset );
+        __take_card( fs->priority );
+        if( (off_t) offset == lseek(fd, offset, SEEK_SET) ) {
+            *bytes_left = size - offset;
+        } else {
+            *bytes_left = 0;
+        }
+        __give_card();
+    }
+}
+
+/**
+ *  Reads the next part of the file straight into as many contiguous idle
+ *  nodes as the read size allows, with a single read(), & passes them on
+ *  stamped with the epoch of the read.
+ *
+ *  While the reader of the stream is draining the buffer the reads grow,
+ *  while it is well behind they shrink back to a cluster.  A read which
+ *  isn't urgent waits for all of its nodes to be released, so it doesn't
+ *  turn into a read of the one node that just came back.  A background
+ *  stream always reads a cluster, so a playback stream never waits long
+ *  for the card.
+ *
+ *  @param fd the file to read
+ *  @param offset the offset in the file to read from
+ *  @param bytes_left the number of bytes left in the file
+ *  @param epoch the epoch of the read
+ *
+ *  @return the number of bytes left in the file after the read
+ */
+static uint32_t __read_nodes( fstream_t *fs, int fd, uint32_t offset,
+                              uint32_t bytes_left, const uint32_t epoch )
+{
+    fstream_buffer_t **nodes = fs->read_nodes;
+    uint32_t buffered;
+    uint32_t wanted;
+    uint32_t count;
+    uint32_t wait;
+    uint32_t start;
+    uint32_t i;
+    size_t requested;
+    ssize_t bytes_read;
+
+    buffered = os_queue_get_queued_messages_waiting( fs->data_active );
+    __set_urgent( fs, (buffered < FSTREAM_LOW_WATER_NODES) ? true : false );
+    if( buffered < FSTREAM_LOW_WATER_NODES ) {
+        if(    (FSTREAM_PRIORITY__PLAYBACK == fs->priority)
+            && (fs->read_units * fs->align_nodes < FSTREAM_MAX_READ_NODES) )
+        {
+            fs->read_units *= 2;
+        }
+        wait = NO_WAIT;
+    } else {
+        if( (FSTREAM_HIGH_WATER_NODES < buffered) && (1 < fs->read_units) ) {
+            fs->read_units /= 2;
+        }
+        wait = WAIT_FOREVER;
+    }
+
+    /* Up to the next aligned offset, & then whole units. */
+    wanted = fs->read_units * fs->align_nodes
+           - (offset / FSTREAM_SMALL_BUFFER_SIZE) % fs->align_nodes;
+    wanted = MIN( wanted, FSTREAM_MAX_READ_NODES );
+    wanted = MIN( wanted, (bytes_left + FSTREAM_SMALL_BUFFER_SIZE - 1)
+                                / FSTREAM_SMALL_BUFFER_SIZE );
+
+    /* An empty file still gets its last node. */
+    os_queue_receive( fs->data_idle, &nodes[0], WAIT_FOREVER );
+
+    /* The idle nodes come back in ring order, so they are contiguous up
+     * to the end of the ring.  Waiting for them can't stall the reader of
+     * the stream, which holds at most FSTREAM_BIG_BUFFER_SIZE of them. */
+    wanted = MIN( wanted, FSTREAM_NODE_COUNT - (uint32_t) (nodes[0] - fs->nodes) );
+    for( count = 1; count < wanted; count++ ) {
+        if( false == os_queue_receive(fs->data_idle, &nodes[count], wait) ) {
+            break;
+        }
+    }
+
+    requested = MIN( count * FSTREAM_SMALL_BUFFER_SIZE, bytes_left );
+    __take_card( fs->priority );
+    start = __now_us();
+    bytes_read = read( fd, nodes[0]->buffer, requested );
+    __record_latency( fs, __now_us() - start );
+    __give_card();
+    fs->stats.read_calls++;
+
+    if( bytes_read == requested ) {
+        bytes_left -= bytes_read;
+    } else {
+        /* The nodes still go out so they stay in ring order - the data
+         * that was read just ends the file. */
+        bytes_read = (0 < bytes_read) ? bytes_read : 0;
+        bytes_left = 0;
+    }
+    fs->stats.bytes_read += bytes_read;
+
+    for( i = 0; i < count; i++ ) {
+        nodes[i]->valid_bytes = MIN( FSTREAM_SMALL_BUFFER_SIZE, (size_t) bytes_read );
+        bytes_read -= nodes[i]->valid_bytes;
+        nodes[i]->last = ((0 == bytes_left) && ((count - 1) == i)) ? true : false;
+        nodes[i]->epoch = epoch;
+        os_queue_send_to_back( fs->data_active, &nodes[i], NO_WAIT );
+    }
+
+    return bytes_left;
+}
+
+/**
+ *  Closes the open file.  If the task has read all of it & a file is
+ *  queued, the task is left reading that one.
+ */
+static void __close( fstream_t *fs )
+{
+    bool read_all;
+
+    read_all = (false == fs->is_open) || (true == fs->window.last);
+
+    /* The nodes held here are older than the ones in fs->data_active, so
+     * they go back first to keep the nodes in ring order. */
+    __return_held_nodes( fs );
+    fs->filesize = 0;
+    fs->is_open = false;
+
+    if( NULL != fs->name ) {
+        (*__free_fn)( fs->name );
+        fs->name = NULL;
+    }
+
+    if( (NULL == fs->queued) || (false == read_all) ) {
+        __stop( fs );
+    }
+}
+
+/**
+ *  Stops the task & throws away all of the data it has read, including
+ *  that of a queued file.
+ */
+static void __stop( fstream_t *fs )
+{
+    fstream_command_t *cmd;
+    fstream_buffer_t *node;
+    fstream_prefetch_t result;
+
+    os_queue_receive( fs->command_idle, &cmd, WAIT_FOREVER );
+    cmd->cmd = FSTS__IDLE;
+    cmd->name = NULL;
+    os_queue_send_to_back( fs->command_active, &cmd, NO_WAIT );
+
+    /* Clear out any active data so we unblock the thread. */
+    while( true == os_queue_receive(fs->data_active, &node, NO_WAIT) ) {
+        os_queue_send_to_back( fs->data_idle, &node, NO_WAIT );
+    }
+
+    /* Wait for it to shut down. */
+    os_queue_peek( fs->command_idle, &cmd, WAIT_FOREVER );
+
+    /* Clear out any active data. */
+    while( true == os_queue_receive(fs->data_active, &node, NO_WAIT) ) {
+        os_queue_send_to_back( fs->data_idle, &node, NO_WAIT );
+    }
+
+    /* The task has seen the queued file before the stop, so it is done
+     * with the name. */
+    os_queue_receive( fs->prefetched, &result, NO_WAIT );
+    if( NULL != fs->queued ) {
+        (*__free_fn)( fs->queued );
+        fs->queued = NULL;
+    }
+}
+
+/**
+ *  Has the task open the file called fs->name, & start reading it at the
+ *  offset.  The task must be idle.
+ *
+ *  @param offset the offset in the file to start reading at
+ *
+ *  @return true on success, false otherwise
+ */
+static bool __reopen( fstream_t *fs, const uint32_t offset )
+{
+    fstream_command_t *cmd;
+    char *name;
+
+    /* The task frees its copy of the name once it has opened the file. */
+    name = (char *) (*__malloc_fn)( strlen(fs->name) + 1 );
+    if( NULL == name ) {
+        return false;
+    }
+    strcpy( name, fs->name );
+
+    os_queue_receive( fs->command_idle, &cmd, WAIT_FOREVER );
+    cmd->name = name;
+    cmd->offset = offset;
+    cmd->cmd = FSTS__STREAMING;
+
+    os_queue_send_to_back( fs->command_active, &cmd, NO_WAIT );
+
+    /* Wait for the command to be processed. */
+    os_queue_peek( fs->command_idle, &cmd, WAIT_FOREVER );
+
+    if( FSTS__STREAMING == cmd->cmd ) {
+        fs->file = cmd->file;
+        fs->filesize = cmd->size;
+        fs->position = offset;
+        fs->is_open = true;
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ *  Queues a file to be read after the one being read.  The name is shared
+ *  with the task, which is done with it once it has opened the file.
+ *
+ *  @param name the name of the file, freed by the reader of the stream
+ */
+static void __queue( fstream_t *fs, char *name )
+{
+    fstream_command_t *cmd;
+
+    fs->queued = name;
+
+    /* There is no ack - the task gets to it after the current file. */
+    cmd = &fs->prefetch_command;
+    cmd->name = name;
+    cmd->cmd = FSTS__PREFETCH;
+    os_queue_send_to_back( fs->command_active, &cmd, NO_WAIT );
+}
+
+/**
+ *  Waits for the card.  A playback reader gets it as soon as the read
+ *  using it is done, a background reader only once no playback reader is
+ *  waiting for it.
+ *
+ *  @param priority the priority of the reader
+ */
+static void __take_card( const fstream_priority_t priority )
+{
+    if( FSTREAM_PRIORITY__PLAYBACK == priority ) {
+        os_mutex_take( __card_lock, WAIT_FOREVER );
+        __playback_needs++;
+        os_mutex_give( __card_lock );
+
+        os_mutex_take( __card, WAIT_FOREVER );
+
+        os_mutex_take( __card_lock, WAIT_FOREVER );
+        __playback_needs--;
+        __playback_done();
+        os_mutex_give( __card_lock );
+    } else {
+        os_mutex_take( __card, WAIT_FOREVER );
+        while( 0 < __playback_needs ) {
+            os_mutex_give( __card );
+            os_semaphore_take( __card_free, WAIT_FOREVER );
+
+            /* Only one waiter is woken, so it passes the wake up on to
+             * any other background reader while the card is still free. */
+            if( 0 == __playback_needs ) {
+                os_semaphore_give( __card_free );
+            }
+            os_mutex_take( __card, WAIT_FOREVER );
+        }
+    }
+}
+
+static void __give_card( void )
+{
+    os_mutex_give( __card );
+}
+
+/**
+ *  Keeps the background streams off the card while a playback stream is
+ *  below its low water mark, so it gets every read it asks for until it
+ *  has caught up.
+ *
+ *  @param urgent true if the stream is below its low water mark
+ */
+static void __set_urgent( fstream_t *fs, const bool urgent )
+{
+    if( (FSTREAM_PRIORITY__PLAYBACK == fs->priority) && (urgent != fs->urgent) ) {
+        os_mutex_take( __card_lock, WAIT_FOREVER );
+        fs->urgent = urgent;
+        if( true == urgent ) {
+            __playback_needs++;
+        } else {
+            __playback_needs--;
+            __playback_done();
         }
+        os_mutex_give( __card_lock );
+    }
+}
+
+/* Wakes the background readers once the playback readers are done with
+ * the card.  Called with __card_lock held. */
+static void __playback_done( void )
+{
+    if( 0 == __playback_needs ) {
+        os_semaphore_give( __card_free );
+    }
+}
+
+/* The bytes read ahead of the reader of the stream. */
+static size_t __buffered( fstream_t *fs )
+{
+    return fs->window.valid + FSTREAM_SMALL_BUFFER_SIZE
+                * os_queue_get_queued_messages_waiting( fs->data_active );
+}
+
+static uint32_t __now_us( void )
+{
+    struct timeval tv;
+    struct timezone tz;
+
+    gettimeofday( &tv, &tz );
+    return (uint32_t) tv.tv_sec * 1000000 + (uint32_t) tv.tv_usec;
+}
+
+static void __record_level( fstream_t *fs, const size_t level )
+{
+    uint32_t bucket;
+
+    bucket = level * FSTREAM_LEVEL_BUCKETS / FSTREAM_TOTAL_BUFFER_SIZE;
+    bucket = MIN( bucket, FSTREAM_LEVEL_BUCKETS - 1 );
+
+    fs->stats.level_histogram[bucket]++;
+    fs->stats.level_samples++;
+    fs->stats.level_total += level;
+    if( level < fs->stats.level_min ) {
+        fs->stats.level_min = level;
+    }
+}
+
+static void __record_latency( fstream_t *fs, const uint32_t us )
+{
+    uint32_t bucket;
+
+    bucket = 0;
+    while( (bucket < (FSTREAM_LATENCY_BUCKETS - 1)) &&
+           (((uint32_t) FSTREAM_LATENCY_BASE_US << bucket) <= us) )
+    {
+        bucket++;
+    }
+
+    fs->stats.latency_histogram[bucket]++;
+    if( fs->stats.latency_max_us < us ) {
+        fs->stats.latency_max_us = us;
+    }
+}
+
+/* Gives the node the window starts in back to the reader task. */
+static void __return_first_node( fstream_t *fs )
+{
+    fstream_buffer_t *node;
+    uint32_t index;
+
+    index = fs->window.read / FSTREAM_SMALL_BUFFER_SIZE;
+    node = &fs->nodes[index];
+    os_queue_send_to_back( fs->data_idle, &node, NO_WAIT );
+    fs->window.held--;
+
+    index++;
+    if( FSTREAM_NODE_COUNT == index ) {
+        index = 0;
+        fs->window.mirrored = 0;
+    }
+    fs->window.read = index * FSTREAM_SMALL_BUFFER_SIZE;
+}
+
+static void __return_held_nodes( fstream_t *fs )
+{
+    while( 0 < fs->window.held ) {
+        __return_first_node( fs );
     }
+    memset( &fs->window, 0, sizeof(fstream_window_t) );
 }
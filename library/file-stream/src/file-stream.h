@@ -21,73 +21,261 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
+#include <sys/types.h>
 
 typedef void *(*fstream_malloc_fct)( size_t size );
 typedef void (*fstream_free_fct)( void *ptr );
 
+/* A stream, from fstream_create(). */
+typedef struct fstream fstream_t;
+
+/* Playback streams always get the card first, background streams (the
+ * database scan, prefetching) get it while playback doesn't need it. */
+typedef enum {
+    FSTREAM_PRIORITY__PLAYBACK,
+    FSTREAM_PRIORITY__BACKGROUND
+} fstream_priority_t;
+
+/* The buffer level histogram is in eighths of the buffer.  Read latency
+ * bucket n counts the reads which took less than FSTREAM_LATENCY_BASE_US
+ * << n, the last bucket counts the rest. */
+#define FSTREAM_LEVEL_BUCKETS       8
+#define FSTREAM_LATENCY_BUCKETS     12
+#define FSTREAM_LATENCY_BASE_US     250
+
+typedef struct {
+    uint64_t bytes_released;    /* Bytes consumed by the reader */
+    uint64_t bytes_copied;      /* Bytes copied to hand them out contiguously */
+    uint64_t bytes_read;        /* Bytes read from the files */
+    uint32_t read_calls;        /* Calls to read() it took */
+
+    /* The bytes buffered ahead of the reader each time it gets a buffer
+     * while a file is open - level_total / level_samples is the average. */
+    uint32_t level_samples;
+    uint32_t level_min;
+    uint64_t level_total;
+    uint32_t level_histogram[FSTREAM_LEVEL_BUCKETS];
+
+    /* fstream_get_buffer() calls which waited for the task to read. */
+    uint32_t blocked;
+    uint64_t blocked_us;
+    uint32_t blocked_max_us;
+
+    /* How long each read() took. */
+    uint32_t latency_histogram[FSTREAM_LATENCY_BUCKETS];
+    uint32_t latency_max_us;
+} fstream_stats_t;
+
 /**
  *  Starts the file-stream 'server'.
  *
- *  @param max_big_buffer_size the size of the largest buffer returned in bytes
- *  @param small_buffer_size the size in bytes of the individual small storage
- *                           buffers to keep around
- *  @param small_buffer_count the maximum number of small buffers to keep around
+ *  @param priority the priority of the stream tasks
+ *  @param malloc_fn the function used to allocate memory
+ *  @param free_fn the function used to free memory
+ *
+ *  @return true on success, false otherwise
  */
 bool fstream_init( const uint32_t priority,
                    fstream_malloc_fct malloc_fn,
                    fstream_free_fct free_fn );
 
+/**
+ *  Creates a stream with its own task & buffers.  Each stream streams one
+ *  file at a time, the streams share the card by priority.
+ *
+ *  @param priority the priority the stream reads the card at
+ *
+ *  @return the stream on success, NULL otherwise
+ */
+fstream_t* fstream_create( const fstream_priority_t priority );
+
 /**
  *  Takes an open file handle and starts buffering & streaming
- *  from the beginning of the file.
+ *  from the beginning of the file.  If the file is the one queued with
+ *  fstream_queue_next() & the current file has been read to the end, the
+ *  data that has already been buffered is used.
  *
+ *  @param fs the stream
  *  @param filename the name of the file to stream
  *
  *  @return true on success, false otherwise
  */
-bool fstream_open( const char *filename );
+bool fstream_open( fstream_t *fs, const char *filename );
 
 /**
- *  Used to get the next block of bytes from a file.
+ *  Queues the file to be opened & buffered as soon as the current file
+ *  has been read, so opening it next starts with a full buffer.  The
+ *  queued file is thrown away if a different file is opened, or if the
+ *  current file is closed before it has been read to the end.
  *
- *  @param wanted the number of bytes desired
+ *  This may be called from a different task than the rest of the API.
+ *
+ *  @param fs the stream
+ *  @param filename the name of the file to stream next
+ *
+ *  @return true on success, false if a file is already queued or on error
+ */
+bool fstream_queue_next( fstream_t *fs, const char *filename );
+
+/**
+ *  Used to get the next block of bytes from a file.  The pointer is into
+ *  the stream's own buffer & is valid until fstream_release_buffer() is
+ *  called.  The bytes are only copied when the block wraps around the
+ *  end of the buffer.
+ *
+ *  @param fs the stream
+ *  @param wanted the number of bytes desired, at most 32k
  *  @param got the number of bytes that are returned - it should be
  *         different only at the end of the file
  *
  *  @return the pointer to the buffer, or NULL on error or if no file
  *          is open
  */
-void* fstream_get_buffer( const size_t wanted, size_t *got );
+void* fstream_get_buffer( fstream_t *fs, const size_t wanted, size_t *got );
 
 /**
  *  Releases the active buffer & return any remaining data back to
  *  the file stream server for later retrieval.
  *
+ *  @param fs the stream
  *  @param consumed the number of bytes out of the buffer that were consumed
  */
-void fstream_release_buffer( const size_t consumed );
+void fstream_release_buffer( fstream_t *fs, const size_t consumed );
 
 /**
- *  Skips a defined number of bytes from the file stream.
+ *  Skips a defined number of bytes from the file stream.  More than has
+ *  been read already is skipped with a seek rather than by reading it.
  *
+ *  @param fs the stream
  *  @param skip the number of bytes to skip
  */
-void fstream_skip( const size_t skip );
+void fstream_skip( fstream_t *fs, const size_t skip );
+
+/**
+ *  Moves the stream to an offset in the open file.  Any buffer that has
+ *  been gotten is released.  Data already read is used where it can be,
+ *  otherwise the data read ahead is thrown away & the reading starts
+ *  again at the offset.  A file queued after the open file stays queued.
+ *
+ *  @param fs the stream
+ *  @param offset the offset from the start of the file, up to the size
+ *                of the file
+ *
+ *  @return true on success, false otherwise - the file is closed if it
+ *          couldn't be read at the offset
+ */
+bool fstream_seek( fstream_t *fs, const uint32_t offset );
+
+/**
+ *  Gets the offset in the open file of the next byte of the stream.
+ *
+ *  @param fs the stream
+ *
+ *  @return the offset from the start of the file
+ */
+uint32_t fstream_tell( fstream_t *fs );
 
 /**
  *  Closes & discards any remaining file data.
+ *
+ *  @param fs the stream
  */
-void fstream_close( void );
+void fstream_close( fstream_t *fs );
 
 /**
  *  Destroys the stream server.
  */
 void fstream_destroy( void );
 
+/**
+ *  Waits for the card for a reader that goes around the streams & needs
+ *  several calls on the card together, otherwise fstream_card_open() & the
+ *  calls that go with it take the card for a call at a time.  It gets the
+ *  card as a stream of the same priority would, & holds it until it calls
+ *  fstream_card_give().
+ *
+ *  @param priority the priority to wait for the card at
+ */
+void fstream_card_take( const fstream_priority_t priority );
+
+/**
+ *  Gives back the card taken with fstream_card_take().
+ */
+void fstream_card_give( void );
+
+/**
+ *  Used by a reader that goes around the streams, such as a codec reading
+ *  the tags for the database scan, in place of open().  The card is taken
+ *  at FSTREAM_PRIORITY__BACKGROUND for the call only, so playback gets it
+ *  between the calls that read a tag.
+ *
+ *  @param filename the file to open read only
+ *
+ *  @return as open()
+ */
+int fstream_card_open( const char *filename );
+
+/**
+ *  Used in place of read() on a file from fstream_card_open(), with the
+ *  card taken for the read only.
+ *
+ *  @return as read()
+ */
+ssize_t fstream_card_read( int fd, void *buf, size_t count );
+
+/**
+ *  Used in place of lseek() on a file from fstream_card_open(), with the
+ *  card taken for the seek only.
+ *
+ *  @return as lseek()
+ */
+off_t fstream_card_lseek( int fd, off_t offset, int whence );
+
+/**
+ *  Used in place of close() on a file from fstream_card_open().
+ *
+ *  @return as close()
+ */
+int fstream_card_close( int fd );
+
 /**
  *  Used to get the size of the currently open file in bytes.
  *
+ *  @param fs the stream
+ *
  *  @return the size of the file in bytes
  */
-uint32_t fstream_get_filesize( void );
+uint32_t fstream_get_filesize( fstream_t *fs );
+
+/**
+ *  Used to get the number of bytes handed out, copied & read, the number
+ *  of read() calls, the buffer level, the time spent waiting for data &
+ *  the read latency, since fstream_create().
+ *
+ *  @param fs the stream
+ *  @param stats the structure to fill in
+ */
+void fstream_get_stats( fstream_t *fs, fstream_stats_t *stats );
+
+/**
+ *  Used to get a percentile of the read latency from the stats.  The
+ *  latency is only known to the bucket it falls in, so this is the upper
+ *  bound of the bucket, or the slowest read for the last bucket.
+ *
+ *  @param stats the stats from fstream_get_stats()
+ *  @param percent the percentile, from 1 to 100
+ *
+ *  @return the latency in microseconds, 0 if there have been no reads
+ */
+uint32_t fstream_stats_latency( const fstream_stats_t *stats,
+                                const uint32_t percent );
+
+/**
+ *  Writes the stats of the stream to stderr, & so to the system log, as a
+ *  single line.
+ *
+ *  @param fs the stream
+ *  @param name the name to log the stream as
+ */
+void fstream_log_stats( fstream_t *fs, const char *name );
 #endif
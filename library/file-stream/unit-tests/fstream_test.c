@@ -0,0 +1,851 @@
+#include <CUnit/Basic.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <freertos/os-mock.h>
+#include "file-stream.h"
+
+#define TEST_DIR            "./fstream-data"
+#define MAX_WANTED          (32*1024)
+#define FRAME_WANTED        (16*1024)   /* Roughly a FLAC max_framesize */
+#define MIN_FRAME           2000
+#define MAX_FRAME           6000
+#define FRAME_DECODE_US     200     /* Slower than the host reads a frame */
+#define MB                  (1024.0 * 1024.0)
+#define OPEN_LATENCY_US     5000    /* Finding a file on the card */
+#define READ_LATENCY_US     1000    /* A card command & the transfer */
+#define TRACK_CHANGES       5
+#define PLAY_FRAME_US       2000    /* Still 10x faster than real time */
+#define SEEKS               200
+#define CLUSTER_SIZE        4096    /* st_blksize on the host */
+
+#define MIN(a,b)    (((a) < (b)) ? (a) : (b))
+
+typedef struct {
+    const char *name;
+    size_t size;
+    uint8_t *data;
+} test_file_t;
+
+/* From nothing, through the node & ring sizes, to several trips around
+ * the ring. */
+static test_file_t files[] = {
+    { TEST_DIR "/EMPTY.BIN",   0,       NULL },
+    { TEST_DIR "/BYTE.BIN",    1,       NULL },
+    { TEST_DIR "/NODE.BIN",    512,     NULL },
+    { TEST_DIR "/ODD.BIN",     100003,  NULL },
+    { TEST_DIR "/RING.BIN",    131072,  NULL },
+    { TEST_DIR "/TRACK.BIN",   1500000, NULL },
+};
+
+#define FILE_COUNT  (sizeof(files) / sizeof(test_file_t))
+
+static uint32_t random_state = 0x1234567;
+
+/* The playback stream most tests use, & a background one reading at the
+ * same time. */
+static fstream_t *stream;
+static fstream_t *background;
+static volatile bool background_stop;
+static uint64_t background_bytes;
+
+/* The tag reads each scanner has made around the streams. */
+#define SCANNERS    2
+static volatile uint32_t scanner_reads[SCANNERS];
+static int scanner_fds[SCANNERS];
+
+/* How long the reader of the stream has waited in fstream_get_buffer(). */
+static double waited_ms;
+
+/* The file-stream open() & read() calls are wrapped by the linker, so
+ * they can take as long as they do on a card. */
+static bool card_latency;
+
+int __real_open( const char *pathname, int flags, ... );
+ssize_t __real_read( int fd, void *buf, size_t count );
+
+int __wrap_open( const char *pathname, int flags, ... )
+{
+    if( true == card_latency ) {
+        usleep( OPEN_LATENCY_US );
+    }
+    return __real_open( pathname, flags );
+}
+
+ssize_t __wrap_read( int fd, void *buf, size_t count )
+{
+    if( true == card_latency ) {
+        usleep( READ_LATENCY_US );
+    }
+    return __real_read( fd, buf, count );
+}
+
+/* xorshift32, so every run streams the same way. */
+static uint32_t random_next( void )
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+static size_t random_range( size_t min, size_t max )
+{
+    return min + random_next() % (max - min + 1);
+}
+
+static bool create_files( void )
+{
+    uint32_t i;
+    size_t j;
+
+    mkdir( TEST_DIR, 0755 );
+    for( i = 0; i < FILE_COUNT; i++ ) {
+        FILE *f;
+
+        files[i].data = (uint8_t *) malloc( files[i].size + 1 );
+        if( NULL == files[i].data ) {
+            return false;
+        }
+        for( j = 0; j < files[i].size; j++ ) {
+            files[i].data[j] = (uint8_t) random_next();
+        }
+
+        f = fopen( files[i].name, "w" );
+        if( NULL == f ) {
+            return false;
+        }
+        fwrite( files[i].data, 1, files[i].size, f );
+        fclose( f );
+    }
+    return true;
+}
+
+static void remove_files( void )
+{
+    uint32_t i;
+
+    for( i = 0; i < FILE_COUNT; i++ ) {
+        unlink( files[i].name );
+        free( files[i].data );
+        files[i].data = NULL;
+    }
+    rmdir( TEST_DIR );
+}
+
+static double now_ms( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/* Reads the rest of the open file through the stream, checking every
+ * byte. */
+static size_t read_to_end( const test_file_t *file, size_t offset,
+                           size_t min_wanted, size_t max_wanted,
+                           size_t min_used, size_t max_used,
+                           useconds_t decode_us )
+{
+    while( 1 ) {
+        size_t wanted;
+        size_t used;
+        size_t got;
+        uint8_t *buffer;
+
+        double begin;
+
+        wanted = random_range( min_wanted, max_wanted );
+        begin = now_ms();
+        buffer = (uint8_t *) fstream_get_buffer( stream, wanted, &got );
+        waited_ms += now_ms() - begin;
+        CU_ASSERT_FATAL( NULL != buffer );
+        CU_ASSERT_FATAL( got <= wanted );
+        CU_ASSERT_FATAL( offset + got <= file->size );
+        if( 0 == got ) {
+            break;
+        }
+
+        /* Short only at the end of the file. */
+        if( got < wanted ) {
+            CU_ASSERT_FATAL( file->size == offset + got );
+        }
+        if( 0 != memcmp(buffer, &file->data[offset], got) ) {
+            CU_FAIL_FATAL( "The stream is different from the file" );
+        }
+
+        used = random_range( MIN(min_used, got), MIN(max_used, got) );
+        fstream_release_buffer( stream, used );
+        offset += used;
+
+        if( 0 < decode_us ) {
+            usleep( decode_us );
+        }
+    }
+
+    return offset;
+}
+
+/* Reads the whole file through the stream, checking every byte. */
+static size_t stream_file( const test_file_t *file, size_t min_wanted,
+                           size_t max_wanted, size_t min_used, size_t max_used,
+                           useconds_t decode_us )
+{
+    size_t offset;
+
+    CU_ASSERT_FATAL( true == fstream_open(stream, file->name) );
+    CU_ASSERT( file->size == fstream_get_filesize(stream) );
+
+    offset = read_to_end( file, 0, min_wanted, max_wanted, min_used,
+                          max_used, decode_us );
+
+    fstream_close( stream );
+    return offset;
+}
+
+/*----------------------------------------------------------------------------*/
+/*                                   Tests                                    */
+/*----------------------------------------------------------------------------*/
+void test_stream( void )
+{
+    uint32_t i;
+
+    for( i = 0; i < FILE_COUNT; i++ ) {
+        CU_ASSERT( files[i].size == stream_file(&files[i], 1, MAX_WANTED, 0, MAX_WANTED, 0) );
+        CU_ASSERT( files[i].size == stream_file(&files[i], 1, 700, 1, 700, 0) );
+    }
+}
+
+void test_skip( void )
+{
+    const test_file_t *file = &files[FILE_COUNT - 1];
+    size_t offset = 0;
+    size_t got;
+    uint8_t *buffer;
+
+    CU_ASSERT_FATAL( true == fstream_open(stream, file->name) );
+
+    /* Across nodes, across the ring & past what has been read. */
+    while( offset + 2 * MAX_WANTED < file->size ) {
+        size_t skip = random_range( 0, 2 * MAX_WANTED );
+
+        fstream_skip( stream, skip );
+        offset += skip;
+
+        buffer = (uint8_t *) fstream_get_buffer( stream, 100, &got );
+        CU_ASSERT_FATAL( 100 == got );
+        CU_ASSERT_FATAL( 0 == memcmp(buffer, &file->data[offset], got) );
+        fstream_release_buffer( stream, 10 );
+        offset += 10;
+    }
+
+    /* Skipping past the end leaves nothing. */
+    fstream_skip( stream, file->size );
+    buffer = (uint8_t *) fstream_get_buffer( stream, 100, &got );
+    CU_ASSERT( 0 == got );
+    fstream_close( stream );
+}
+
+void test_close_early( void )
+{
+    const test_file_t *file = &files[FILE_COUNT - 1];
+    uint32_t i;
+    size_t got;
+    uint8_t *buffer;
+
+    /* Closing with data held & data queued leaves the ring in order for
+     * the next file. */
+    for( i = 0; i < 20; i++ ) {
+        CU_ASSERT_FATAL( true == fstream_open(stream, file->name) );
+        fstream_skip( stream, random_range(0, file->size / 2) );
+        buffer = (uint8_t *) fstream_get_buffer( stream, random_range(1, MAX_WANTED), &got );
+        CU_ASSERT_FATAL( NULL != buffer );
+        fstream_release_buffer( stream, got / 2 );
+        if( 0 != (i & 1) ) {
+            fstream_close( stream );
+        }
+    }
+
+    CU_ASSERT( files[3].size == stream_file(&files[3], 1, MAX_WANTED, 0, MAX_WANTED, 0) );
+}
+
+void test_failures( void )
+{
+    size_t got;
+
+    CU_ASSERT( NULL == fstream_create(FSTREAM_PRIORITY__BACKGROUND + 1) );
+    CU_ASSERT( false == fstream_open(NULL, files[2].name) );
+    CU_ASSERT( false == fstream_queue_next(NULL, files[2].name) );
+    CU_ASSERT( NULL == fstream_get_buffer(NULL, 100, &got) );
+    CU_ASSERT( false == fstream_seek(NULL, 0) );
+    CU_ASSERT( 0 == fstream_get_filesize(NULL) );
+
+    CU_ASSERT( false == fstream_open(stream, NULL) );
+    CU_ASSERT( false == fstream_open(stream, TEST_DIR "/MISSING.BIN") );
+    CU_ASSERT( 0 == fstream_get_filesize(stream) );
+
+    CU_ASSERT( NULL == fstream_get_buffer(stream, 0, &got) );
+    CU_ASSERT( NULL == fstream_get_buffer(stream, 100, NULL) );
+    CU_ASSERT( NULL == fstream_get_buffer(stream, MAX_WANTED + 1, &got) );
+
+    /* Nothing is open, so there is nothing to get. */
+    CU_ASSERT( NULL != fstream_get_buffer(stream, 100, &got) );
+    CU_ASSERT( 0 == got );
+    fstream_release_buffer( stream, 100 );
+
+    CU_ASSERT( files[2].size == stream_file(&files[2], 1, MAX_WANTED, 0, MAX_WANTED, 0) );
+}
+
+void test_copies( void )
+{
+    fstream_stats_t before;
+    fstream_stats_t after;
+    uint64_t released;
+    uint64_t copied;
+    uint32_t i;
+
+    /* Decoding frames out of a max_framesize window.  Before the ring the
+     * window was copied out of the nodes & what was left over moved down,
+     * which is about 2 bytes copied for every byte decoded. */
+    fstream_get_stats( stream, &before );
+    for( i = 0; i < 4; i++ ) {
+        stream_file( &files[FILE_COUNT - 1], FRAME_WANTED, FRAME_WANTED,
+                     MIN_FRAME, MAX_FRAME, 0 );
+    }
+    fstream_get_stats( stream, &after );
+
+    released = after.bytes_released - before.bytes_released;
+    copied = after.bytes_copied - before.bytes_copied;
+
+    printf( "\n    %llu bytes decoded, %llu copied, %.4f copied per byte\n",
+            (unsigned long long) released, (unsigned long long) copied,
+            (double) copied / released );
+
+    CU_ASSERT( 4 * files[FILE_COUNT - 1].size == released );
+
+    /* Only the part of a window past the end of the ring gets copied,
+     * so at most FRAME_WANTED bytes for each trip around the ring. */
+    CU_ASSERT( copied * 8 < released );
+}
+
+static double read_calls_per_mb( useconds_t decode_us )
+{
+    fstream_stats_t before;
+    fstream_stats_t after;
+    const test_file_t *file = &files[FILE_COUNT - 1];
+
+    fstream_get_stats( stream, &before );
+    CU_ASSERT( file->size == stream_file(file, FRAME_WANTED, FRAME_WANTED,
+                                         MIN_FRAME, MAX_FRAME, decode_us) );
+    fstream_get_stats( stream, &after );
+
+    /* The whole file, & only once. */
+    CU_ASSERT( file->size == after.bytes_read - before.bytes_read );
+
+    return (after.read_calls - before.read_calls) * MB
+           / (after.bytes_read - before.bytes_read);
+}
+
+void test_read_calls( void )
+{
+    double draining;
+    double behind;
+
+    /* One read() per node is 2048 calls per MB. */
+    draining = read_calls_per_mb( 0 );
+    behind = read_calls_per_mb( FRAME_DECODE_US );
+
+    printf( "\n    read calls per MB: draining %.1f, decoding %.1f\n",
+            draining, behind );
+
+    /* At least a cluster (4k on the host) at a time, except at the end
+     * of the ring & the file. */
+    CU_ASSERT( draining < 300.0 );
+    CU_ASSERT( behind < 300.0 );
+}
+
+/* Plays current to the end & changes to next, which may have been queued.
+ * Returns the time from the end of current to the first frame of next. */
+static double track_change( const test_file_t *current,
+                            const test_file_t *next, bool queue )
+{
+    size_t got;
+    uint8_t *buffer;
+    double begin;
+    double gap;
+
+    CU_ASSERT_FATAL( true == fstream_open(stream, current->name) );
+    if( true == queue ) {
+        CU_ASSERT_FATAL( true == fstream_queue_next(stream, next->name) );
+    }
+    CU_ASSERT( current->size == read_to_end(current, 0, FRAME_WANTED, FRAME_WANTED,
+                                            MIN_FRAME, MAX_FRAME, PLAY_FRAME_US) );
+
+    begin = now_ms();
+    fstream_close( stream );
+    CU_ASSERT_FATAL( true == fstream_open(stream, next->name) );
+    buffer = (uint8_t *) fstream_get_buffer( stream, FRAME_WANTED, &got );
+    gap = now_ms() - begin;
+
+    CU_ASSERT_FATAL( FRAME_WANTED == got );
+    CU_ASSERT_FATAL( 0 == memcmp(buffer, next->data, got) );
+    CU_ASSERT( next->size == fstream_get_filesize(stream) );
+    fstream_release_buffer( stream, MAX_FRAME );
+
+    CU_ASSERT( next->size == read_to_end(next, MAX_FRAME, 1, MAX_WANTED,
+                                         0, MAX_WANTED, 0) );
+    fstream_close( stream );
+    return gap;
+}
+
+void test_queue_next( void )
+{
+    const test_file_t *current = &files[3];
+    const test_file_t *next = &files[FILE_COUNT - 1];
+    double cold = 0.0;
+    double warm = 0.0;
+    uint32_t i;
+
+    card_latency = true;
+    for( i = 0; i < TRACK_CHANGES; i++ ) {
+        cold += track_change( current, next, false );
+        warm += track_change( current, next, true );
+    }
+    card_latency = false;
+
+    printf( "\n    track change gap: cold open %.2f ms, queued %.2f ms\n",
+            cold / TRACK_CHANGES, warm / TRACK_CHANGES );
+    CU_ASSERT( warm * 10 < cold );
+
+    /* The next file can be queued before anything is open. */
+    CU_ASSERT( true == fstream_queue_next(stream, next->name) );
+    CU_ASSERT( false == fstream_queue_next(stream, current->name) );
+    CU_ASSERT( next->size == stream_file(next, 1, MAX_WANTED, 0, MAX_WANTED, 0) );
+
+    CU_ASSERT( false == fstream_queue_next(stream, NULL) );
+
+    /* Opening a different file throws the queued one away. */
+    CU_ASSERT_FATAL( true == fstream_open(stream, current->name) );
+    CU_ASSERT( true == fstream_queue_next(stream, next->name) );
+    CU_ASSERT( current->size == read_to_end(current, 0, 1, MAX_WANTED, 0, MAX_WANTED, 0) );
+    CU_ASSERT( files[2].size == stream_file(&files[2], 1, MAX_WANTED, 0, MAX_WANTED, 0) );
+
+    /* So does closing before the end, the queued file is then opened
+     * like any other. */
+    CU_ASSERT_FATAL( true == fstream_open(stream, next->name) );
+    CU_ASSERT( true == fstream_queue_next(stream, current->name) );
+    fstream_skip( stream, next->size / 2 );
+    fstream_close( stream );
+    CU_ASSERT( current->size == stream_file(current, 1, MAX_WANTED, 0, MAX_WANTED, 0) );
+
+    /* A queued file which isn't there fails to open. */
+    CU_ASSERT_FATAL( true == fstream_open(stream, current->name) );
+    CU_ASSERT( true == fstream_queue_next(stream, TEST_DIR "/MISSING.BIN") );
+    CU_ASSERT( current->size == read_to_end(current, 0, 1, MAX_WANTED, 0, MAX_WANTED, 0) );
+    CU_ASSERT( false == fstream_open(stream, TEST_DIR "/MISSING.BIN") );
+    CU_ASSERT( 0 == fstream_get_filesize(stream) );
+
+    /* An empty file ends on its own too. */
+    CU_ASSERT( true == fstream_queue_next(stream, files[0].name) );
+    CU_ASSERT( 0 == stream_file(&files[0], 1, MAX_WANTED, 0, MAX_WANTED, 0) );
+    CU_ASSERT( files[1].size == stream_file(&files[1], 1, MAX_WANTED, 0, MAX_WANTED, 0) );
+}
+
+/* Seeks to the offset & checks what is there. */
+static size_t seek_and_check( const test_file_t *file, size_t offset )
+{
+    size_t wanted;
+    size_t used;
+    size_t got;
+    uint8_t *buffer;
+
+    CU_ASSERT_FATAL( true == fstream_seek(stream, offset) );
+    CU_ASSERT_FATAL( offset == fstream_tell(stream) );
+
+    wanted = random_range( 1, MAX_WANTED );
+    buffer = (uint8_t *) fstream_get_buffer( stream, wanted, &got );
+    CU_ASSERT_FATAL( NULL != buffer );
+    CU_ASSERT_FATAL( MIN(wanted, file->size - offset) == got );
+    if( 0 != memcmp(buffer, &file->data[offset], got) ) {
+        CU_FAIL_FATAL( "The stream is different from the file" );
+    }
+
+    used = random_range( 0, got );
+    fstream_release_buffer( stream, used );
+    CU_ASSERT_FATAL( offset + used == fstream_tell(stream) );
+
+    return offset + used;
+}
+
+void test_seek( void )
+{
+    const test_file_t *file = &files[FILE_COUNT - 1];
+    const test_file_t *small = &files[3];
+    fstream_stats_t before;
+    fstream_stats_t after;
+    size_t offset;
+    size_t got;
+    uint8_t *buffer;
+    uint32_t i;
+
+    CU_ASSERT( false == fstream_seek(stream, 0) );
+
+    /* Backwards, forwards, within what has been read & past it. */
+    CU_ASSERT_FATAL( true == fstream_open(stream, file->name) );
+    CU_ASSERT( 0 == fstream_tell(stream) );
+    offset = 0;
+    for( i = 0; i < SEEKS; i++ ) {
+        switch( random_next() % 3 ) {
+            case 0:
+                offset = random_range( 0, file->size );
+                break;
+            case 1:
+                offset = MIN( offset + random_range(0, 2 * MAX_WANTED), file->size );
+                break;
+            default:
+                offset -= random_range( 0, offset );
+                break;
+        }
+        offset = seek_and_check( file, offset );
+    }
+    CU_ASSERT( false == fstream_seek(stream, file->size + 1) );
+    CU_ASSERT( file->size == read_to_end(file, offset, 1, MAX_WANTED, 0, MAX_WANTED, 0) );
+    CU_ASSERT( file->size == fstream_tell(stream) );
+
+    /* The task is done with the file, so it is opened again. */
+    offset = seek_and_check( file, 0 );
+    CU_ASSERT( file->size == read_to_end(file, offset, 1, MAX_WANTED, 0, MAX_WANTED, 0) );
+    fstream_close( stream );
+
+    /* Skipping most of the file only reads what follows it. */
+    fstream_get_stats( stream, &before );
+    CU_ASSERT_FATAL( true == fstream_open(stream, file->name) );
+    buffer = (uint8_t *) fstream_get_buffer( stream, 100, &got );
+    CU_ASSERT_FATAL( NULL != buffer );
+    CU_ASSERT_FATAL( 100 == got );
+    CU_ASSERT( 0 == memcmp(buffer, file->data, got) );
+    fstream_release_buffer( stream, 100 );
+    fstream_skip( stream, file->size - 2 * FRAME_WANTED );
+    offset = file->size - 2 * FRAME_WANTED + 100;
+    CU_ASSERT( offset == fstream_tell(stream) );
+    CU_ASSERT( file->size == read_to_end(file, offset, 1, MAX_WANTED, 0, MAX_WANTED, 0) );
+    fstream_close( stream );
+    fstream_get_stats( stream, &after );
+    CU_ASSERT( after.bytes_read - before.bytes_read < file->size / 2 );
+
+    /* Seeking back in a file which has been read keeps the queued file. */
+    CU_ASSERT_FATAL( true == fstream_open(stream, small->name) );
+    CU_ASSERT( true == fstream_queue_next(stream, file->name) );
+    CU_ASSERT( small->size == read_to_end(small, 0, 1, MAX_WANTED, 0, MAX_WANTED, 0) );
+    offset = seek_and_check( small, small->size / 2 );
+    CU_ASSERT( small->size == read_to_end(small, offset, 1, MAX_WANTED, 0, MAX_WANTED, 0) );
+    fstream_close( stream );
+    CU_ASSERT( false == fstream_queue_next(stream, small->name) );
+    CU_ASSERT( file->size == stream_file(file, 1, MAX_WANTED, 0, MAX_WANTED, 0) );
+}
+
+/* Reads files through the background stream until it is told to stop. */
+static void* background_reader( void *arg )
+{
+    const test_file_t *file = &files[FILE_COUNT - 1];
+
+    while( false == background_stop ) {
+        size_t offset = 0;
+
+        CU_ASSERT_FATAL( true == fstream_open(background, file->name) );
+        while( (false == background_stop) && (offset < file->size) ) {
+            size_t got;
+            uint8_t *buffer;
+
+            buffer = (uint8_t *) fstream_get_buffer( background, MAX_WANTED, &got );
+            if( (NULL == buffer) || (0 != memcmp(buffer, &file->data[offset], got)) ) {
+                CU_FAIL( "The background stream is different from the file" );
+                break;
+            }
+            fstream_release_buffer( background, got );
+            offset += got;
+            background_bytes += got;
+        }
+        fstream_close( background );
+    }
+    return NULL;
+}
+
+/* Jumps around the file like fast forward does, so each frame has to be
+ * read from the card while it is played. */
+static double playback_wait( void )
+{
+    const test_file_t *file = &files[FILE_COUNT - 1];
+    uint32_t i;
+
+    CU_ASSERT_FATAL( true == fstream_open(stream, file->name) );
+    waited_ms = 0.0;
+    for( i = 0; i < SEEKS; i++ ) {
+        size_t offset = random_range( 0, file->size - FRAME_WANTED );
+        size_t got;
+        uint8_t *buffer;
+        double begin;
+
+        begin = now_ms();
+        CU_ASSERT_FATAL( true == fstream_seek(stream, offset) );
+        buffer = (uint8_t *) fstream_get_buffer( stream, FRAME_WANTED, &got );
+        waited_ms += now_ms() - begin;
+
+        CU_ASSERT_FATAL( FRAME_WANTED == got );
+        CU_ASSERT_FATAL( 0 == memcmp(buffer, &file->data[offset], got) );
+        fstream_release_buffer( stream, MAX_FRAME );
+        usleep( PLAY_FRAME_US );
+    }
+    fstream_close( stream );
+
+    return waited_ms / SEEKS;
+}
+
+void test_priority( void )
+{
+    const test_file_t *file = &files[FILE_COUNT - 1];
+    fstream_stats_t stats;
+    pthread_t thread;
+    uint64_t seeking;
+    double alone;
+    double shared;
+
+    card_latency = true;
+    alone = playback_wait();
+
+    /* A scan reading the card as fast as it can. */
+    background_stop = false;
+    background_bytes = 0;
+    CU_ASSERT_FATAL( 0 == pthread_create(&thread, NULL, background_reader, NULL) );
+    shared = playback_wait();
+    seeking = background_bytes;
+
+    background_bytes = 0;
+    CU_ASSERT( file->size == stream_file(file, FRAME_WANTED, FRAME_WANTED,
+                                         MIN_FRAME, MAX_FRAME, PLAY_FRAME_US) );
+    background_stop = true;
+    pthread_join( thread, NULL );
+    card_latency = false;
+
+    fstream_get_stats( background, &stats );
+    printf( "\n    seek to a frame: %.2f ms alone, %.2f ms with a background "
+            "stream\n    background read: %.0f kB while seeking, %.0f kB while "
+            "playing\n", alone, shared, seeking / 1024.0,
+            background_bytes / 1024.0 );
+
+    /* While playback is catching up the background stream keeps off the
+     * card, otherwise it reads between the playback reads, a cluster at a
+     * time. */
+    CU_ASSERT( shared < alone + 2 * READ_LATENCY_US / 1000.0 );
+    CU_ASSERT( file->size / 2 < background_bytes );
+    CU_ASSERT( stats.bytes_read <= (uint64_t) stats.read_calls * CLUSTER_SIZE );
+}
+
+/* Reads a tag like the codecs do for the database scan, each call taking
+ * the card on its own. */
+static void* scanner( void *arg )
+{
+    int i = (int) (intptr_t) arg;
+    uint8_t tag[64];
+
+    while( false == background_stop ) {
+        CU_ASSERT( 0 == fstream_card_lseek(scanner_fds[i], 0, SEEK_SET) );
+        CU_ASSERT( sizeof(tag) == fstream_card_read(scanner_fds[i], tag, sizeof(tag)) );
+        scanner_reads[i]++;
+    }
+    return NULL;
+}
+
+void test_card_take( void )
+{
+    pthread_t threads[SCANNERS];
+    uint32_t before[SCANNERS];
+    double alone;
+    double shared;
+    int i;
+
+    /* The files are found before the card is slow. */
+    for( i = 0; i < SCANNERS; i++ ) {
+        scanner_fds[i] = fstream_card_open( files[FILE_COUNT - 1 - i].name );
+        CU_ASSERT_FATAL( -1 != scanner_fds[i] );
+    }
+
+    card_latency = true;
+    alone = playback_wait();
+
+    background_stop = false;
+    for( i = 0; i < SCANNERS; i++ ) {
+        scanner_reads[i] = 0;
+        CU_ASSERT_FATAL( 0 == pthread_create(&threads[i], NULL, scanner,
+                                             (void *) (intptr_t) i) );
+    }
+    shared = playback_wait();
+
+    /* With playback done every scanner gets the card, not just the one
+     * woken first. */
+    for( i = 0; i < SCANNERS; i++ ) {
+        before[i] = scanner_reads[i];
+    }
+    usleep( 50 * READ_LATENCY_US );
+    background_stop = true;
+    for( i = 0; i < SCANNERS; i++ ) {
+        pthread_join( threads[i], NULL );
+        CU_ASSERT( before[i] < scanner_reads[i] );
+        CU_ASSERT( 0 == fstream_card_close(scanner_fds[i]) );
+    }
+    card_latency = false;
+
+    printf( "\n    seek to a frame: %.2f ms alone, %.2f ms while scanning\n",
+            alone, shared );
+
+    /* Playback only waits for the tag read already on the card. */
+    CU_ASSERT( shared < alone + 2 * READ_LATENCY_US / 1000.0 );
+}
+
+void test_stats( void )
+{
+    const test_file_t *file = &files[FILE_COUNT - 1];
+    fstream_stats_t draining;
+    fstream_stats_t playing;
+    fstream_stats_t fake;
+    fstream_t *shared;
+    uint32_t levels;
+    uint32_t reads;
+    uint32_t i;
+
+    /* The latency is known to a bucket, the last bucket to the slowest. */
+    memset( &fake, 0, sizeof(fstream_stats_t) );
+    CU_ASSERT( 0 == fstream_stats_latency(&fake, 50) );
+    fake.latency_histogram[0] = 50;
+    fake.latency_histogram[2] = 40;
+    fake.latency_histogram[FSTREAM_LATENCY_BUCKETS - 1] = 10;
+    fake.latency_max_us = 900000;
+    CU_ASSERT( FSTREAM_LATENCY_BASE_US == fstream_stats_latency(&fake, 50) );
+    CU_ASSERT( FSTREAM_LATENCY_BASE_US * 4 == fstream_stats_latency(&fake, 51) );
+    CU_ASSERT( FSTREAM_LATENCY_BASE_US * 4 == fstream_stats_latency(&fake, 90) );
+    CU_ASSERT( 900000 == fstream_stats_latency(&fake, 91) );
+    CU_ASSERT( 900000 == fstream_stats_latency(&fake, 100) );
+    CU_ASSERT( 0 == fstream_stats_latency(&fake, 0) );
+    CU_ASSERT( 0 == fstream_stats_latency(&fake, 101) );
+    CU_ASSERT( 0 == fstream_stats_latency(NULL, 50) );
+
+    /* A stream of its own, so the stats start from nothing. */
+    shared = stream;
+    stream = fstream_create( FSTREAM_PRIORITY__PLAYBACK );
+    CU_ASSERT_FATAL( NULL != stream );
+
+    fstream_get_stats( stream, &draining );
+    CU_ASSERT( 0 == draining.level_samples );
+    CU_ASSERT( 0 == draining.blocked );
+    CU_ASSERT( 0 == fstream_stats_latency(&draining, 50) );
+
+    card_latency = true;
+    CU_ASSERT( file->size == stream_file(file, FRAME_WANTED, FRAME_WANTED,
+                                         MIN_FRAME, MAX_FRAME, 0) );
+    fstream_get_stats( stream, &draining );
+    CU_ASSERT( file->size == stream_file(file, FRAME_WANTED, FRAME_WANTED,
+                                         MIN_FRAME, MAX_FRAME, PLAY_FRAME_US) );
+    fstream_get_stats( stream, &playing );
+    card_latency = false;
+
+    fstream_log_stats( stream, "test" );
+    fstream_log_stats( NULL, "test" );
+    fstream_log_stats( stream, NULL );
+
+    printf( "\n    draining: blocked %u times, %.1f ms, buffered avg %.0f kB\n"
+            "    playing:  blocked %u times, %.1f ms, buffered avg %.0f kB\n"
+            "    read latency p50 %u us, p99 %u us, max %u us\n",
+            draining.blocked, draining.blocked_us / 1000.0,
+            draining.level_total / 1024.0 / draining.level_samples,
+            playing.blocked - draining.blocked,
+            (playing.blocked_us - draining.blocked_us) / 1000.0,
+            (playing.level_total - draining.level_total) / 1024.0
+                / (playing.level_samples - draining.level_samples),
+            fstream_stats_latency(&playing, 50),
+            fstream_stats_latency(&playing, 99), playing.latency_max_us );
+
+    /* Every sample & read is in a bucket. */
+    levels = 0;
+    for( i = 0; i < FSTREAM_LEVEL_BUCKETS; i++ ) {
+        levels += playing.level_histogram[i];
+    }
+    reads = 0;
+    for( i = 0; i < FSTREAM_LATENCY_BUCKETS; i++ ) {
+        reads += playing.latency_histogram[i];
+    }
+    CU_ASSERT( levels == playing.level_samples );
+    CU_ASSERT( reads == playing.read_calls );
+
+    /* Reading as fast as the card empties the buffer & waits on it, a
+     * player slower than the card keeps it full. */
+    CU_ASSERT( 0 < draining.blocked );
+    CU_ASSERT( draining.blocked_max_us <= draining.blocked_us );
+    CU_ASSERT( draining.level_min < FRAME_WANTED );
+    CU_ASSERT( (playing.blocked - draining.blocked) < draining.blocked );
+    CU_ASSERT( draining.level_total / draining.level_samples
+               < (playing.level_total - draining.level_total)
+                    / (playing.level_samples - draining.level_samples) );
+
+    CU_ASSERT( READ_LATENCY_US <= fstream_stats_latency(&playing, 50) );
+    CU_ASSERT( fstream_stats_latency(&playing, 50) <= fstream_stats_latency(&playing, 99) );
+    CU_ASSERT( playing.latency_max_us == fstream_stats_latency(&playing, 100) );
+
+    stream = shared;
+}
+
+void add_suites( CU_pSuite *suite )
+{
+    *suite = CU_add_suite( "File Stream Test", NULL, NULL );
+    CU_add_test( *suite, "Test Stream     ", test_stream );
+    CU_add_test( *suite, "Test Skip       ", test_skip );
+    CU_add_test( *suite, "Test Close Early", test_close_early );
+    CU_add_test( *suite, "Test Failures   ", test_failures );
+    CU_add_test( *suite, "Test Copies     ", test_copies );
+    CU_add_test( *suite, "Test Read Calls ", test_read_calls );
+    CU_add_test( *suite, "Test Queue Next ", test_queue_next );
+    CU_add_test( *suite, "Test Seek       ", test_seek );
+    CU_add_test( *suite, "Test Priority   ", test_priority );
+    CU_add_test( *suite, "Test Card Take  ", test_card_take );
+    CU_add_test( *suite, "Test Stats      ", test_stats );
+}
+
+int main( int argc, char *argv[] )
+{
+    int rv = 1;
+    CU_pSuite suite = NULL;
+
+    MOCK_os_init();
+    MOCK_reset__os();
+
+    if( CUE_SUCCESS == CU_initialize_registry() ) {
+        add_suites( &suite );
+
+        if(    (NULL != suite) && (true == create_files())
+            && (true == fstream_init(0, malloc, free))
+            && (NULL != (stream = fstream_create(FSTREAM_PRIORITY__PLAYBACK)))
+            && (NULL != (background = fstream_create(FSTREAM_PRIORITY__BACKGROUND))) )
+        {
+            CU_basic_set_mode( CU_BRM_VERBOSE );
+            CU_basic_run_tests();
+            printf( "\n" );
+            CU_basic_show_failures( CU_get_failure_list() );
+            printf( "\n\n" );
+            rv = CU_get_number_of_tests_failed();
+        }
+
+        remove_files();
+        CU_cleanup_registry();
+    }
+
+    /* The stream tasks never exit, so the mock OS is left as is. */
+
+    if( 0 != rv ) {
+        return 1;
+    }
+    return CU_get_error();
+}
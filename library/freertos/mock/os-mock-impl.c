@@ -262,7 +262,7 @@ queue_handle_t os_queue_create_std( uint32_t length, uint32_t size )
 
     queue = NULL;
     __lock();
-    for( i = 0; i < OS_MAX_TASK_COUNT; i++ ) {
+    for( i = 0; i < OS_MAX_QUEUE_COUNT; i++ ) {
         if( false == __queues[i].active ) {
             __queues[i].active = true;
             queue = &__queues[i];
@@ -408,8 +408,10 @@ bool os_queue_receive_ISR_std( queue_handle_t queue,
                                void *buffer,
                                bool *hp_task_woke )
 {
-    *hp_task_woke = false;
-    return os_queue_receive( queue, buffer, WAIT_FOREVER );
+    if( NULL != hp_task_woke ) {
+        *hp_task_woke = false;
+    }
+    return os_queue_receive( queue, buffer, NO_WAIT );
 }
 
 
@@ -427,8 +429,10 @@ bool os_queue_send_to_back_ISR_std( queue_handle_t queue,
                                     const void *buffer,
                                     bool *hp_task_woke )
 {
-    *hp_task_woke = false;
-    return os_queue_send_to_back( queue, buffer, WAIT_FOREVER );
+    if( NULL != hp_task_woke ) {
+        *hp_task_woke = false;
+    }
+    return os_queue_send_to_back( queue, buffer, NO_WAIT );
 }
 
 
@@ -446,8 +450,10 @@ bool os_queue_send_to_front_ISR_std( queue_handle_t queue,
                                      const void *buffer,
                                      bool *hp_task_woke )
 {
-    *hp_task_woke = false;
-    return os_queue_send_to_front( queue, buffer, WAIT_FOREVER );
+    if( NULL != hp_task_woke ) {
+        *hp_task_woke = false;
+    }
+    return os_queue_send_to_front( queue, buffer, NO_WAIT );
 }
 
 
@@ -568,7 +574,9 @@ bool os_semaphore_give_std( semaphore_handle_t semaphore )
 bool os_semaphore_give_ISR_std( semaphore_handle_t semaphore,
                                 bool *hp_task_woke )
 {
-    *hp_task_woke = false;
+    if( NULL != hp_task_woke ) {
+        *hp_task_woke = false;
+    }
 
     return os_semaphore_give( semaphore );
 }
@@ -588,6 +596,7 @@ mutex_handle_t os_mutex_create_std( void )
     for( i = 0; i < OS_MAX_MUTEX_COUNT; i++ ) {
         if( false == __mutexes[i].active ) {
             mutex = &__mutexes[i];
+            mutex->active = true;
             break;
         }
     }
@@ -43,12 +43,20 @@
 #define NEG_SSR32(a,s) (((int32_t)(a))>>(32-(s)))
 #define NEG_USR32(a,s) (((uint32_t)(a))>>(32-(s)))
 
+/* Build with CACHED_BITSTREAM_READER to keep the next 64 bits of the stream
+   in the GetBitContext instead of loading 32 bits on every read.  See
+   UPDATE_CACHE below. */
+
 /* bit input */
 /* buffer, buffer_end and size_in_bits must be present and used by every reader */
 typedef struct GetBitContext {
     const uint8_t *buffer, *buffer_end;
     int index;
     int size_in_bits;
+#ifdef CACHED_BITSTREAM_READER
+    uint64_t cache;     ///< 64 bits of the stream from bit cache_index on
+    int cache_index;    ///< a multiple of 8
+#endif
 } GetBitContext;
 
 #define VLC_TYPE int16_t
@@ -158,6 +166,94 @@ static inline int unaligned32_le(const void *v)
 #endif
 }
 
+#ifdef CACHED_BITSTREAM_READER
+
+# ifdef ALT_BITSTREAM_READER_LE
+#   error "the cached bitstream reader is big endian only"
+# endif
+
+#if defined(ARCH_X86) || defined(ARCH_X86_64)
+#    define unaligned64(a) (*(const uint64_t*)(a))
+#else
+static inline uint64_t unaligned64(const void *v) {
+    struct Unaligned {
+	uint64_t i;
+    } __attribute__((packed));
+
+    return ((const struct Unaligned *) v)->i;
+}
+#endif
+
+/**
+ * loads the 64 bits from p on, reading nothing at or past end.
+ */
+static inline uint64_t unaligned64_be(const uint8_t *p, const uint8_t *end)
+{
+    uint64_t v= 0;
+    int i;
+
+    if(end - p >= 8){
+#if defined(CONFIG_ALIGN)
+        for(i=0; i<8; i++)
+            v= (v<<8) | p[i];
+#elif defined(BUILD_BIGENDIAN)
+        v= unaligned64(p);
+#else
+        v= __builtin_bswap64( unaligned64(p));
+#endif
+    }else{
+        for(i=0; i<8; i++)
+            v= (v<<8) | (p + i < end ? p[i] : 0);
+    }
+    return v;
+}
+
+/* index stays the count of bits read, so the readers that skip or rewind
+   by setting it still work.  The cache is only reloaded once fewer than
+   MIN_CACHE_BITS of it are left after index, or when index went back
+   before cache_index. */
+#   define MIN_CACHE_BITS 25
+
+#   define OPEN_READER(name, gb)\
+        int name##_index= (gb)->index;\
+        uint64_t name##_cache= 0;\
+
+#   define CLOSE_READER(name, gb)\
+        (gb)->index= name##_index;\
+
+#   define UPDATE_CACHE(name, gb)\
+        if((unsigned int)(name##_index - (gb)->cache_index) > 64 - MIN_CACHE_BITS){\
+            (gb)->cache_index= name##_index & ~7;\
+            (gb)->cache= unaligned64_be( ((const uint8_t *)(gb)->buffer)+(name##_index>>3), (gb)->buffer_end );\
+        }\
+        name##_cache= (gb)->cache << (name##_index - (gb)->cache_index);\
+
+#   define SKIP_CACHE(name, gb, num)\
+        name##_cache <<= (num);
+
+#   define SKIP_COUNTER(name, gb, num)\
+        name##_index += (num);\
+
+#   define SKIP_BITS(name, gb, num)\
+        {\
+            SKIP_CACHE(name, gb, num)\
+            SKIP_COUNTER(name, gb, num)\
+        }\
+
+#   define LAST_SKIP_BITS(name, gb, num) SKIP_COUNTER(name, gb, num)
+#   define LAST_SKIP_CACHE(name, gb, num) ;
+
+#   define SHOW_UBITS(name, gb, num)\
+        ((uint32_t)(name##_cache >> (64-(num))))
+
+#   define SHOW_SBITS(name, gb, num)\
+        ((int32_t)((int64_t)name##_cache >> (64-(num))))
+
+#   define GET_CACHE(name, gb)\
+        ((uint32_t)(name##_cache >> 32))
+
+#else /* !CACHED_BITSTREAM_READER */
+
 #   define MIN_CACHE_BITS 25
 
 #   define OPEN_READER(name, gb)\
@@ -208,6 +304,8 @@ static inline int unaligned32_le(const void *v)
 #   define GET_CACHE(name, gb)\
         ((uint32_t)name##_cache)
 
+#endif /* CACHED_BITSTREAM_READER */
+
 static inline int get_bits_count(GetBitContext *s){
     return s->index;
 }
@@ -304,6 +402,9 @@ static inline void init_get_bits(GetBitContext *s,
     s->size_in_bits= bit_size;
     s->buffer_end= buffer + buffer_size;
     s->index=0;
+#ifdef CACHED_BITSTREAM_READER
+    s->cache_index= -64;
+#endif
     {
         OPEN_READER(re, s)
         UPDATE_CACHE(re, s)
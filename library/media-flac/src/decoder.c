@@ -49,6 +49,8 @@
 #include "arm.h"
 #elif defined(CPU_AVR32)
 #include "avr32.h"
+#elif defined(CPU_X86)
+#include "x86.h"
 #endif
 
 #define FFMAX(a,b) ((a) > (b) ? (a) : (b))
@@ -140,6 +142,99 @@ static int get_crc8(const uint8_t *buf, int count)
     return crc;
 }
 
+/* The Rice codes of a partition are read straight from the buffer through
+   a cache of the next bits, the most a register holds.  The quotient is
+   the count of leading zeros of the cache, & the cache is only refilled
+   when what's left of it runs out.  The parameters above RICE_MAX_K can
+   need more than a 32 bit cache holds after a refill, those partitions
+   are left to get_sr_golomb_flac(). */
+#if UINTPTR_MAX > 0xffffffff
+typedef uint64_t rice_cache_t;
+#define RICE_CLZ(x) __builtin_clzll(x)
+#else
+typedef uint32_t rice_cache_t;
+#define RICE_CLZ(x) __builtin_clz(x)
+#endif
+
+#define RICE_CACHE_BITS ((int)(8 * sizeof(rice_cache_t)))
+#define RICE_MAX_K      (32 - 8)
+
+/* The bits from byte p on, the bytes from the end on read as 0 */
+static inline rice_cache_t rice_load(const uint8_t *p, const uint8_t *end)
+{
+    rice_cache_t cache = 0;
+    int i;
+
+    if (end - p >= (int)sizeof(rice_cache_t)) {
+#ifdef CONFIG_ALIGN
+        for (i = 0; i < (int)sizeof(rice_cache_t); i++)
+            cache = (cache << 8) | p[i];
+#else
+        memcpy(&cache, p, sizeof(rice_cache_t));
+    #ifndef BUILD_BIGENDIAN
+        cache = (RICE_CACHE_BITS == 64) ? __builtin_bswap64(cache)
+                                        : __builtin_bswap32(cache);
+    #endif
+#endif
+    } else {
+        for (i = 0; i < (int)sizeof(rice_cache_t); i++)
+            cache = (cache << 8) | ((p + i < end) ? p[i] : 0);
+    }
+    return cache;
+}
+
+static int decode_rice(GetBitContext *gb, int32_t *decoded, int count, int k) ICODE_ATTR_FLAC;
+static int decode_rice(GetBitContext *gb, int32_t *decoded, int count, int k)
+{
+    const uint8_t *buffer = gb->buffer;
+    const uint8_t *end = gb->buffer_end;
+    int index = gb->index;
+    rice_cache_t cache;
+    int avail;
+    int i;
+
+    /* The cache holds avail bits from index on, from the top bit down */
+    cache = rice_load(buffer + (index >> 3), end) << (index & 7);
+    avail = RICE_CACHE_BITS - (index & 7);
+
+    for (i = 0; i < count; i++)
+    {
+        unsigned int q = 0;
+        int zeros;
+        int v;
+
+        /* The unary quotient, which can run on past the cache */
+        while ((zeros = (cache ? RICE_CLZ(cache) : RICE_CACHE_BITS)) >= avail)
+        {
+            q += avail;
+            index += avail;
+            if (index >= gb->size_in_bits)
+                return -1;
+            cache = rice_load(buffer + (index >> 3), end) << (index & 7);
+            avail = RICE_CACHE_BITS - (index & 7);
+        }
+        q += zeros;
+        index += zeros + 1;
+        cache = (cache << zeros) << 1;
+        avail -= zeros + 1;
+
+        if (avail < k)
+        {
+            cache = rice_load(buffer + (index >> 3), end) << (index & 7);
+            avail = RICE_CACHE_BITS - (index & 7);
+        }
+        v = (q << k) | (unsigned int)((cache >> 1) >> (RICE_CACHE_BITS - 1 - k));
+        index += k;
+        cache <<= k;
+        avail -= k;
+
+        decoded[i] = (v >> 1) ^ -(v & 1);
+    }
+
+    gb->index = index;
+    return 0;
+}
+
 static int decode_residuals(FLACContext *s, int32_t* decoded, int pred_order) ICODE_ATTR_FLAC;
 static int decode_residuals(FLACContext *s, int32_t* decoded, int pred_order)
 {
@@ -168,6 +263,15 @@ static int decode_residuals(FLACContext *s, int32_t* decoded, int pred_order)
             for (; i < samples; i++, sample++)
                 decoded[sample] = get_sbits(&s->gb, tmp);
         }
+        else if (tmp <= RICE_MAX_K)
+        {
+            if (i < samples)
+            {
+                if (decode_rice(&s->gb, decoded + sample, samples - i, tmp) < 0)
+                    return -2;
+                sample += samples - i;
+            }
+        }
         else
         {
             for (; i < samples; i++, sample++){
@@ -195,28 +299,34 @@ static int decode_subframe_fixed(FLACContext *s, int32_t* decoded, int pred_orde
     if (decode_residuals(s, decoded, pred_order) < 0)
         return -4;
 
-    a = decoded[pred_order-1];
-    b = a - decoded[pred_order-2];
-    c = b - decoded[pred_order-2] + decoded[pred_order-3];
-    d = c - decoded[pred_order-2] + 2*decoded[pred_order-3] - decoded[pred_order-4];
-
+    /* Only the warm up samples of this order are there to start from */
     switch(pred_order)
     {
         case 0:
             break;
         case 1:
+            a = decoded[0];
             for (i = pred_order; i < blocksize; i++)
                 decoded[i] = a += decoded[i];
             break;
         case 2:
+            a = decoded[1];
+            b = a - decoded[0];
             for (i = pred_order; i < blocksize; i++)
                 decoded[i] = a += b += decoded[i];
             break;
         case 3:
+            a = decoded[2];
+            b = a - decoded[1];
+            c = b - decoded[1] + decoded[0];
             for (i = pred_order; i < blocksize; i++)
                 decoded[i] = a += b += c += decoded[i];
             break;
         case 4:
+            a = decoded[3];
+            b = a - decoded[2];
+            c = b - decoded[2] + decoded[1];
+            d = c - decoded[2] + 2*decoded[1] - decoded[0];
             for (i = pred_order; i < blocksize; i++)
                 decoded[i] = a += b += c += d += decoded[i];
             break;
@@ -227,16 +337,125 @@ static int decode_subframe_fixed(FLACContext *s, int32_t* decoded, int pred_orde
     return 0;
 }
 
+/* sum += coeffs[n-1] * data[i-n] for each tap from order down to 1.  The
+   order is a constant wherever this is used, so the switch goes away &
+   leaves just the taps, unrolled. */
+#define LPC_TAP(n, type) \
+    case n: sum += (type)coeffs[n-1] * (type)data[i-n];
+
+#define LPC_TAPS(type) \
+    switch (order) { \
+        LPC_TAP(32, type) LPC_TAP(31, type) LPC_TAP(30, type) \
+        LPC_TAP(29, type) LPC_TAP(28, type) LPC_TAP(27, type) \
+        LPC_TAP(26, type) LPC_TAP(25, type) LPC_TAP(24, type) \
+        LPC_TAP(23, type) LPC_TAP(22, type) LPC_TAP(21, type) \
+        LPC_TAP(20, type) LPC_TAP(19, type) LPC_TAP(18, type) \
+        LPC_TAP(17, type) LPC_TAP(16, type) LPC_TAP(15, type) \
+        LPC_TAP(14, type) LPC_TAP(13, type) LPC_TAP(12, type) \
+        LPC_TAP(11, type) LPC_TAP(10, type) LPC_TAP(9, type)  \
+        LPC_TAP(8, type)  LPC_TAP(7, type)  LPC_TAP(6, type)  \
+        LPC_TAP(5, type)  LPC_TAP(4, type)  LPC_TAP(3, type)  \
+        LPC_TAP(2, type)  LPC_TAP(1, type)                    \
+    }
+
+/* Restores count samples in place from the residuals at data, after the
+   order samples before it.  The 32 bit sum is only used when it can't
+   overflow (see decode_subframe_lpc()), it is unsigned so a broken stream
+   that does overflow it just wraps. */
+static inline __attribute__((always_inline))
+void lpc_restore(int32_t *data, int count, const int16_t *coeffs,
+                 int qlevel, const int order)
+{
+    int i;
+
+    for (i = 0; i < count; i++)
+    {
+        uint32_t sum = 0;
+        LPC_TAPS(uint32_t)
+        data[i] += (int32_t)sum >> qlevel;
+    }
+}
+
+/* The same with 64 bit sums, for 24 bit audio & the highest precisions */
+static inline __attribute__((always_inline))
+void lpc_restore_wide(int32_t *data, int count, const int16_t *coeffs,
+                      int qlevel, const int order)
+{
+    int i;
+
+    for (i = 0; i < count; i++)
+    {
+        int64_t sum = 0;
+        LPC_TAPS(int64_t)
+        data[i] += sum >> qlevel;
+    }
+}
+
+typedef void (*lpc_restore_fn)(int32_t *data, int count,
+                               const int16_t *coeffs, int qlevel);
+
+#define LPC_RESTORE(order) \
+static void lpc_restore_##order(int32_t *data, int count, \
+                                const int16_t *coeffs, int qlevel) ICODE_ATTR_FLAC; \
+static void lpc_restore_##order(int32_t *data, int count, \
+                                const int16_t *coeffs, int qlevel) \
+{ \
+    lpc_restore(data, count, coeffs, qlevel, order); \
+} \
+static void lpc_restore_wide_##order(int32_t *data, int count, \
+                                     const int16_t *coeffs, int qlevel) ICODE_ATTR_FLAC; \
+static void lpc_restore_wide_##order(int32_t *data, int count, \
+                                     const int16_t *coeffs, int qlevel) \
+{ \
+    lpc_restore_wide(data, count, coeffs, qlevel, order); \
+}
+
+LPC_RESTORE(1)  LPC_RESTORE(2)  LPC_RESTORE(3)  LPC_RESTORE(4)
+LPC_RESTORE(5)  LPC_RESTORE(6)  LPC_RESTORE(7)  LPC_RESTORE(8)
+LPC_RESTORE(9)  LPC_RESTORE(10) LPC_RESTORE(11) LPC_RESTORE(12)
+LPC_RESTORE(13) LPC_RESTORE(14) LPC_RESTORE(15) LPC_RESTORE(16)
+LPC_RESTORE(17) LPC_RESTORE(18) LPC_RESTORE(19) LPC_RESTORE(20)
+LPC_RESTORE(21) LPC_RESTORE(22) LPC_RESTORE(23) LPC_RESTORE(24)
+LPC_RESTORE(25) LPC_RESTORE(26) LPC_RESTORE(27) LPC_RESTORE(28)
+LPC_RESTORE(29) LPC_RESTORE(30) LPC_RESTORE(31) LPC_RESTORE(32)
+
+static const lpc_restore_fn lpc_restore_table[32] ICONST_ATTR = {
+    lpc_restore_1,  lpc_restore_2,  lpc_restore_3,  lpc_restore_4,
+    lpc_restore_5,  lpc_restore_6,  lpc_restore_7,  lpc_restore_8,
+    lpc_restore_9,  lpc_restore_10, lpc_restore_11, lpc_restore_12,
+    lpc_restore_13, lpc_restore_14, lpc_restore_15, lpc_restore_16,
+    lpc_restore_17, lpc_restore_18, lpc_restore_19, lpc_restore_20,
+    lpc_restore_21, lpc_restore_22, lpc_restore_23, lpc_restore_24,
+    lpc_restore_25, lpc_restore_26, lpc_restore_27, lpc_restore_28,
+    lpc_restore_29, lpc_restore_30, lpc_restore_31, lpc_restore_32
+};
+
+static const lpc_restore_fn lpc_restore_wide_table[32] ICONST_ATTR = {
+    lpc_restore_wide_1,  lpc_restore_wide_2,  lpc_restore_wide_3,
+    lpc_restore_wide_4,  lpc_restore_wide_5,  lpc_restore_wide_6,
+    lpc_restore_wide_7,  lpc_restore_wide_8,  lpc_restore_wide_9,
+    lpc_restore_wide_10, lpc_restore_wide_11, lpc_restore_wide_12,
+    lpc_restore_wide_13, lpc_restore_wide_14, lpc_restore_wide_15,
+    lpc_restore_wide_16, lpc_restore_wide_17, lpc_restore_wide_18,
+    lpc_restore_wide_19, lpc_restore_wide_20, lpc_restore_wide_21,
+    lpc_restore_wide_22, lpc_restore_wide_23, lpc_restore_wide_24,
+    lpc_restore_wide_25, lpc_restore_wide_26, lpc_restore_wide_27,
+    lpc_restore_wide_28, lpc_restore_wide_29, lpc_restore_wide_30,
+    lpc_restore_wide_31, lpc_restore_wide_32
+};
+
 static int decode_subframe_lpc(FLACContext *s, int32_t* slow_decoded, int pred_order) ICODE_ATTR_FLAC;
 static int decode_subframe_lpc(FLACContext *s, int32_t* slow_decoded, int pred_order)
 {
-    register int i, j;
-    int64_t wsum;
+    int i;
     int coeff_prec, qlevel;
     int16_t coeffs[pred_order];
+#if defined(CPU_AVR32)
+    /* Filtered in a copy on the stack, which is in the internal SRAM */
     int32_t decoded[MAX_BLOCKSIZE];
-
-    memcpy( decoded, slow_decoded, (s->blocksize*sizeof(int32_t)) );
+#else
+    int32_t *decoded = slow_decoded;
+#endif
 
     /* warm up samples */
     for (i = 0; i < pred_order; i++)
@@ -277,32 +496,28 @@ static int decode_subframe_lpc(FLACContext *s, int32_t* slow_decoded, int pred_o
                           (decoded + pred_order), coeffs, &slow_decoded[0] );
         memcpy( slow_decoded, decoded, (s->blocksize*sizeof(int32_t)) );
         #else
-        for (i = pred_order; i < s->blocksize; i++)
-        {
-            register int sum;
-            sum = 0;
-            for (j = 0; j < pred_order; j++)
-                sum += coeffs[j] * decoded[i-j-1];
-            decoded[i] += sum >> qlevel;
-        }
-        memcpy( slow_decoded, decoded, (s->blocksize*sizeof(int32_t)) );
+        #if defined(CPU_X86)
+        if (pred_order >= LPC_X86_MIN_ORDER)
+            lpc_decode_x86(s->blocksize - pred_order, qlevel, pred_order,
+                           decoded + pred_order, coeffs);
+        else
+        #endif
+        lpc_restore_table[pred_order-1](decoded + pred_order,
+                                        s->blocksize - pred_order,
+                                        coeffs, qlevel);
         #endif
     } else {
         #if defined(CPU_COLDFIRE)
-        (void)wsum;
-        (void)j;
         lpc_decode_emac_wide(s->blocksize - pred_order, qlevel, pred_order,
                              decoded + pred_order, coeffs);
         #else
-        for (i = pred_order; i < s->blocksize; i++)
-        {
-            wsum = 0;
-            for (j = 0; j < pred_order; j++)
-                wsum += (int64_t)coeffs[j] * (int64_t)decoded[i-j-1];
-            decoded[i] += wsum >> qlevel;
-        }
+        lpc_restore_wide_table[pred_order-1](decoded + pred_order,
+                                             s->blocksize - pred_order,
+                                             coeffs, qlevel);
         #endif
+        #if defined(CPU_AVR32)
         memcpy( slow_decoded, decoded, (s->blocksize*sizeof(int32_t)) );
+        #endif
     }
     
     return 0;
@@ -503,6 +718,67 @@ static int decode_frame(FLACContext *s,
     return 0;
 }
 
+int flac_parse_frame_header(FLACContext *s, uint8_t *buf, int buf_size,
+                            unsigned long *samplenumber, int *blocksize)
+{
+    GetBitContext gb;
+    int blocksize_code, sample_rate_code, assignment, sample_size_code;
+    int64_t number;
+
+    if (buf_size < FLAC_MAX_HEADER_SIZE)
+        return -40;
+
+    init_get_bits(&gb, buf, FLAC_MAX_HEADER_SIZE*8);
+
+    if ((get_bits(&gb, 16) & 0xFFFE) != 0xFFF8)
+        return -41;
+
+    blocksize_code = get_bits(&gb, 4);
+    sample_rate_code = get_bits(&gb, 4);
+    assignment = get_bits(&gb, 4);
+    sample_size_code = get_bits(&gb, 3);
+
+    /* The reserved values, which libFLAC treats as a lost sync too */
+    if ((blocksize_code == 0) || (sample_rate_code == 15) ||
+        (assignment > 10) || (sample_size_code == 3) ||
+        (sample_size_code == 7) || get_bits1(&gb))
+        return -42;
+
+    /* 7 bytes of sample number are past the 32 bits kept, 8 isn't UTF-8 */
+    if (show_bits(&gb, 8) >= 0xFE)
+        return -43;
+
+    number = get_utf8(&gb);
+    if (number < 0)
+        return -43;
+
+    /* See decode_frame() */
+    if (s->min_blocksize == s->max_blocksize)
+        number *= s->min_blocksize;
+
+    if (blocksize_code == 6)
+        *blocksize = get_bits(&gb, 8)+1;
+    else if (blocksize_code == 7)
+        *blocksize = get_bits(&gb, 16)+1;
+    else
+        *blocksize = blocksize_table[blocksize_code];
+
+    if ((*blocksize == 0) || (*blocksize > s->max_blocksize))
+        return -44;
+
+    if (sample_rate_code == 12)
+        skip_bits(&gb, 8);
+    else if ((sample_rate_code == 13) || (sample_rate_code == 14))
+        skip_bits(&gb, 16);
+
+    /* The CRC of the header including its own CRC is 0 */
+    if (get_crc8(buf, get_bits_count(&gb)/8 + 1))
+        return -45;
+
+    *samplenumber = number;
+    return 0;
+}
+
 int flac_decode_frame(FLACContext *s,
                              int32_t* decoded0,
                              int32_t* decoded1,
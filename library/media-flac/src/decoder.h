@@ -6,6 +6,7 @@
 #define MAX_CHANNELS 2       /* Maximum supported channels */
 #define MAX_BLOCKSIZE 4608   /* Maxsize in samples of one uncompressed frame */
 #define MAX_FRAMESIZE 32768  /* Maxsize in bytes of one compressed frame */
+#define FLAC_MAX_HEADER_SIZE 16 /* Maxsize in bytes of a frame header */
 
 #define FLAC_OUTPUT_DEPTH 29 /* Provide samples left-shifted to 28 bits+sign */
 
@@ -45,4 +46,11 @@ int flac_decode_frame(FLACContext *s,
                       int32_t* decoded1,
                       uint8_t *buf, int buf_size) ICODE_ATTR_FLAC;
 
+/* Checks for a frame header at the start of buf without decoding the
+   frame, for finding the frames again after a seek.  buf must hold at
+   least FLAC_MAX_HEADER_SIZE bytes.  Returns 0 & the number of the first
+   sample & the samples in the frame if the header is valid, or < 0 */
+int flac_parse_frame_header(FLACContext *s, uint8_t *buf, int buf_size,
+                            unsigned long *samplenumber, int *blocksize);
+
 #endif
@@ -38,6 +38,26 @@
 #define MIN(a, b)   ((a) < (b)) ? (a) : (b)
 #define NODE_COUNT  2
 
+/* The most of a VORBIS_COMMENT block that is read at once. */
+#define COMMENT_BUFFER_SIZE 2048
+
+/* The longest key we know, "REPLAYGAIN_REFERENCE_LOUDNESS=". */
+#define COMMENT_KEY_MAX     30
+
+/* The most of a value that is parsed, enough for any of the strings. */
+#define COMMENT_VALUE_MAX   128
+
+/* The bytes in a SEEKTABLE point & the most of them kept.  libFLAC puts
+ * one every 10s, so longer songs keep every 2nd, 3rd... point. */
+#define SEEK_POINT_SIZE     18
+#define SEEK_POINTS_MAX     128
+
+/* The bytes looked through at a time for a frame header. */
+#define SEEK_SYNC_SIZE      1024
+
+/* The guesses at where a sample is before stepping through the frames. */
+#define SEEK_GUESSES_MAX    16
+
 /*----------------------------------------------------------------------------*/
 /*                               Data Structures                              */
 /*----------------------------------------------------------------------------*/
@@ -73,6 +93,26 @@ typedef enum {
     FM__UNKNOWN
 } flac_metadata_t;
 
+typedef struct {
+    uint32_t sample;    /* The first sample in the frame */
+    uint32_t offset;    /* From the first frame to the frame's header */
+} flac_seek_point_t;
+
+typedef struct {
+    const char *key;
+    uint32_t length;
+    flac_metadata_t type;
+} flac_key_t;
+
+typedef struct {
+    int fd;
+    uint8_t *buf;
+    uint32_t size;      /* The size of buf */
+    uint32_t pos;       /* The next byte of buf to parse */
+    uint32_t fill;      /* The bytes of the block in buf */
+    uint32_t left;      /* The bytes of the block not read into buf yet */
+} comment_reader_t;
+
 typedef media_status_t (*stream__block_handler_t)( FLACContext *fc,
                                                    const uint32_t length );
 typedef media_status_t (*file__block_handler_t)( int fd,
@@ -82,7 +122,27 @@ typedef media_status_t (*file__block_handler_t)( int fd,
 /*----------------------------------------------------------------------------*/
 /*                            File Scoped Variables                           */
 /*----------------------------------------------------------------------------*/
-/* None */
+/* The stream the songs are played from. */
+static fstream_t *__stream;
+
+/* The SEEKTABLE of the song playing, empty if it didn't have one. */
+static flac_seek_point_t __seek_points[SEEK_POINTS_MAX];
+static uint32_t __seek_point_count;
+
+/* The vorbis comment keys we know, including the '='. */
+static const flac_key_t __keys[] = {
+    { "ALBUM=",                          6, FM__ALBUM                         },
+    { "ARTIST=",                         7, FM__ARTIST                        },
+    { "DISCNUMBER=",                    11, FM__DISCNUMBER                    },
+    { "TITLE=",                          6, FM__TITLE                         },
+    { "TRACKNUMBER=",                   12, FM__TRACKNUMBER                   },
+    { "REPLAYGAIN_ALBUM_PEAK=",         22, FM__REPLAYGAIN_ALBUM_PEAK         },
+    { "REPLAYGAIN_ALBUM_GAIN=",         22, FM__REPLAYGAIN_ALBUM_GAIN         },
+    { "REPLAYGAIN_TRACK_PEAK=",         22, FM__REPLAYGAIN_TRACK_PEAK         },
+    { "REPLAYGAIN_TRACK_GAIN=",         22, FM__REPLAYGAIN_TRACK_GAIN         },
+    { "REPLAYGAIN_REFERENCE_LOUDNESS=", 30, FM__REPLAYGAIN_REFERENCE_LOUDNESS },
+    { NULL,                              0, FM__UNKNOWN                       }
+};
 
 /*----------------------------------------------------------------------------*/
 /*                             Function Prototypes                            */
@@ -106,6 +166,15 @@ static media_status_t stream__metadata_block_ignore( FLACContext *fc,
                                                      const uint32_t length );
 static media_status_t stream__metadata_streaminfo_block( FLACContext *fc,
                                                          const uint32_t length );
+static media_status_t stream__metadata_seektable_block( FLACContext *fc,
+                                                        const uint32_t length );
+static media_status_t stream__seek( FLACContext *fc, const uint32_t sample );
+static bool stream__find_frame( FLACContext *fc,
+                                uint32_t offset,
+                                const uint32_t limit,
+                                uint32_t *frame_offset,
+                                uint32_t *frame_sample,
+                                uint32_t *frame_samples );
 
 /*---------- File based metadata handlers ----------*/
 static media_status_t file__process_metadata( int fd,
@@ -116,17 +185,25 @@ static media_status_t file__metadata_vorbis_comment( int fd,
 static media_status_t file__metadata_block_ignore( int fd,
                                                    const uint32_t length,
                                                    media_metadata_t *metadata );
-static bool file__read_uint32_t( int fd, uint32_t *out );
-static flac_metadata_t flac_get_key_value( int fd,
+static bool comment__need( comment_reader_t *reader, const uint32_t count );
+static bool comment__skip( comment_reader_t *reader, const uint32_t count );
+static bool comment__read_uint32_t( comment_reader_t *reader, uint32_t *out );
+static flac_metadata_t flac_get_key_value( const char *comment,
                                            uint32_t *len );
-static bool flac_get_int32_t( int fd, uint32_t *len, int32_t *out );
-static bool flac_get_double( int fd, uint32_t *len, double *out );
+static bool flac_get_int32_t( const char *value, uint32_t len, int32_t *out );
+static bool flac_get_double( const char *value, uint32_t len, double *out );
 static void dsp_callback( int32_t *left, int32_t *right, void *data );
 
 /*----------------------------------------------------------------------------*/
 /*                             External Functions                             */
 /*----------------------------------------------------------------------------*/
 
+/** See media-flac.h for details. */
+void media_flac_init( fstream_t *stream )
+{
+    __stream = stream;
+}
+
 /** See media-interface.h for details. */
 media_status_t media_flac_play( const char *filename,
                                 const double gain,
@@ -154,7 +231,7 @@ media_status_t media_flac_play( const char *filename,
 
     dsp_scale_factor = dsp_determine_scale_factor( peak, gain );
 
-    if( true != fstream_open(filename) ) {
+    if( true != fstream_open(__stream, filename) ) {
         rv = MI_ERROR_INVALID_FORMAT;
         goto error_0;
     }
@@ -162,14 +239,14 @@ media_status_t media_flac_play( const char *filename,
     {
         uint8_t *buffer;
         size_t got;
-        buffer = fstream_get_buffer( 4, &got );
+        buffer = fstream_get_buffer( __stream, 4, &got );
         if( (4 != got) || (0 != memcmp(buffer, "fLaC", 4)) )
         {
             rv = MI_ERROR_INVALID_FORMAT;
-            fstream_release_buffer( 0 );
+            fstream_release_buffer( __stream, 0 );
             goto error_1;
         }
-        fstream_release_buffer( 4 );
+        fstream_release_buffer( __stream, 4 );
     }
 
     node_count = MIN( queue_size, NODE_COUNT );
@@ -191,8 +268,9 @@ media_status_t media_flac_play( const char *filename,
     memset( &fc, 0, sizeof(FLACContext) );
 
     /* From above we've already read 4 bytes of metadata */
-    fc.filesize = fstream_get_filesize();
+    fc.filesize = fstream_get_filesize( __stream );
     fc.metadatalength = 4;
+    __seek_point_count = 0;
 
     rv = stream__process_file( &fc, idle, dsp_scale_factor, command_fn );
 
@@ -205,7 +283,7 @@ error_1:
         (*free_fn)( node );
     }
 
-    fstream_close();
+    fstream_close( __stream );
 
 error_0:
 
@@ -244,7 +322,9 @@ media_status_t media_flac_get_metadata( const char *filename,
         goto error_0;
     }
 
-    fd = open( filename, O_RDONLY );
+    /* Each call takes the card on its own, so playback isn't kept off the
+     * card for the whole tag. */
+    fd = fstream_card_open( filename );
     if( -1 == fd ) {
         rv = MI_ERROR_PARAMETER;
         goto error_0;
@@ -252,7 +332,7 @@ media_status_t media_flac_get_metadata( const char *filename,
 
     {
         uint8_t buf[4];
-        if( 4 != read(fd, buf, 4) ) {
+        if( 4 != fstream_card_read(fd, buf, 4) ) {
             rv = MI_ERROR_INVALID_FORMAT;
             goto error_1;
         }
@@ -266,7 +346,7 @@ media_status_t media_flac_get_metadata( const char *filename,
     rv = file__process_metadata( fd, metadata );
 
 error_1:
-    close( fd );
+    fstream_card_close( fd );
 
 error_0:
 
@@ -316,7 +396,7 @@ static media_status_t stream__process_metadata( FLACContext *fc )
     handler[FLAC__STREAMINFO]     = stream__metadata_streaminfo_block;
     handler[FLAC__PADDING]        = stream__metadata_block_ignore;
     handler[FLAC__APPLICATION]    = stream__metadata_block_ignore;
-    handler[FLAC__SEEKTABLE]      = stream__metadata_block_ignore;
+    handler[FLAC__SEEKTABLE]      = stream__metadata_seektable_block;
     handler[FLAC__VORBIS_COMMENT] = stream__metadata_block_ignore;
     handler[FLAC__CUESHEET]       = stream__metadata_block_ignore;
     handler[FLAC__PICTURE]        = stream__metadata_block_ignore;
@@ -329,14 +409,14 @@ static media_status_t stream__process_metadata( FLACContext *fc )
         {
             size_t got;
             uint8_t *buf;
-            buf = (uint8_t*) fstream_get_buffer( 4, &got );
+            buf = (uint8_t*) fstream_get_buffer( __stream, 4, &got );
             if( 4 != got ) {
-                fstream_release_buffer( 0 );
+                fstream_release_buffer( __stream, 0 );
                 return MI_ERROR_DECODE_ERROR;
             }
 
             process_metadata_block_header( buf, &end, &type, &block_length );
-            fstream_release_buffer( 4 );
+            fstream_release_buffer( __stream, 4 );
         }
 
         status = (*handler[type])( fc, block_length );
@@ -391,7 +471,7 @@ static media_status_t file__process_metadata( int fd,
     while( !end ) {
         {
             uint8_t buf[4];
-            if( 4 != read(fd, buf, 4) ) {
+            if( 4 != fstream_card_read(fd, buf, 4) ) {
                 return MI_ERROR_DECODE_ERROR;
             }
 
@@ -454,7 +534,7 @@ static void process_metadata_block_header( uint8_t *header,
 static media_status_t stream__metadata_block_ignore( FLACContext *fc,
                                                      const uint32_t length )
 {
-    fstream_skip( length );
+    fstream_skip( __stream, length );
     return MI_RETURN_OK;
 }
 
@@ -469,7 +549,7 @@ static media_status_t file__metadata_block_ignore( int fd,
                                                    const uint32_t length,
                                                    media_metadata_t *metadata )
 {
-    if( -1 != lseek(fd, length, SEEK_CUR) ) {
+    if( -1 != fstream_card_lseek(fd, length, SEEK_CUR) ) {
         return MI_RETURN_OK;
     }
 
@@ -488,9 +568,9 @@ static media_status_t stream__metadata_streaminfo_block( FLACContext *fc,
     size_t got;
     uint8_t *buf;
 
-    buf = (uint8_t*) fstream_get_buffer( length, &got );
+    buf = (uint8_t*) fstream_get_buffer( __stream, length, &got );
     if( length != got ) {
-        fstream_release_buffer( 0 );
+        fstream_release_buffer( __stream, 0 );
         return MI_ERROR_DECODE_ERROR;
     }
 
@@ -505,22 +585,91 @@ static media_status_t stream__metadata_streaminfo_block( FLACContext *fc,
     /* totalsamples is a 36-bit field, but we assume <= 32 bits are 
      * used */
     if( 0 != (0x0f & buf[13]) ) {
-        fstream_release_buffer( got );
+        fstream_release_buffer( __stream, got );
         return MI_ERROR_DECODE_ERROR;
     }
     fc->totalsamples = (buf[14] << 24) | (buf[15] << 16) | (buf[16] << 8) | buf[17];
     fc->length = (fc->totalsamples / fc->samplerate) * 1000;
-    fstream_release_buffer( got );
+    fstream_release_buffer( __stream, got );
 
     return MI_RETURN_OK;
 }
 
+/**
+ *  Keeps the points of a SEEKTABLE block for stream__seek().  Placeholder
+ *  points & points past 32 bits of samples or bytes are left out.
+ *
+ *  @param fc ignored
+ *  @param length the number of bytes in the block
+ */
+static media_status_t stream__metadata_seektable_block( FLACContext *fc,
+                                                        const uint32_t length )
+{
+    uint32_t points;
+    uint32_t every;
+    uint32_t i;
+
+    points = length / SEEK_POINT_SIZE;
+    every = (points + SEEK_POINTS_MAX - 1) / SEEK_POINTS_MAX;
+    __seek_point_count = 0;
+
+    for( i = 0; i < points; i++ ) {
+        size_t got;
+        uint8_t *buf;
+
+        buf = (uint8_t*) fstream_get_buffer( __stream, SEEK_POINT_SIZE, &got );
+        if( SEEK_POINT_SIZE != got ) {
+            fstream_release_buffer( __stream, 0 );
+            return MI_ERROR_DECODE_ERROR;
+        }
+
+        /* Big endian 64 bit sample & offset, then 16 bits of samples. */
+        if( (0 == (i % every)) && (__seek_point_count < SEEK_POINTS_MAX) &&
+            (0 == (buf[0] | buf[1] | buf[2] | buf[3])) &&
+            (0 == (buf[8] | buf[9] | buf[10] | buf[11])) )
+        {
+            flac_seek_point_t *point = &__seek_points[__seek_point_count];
+
+            point->sample = ((uint32_t) buf[4] << 24) | (buf[5] << 16) |
+                            (buf[6] << 8) | buf[7];
+            point->offset = ((uint32_t) buf[12] << 24) | (buf[13] << 16) |
+                            (buf[14] << 8) | buf[15];
+
+            /* The points have to be in order to be searched. */
+            if( (0 == __seek_point_count) ||
+                ((point[-1].sample < point->sample) &&
+                 (point[-1].offset < point->offset)) )
+            {
+                __seek_point_count++;
+            }
+        }
+
+        fstream_release_buffer( __stream, SEEK_POINT_SIZE );
+    }
+
+    fstream_skip( __stream, length - (points * SEEK_POINT_SIZE) );
+
+    return MI_RETURN_OK;
+}
+
+/**
+ *  Processes the data in a VORBIS_COMMENT block.  The block is read into
+ *  a buffer COMMENT_BUFFER_SIZE bytes at a time & the comments are parsed
+ *  out of it, so a tag costs a read per buffer instead of per character.
+ *
+ *  @param fd the file descriptor to read from
+ *  @param length the number of bytes in the block
+ *  @param metadata the metadata to fill in
+ */
 static media_status_t file__metadata_vorbis_comment( int fd,
                                                      const uint32_t length,
                                                      media_metadata_t *metadata )
 {
+    comment_reader_t reader;
+    uint32_t vendor_length;
     uint32_t list_size;
-    
+    media_status_t rv;
+
     bzero( metadata, sizeof(media_metadata_t) );
     metadata->track_number = -1;
     metadata->disc_number = -1;
@@ -529,101 +678,108 @@ static media_status_t file__metadata_vorbis_comment( int fd,
     metadata->gain.album_gain = 0.0;
     metadata->gain.album_peak = 0.0;
 
-    /* Skip the vendor information */
-    {   uint32_t vendor_length;
-        if( false == file__read_uint32_t(fd, &vendor_length) ) {
-            return MI_ERROR_DECODE_ERROR;
-        }
-        if( -1 == lseek(fd, vendor_length, SEEK_CUR) ) {
-            return MI_ERROR_DECODE_ERROR;
-        }
+    if( 0 == length ) {
+        return MI_ERROR_DECODE_ERROR;
     }
 
-    if( false == file__read_uint32_t(fd, &list_size) ) {
-        return MI_ERROR_DECODE_ERROR;
+    reader.fd = fd;
+    reader.size = MIN( length, COMMENT_BUFFER_SIZE );
+    reader.pos = 0;
+    reader.fill = 0;
+    reader.left = length;
+    reader.buf = (uint8_t*) malloc( reader.size );
+    if( NULL == reader.buf ) {
+        return MI_ERROR_OUT_OF_MEMORY;
+    }
+
+    rv = MI_ERROR_DECODE_ERROR;
+
+    /* Skip the vendor information */
+    if( (false == comment__read_uint32_t(&reader, &vendor_length)) ||
+        (false == comment__skip(&reader, vendor_length)) ||
+        (false == comment__read_uint32_t(&reader, &list_size)) )
+    {
+        goto done;
     }
 
     while( 0 < list_size ) {
         uint32_t comment_length;
+        uint32_t key_length;
+        uint32_t value_length;
         flac_metadata_t type;
+        char *value;
 
         list_size--;
+        value = NULL;
+        value_length = 0;
 
-        if( false == file__read_uint32_t(fd, &comment_length) ) {
-            return MI_ERROR_DECODE_ERROR;
+        if( false == comment__read_uint32_t(&reader, &comment_length) ) {
+            goto done;
+        }
+
+        key_length = MIN( comment_length, COMMENT_KEY_MAX + 1 );
+        if( false == comment__need(&reader, key_length) ) {
+            goto done;
+        }
+
+        type = flac_get_key_value( (char*) &reader.buf[reader.pos], &key_length );
+        if( FM__UNKNOWN != type ) {
+            reader.pos += key_length;
+            comment_length -= key_length;
+
+            value_length = MIN( comment_length, COMMENT_VALUE_MAX );
+            if( false == comment__need(&reader, value_length) ) {
+                goto done;
+            }
+            value = (char*) &reader.buf[reader.pos];
         }
 
-        type = flac_get_key_value( fd, &comment_length );
         switch( type ) {
             case FM__ALBUM:
-            {
-                uint32_t album_length;
-
-                album_length = MIN( MEDIA_ALBUM_LENGTH, comment_length );
-                if( album_length != read(fd, &metadata->album, album_length) ) {
-                    return MI_ERROR_DECODE_ERROR;
-                }
-                comment_length -= album_length;
+                memcpy( metadata->album, value, MIN(MEDIA_ALBUM_LENGTH, value_length) );
                 break;
-            }
 
             case FM__ARTIST:
-            {
-                uint32_t artist_length;
-
-                artist_length = MIN( MEDIA_ARTIST_LENGTH, comment_length );
-                if( artist_length != read(fd, &metadata->artist, artist_length) ) {
-                    return MI_ERROR_DECODE_ERROR;
-                }
-                comment_length -= artist_length;
+                memcpy( metadata->artist, value, MIN(MEDIA_ARTIST_LENGTH, value_length) );
                 break;
-            }
 
             case FM__DISCNUMBER:
-                if( false == flac_get_int32_t(fd, &comment_length, &metadata->disc_number) ) {
-                    return MI_ERROR_DECODE_ERROR;
+                if( false == flac_get_int32_t(value, value_length, &metadata->disc_number) ) {
+                    goto done;
                 }
                 break;
 
             case FM__TITLE:
-            {
-                uint32_t title_length;
-
-                title_length = MIN( MEDIA_TITLE_LENGTH, comment_length );
-                if( title_length != read(fd, &metadata->title, title_length) ) {
-                    return MI_ERROR_DECODE_ERROR;
-                }
-                comment_length -= title_length;
+                memcpy( metadata->title, value, MIN(MEDIA_TITLE_LENGTH, value_length) );
                 break;
-            }
 
             case FM__TRACKNUMBER:
-                if( false == flac_get_int32_t(fd, &comment_length, &metadata->track_number) ) {
-                    return MI_ERROR_DECODE_ERROR;
+                if( false == flac_get_int32_t(value, value_length, &metadata->track_number) ) {
+                    goto done;
                 }
                 break;
 
             case FM__REPLAYGAIN_ALBUM_PEAK:
-                if( false == flac_get_double(fd, &comment_length, &metadata->gain.album_peak) ) {
-                    return MI_ERROR_DECODE_ERROR;
+                if( false == flac_get_double(value, value_length, &metadata->gain.album_peak) ) {
+                    goto done;
                 }
                 break;
 
             case FM__REPLAYGAIN_ALBUM_GAIN:
-                if( false == flac_get_double(fd, &comment_length, &metadata->gain.album_gain) ) {
-                    return MI_ERROR_DECODE_ERROR;
+                if( false == flac_get_double(value, value_length, &metadata->gain.album_gain) ) {
+                    goto done;
                 }
                 break;
 
             case FM__REPLAYGAIN_TRACK_PEAK:
-                if( false == flac_get_double(fd, &comment_length, &metadata->gain.track_peak) ) {
-                    return MI_ERROR_DECODE_ERROR;
+                if( false == flac_get_double(value, value_length, &metadata->gain.track_peak) ) {
+                    goto done;
                 }
                 break;
 
             case FM__REPLAYGAIN_TRACK_GAIN:
-                if( false == flac_get_double(fd, &comment_length, &metadata->gain.track_gain) ) {
-                    return MI_ERROR_DECODE_ERROR;
+                if( false == flac_get_double(value, value_length, &metadata->gain.track_gain) ) {
+                    goto done;
                 }
                 break;
 
@@ -631,12 +787,19 @@ static media_status_t file__metadata_vorbis_comment( int fd,
                 break;
         }
 
-        if( -1 == lseek(fd, comment_length, SEEK_CUR) ) {
-            return MI_ERROR_DECODE_ERROR;
+        if( false == comment__skip(&reader, comment_length) ) {
+            goto done;
         }
     }
 
-    return MI_RETURN_OK;
+    /* Leave the file at the next block, past any padding in this one. */
+    if( true == comment__skip(&reader, (reader.fill - reader.pos) + reader.left) ) {
+        rv = MI_RETURN_OK;
+    }
+
+done:
+    free( reader.buf );
+    return rv;
 }
 
 static media_status_t play_song( FLACContext *fc,
@@ -647,30 +810,50 @@ static media_status_t play_song( FLACContext *fc,
     dsp_status_t status;
     flac_data_node_t *node;
     media_status_t rv;
+    uint32_t played;
 
     rv = MI_END_OF_SONG;
     node = NULL;
+    played = 0;
 
     while( 1 ) {
         int32_t consumed;
         uint8_t *read_buffer;
         int32_t bytes_left;
+        uint32_t position;
+        uint32_t seek;
+        int32_t samples;
+        size_t got;
 
         if( NULL == node ) {
             os_queue_receive( idle, &node, WAIT_FOREVER );
         }
 
-        read_buffer = (uint8_t*) fstream_get_buffer( fc->max_framesize, (size_t*) &bytes_left );
+        read_buffer = (uint8_t*) fstream_get_buffer( __stream, fc->max_framesize,
+                                                     &got );
+        bytes_left = (int32_t) got;
 
         if( 0 == bytes_left ) {
             goto done;
         }
 
-        if( false == (*command_fn)() ) {
+        position = (uint32_t) (((uint64_t) played * 1000) / fc->samplerate);
+        seek = position;
+        if( false == (*command_fn)(position, &seek) ) {
             rv = MI_STOPPED_BY_REQUEST;
             goto done;
         }
 
+        if( seek != position ) {
+            played = (uint32_t) (((uint64_t) seek * fc->samplerate) / 1000);
+            rv = stream__seek( fc, played );
+            if( MI_RETURN_OK != rv ) {
+                goto done;
+            }
+            rv = MI_END_OF_SONG;
+            continue;
+        }
+
         memset( node->decode_0, 0, sizeof(node->decode_0) );
         memset( node->decode_1, 0, sizeof(node->decode_1) );
 
@@ -681,10 +864,24 @@ static media_status_t play_song( FLACContext *fc,
 
         consumed = fc->gb.index / 8;
 
-        fstream_release_buffer( consumed );
+        fstream_release_buffer( __stream, consumed );
 
-        if( 0 < fc->blocksize ) {
-            status = dsp_queue_data( node->decode_0, node->decode_1, fc->blocksize,
+        played = fc->samplenumber + fc->blocksize;
+        samples = fc->blocksize;
+
+        /* The samples before the one seeked to. */
+        if( 0 < fc->sample_skip ) {
+            int32_t skip;
+
+            skip = MIN( fc->sample_skip, samples );
+            samples -= skip;
+            memmove( node->decode_0, &node->decode_0[skip], samples * sizeof(int32_t) );
+            memmove( node->decode_1, &node->decode_1[skip], samples * sizeof(int32_t) );
+            fc->sample_skip = 0;
+        }
+
+        if( 0 < samples ) {
+            status = dsp_queue_data( node->decode_0, node->decode_1, samples,
                                      fc->samplerate, gain, &dsp_callback, node );
             if( DSP_RETURN_OK != status ) {
                 os_queue_send_to_back( idle, &node, NO_WAIT );
@@ -697,7 +894,7 @@ static media_status_t play_song( FLACContext *fc,
     }
 
 done:
-    fstream_release_buffer( 0 );
+    fstream_release_buffer( __stream, 0 );
     if( NULL != node ) {
         os_queue_send_to_back( idle, &node, NO_WAIT );
     }
@@ -706,155 +903,323 @@ done:
 }
 
 /**
- *  Used to read a uint32_t from a file and advance the file
- *  pointer.
+ *  Used to move the stream to the frame holding a sample so decoding
+ *  carries on from there, with the samples before it in the frame to be
+ *  skipped.  The SEEKTABLE points either side of the sample are found,
+ *  or the first frame & the end of the file without one.  Between them
+ *  the place of the sample is guessed from the bytes per sample & the
+ *  frame found there narrows the search, until the frame holding the
+ *  sample is found or the guesses are close enough to step through the
+ *  frames.
  *
- *  @param fd the file descriptor to read from
- *  @param out the uint32_t data to output
+ *  @param fc the FLAC context data
+ *  @param sample the sample to play next
  *
- *  @return true on success, false otherwise
+ *  @retval MI_RETURN_OK
+ *          MI_END_OF_SONG if the sample is past the end of the song
+ *          MI_ERROR_DECODE_ERROR if the frame couldn't be found
+ */
+static media_status_t stream__seek( FLACContext *fc, const uint32_t sample )
+{
+    uint32_t lo_sample;
+    uint32_t lo_offset;
+    uint32_t hi_sample;
+    uint32_t hi_offset;
+    uint32_t frame_offset;
+    uint32_t frame_sample;
+    uint32_t frame_samples;
+    uint32_t i;
+
+    if( fc->totalsamples <= sample ) {
+        return MI_END_OF_SONG;
+    }
+
+    lo_sample = 0;
+    lo_offset = fc->metadatalength;
+    hi_sample = fc->totalsamples;
+    hi_offset = fc->filesize;
+
+    if( 0 < __seek_point_count ) {
+        int32_t first;
+        int32_t last;
+
+        first = 0;
+        last = __seek_point_count - 1;
+        while( first <= last ) {
+            int32_t middle = (first + last) / 2;
+            flac_seek_point_t *point = &__seek_points[middle];
+
+            if( point->sample <= sample ) {
+                lo_sample = point->sample;
+                lo_offset = fc->metadatalength + point->offset;
+                first = middle + 1;
+            } else {
+                hi_sample = point->sample;
+                hi_offset = fc->metadatalength + point->offset;
+                last = middle - 1;
+            }
+        }
+    }
+
+    for( i = 0; i < SEEK_GUESSES_MAX; i++ ) {
+        uint32_t guess;
+
+        if( ((hi_sample - lo_sample) <= (uint32_t) fc->max_blocksize) ||
+            ((hi_offset - lo_offset) <= SEEK_SYNC_SIZE) )
+        {
+            break;
+        }
+
+        /* Where the sample would be at the average bytes per sample,
+         * less a frame as the frame holding it starts before it. */
+        guess = (uint32_t) (((uint64_t) (sample - lo_sample) *
+                             (hi_offset - lo_offset)) / (hi_sample - lo_sample));
+        guess = lo_offset + MIN( guess, (hi_offset - lo_offset) - 1 );
+        if( (lo_offset + fc->max_framesize) < guess ) {
+            guess -= fc->max_framesize;
+        } else {
+            guess = lo_offset + 1;
+        }
+
+        if( false == stream__find_frame(fc, guess, hi_offset, &frame_offset,
+                                        &frame_sample, &frame_samples) )
+        {
+            /* No frame starts between the guess & the top. */
+            hi_offset = guess;
+        } else if( sample < frame_sample ) {
+            hi_sample = frame_sample;
+            hi_offset = frame_offset;
+        } else if( sample < (frame_sample + frame_samples) ) {
+            goto found;
+        } else {
+            lo_sample = frame_sample;
+            lo_offset = frame_offset;
+        }
+    }
+
+    /* Step through the frames from the bottom. */
+    frame_offset = lo_offset;
+    while( 1 ) {
+        if( false == stream__find_frame(fc, frame_offset, fc->filesize, &frame_offset,
+                                        &frame_sample, &frame_samples) )
+        {
+            return MI_ERROR_DECODE_ERROR;
+        }
+        if( sample < (frame_sample + frame_samples) ) {
+            break;
+        }
+        frame_offset++;
+    }
+
+found:
+    if( false == fstream_seek(__stream, frame_offset) ) {
+        return MI_ERROR_DECODE_ERROR;
+    }
+
+    fc->sample_skip = 0;
+    if( frame_sample < sample ) {
+        fc->sample_skip = sample - frame_sample;
+    }
+
+    return MI_RETURN_OK;
+}
+
+/**
+ *  Used to find the first frame header at or after an offset.  The
+ *  stream is left somewhere past the offset.
+ *
+ *  @param fc the FLAC context data
+ *  @param offset the offset in the file to look from
+ *  @param limit the offset in the file the frame has to start before
+ *  @param frame_offset the offset of the frame found
+ *  @param frame_sample the first sample in the frame found
+ *  @param frame_samples the number of samples in the frame found
+ *
+ *  @return true if a frame was found, false otherwise
  */
-static bool file__read_uint32_t( int fd, uint32_t *out )
+static bool stream__find_frame( FLACContext *fc,
+                                uint32_t offset,
+                                const uint32_t limit,
+                                uint32_t *frame_offset,
+                                uint32_t *frame_sample,
+                                uint32_t *frame_samples )
 {
-    uint8_t buf[4];
+    while( offset < limit ) {
+        uint8_t *buf;
+        size_t got;
+        size_t i;
 
-    if( 4 == read(fd, buf, 4) ) {
-        *out = buf[0];
-        *out |= (buf[1] << 8);
-        *out |= (buf[2] << 16);
-        *out |= (buf[3] << 24);
+        if( false == fstream_seek(__stream, offset) ) {
+            return false;
+        }
 
-        return true;
+        buf = (uint8_t*) fstream_get_buffer( __stream, SEEK_SYNC_SIZE, &got );
+        if( (NULL == buf) || (got < FLAC_MAX_HEADER_SIZE) ) {
+            fstream_release_buffer( __stream, 0 );
+            return false;
+        }
+
+        for( i = 0; (i <= (got - FLAC_MAX_HEADER_SIZE)) && ((offset + i) < limit); i++ ) {
+            unsigned long number;
+            int blocksize;
+
+            if( (0xff == buf[i]) && (0xf8 == (0xfe & buf[i + 1])) &&
+                (0 == flac_parse_frame_header(fc, &buf[i], got - i, &number, &blocksize)) )
+            {
+                fstream_release_buffer( __stream, 0 );
+                *frame_offset = offset + i;
+                *frame_sample = number;
+                *frame_samples = blocksize;
+                return true;
+            }
+        }
+
+        fstream_release_buffer( __stream, 0 );
+        offset += i;
     }
 
     return false;
 }
 
 /**
- *  Used to read out of a vorbis comment the key and point the
- *  next file character to the value if it is a known type.  If
- *  the type is unknown, the entire comment is skipped.
+ *  Used to make sure the next count bytes of the block are in the buffer,
+ *  moving the bytes not used yet to the front & reading as much more of
+ *  the block as fits after them.
  *
- *  @param fd the file descriptor to read from
- *  @param len the bytes in the comment (in), then the bytes
- *             left after processing
+ *  @param reader the block being read
+ *  @param count the number of bytes wanted
  *
- *  @return the metadata type of this comment
+ *  @return true on success, false if the block or file is too short
  */
-static flac_metadata_t flac_get_key_value( int fd, uint32_t *len )
+static bool comment__need( comment_reader_t *reader, const uint32_t count )
 {
-    char c;
-
-    if( 0 < *len ) {
-        if( 1 == read(fd, &c, 1) ) {
-            (*len)--;
-            switch( c ) {
-                case 'a':
-                case 'A':
-                    if( 5 < *len ) {
-                        uint8_t buf[5];
-                        if( 5 == read(fd, buf, 5) ) {
-                            *len -= 5;
-                            if( 0 == strncasecmp((char*) buf, "LBUM=", 5) ) {
-                                return FM__ALBUM;
-                            }
-                            if( 0 == strncasecmp((char*) buf, "RTIST", 5) ) {
-                                if( 1 == read(fd, &c, 1) ) {
-                                    (*len)--;
-                                    if( '=' == c ) {
-                                        return FM__ARTIST;
-                                    }
-                                }
-                            }
-                        }
-                    }
-                    break;
-
-                case 'd':
-                case 'D':
-                    if( 10 < *len ) {
-                        uint8_t buf[10];
-                        if( 10 == read(fd, buf, 10) ) {
-                            *len -= 10;
-                            if( 0 == strncasecmp((char*) buf, "ISCNUMBER=", 10) ) {
-                                return FM__DISCNUMBER;
-                            }
-                        }
-                    }
-                    break;
-
-                case 'r':
-                case 'R':
-                    if( 21 < *len ) {
-                        uint8_t buf[21];
-                        if( 21 == read(fd, buf, 21) ) {
-                            *len -= 21;
-                            if( 0 == strncasecmp((char*) buf, "EPLAYGAIN_ALBUM_PEAK=", 21) ) {
-                                return FM__REPLAYGAIN_ALBUM_PEAK;
-                            } else if( 0 == strncasecmp((char*) buf, "EPLAYGAIN_ALBUM_GAIN=", 21) ) {
-                                return FM__REPLAYGAIN_ALBUM_GAIN;
-                            } else if( 0 == strncasecmp((char*) buf, "EPLAYGAIN_TRACK_PEAK=", 21) ) {
-                                return FM__REPLAYGAIN_TRACK_PEAK;
-                            } else if( 0 == strncasecmp((char*) buf, "EPLAYGAIN_TRACK_GAIN=", 21) ) {
-                                return FM__REPLAYGAIN_TRACK_GAIN;
-                            } else if( 0 == strncasecmp((char*) buf, "EPLAYGAIN_REFERENCE_L", 21) ) {
-                                if( 8 < *len ) {
-                                    if( 8 == read(fd, buf, 8) ) {
-                                        *len -= 8;
-                                        if( 0 == strncasecmp((char*) buf, "OUDNESS=", 8) ) {
-                                            return FM__REPLAYGAIN_REFERENCE_LOUDNESS;
-                                        }
-                                    }
-                                }
-                            }
-                        }
-                    }
-                    break;
-
-                case 't':
-                case 'T':
-                    if( 5 < *len ) {
-                        uint8_t buf[6];
-                        if( 5 == read(fd, buf, 5) ) {
-                            *len -= 5;
-                            if( 0 == strncasecmp((char*) buf, "ITLE=", 5) ) {
-                                return FM__TITLE;
-                            }
-                            if( 0 == strncasecmp((char*) buf, "RACKN", 5) ) {
-                                if( 6 < *len ) {
-                                    if( 6 == read(fd, buf, 6) ) {
-                                        *len -= 6;
-                                        if( 0 == strncasecmp((char*) buf, "UMBER=", 6) ) {
-                                            return FM__TRACKNUMBER;
-                                        }
-                                    }
-                                }
-                            }
-                        }
-                    }
-                    break;
-
-                default:
-                    break;
-            }
+    uint32_t have;
+    uint32_t want;
+
+    have = reader->fill - reader->pos;
+    if( count <= have ) {
+        return true;
+    }
+
+    if( (reader->size < count) || (reader->left < (count - have)) ) {
+        return false;
+    }
+
+    memmove( reader->buf, &reader->buf[reader->pos], have );
+    reader->pos = 0;
+    reader->fill = have;
+
+    want = MIN( reader->size - have, reader->left );
+    if( want != fstream_card_read(reader->fd, &reader->buf[have], want) ) {
+        return false;
+    }
+    reader->fill += want;
+    reader->left -= want;
+
+    return true;
+}
+
+/**
+ *  Used to skip over bytes of the block, seeking past any that haven't
+ *  been read into the buffer.
+ *
+ *  @param reader the block being read
+ *  @param count the number of bytes to skip
+ *
+ *  @return true on success, false if the block is too short
+ */
+static bool comment__skip( comment_reader_t *reader, const uint32_t count )
+{
+    uint32_t have;
+    uint32_t rest;
+
+    have = reader->fill - reader->pos;
+    if( count <= have ) {
+        reader->pos += count;
+        return true;
+    }
+
+    rest = count - have;
+    if( reader->left < rest ) {
+        return false;
+    }
+
+    reader->pos = 0;
+    reader->fill = 0;
+
+    if( 0 < rest ) {
+        if( -1 == fstream_card_lseek(reader->fd, rest, SEEK_CUR) ) {
+            return false;
+        }
+        reader->left -= rest;
+    }
+
+    return true;
+}
+
+/**
+ *  Used to get a little endian uint32_t out of the block.
+ *
+ *  @param reader the block being read
+ *  @param out the uint32_t data to output
+ *
+ *  @return true on success, false otherwise
+ */
+static bool comment__read_uint32_t( comment_reader_t *reader, uint32_t *out )
+{
+    uint8_t *buf;
+
+    if( false == comment__need(reader, 4) ) {
+        return false;
+    }
+
+    buf = &reader->buf[reader->pos];
+    *out = buf[0];
+    *out |= (buf[1] << 8);
+    *out |= (buf[2] << 16);
+    *out |= ((uint32_t) buf[3] << 24);
+    reader->pos += 4;
+
+    return true;
+}
+
+/**
+ *  Used to match the key of a vorbis comment against the keys we know.
+ *  Keys are matched without regard to case & only if a value follows.
+ *
+ *  @param comment the start of the comment
+ *  @param len the bytes of the comment available (in), then the bytes
+ *             in the key including the '=' if it is known
+ *
+ *  @return the metadata type of this comment, FM__UNKNOWN if the key
+ *          isn't one we know
+ */
+static flac_metadata_t flac_get_key_value( const char *comment, uint32_t *len )
+{
+    const flac_key_t *key;
+
+    for( key = __keys; NULL != key->key; key++ ) {
+        if( (key->length < *len) &&
+            (0 == strncasecmp(comment, key->key, key->length)) )
+        {
+            *len = key->length;
+            return key->type;
         }
     }
 
-    lseek( fd, *len, SEEK_CUR );
-    *len = 0;
     return FM__UNKNOWN;
 }
 
 /**
- *  Used to read in an int32_t from a file as an ASCII string.
+ *  Used to parse an int32_t from an ASCII string.
  *
- *  @param fd the file descriptor to read and process
- *  @param len the maximum valid number of of bytes
+ *  @param value the string to parse, not '\0' terminated
+ *  @param len the number of bytes in the string
  *  @param out the output int32_t data
  *
  *  @return true if successful, false otherwise
  */
-static bool flac_get_int32_t( int fd, uint32_t *len, int32_t *out )
+static bool flac_get_int32_t( const char *value, uint32_t len, int32_t *out )
 {
     bool positive;
     bool got_sign;
@@ -863,14 +1228,10 @@ static bool flac_get_int32_t( int fd, uint32_t *len, int32_t *out )
     positive = true;
     got_sign = false;
 
-    while( 0 < *len ) {
-        char c;
+    while( 0 < len ) {
+        char c = *value++;
 
-        if( 1 != read(fd, &c, 1) ) {
-            return false;
-        }
-
-        (*len)--;
+        len--;
 
         if( ('0' <= c) && (c <= '9') ) {
             if( ((*out) * 10) < (*out) ) {
@@ -903,15 +1264,16 @@ static bool flac_get_int32_t( int fd, uint32_t *len, int32_t *out )
 }
 
 /**
- *  Used to read in double from a file as an ASCII string.
+ *  Used to parse a double from an ASCII string, stopping at the first
+ *  character that isn't part of the number (as in "-6.5 dB").
  *
- *  @param fd the file descriptor to read and process
- *  @param len the maximum valid number of of bytes
+ *  @param value the string to parse, not '\0' terminated
+ *  @param len the number of bytes in the string
  *  @param out the output double data
  *
  *  @return true if successful, false otherwise
  */
-static bool flac_get_double( int fd, uint32_t *len, double *out )
+static bool flac_get_double( const char *value, uint32_t len, double *out )
 {
     bool positive;
     uint32_t number;
@@ -922,14 +1284,10 @@ static bool flac_get_double( int fd, uint32_t *len, double *out )
     decimal_point = 0;
     number = 0;
 
-    while( 0 < *len ) {
-        char c;
-
-        if( 1 != read(fd, &c, 1) ) {
-            return false;
-        }
+    while( 0 < len ) {
+        char c = *value++;
 
-        (*len)--;
+        len--;
 
         switch( c ) {
             case '+':
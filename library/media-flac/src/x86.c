@@ -0,0 +1,139 @@
+/*
+ * LPC restoration with SSE2 or AVX2 for host builds, selected with
+ * CPU_X86 & -mavx2.  Samples are restored in place four at a time.  The
+ * taps from 4 on only need samples from before the four, so they are
+ * summed for all four at once with the coefficient in every lane.  The
+ * first three taps are then added one sample after another, as each
+ * needs the sample before it.  The sums are the low 32 bits of the
+ * products, as the C filters do them, so the output is bit-exact.
+ *
+ * The last two groups of four are kept in registers & stored as whole
+ * vectors, so the loads of the recent samples are never of a store the
+ * CPU can't forward.
+ */
+#include <stdint.h>
+#include <emmintrin.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "x86.h"
+
+#if defined(__AVX2__)
+#define MUL32(a, b) _mm_mullo_epi32( (a), (b) )
+#else
+/* The low 32 bits of each product, SSE2 only multiplies lanes 0 & 2 */
+static inline __m128i MUL32( __m128i a, __m128i b )
+{
+    __m128i even = _mm_mul_epu32( a, b );
+    __m128i odd = _mm_mul_epu32( _mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32) );
+
+    return _mm_unpacklo_epi32( _mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                               _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)) );
+}
+#endif
+
+/* data[i - k] for the four samples from i, from the last two groups */
+#define RECENT(prev, prev2, k) \
+    _mm_or_si128( _mm_srli_si128((prev2), 16 - 4 * ((k) - 4)), \
+                  _mm_slli_si128((prev), 4 * ((k) - 4)) )
+
+/** See x86.h for details.  pred_order must be at least 8. */
+void lpc_decode_x86( int32_t count, int32_t qlevel,
+                     int32_t pred_order, int32_t* data,
+                     const int16_t* coeffs )
+{
+    const uint32_t c0 = coeffs[0];
+    const uint32_t c1 = coeffs[1];
+    const uint32_t c2 = coeffs[2];
+    uint32_t y1 = data[-1];
+    uint32_t y2 = data[-2];
+    uint32_t y3 = data[-3];
+    __m128i taps[32];
+    __m128i prev;
+    __m128i prev2;
+#if defined(__AVX2__)
+    __m256i pairs[16];
+#endif
+    int32_t i;
+    int32_t k;
+
+    for( k = 3; k < pred_order; k++ ) {
+        taps[k] = _mm_set1_epi32( coeffs[k] );
+    }
+#if defined(__AVX2__)
+    /* Taps 8 & 9, 10 & 11 ... multiplied two at a time */
+    for( k = 7; (k + 1) < pred_order; k += 2 ) {
+        pairs[k / 2] = _mm256_inserti128_si256( _mm256_castsi128_si256(taps[k]),
+                                                taps[k + 1], 1 );
+    }
+#endif
+
+    prev = _mm_loadu_si128( (const __m128i*) &data[-4] );
+    prev2 = _mm_loadu_si128( (const __m128i*) &data[-8] );
+
+    for( i = 0; (i + 4) <= count; i += 4 ) {
+        int32_t *d = &data[i];
+        __m128i sum;
+        uint32_t p0, p1, p2, p3;
+        uint32_t r0, r1, r2, r3;
+
+        sum = MUL32( prev, taps[3] );
+        sum = _mm_add_epi32( sum, MUL32(RECENT(prev, prev2, 5), taps[4]) );
+        sum = _mm_add_epi32( sum, MUL32(RECENT(prev, prev2, 6), taps[5]) );
+        sum = _mm_add_epi32( sum, MUL32(RECENT(prev, prev2, 7), taps[6]) );
+
+#if defined(__AVX2__)
+        {
+            __m256i wide = _mm256_setzero_si256();
+
+            for( k = 8; k < pred_order; k += 2 ) {
+                __m256i two;
+
+                two = _mm256_inserti128_si256(
+                        _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*) &d[-k])),
+                        _mm_loadu_si128((const __m128i*) &d[-k - 1]), 1 );
+                wide = _mm256_add_epi32( wide, _mm256_mullo_epi32(two, pairs[(k - 1) / 2]) );
+            }
+            sum = _mm_add_epi32( sum, _mm256_castsi256_si128(wide) );
+            sum = _mm_add_epi32( sum, _mm256_extracti128_si256(wide, 1) );
+        }
+        if( k == pred_order ) {
+            sum = _mm_add_epi32( sum, MUL32(_mm_loadu_si128((const __m128i*) &d[-k]),
+                                            taps[k - 1]) );
+        }
+#else
+        for( k = 8; k <= pred_order; k++ ) {
+            sum = _mm_add_epi32( sum, MUL32(_mm_loadu_si128((const __m128i*) &d[-k]),
+                                            taps[k - 1]) );
+        }
+#endif
+
+        p0 = _mm_cvtsi128_si32( sum );
+        p1 = _mm_cvtsi128_si32( _mm_srli_si128(sum, 4) );
+        p2 = _mm_cvtsi128_si32( _mm_srli_si128(sum, 8) );
+        p3 = _mm_cvtsi128_si32( _mm_srli_si128(sum, 12) );
+
+        r0 = d[0] + ((int32_t) (p0 + c0 * y1 + c1 * y2 + c2 * y3) >> qlevel);
+        r1 = d[1] + ((int32_t) (p1 + c0 * r0 + c1 * y1 + c2 * y2) >> qlevel);
+        r2 = d[2] + ((int32_t) (p2 + c0 * r1 + c1 * r0 + c2 * y1) >> qlevel);
+        r3 = d[3] + ((int32_t) (p3 + c0 * r2 + c1 * r1 + c2 * r0) >> qlevel);
+
+        y1 = r3;
+        y2 = r2;
+        y3 = r1;
+        prev2 = prev;
+        prev = _mm_set_epi32( r3, r2, r1, r0 );
+        _mm_storeu_si128( (__m128i*) d, prev );
+    }
+
+    /* What's left of the block */
+    for( ; i < count; i++ ) {
+        uint32_t sum = 0;
+
+        for( k = 0; k < pred_order; k++ ) {
+            sum += (uint32_t) coeffs[k] * (uint32_t) data[i - k - 1];
+        }
+        data[i] += (int32_t) sum >> qlevel;
+    }
+}
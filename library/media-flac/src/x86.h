@@ -0,0 +1,17 @@
+#ifndef __FLAC_X86_H__
+#define __FLAC_X86_H__
+
+#include <stdint.h>
+
+/* The lowest order lpc_decode_x86() beats the C filters at */
+#if defined(__AVX2__)
+#define LPC_X86_MIN_ORDER 12
+#else
+#define LPC_X86_MIN_ORDER 14
+#endif
+
+void lpc_decode_x86( int32_t count, int32_t qlevel,
+                     int32_t pred_order, int32_t* data,
+                     const int16_t* coeffs );
+
+#endif
@@ -0,0 +1,501 @@
+/*
+ * Decode benchmark - not a unit test, run it with "make bench".
+ *
+ * Encodes 20s of stereo audio, a few tones with a little noise, into LPC
+ * subframes the way libFLAC does at its usual settings: 4096 sample
+ * blocks, 12 bit coefficients from the autocorrelation of a Hann windowed
+ * block & Rice coded residuals in 16 partitions.  Each profile picks the
+ * sample size & the LPC orders used, from the order 8 of "flac -5" to all
+ * 32 orders in turn.  Order 32 of 16 bit audio & all 24 bit audio need
+ * the 64 bit sums.  The residuals profiles time the Rice decoding on its
+ * own: the order 8 residuals go in FIXED order 0 subframes, which decode
+ * to the residuals with nothing else to do.  The frames are decoded with
+ * flac_decode_frame() & checked against what they were made from, so the
+ * decoding has to be exact, then decoded again for at least 0.3s keeping
+ * the fastest pass.  The results are written to stdout as JSON so runs
+ * can be compared.
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include "decoder.h"
+
+#define SAMPLE_RATE     44100
+#define BLOCKSIZE       4096
+#define FRAMES          216             /* About 20s */
+#define PRECISION       12
+#define PARTITION_ORDER 4
+#define MIN_BENCH_NS    300000000ull   /* Decoding each profile */
+
+typedef struct {
+    const char *name;
+    int bps;
+    int orders[32];
+    int order_count;
+    bool residuals;     /* Just the residuals of the LPC, in FIXED subframes */
+} bench_profile_t;
+
+static const bench_profile_t profiles[] = {
+    { "16bit_order_8",      16, { 8 },  1 },
+    { "16bit_order_12",     16, { 12 }, 1 },
+    { "16bit_order_24",     16, { 24 }, 1 },
+    { "16bit_order_32",     16, { 32 }, 1 },
+    { "16bit_all_orders",   16, { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13,
+                                  14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24,
+                                  25, 26, 27, 28, 29, 30, 31, 32 }, 32 },
+    { "24bit_order_12",     24, { 12 }, 1 },
+    { "16bit_residuals",    16, { 8 },  1, true },
+    { "24bit_residuals",    24, { 8 },  1, true },
+};
+
+static int32_t source[2][FRAMES * BLOCKSIZE];
+static int32_t expected[2][FRAMES * BLOCKSIZE];
+static uint8_t *stream;
+static uint32_t frame_offset[FRAMES + 1];
+static uint32_t random_state = 0x2545f491;
+
+static int32_t decoded0[MAX_BLOCKSIZE];
+static int32_t decoded1[MAX_BLOCKSIZE];
+
+static void fail( const char *what, const char *name )
+{
+    fprintf( stderr, "%s %s failed\n", what, name );
+    exit( 1 );
+}
+
+static uint64_t now_ns( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* xorshift32, so every run encodes the same audio. */
+static uint32_t random_next( void )
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+/*----------------------------------------------------------------------------*/
+/*                                 Bit writer                                 */
+/*----------------------------------------------------------------------------*/
+static uint8_t *out;
+static uint64_t out_bits;
+
+static void put_bits( uint32_t value, int count )
+{
+    while( 0 < count-- ) {
+        if( 0 == (out_bits & 7) ) {
+            out[out_bits / 8] = 0;
+        }
+        if( 0 != ((value >> count) & 1) ) {
+            out[out_bits / 8] |= 0x80 >> (out_bits & 7);
+        }
+        out_bits++;
+    }
+}
+
+static void put_unary( uint32_t zeros )
+{
+    while( 31 < zeros ) {
+        put_bits( 0, 31 );
+        zeros -= 31;
+    }
+    put_bits( 1, zeros + 1 );
+}
+
+static uint8_t crc8( const uint8_t *buf, uint32_t count )
+{
+    uint8_t crc = 0;
+
+    while( 0 < count-- ) {
+        int i;
+
+        crc ^= *buf++;
+        for( i = 0; i < 8; i++ ) {
+            crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : (crc << 1);
+        }
+    }
+    return crc;
+}
+
+static uint16_t crc16( const uint8_t *buf, uint32_t count )
+{
+    uint16_t crc = 0;
+
+    while( 0 < count-- ) {
+        int i;
+
+        crc ^= (*buf++) << 8;
+        for( i = 0; i < 8; i++ ) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x8005 : (crc << 1);
+        }
+    }
+    return crc;
+}
+
+/*----------------------------------------------------------------------------*/
+/*                                LPC encoder                                 */
+/*----------------------------------------------------------------------------*/
+static void make_audio( int bps )
+{
+    static const double tones[2][4] = {
+        { 110.0, 277.2, 659.3, 1864.7 },
+        { 146.8, 329.6, 880.0, 2489.0 },
+    };
+    double scale = (double) (1 << (bps - 1));
+    int32_t noise = 1 << (bps - 11);
+    int channel;
+    int i;
+
+    for( channel = 0; channel < 2; channel++ ) {
+        for( i = 0; i < FRAMES * BLOCKSIZE; i++ ) {
+            double t = (double) i / SAMPLE_RATE;
+            double swell = 0.6 + 0.4 * sin( 2.0 * M_PI * 0.25 * t );
+            double x = 0.0;
+            int tone;
+
+            for( tone = 0; tone < 4; tone++ ) {
+                x += sin( 2.0 * M_PI * tones[channel][tone] * t ) / (2 << tone);
+            }
+            source[channel][i] = (int32_t) (x * swell * 0.6 * scale) +
+                                 (int32_t) (random_next() % (2 * noise)) - noise;
+        }
+    }
+}
+
+/* Levinson-Durbin on the autocorrelation of the windowed block. */
+static void compute_lpc( const int32_t *x, int order, double *lpc )
+{
+    static double w[BLOCKSIZE];
+    double r[33];
+    double a[33];
+    double err;
+    int i, j;
+
+    for( i = 0; i < BLOCKSIZE; i++ ) {
+        w[i] = x[i] * (0.5 - 0.5 * cos(2.0 * M_PI * i / (BLOCKSIZE - 1)));
+    }
+    for( i = 0; i <= order; i++ ) {
+        r[i] = 0.0;
+        for( j = i; j < BLOCKSIZE; j++ ) {
+            r[i] += w[j] * w[j - i];
+        }
+    }
+    r[0] *= 1.0 + 1e-9;
+
+    err = r[0];
+    for( i = 0; i < order; i++ ) {
+        double k = -r[i + 1];
+        double tmp[33];
+
+        for( j = 0; j < i; j++ ) {
+            k -= a[j] * r[i - j];
+        }
+        k /= err;
+
+        memcpy( tmp, a, sizeof(tmp) );
+        for( j = 0; j < i; j++ ) {
+            a[j] = tmp[j] + k * tmp[i - 1 - j];
+        }
+        a[i] = k;
+        err *= 1.0 - k * k;
+    }
+
+    /* decoded[i] += sum(lpc[j] * decoded[i - j - 1]) */
+    for( i = 0; i < order; i++ ) {
+        lpc[i] = -a[i];
+    }
+}
+
+/* As FLAC__lpc_quantize_coefficients() does it. */
+static int quantize_lpc( const double *lpc, int order, int32_t *qlp )
+{
+    int32_t max_coeff = (1 << (PRECISION - 1)) - 1;
+    double cmax = 0.0;
+    double error = 0.0;
+    int shift;
+    int i;
+
+    for( i = 0; i < order; i++ ) {
+        if( cmax < fabs(lpc[i]) ) {
+            cmax = fabs( lpc[i] );
+        }
+    }
+    frexp( cmax, &shift );
+    shift = (PRECISION - 1) - shift;
+    if( 15 < shift ) {
+        shift = 15;
+    } else if( shift < 0 ) {
+        shift = 0;
+    }
+
+    for( i = 0; i < order; i++ ) {
+        int32_t q;
+
+        error += lpc[i] * (1 << shift);
+        q = (int32_t) lround( error );
+        if( max_coeff < q ) {
+            q = max_coeff;
+        } else if( q < -max_coeff - 1 ) {
+            q = -max_coeff - 1;
+        }
+        error -= q;
+        qlp[i] = q;
+    }
+    return shift;
+}
+
+static void put_residuals( const int32_t *residual, int order )
+{
+    int partitions = 1 << PARTITION_ORDER;
+    int samples = BLOCKSIZE >> PARTITION_ORDER;
+    int params[1 << PARTITION_ORDER];
+    int method = 0;
+    int partition;
+
+    /* The cheapest Rice parameter for each partition */
+    for( partition = 0; partition < partitions; partition++ ) {
+        int first = (0 == partition) ? order : 0;
+        uint64_t best = UINT64_MAX;
+        int k;
+
+        for( k = 0; k < 30; k++ ) {
+            uint64_t bits = 0;
+            int i;
+
+            for( i = first; i < samples; i++ ) {
+                int32_t r = residual[partition * samples + i];
+                uint32_t u = ((uint32_t) r << 1) ^ (uint32_t) (r >> 31);
+
+                bits += (u >> k) + 1 + k;
+            }
+            if( bits < best ) {
+                best = bits;
+                params[partition] = k;
+            }
+        }
+        if( 14 < params[partition] ) {
+            method = 1;
+        }
+    }
+
+    put_bits( method, 2 );
+    put_bits( PARTITION_ORDER, 4 );
+    for( partition = 0; partition < partitions; partition++ ) {
+        int first = (0 == partition) ? order : 0;
+        int k = params[partition];
+        int i;
+
+        put_bits( k, (0 == method) ? 4 : 5 );
+        for( i = first; i < samples; i++ ) {
+            int32_t r = residual[partition * samples + i];
+            uint32_t u = ((uint32_t) r << 1) ^ (uint32_t) (r >> 31);
+
+            put_unary( u >> k );
+            put_bits( u & ((1u << k) - 1), k );
+        }
+    }
+}
+
+/* An LPC subframe of x, or a FIXED order 0 subframe of its residuals that
+ * decodes to the residuals, with what it decodes to in expect. */
+static void put_subframe( const int32_t *x, int bps, int order,
+                          bool residuals, int32_t *expect )
+{
+    static int32_t residual[BLOCKSIZE];
+    double lpc[32];
+    int32_t qlp[32];
+    int shift;
+    int i, j;
+
+    compute_lpc( x, order, lpc );
+    shift = quantize_lpc( lpc, order, qlp );
+
+    for( i = 0; i < order; i++ ) {
+        residual[i] = x[i];
+    }
+    for( i = order; i < BLOCKSIZE; i++ ) {
+        int64_t sum = 0;
+
+        for( j = 0; j < order; j++ ) {
+            sum += (int64_t) qlp[j] * x[i - j - 1];
+        }
+        residual[i] = x[i] - (int32_t) (sum >> shift);
+    }
+
+    if( true == residuals ) {
+        put_bits( 0x08 << 1, 8 );
+        put_residuals( residual, 0 );
+        memcpy( expect, residual, sizeof(residual) );
+        return;
+    }
+
+    put_bits( (0x20 | (order - 1)) << 1, 8 );
+    for( i = 0; i < order; i++ ) {
+        put_bits( (uint32_t) x[i] & ((1u << bps) - 1), bps );
+    }
+    put_bits( PRECISION - 1, 4 );
+    put_bits( shift, 5 );
+    for( i = 0; i < order; i++ ) {
+        put_bits( (uint32_t) qlp[i] & ((1u << PRECISION) - 1), PRECISION );
+    }
+    put_residuals( residual, order );
+    memcpy( expect, x, sizeof(residual) );
+}
+
+static void encode( const bench_profile_t *profile )
+{
+    uint32_t n;
+
+    out = stream;
+    out_bits = 0;
+    for( n = 0; n < FRAMES; n++ ) {
+        int order = profile->orders[n % profile->order_count];
+        uint32_t start = out_bits / 8;
+
+        frame_offset[n] = start;
+        put_bits( 0xfff8, 16 );
+        put_bits( 12, 4 );                              /* 4096 samples */
+        put_bits( 9, 4 );                               /* 44.1kHz */
+        put_bits( 1, 4 );                               /* Left, right */
+        put_bits( (16 == profile->bps) ? 4 : 6, 3 );
+        put_bits( 0, 1 );
+        if( n < 0x80 ) {
+            put_bits( n, 8 );
+        } else {
+            put_bits( 0xc0 | (n >> 6), 8 );
+            put_bits( 0x80 | (n & 0x3f), 8 );
+        }
+        put_bits( crc8(&stream[start], out_bits / 8 - start), 8 );
+
+        put_subframe( &source[0][n * BLOCKSIZE], profile->bps, order,
+                      profile->residuals, &expected[0][n * BLOCKSIZE] );
+        put_subframe( &source[1][n * BLOCKSIZE], profile->bps, order,
+                      profile->residuals, &expected[1][n * BLOCKSIZE] );
+
+        while( 0 != (out_bits & 7) ) {
+            put_bits( 0, 1 );
+        }
+        put_bits( crc16(&stream[start], out_bits / 8 - start), 16 );
+    }
+    frame_offset[FRAMES] = out_bits / 8;
+}
+
+/*----------------------------------------------------------------------------*/
+/*                                 Benchmark                                  */
+/*----------------------------------------------------------------------------*/
+static void init_context( FLACContext *fc, int bps )
+{
+    memset( fc, 0, sizeof(FLACContext) );
+    fc->min_blocksize = BLOCKSIZE;
+    fc->max_blocksize = BLOCKSIZE;
+    fc->max_framesize = MAX_FRAMESIZE;
+    fc->samplerate = SAMPLE_RATE;
+    fc->channels = 2;
+    fc->bps = bps;
+}
+
+static bool decode_all( const bench_profile_t *profile, bool check )
+{
+    FLACContext fc;
+    int scale = FLAC_OUTPUT_DEPTH - profile->bps;
+    uint32_t n;
+
+    init_context( &fc, profile->bps );
+    for( n = 0; n < FRAMES; n++ ) {
+        uint32_t length = frame_offset[n + 1] - frame_offset[n];
+        int i;
+
+        if( 0 != flac_decode_frame(&fc, decoded0, decoded1,
+                                   &stream[frame_offset[n]], length) )
+        {
+            return false;
+        }
+        if( (true == check) && (length != fc.framesize) ) {
+            return false;
+        }
+        for( i = 0; (true == check) && (i < BLOCKSIZE); i++ ) {
+            if( (expected[0][n * BLOCKSIZE + i] * (1 << scale) != decoded0[i]) ||
+                (expected[1][n * BLOCKSIZE + i] * (1 << scale) != decoded1[i]) )
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void run( const bench_profile_t *profile, bool last )
+{
+    uint64_t ns;
+    uint64_t total;
+    bool exact;
+
+    make_audio( profile->bps );
+    encode( profile );
+
+    exact = decode_all( profile, true );
+    if( false == exact ) {
+        fail( "decoding", profile->name );
+    }
+
+    /* The fastest pass, as the others were interrupted */
+    ns = UINT64_MAX;
+    total = 0;
+    do {
+        uint64_t begin = now_ns();
+        uint64_t pass;
+
+        decode_all( profile, false );
+        pass = now_ns() - begin;
+        if( pass < ns ) {
+            ns = pass;
+        }
+        total += pass;
+    } while( total < MIN_BENCH_NS );
+
+    printf( "    {\n" );
+    printf( "      \"name\": \"%s\",\n", profile->name );
+    printf( "      \"bits_per_sample\": %d,\n", profile->bps );
+    printf( "      \"exact\": %s,\n", (true == exact) ? "true" : "false" );
+    printf( "      \"compressed_bytes\": %u,\n", frame_offset[FRAMES] );
+    printf( "      \"ns_per_sample\": %.2f,\n",
+            (double) ns / (2.0 * FRAMES * BLOCKSIZE) );
+    printf( "      \"bits_per_ns\": %.3f,\n", 8.0 * frame_offset[FRAMES] / ns );
+    printf( "      \"realtime\": %.0f\n",
+            ((double) FRAMES * BLOCKSIZE / SAMPLE_RATE) * 1e9 / ns );
+    printf( "    }%s\n", (true == last) ? "" : "," );
+}
+
+int main( int argc, char *argv[] )
+{
+    uint32_t count = sizeof(profiles) / sizeof(profiles[0]);
+    uint32_t i;
+
+    /* More than enough for 24 bit audio that won't compress. */
+    stream = (uint8_t*) calloc( FRAMES * 2 * BLOCKSIZE * 4 + 16, 1 );
+    if( NULL == stream ) {
+        fail( "allocate", "stream" );
+    }
+
+    printf( "{\n" );
+    printf( "  \"blocksize\": %u,\n", BLOCKSIZE );
+    printf( "  \"frames\": %u,\n", FRAMES );
+    printf( "  \"profiles\": [\n" );
+    for( i = 0; i < count; i++ ) {
+        run( &profiles[i], (count - 1) == i );
+    }
+    printf( "  ]\n}\n" );
+
+    free( stream );
+    return 0;
+}
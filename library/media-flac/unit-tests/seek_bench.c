@@ -0,0 +1,552 @@
+/*
+ * Seek benchmark - not a unit test, run it with "make bench".
+ *
+ * Writes a 6 minute 44.1kHz 16 bit stereo FLAC file the way libFLAC lays
+ * it out, with 4096 sample frames & a SEEKTABLE point every 10s, and the
+ * same song without the SEEKTABLE.  The frames are verbatim & constant
+ * subframes of varying sizes, with each sample holding its own number so
+ * the first sample played after a seek shows if it is the right one.
+ * Each song is played through media_flac_play() & seeked 30s & 5 minutes
+ * forwards & backwards the way the fast play does it.  The stream reads
+ * the file 16kB at a time like the file stream, each read costing the
+ * card time card_bench uses (500us a command, 250us a sector), from the
+ * seek being asked for until the first samples reach the DSP.  The
+ * results are written to stdout as JSON so runs can be compared.
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dsp/dsp.h>
+#include <file-stream/file-stream.h>
+#include <freertos/os.h>
+#include "media-flac.h"
+#include "decoder.h"
+
+#define SONG            "./seek_bench_song.flac"
+#define SONG_NO_TABLE   "./seek_bench_song_no_table.flac"
+#define SAMPLE_RATE     44100
+#define BLOCKSIZE       4096
+#define SONG_SECONDS    360
+#define TOTAL_SAMPLES   (SONG_SECONDS * SAMPLE_RATE)
+#define SEEK_EVERY      (10 * SAMPLE_RATE)
+#define READ_SIZE       (16 * 1024)
+#define COMMAND_US      500
+#define SECTOR_US       250
+
+typedef struct {
+    const char *name;
+    uint32_t from_ms;
+    uint32_t to_ms;
+} bench_seek_t;
+
+static const bench_seek_t seeks[] = {
+    { "forward_30s",     60000,  90000 },
+    { "forward_5min",    30000, 330000 },
+    { "reverse_30s",    200000, 170000 },
+    { "reverse_5min",   330000,  30000 },
+    { "forward_0.5s",   100000, 100500 },
+    { "past_the_end",   300000, 400000 },
+};
+
+/*----------------------------------------------------------------------------*/
+/*                 A file stream reading the way the real one does            */
+/*----------------------------------------------------------------------------*/
+struct fstream {
+    int fd;
+    uint32_t size;
+    uint32_t pos;           /* The next byte handed out */
+    uint32_t start;         /* The file offset of buf[0] */
+    uint32_t fill;
+    uint8_t buf[MAX_FRAMESIZE + READ_SIZE];
+};
+
+static struct fstream stream;
+static uint32_t reads;
+static uint32_t sectors;
+
+bool fstream_open( fstream_t *fs, const char *filename )
+{
+    fs->fd = open( filename, O_RDONLY );
+    if( -1 == fs->fd ) {
+        return false;
+    }
+    fs->size = lseek( fs->fd, 0, SEEK_END );
+    fs->pos = 0;
+    fs->start = 0;
+    fs->fill = 0;
+    return true;
+}
+
+void fstream_close( fstream_t *fs )
+{
+    close( fs->fd );
+}
+
+uint32_t fstream_get_filesize( fstream_t *fs )
+{
+    return fs->size;
+}
+
+void* fstream_get_buffer( fstream_t *fs, const size_t wanted, size_t *got )
+{
+    uint32_t have = fs->start + fs->fill - fs->pos;
+
+    /* Read ahead of what's left in READ_SIZE reads, like the stream. */
+    if( (have < wanted) && (fs->pos < fs->size) ) {
+        memmove( fs->buf, &fs->buf[fs->pos - fs->start], have );
+        fs->start = fs->pos;
+        fs->fill = have;
+        while( (fs->fill < wanted) && ((fs->start + fs->fill) < fs->size) ) {
+            ssize_t count;
+
+            lseek( fs->fd, fs->start + fs->fill, SEEK_SET );
+            count = read( fs->fd, &fs->buf[fs->fill], READ_SIZE );
+            if( count <= 0 ) {
+                break;
+            }
+            fs->fill += count;
+            reads++;
+            sectors += (count + 511) / 512;
+        }
+        have = fs->fill;
+    }
+
+    *got = (have < wanted) ? have : wanted;
+    return &fs->buf[fs->pos - fs->start];
+}
+
+void fstream_release_buffer( fstream_t *fs, const size_t consumed )
+{
+    fs->pos += consumed;
+}
+
+void fstream_skip( fstream_t *fs, const size_t skip )
+{
+    fs->pos += skip;
+}
+
+bool fstream_seek( fstream_t *fs, const uint32_t offset )
+{
+    if( fs->size < offset ) {
+        return false;
+    }
+
+    /* What has been read already is used where it can be. */
+    if( (offset < fs->start) || ((fs->start + fs->fill) < offset) ) {
+        fs->start = offset;
+        fs->fill = 0;
+    }
+    fs->pos = offset;
+    return true;
+}
+
+/* The tags aren't read, but media-flac.c links against the tag reads. */
+int fstream_card_open( const char *filename )
+{
+    return open( filename, O_RDONLY );
+}
+
+ssize_t fstream_card_read( int fd, void *buf, size_t count )
+{
+    return read( fd, buf, count );
+}
+
+off_t fstream_card_lseek( int fd, off_t offset, int whence )
+{
+    return lseek( fd, offset, whence );
+}
+
+int fstream_card_close( int fd )
+{
+    return close( fd );
+}
+
+/*----------------------------------------------------------------------------*/
+/*                        The DSP & OS under the codec                        */
+/*----------------------------------------------------------------------------*/
+typedef struct {
+    void *items[8];
+    uint32_t count;
+} bench_queue_t;
+
+static const bench_seek_t *seeking;
+static bool seek_asked;
+static bool seek_done;
+static bool seek_exact;
+static uint64_t seek_ns;
+static uint32_t seek_reads;
+static uint32_t seek_sectors;
+static uint32_t frames_played;
+
+static uint64_t now_ns( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+bool os_queue_receive( queue_handle_t queue, void *buffer, uint32_t ms )
+{
+    bench_queue_t *q = (bench_queue_t*) queue;
+
+    if( 0 == q->count ) {
+        return false;
+    }
+    q->count--;
+    memcpy( buffer, &q->items[q->count], sizeof(void*) );
+    return true;
+}
+
+bool os_queue_send_to_back( queue_handle_t queue, const void *buffer, uint32_t ms )
+{
+    bench_queue_t *q = (bench_queue_t*) queue;
+
+    memcpy( &q->items[q->count], buffer, sizeof(void*) );
+    q->count++;
+    return true;
+}
+
+int32_t dsp_determine_scale_factor( const double peak, const double gain )
+{
+    return 0;
+}
+
+dsp_status_t dsp_queue_data( int32_t *left, int32_t *right,
+                             const size_t count, const uint32_t bitrate,
+                             const int32_t gain, dsp_buffer_return_fct cb,
+                             void *data )
+{
+    if( (true == seek_asked) && (false == seek_done) ) {
+        uint32_t sample = (uint32_t) ((uint64_t) seeking->to_ms * SAMPLE_RATE / 1000);
+        int32_t expect_left = (int16_t) (sample & 0xffff);
+        int32_t expect_right = (int16_t) (sample >> 16);
+
+        seek_ns = now_ns() - seek_ns;
+        seek_reads = reads - seek_reads;
+        seek_sectors = sectors - seek_sectors;
+        seek_exact = ((expect_left * (1 << 13)) == left[0]) &&
+                     ((expect_right * (1 << 13)) == right[0]);
+        seek_done = true;
+    }
+    frames_played++;
+
+    (*cb)( left, right, data );
+    return DSP_RETURN_OK;
+}
+
+void dsp_data_complete( dsp_buffer_return_fct cb, void *data )
+{
+}
+
+/* Asks for the seek once the song gets to it, then stops after it. */
+static bool command( const uint32_t position, uint32_t *seek )
+{
+    if( true == seek_done ) {
+        return false;
+    }
+
+    if( (false == seek_asked) && (seeking->from_ms <= position) ) {
+        seek_asked = true;
+        seek_ns = now_ns();
+        seek_reads = reads;
+        seek_sectors = sectors;
+        *seek = seeking->to_ms;
+    }
+
+    return true;
+}
+
+static void *bench_malloc( const size_t size )
+{
+    return malloc( size );
+}
+
+static void bench_free( void *ptr )
+{
+    free( ptr );
+}
+
+/*----------------------------------------------------------------------------*/
+/*                               Writing the songs                            */
+/*----------------------------------------------------------------------------*/
+static uint8_t frame[4 * BLOCKSIZE + 64];
+static uint32_t frame_bits;
+
+static void fail( const char *what, const char *path )
+{
+    fprintf( stderr, "%s %s failed\n", what, path );
+    exit( 1 );
+}
+
+static void put_bits( uint32_t value, uint32_t count )
+{
+    while( 0 < count-- ) {
+        if( 0 == (frame_bits & 7) ) {
+            frame[frame_bits / 8] = 0;
+        }
+        if( 0 != ((value >> count) & 1) ) {
+            frame[frame_bits / 8] |= 0x80 >> (frame_bits & 7);
+        }
+        frame_bits++;
+    }
+}
+
+static uint8_t crc8( const uint8_t *buf, uint32_t count )
+{
+    uint8_t crc = 0;
+
+    while( 0 < count-- ) {
+        uint32_t i;
+
+        crc ^= *buf++;
+        for( i = 0; i < 8; i++ ) {
+            crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : (crc << 1);
+        }
+    }
+    return crc;
+}
+
+static uint16_t crc16( const uint8_t *buf, uint32_t count )
+{
+    uint16_t crc = 0;
+
+    while( 0 < count-- ) {
+        uint32_t i;
+
+        crc ^= (*buf++) << 8;
+        for( i = 0; i < 8; i++ ) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x8005 : (crc << 1);
+        }
+    }
+    return crc;
+}
+
+/* Builds frame n, with the right channel verbatim or constant. */
+static uint32_t build_frame( uint32_t n, uint32_t *random )
+{
+    uint32_t first = n * BLOCKSIZE;
+    uint32_t samples = TOTAL_SAMPLES - first;
+    uint32_t i;
+
+    if( BLOCKSIZE < samples ) {
+        samples = BLOCKSIZE;
+    }
+
+    frame_bits = 0;
+    put_bits( 0xfff8, 16 );
+    /* 4096 samples (or 16 bits at the end), 44.1kHz, 2 channels, 16 bits */
+    put_bits( (BLOCKSIZE == samples) ? 12 : 7, 4 );
+    put_bits( 9, 4 );
+    put_bits( 1, 4 );
+    put_bits( 4, 3 );
+    put_bits( 0, 1 );
+
+    /* The frame number as UTF-8 */
+    if( n < 0x80 ) {
+        put_bits( n, 8 );
+    } else if( n < 0x800 ) {
+        put_bits( 0xc0 | (n >> 6), 8 );
+        put_bits( 0x80 | (n & 0x3f), 8 );
+    } else {
+        put_bits( 0xe0 | (n >> 12), 8 );
+        put_bits( 0x80 | ((n >> 6) & 0x3f), 8 );
+        put_bits( 0x80 | (n & 0x3f), 8 );
+    }
+    if( BLOCKSIZE != samples ) {
+        put_bits( samples - 1, 16 );
+    }
+    put_bits( crc8(frame, frame_bits / 8), 8 );
+
+    /* Left: verbatim, the low 16 bits of the sample number. */
+    put_bits( 1 << 1, 8 );
+    for( i = 0; i < samples; i++ ) {
+        put_bits( (first + i) & 0xffff, 16 );
+    }
+
+    /* Right: the high 16 bits, constant or verbatim. */
+    *random ^= *random << 13;
+    *random ^= *random >> 17;
+    *random ^= *random << 5;
+    if( 0 == (*random & 1) ) {
+        put_bits( 0 << 1, 8 );
+        put_bits( first >> 16, 16 );
+    } else {
+        put_bits( 1 << 1, 8 );
+        for( i = 0; i < samples; i++ ) {
+            put_bits( (first + i) >> 16, 16 );
+        }
+    }
+
+    while( 0 != (frame_bits & 7) ) {
+        put_bits( 0, 1 );
+    }
+    put_bits( crc16(frame, frame_bits / 8), 16 );
+
+    return frame_bits / 8;
+}
+
+static void put_header( int fd, uint8_t type, bool last, uint32_t length )
+{
+    uint8_t header[4] = { type | ((true == last) ? 0x80 : 0),
+                          length >> 16, length >> 8, length };
+
+    write( fd, header, 4 );
+}
+
+static void write_song( const char *path, bool seektable )
+{
+    uint32_t frames = (TOTAL_SAMPLES + BLOCKSIZE - 1) / BLOCKSIZE;
+    uint32_t points = (TOTAL_SAMPLES + SEEK_EVERY - 1) / SEEK_EVERY;
+    uint8_t *table;
+    uint32_t offset;
+    uint32_t random;
+    uint32_t i;
+    int fd;
+
+    uint8_t streaminfo[34] = {
+        BLOCKSIZE >> 8, BLOCKSIZE & 0xff, BLOCKSIZE >> 8, BLOCKSIZE & 0xff,
+        0, 0, 16,                               /* min frame size */
+        0, (4 * BLOCKSIZE + 32) >> 8, (4 * BLOCKSIZE + 32) & 0xff,
+        (SAMPLE_RATE >> 12) & 0xff, (SAMPLE_RATE >> 4) & 0xff,
+        ((SAMPLE_RATE & 0xf) << 4) | (1 << 1) | 0,   /* 2 channels */
+        (15 << 4) | 0,                          /* 16 bits, samples 35-32 */
+        TOTAL_SAMPLES >> 24, (TOTAL_SAMPLES >> 16) & 0xff,
+        (TOTAL_SAMPLES >> 8) & 0xff, TOTAL_SAMPLES & 0xff
+    };
+
+    fd = open( path, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+    if( -1 == fd ) {
+        fail( "create", path );
+    }
+
+    write( fd, "fLaC", 4 );
+    put_header( fd, 0, false, sizeof(streaminfo) );
+    write( fd, streaminfo, sizeof(streaminfo) );
+
+    /* The seektable is filled in once the frames are written. */
+    table = calloc( points, 18 );
+    if( true == seektable ) {
+        put_header( fd, 3, false, points * 18 );
+        write( fd, table, points * 18 );
+    }
+    put_header( fd, 1, true, 8192 );
+    {
+        static uint8_t padding[8192];
+        write( fd, padding, sizeof(padding) );
+    }
+
+    offset = 0;
+    random = 0x2545f491;
+    for( i = 0; i < frames; i++ ) {
+        uint32_t first = i * BLOCKSIZE;
+        uint32_t length = build_frame( i, &random );
+
+        /* The point is the frame holding each 10s, as libFLAC does it. */
+        if( (first / SEEK_EVERY) != ((first + BLOCKSIZE - 1) / SEEK_EVERY) ||
+            (0 == first) )
+        {
+            uint32_t point = (0 == first) ? 0 : (first + BLOCKSIZE - 1) / SEEK_EVERY;
+            uint8_t *p = &table[point * 18];
+
+            if( point < points ) {
+                memset( p, 0, 18 );
+                p[4] = first >> 24; p[5] = first >> 16; p[6] = first >> 8; p[7] = first;
+                p[12] = offset >> 24; p[13] = offset >> 16; p[14] = offset >> 8; p[15] = offset;
+                p[16] = BLOCKSIZE >> 8; p[17] = BLOCKSIZE & 0xff;
+            }
+        }
+
+        if( length != write(fd, frame, length) ) {
+            fail( "write", path );
+        }
+        offset += length;
+    }
+
+    if( true == seektable ) {
+        pwrite( fd, table, points * 18, 4 + 4 + sizeof(streaminfo) + 4 );
+    }
+
+    free( table );
+    close( fd );
+}
+
+/*----------------------------------------------------------------------------*/
+/*                                 Benchmark                                  */
+/*----------------------------------------------------------------------------*/
+static void run( const char *name, const char *path, bool last )
+{
+    uint32_t count = sizeof(seeks) / sizeof(seeks[0]);
+    uint32_t i;
+
+    printf( "    {\n" );
+    printf( "      \"song\": \"%s\",\n", name );
+    printf( "      \"seeks\": [\n" );
+
+    for( i = 0; i < count; i++ ) {
+        bench_queue_t idle = { { NULL }, 0 };
+        media_status_t status;
+        uint32_t card_us;
+
+        seeking = &seeks[i];
+        seek_asked = false;
+        seek_done = false;
+        seek_exact = false;
+        frames_played = 0;
+
+        status = media_flac_play( path, 0.0, 0.0, &idle, 8, &bench_malloc,
+                                  &bench_free, &command );
+
+        /* Past the end is the end of the song, not a seek. */
+        if( 400000 == seeking->to_ms ) {
+            if( (MI_END_OF_SONG != status) || (true == seek_done) ) {
+                fail( "seek past the end of", path );
+            }
+            seek_ns = now_ns() - seek_ns;
+            seek_reads = reads - seek_reads;
+            seek_sectors = sectors - seek_sectors;
+            seek_exact = true;
+        } else if( (MI_STOPPED_BY_REQUEST != status) || (false == seek_done) ) {
+            fail( "seek in", path );
+        }
+
+        card_us = seek_reads * COMMAND_US + seek_sectors * SECTOR_US;
+        printf( "        {\n" );
+        printf( "          \"name\": \"%s\",\n", seeking->name );
+        printf( "          \"exact\": %s,\n", (true == seek_exact) ? "true" : "false" );
+        printf( "          \"reads\": %u,\n", seek_reads );
+        printf( "          \"kb_read\": %u,\n", seek_sectors / 2 );
+        printf( "          \"card_ms\": %.1f,\n", card_us / 1000.0 );
+        printf( "          \"host_us\": %.1f\n", seek_ns / 1000.0 );
+        printf( "        }%s\n", ((count - 1) == i) ? "" : "," );
+    }
+
+    printf( "      ]\n" );
+    printf( "    }%s\n", (true == last) ? "" : "," );
+}
+
+int main( int argc, char *argv[] )
+{
+    write_song( SONG, true );
+    write_song( SONG_NO_TABLE, false );
+    media_flac_init( &stream );
+
+    printf( "{\n" );
+    printf( "  \"song_seconds\": %u,\n", SONG_SECONDS );
+    printf( "  \"read_size\": %u,\n", READ_SIZE );
+    printf( "  \"command_us\": %u,\n", COMMAND_US );
+    printf( "  \"sector_us\": %u,\n", SECTOR_US );
+    printf( "  \"songs\": [\n" );
+    run( "seektable", SONG, false );
+    run( "no_seektable", SONG_NO_TABLE, true );
+    printf( "  ]\n}\n" );
+
+    unlink( SONG );
+    unlink( SONG_NO_TABLE );
+    return 0;
+}
@@ -0,0 +1,419 @@
+/*
+ * Tag scan benchmark - not a unit test, run it with "make bench".
+ *
+ * Writes directories of FLAC files laid out the way libFLAC writes them:
+ * the STREAMINFO, a SEEKTABLE, the VORBIS_COMMENT, a cover PICTURE & the
+ * PADDING, then the start of the audio.  The comments go from a handful
+ * of tags, to what a ripper writes (MusicBrainz ids & ReplayGain), to the
+ * same with a set of lyrics longer than the comment buffer.  Every file is
+ * then read with media_flac_get_metadata() the way populate_database()
+ * does it, checking the tags that come back.  The reads & seeks made
+ * through the file-stream are counted, as each one takes the card & is a
+ * trip through newlib & FatFs on the board.  The results are written to stdout as JSON so runs
+ * can be compared.
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <dsp/dsp.h>
+#include <freertos/os.h>
+#include "media-flac.h"
+#include "decoder.h"
+
+#define DIRECTORY       "./tag_bench_files"
+#define FILES           200
+#define PASSES          20
+#define SEEK_POINTS     100
+#define PICTURE_SIZE    (24 * 1024)
+#define PADDING_SIZE    8192
+#define AUDIO_SIZE      (16 * 1024)
+#define LYRICS_SIZE     4000
+
+typedef struct {
+    const char *name;
+    bool ripper;        /* MusicBrainz ids, ReplayGain & the rest */
+    bool lyrics;        /* A comment longer than the comment buffer */
+} bench_profile_t;
+
+static const bench_profile_t profiles[] = {
+    { "few_tags",   false,  false },
+    { "ripper",     true,   false },
+    { "lyrics",     true,   true  },
+};
+
+static uint32_t reads;
+static uint32_t seeks;
+
+/*----------------------------------------------------------------------------*/
+/*                 What media-flac.c needs to link for playing                */
+/*----------------------------------------------------------------------------*/
+void* fstream_get_buffer( fstream_t *fs, const size_t wanted, size_t *got )
+{
+    *got = 0;
+    return NULL;
+}
+
+void fstream_release_buffer( fstream_t *fs, const size_t consumed )
+{
+}
+
+void fstream_skip( fstream_t *fs, const size_t skip )
+{
+}
+
+bool fstream_seek( fstream_t *fs, const uint32_t offset )
+{
+    return false;
+}
+
+bool fstream_open( fstream_t *fs, const char *filename )
+{
+    return false;
+}
+
+void fstream_close( fstream_t *fs )
+{
+}
+
+uint32_t fstream_get_filesize( fstream_t *fs )
+{
+    return 0;
+}
+
+dsp_status_t dsp_queue_data( int32_t *left, int32_t *right,
+                             const size_t length, const uint32_t bitrate,
+                             const int32_t gain, dsp_buffer_return_fct cb,
+                             void *data )
+{
+    return DSP_RETURN_OK;
+}
+
+void dsp_data_complete( dsp_buffer_return_fct cb, void *data )
+{
+}
+
+int32_t dsp_determine_scale_factor( const double peak, const double gain )
+{
+    return 0;
+}
+
+bool os_queue_receive( queue_handle_t queue, void *buffer, uint32_t ms )
+{
+    return false;
+}
+
+bool os_queue_send_to_back( queue_handle_t queue, const void *buffer, uint32_t ms )
+{
+    return true;
+}
+
+int flac_decode_frame( FLACContext *s, int32_t *decoded0, int32_t *decoded1,
+                       uint8_t *buf, int buf_size )
+{
+    return -1;
+}
+
+int flac_parse_frame_header( FLACContext *s, uint8_t *buf, int buf_size,
+                             unsigned long *samplenumber, int *blocksize )
+{
+    return -1;
+}
+
+/*----------------------------------------------------------------------------*/
+/*                The tag reads, counting the calls to the file               */
+/*----------------------------------------------------------------------------*/
+int fstream_card_open( const char *filename )
+{
+    return open( filename, O_RDONLY );
+}
+
+ssize_t fstream_card_read( int fd, void *buf, size_t count )
+{
+    reads++;
+    return read( fd, buf, count );
+}
+
+off_t fstream_card_lseek( int fd, off_t offset, int whence )
+{
+    seeks++;
+    return lseek( fd, offset, whence );
+}
+
+int fstream_card_close( int fd )
+{
+    return close( fd );
+}
+
+/*----------------------------------------------------------------------------*/
+/*                              Writing the files                             */
+/*----------------------------------------------------------------------------*/
+static uint8_t file[256 * 1024];
+static uint32_t file_length;
+
+static void fail( const char *what, const char *path )
+{
+    fprintf( stderr, "%s %s failed\n", what, path );
+    exit( 1 );
+}
+
+static uint64_t now_ns( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void put( const void *data, uint32_t length )
+{
+    memcpy( &file[file_length], data, length );
+    file_length += length;
+}
+
+static void put_le32( uint32_t value )
+{
+    uint8_t buf[4] = { value, value >> 8, value >> 16, value >> 24 };
+
+    put( buf, 4 );
+}
+
+static void put_block_header( uint8_t type, bool last, uint32_t length )
+{
+    uint8_t buf[4] = { type | ((true == last) ? 0x80 : 0),
+                       length >> 16, length >> 8, length };
+
+    put( buf, 4 );
+}
+
+static void put_comment( const char *comment )
+{
+    put_le32( strlen(comment) );
+    put( comment, strlen(comment) );
+}
+
+static void make_title( char *title, uint32_t i )
+{
+    sprintf( title, "Track %u of the Synthetic Album", i );
+}
+
+/* Lays out one file, returning the comment block's size. */
+static uint32_t build_file( const bench_profile_t *profile, uint32_t i )
+{
+    static const char *ripper[] = {
+        "DATE=1997",
+        "GENRE=Alternative",
+        "TRACKTOTAL=12",
+        "DISCTOTAL=2",
+        "COMPOSER=Somebody Else",
+        "COMMENT=Ripped at the highest setting",
+        "MUSICBRAINZ_ALBUMID=0f9e4a16-8a5c-4d6b-9e0b-4f1b2c3d4e5f",
+        "MUSICBRAINZ_ARTISTID=1a2b3c4d-5e6f-7081-92a3-b4c5d6e7f809",
+        "MUSICBRAINZ_ALBUMARTISTID=1a2b3c4d-5e6f-7081-92a3-b4c5d6e7f809",
+        "MUSICBRAINZ_TRACKID=8c7d6e5f-4a3b-2c1d-0e9f-8a7b6c5d4e3f",
+        "MUSICBRAINZ_DISCID=Xk3pLQ9vN2mR7tY0wZ5aB8cD1eF-",
+        "REPLAYGAIN_REFERENCE_LOUDNESS=89.0 dB",
+        "REPLAYGAIN_TRACK_GAIN=-7.03 dB",
+        "REPLAYGAIN_TRACK_PEAK=0.98876953",
+        "REPLAYGAIN_ALBUM_GAIN=-6.50 dB",
+        "REPLAYGAIN_ALBUM_PEAK=0.99996948",
+    };
+    static const char vendor[] = "reference libFLAC 1.2.1 20070917";
+    char comment[LYRICS_SIZE + 16];
+    uint32_t comment_start;
+    uint32_t count;
+    uint32_t j;
+
+    file_length = 0;
+    put( "fLaC", 4 );
+
+    /* 44.1kHz, 2 channels, 16 bits, 3 minutes */
+    {
+        uint8_t streaminfo[34] = { 0x10, 0x00, 0x10, 0x00, 0x00, 0x00, 0x0e,
+                                   0x00, 0x3a, 0x5c, 0x0a, 0xc4, 0x42, 0xf0,
+                                   0x00, 0x79, 0x1c, 0x20 };
+
+        put_block_header( 0, false, sizeof(streaminfo) );
+        put( streaminfo, sizeof(streaminfo) );
+    }
+
+    put_block_header( 3, false, SEEK_POINTS * 18 );
+    memset( &file[file_length], 0x5a, SEEK_POINTS * 18 );
+    file_length += SEEK_POINTS * 18;
+
+    count = (true == profile->ripper) ? 5 + sizeof(ripper) / sizeof(ripper[0]) : 5;
+    if( true == profile->lyrics ) {
+        count++;
+    }
+
+    put_block_header( 4, false, 0 );
+    comment_start = file_length;
+    put_le32( sizeof(vendor) - 1 );
+    put( vendor, sizeof(vendor) - 1 );
+    put_le32( count );
+
+    strcpy( comment, "TITLE=" );
+    make_title( &comment[6], i );
+    put_comment( comment );
+    put_comment( "ARTIST=The Synthetic Band" );
+    put_comment( "Album=A Library of Made Up Songs" );
+    sprintf( comment, "TRACKNUMBER=%u", 1 + (i % 12) );
+    put_comment( comment );
+    sprintf( comment, "DISCNUMBER=%u", 1 + (i / 12) % 2 );
+    put_comment( comment );
+
+    if( true == profile->ripper ) {
+        for( j = 0; j < sizeof(ripper) / sizeof(ripper[0]); j++ ) {
+            put_comment( ripper[j] );
+        }
+    }
+
+    if( true == profile->lyrics ) {
+        strcpy( comment, "LYRICS=" );
+        for( j = 7; j < LYRICS_SIZE; j++ ) {
+            comment[j] = (0 == (j % 60)) ? '\n' : 'a' + (j % 26);
+        }
+        comment[LYRICS_SIZE] = '\0';
+        put_comment( comment );
+    }
+
+    count = file_length - comment_start;
+    file[comment_start - 3] = count >> 16;
+    file[comment_start - 2] = count >> 8;
+    file[comment_start - 1] = count;
+
+    put_block_header( 6, false, PICTURE_SIZE );
+    memset( &file[file_length], 0xa5, PICTURE_SIZE );
+    file_length += PICTURE_SIZE;
+
+    put_block_header( 1, true, PADDING_SIZE );
+    memset( &file[file_length], 0, PADDING_SIZE );
+    file_length += PADDING_SIZE;
+
+    /* The first frame header, then something like audio. */
+    file[file_length++] = 0xff;
+    file[file_length++] = 0xf8;
+    for( j = 2; j < AUDIO_SIZE; j++ ) {
+        file[file_length++] = (uint8_t) (j * 31 + i);
+    }
+
+    return count;
+}
+
+static void write_files( const bench_profile_t *profile, uint32_t *comment_size )
+{
+    char path[128];
+    uint32_t i;
+    int fd;
+
+    sprintf( path, "%s/%s", DIRECTORY, profile->name );
+    mkdir( DIRECTORY, 0755 );
+    mkdir( path, 0755 );
+
+    for( i = 0; i < FILES; i++ ) {
+        *comment_size = build_file( profile, i );
+
+        sprintf( path, "%s/%s/%03u.flac", DIRECTORY, profile->name, i );
+        fd = open( path, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+        if( (-1 == fd) || (file_length != write(fd, file, file_length)) ) {
+            fail( "write", path );
+        }
+        close( fd );
+    }
+}
+
+/*----------------------------------------------------------------------------*/
+/*                                 Benchmark                                  */
+/*----------------------------------------------------------------------------*/
+static void scan( const bench_profile_t *profile )
+{
+    media_metadata_t metadata;
+    char path[128];
+    char title[MEDIA_TITLE_LENGTH + 1];
+    uint32_t i;
+
+    for( i = 0; i < FILES; i++ ) {
+        sprintf( path, "%s/%s/%03u.flac", DIRECTORY, profile->name, i );
+        if( MI_RETURN_OK != media_flac_get_metadata(path, &metadata) ) {
+            fail( "metadata", path );
+        }
+
+        make_title( title, i );
+        if( (0 != strcmp(title, metadata.title)) ||
+            (0 != strcmp("The Synthetic Band", metadata.artist)) ||
+            (0 != strcmp("A Library of Made Up Songs", metadata.album)) ||
+            ((int32_t) (1 + (i % 12)) != metadata.track_number) ||
+            ((int32_t) (1 + (i / 12) % 2) != metadata.disc_number) )
+        {
+            fail( "tags", path );
+        }
+
+        if( (true == profile->ripper) &&
+            ((metadata.gain.track_gain != -7.03) ||
+             (metadata.gain.album_peak != 0.99996948)) )
+        {
+            fail( "replaygain", path );
+        }
+    }
+}
+
+static void run( const bench_profile_t *profile, bool last )
+{
+    uint32_t comment_size;
+    uint32_t file_reads;
+    uint32_t file_seeks;
+    uint64_t best_ns;
+    uint32_t pass;
+
+    write_files( profile, &comment_size );
+
+    /* The first pass warms the page cache & gives the call counts. */
+    reads = 0;
+    seeks = 0;
+    scan( profile );
+    file_reads = reads;
+    file_seeks = seeks;
+
+    best_ns = UINT64_MAX;
+    for( pass = 0; pass < PASSES; pass++ ) {
+        uint64_t begin = now_ns();
+        uint64_t ns;
+
+        scan( profile );
+        ns = now_ns() - begin;
+        if( ns < best_ns ) {
+            best_ns = ns;
+        }
+    }
+
+    printf( "    {\n" );
+    printf( "      \"name\": \"%s\",\n", profile->name );
+    printf( "      \"vorbis_comment_bytes\": %u,\n", comment_size );
+    printf( "      \"reads_per_file\": %.1f,\n", (double) file_reads / FILES );
+    printf( "      \"seeks_per_file\": %.1f,\n", (double) file_seeks / FILES );
+    printf( "      \"us_per_file\": %.2f,\n", best_ns / 1000.0 / FILES );
+    printf( "      \"files_per_second\": %.0f\n", FILES * 1e9 / best_ns );
+    printf( "    }%s\n", (true == last) ? "" : "," );
+}
+
+int main( int argc, char *argv[] )
+{
+    uint32_t count = sizeof(profiles) / sizeof(profiles[0]);
+    uint32_t i;
+
+    printf( "{\n" );
+    printf( "  \"files\": %u,\n", FILES );
+    printf( "  \"profiles\": [\n" );
+    for( i = 0; i < count; i++ ) {
+        run( &profiles[i], (count - 1) == i );
+    }
+    printf( "  ]\n}\n" );
+
+    return 0;
+}
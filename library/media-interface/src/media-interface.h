@@ -73,13 +73,19 @@ typedef void* (*media_malloc_fn_t)( const size_t size );
 typedef void (*media_free_fn_t)( void *ptr );
 
 /**
- *  Used to ask if the decoder should continue decoding.
+ *  Used to ask if the decoder should continue decoding & if it should
+ *  move to another place in the song first.
  *
  *  @note May block - this is by design.
  *
+ *  @param position the place in the song being played, in ms
+ *  @param seek the place in the song to decode from next in ms, which is
+ *              set if the decoder should move & left alone otherwise.
+ *              NULL if the decoder can't move in the song.
+ *
  *  @return true to continue decoding, false otherwise
  */
-typedef bool (*media_command_fn_t)( void );
+typedef bool (*media_command_fn_t)( const uint32_t position, uint32_t *seek );
 
 /**
  *  The media decoder function.
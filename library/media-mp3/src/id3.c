@@ -41,6 +41,8 @@
 #include <fcntl.h>
 #include <unistd.h>
 
+#include <file-stream/file-stream.h>
+
 #include "metadata.h"
 
 #define MIN(a,b)    ((a) < (b)) ? (a) : (b)
@@ -190,8 +192,6 @@ struct tag_resolver {
     bool binary;
 };
 
-static bool global_ff_found;
-
 static int unsynchronize(char* tag, int len, bool *ff_found)
 {
     int i;
@@ -227,7 +227,7 @@ static int unsynchronize_frame(char* tag, int len)
     return unsynchronize(tag, len, &ff_found);
 }
 
-static int read_unsynched( int fd, void *buf, int len)
+static int read_unsynched( int fd, void *buf, int len, bool *ff_found)
 {
     int i;
     ssize_t rc;
@@ -239,11 +239,11 @@ static int read_unsynched( int fd, void *buf, int len)
 
     while(remaining) {
         rp = wp;
-        rc = read(fd, rp, remaining);
+        rc = fstream_card_read(fd, rp, remaining);
         if(rc <= 0)
             return rc;
 
-        i = unsynchronize(wp, remaining, &global_ff_found);
+        i = unsynchronize(wp, remaining, ff_found);
         remaining -= i;
         wp += i;
     }
@@ -251,7 +251,7 @@ static int read_unsynched( int fd, void *buf, int len)
     return len;
 }
 
-static int skip_unsynched(int fd, int len)
+static int skip_unsynched(int fd, int len, bool *ff_found)
 {
     ssize_t rc;
     int remaining = len;
@@ -260,11 +260,11 @@ static int skip_unsynched(int fd, int len)
 
     while(remaining) {
         rlen = MIN(sizeof(buf), (unsigned int)remaining);
-        rc = read(fd, buf, rlen);
+        rc = fstream_card_read(fd, buf, rlen);
         if(rc <= 0)
             return rc;
 
-        remaining -= unsynchronize(buf, rlen, &global_ff_found);
+        remaining -= unsynchronize(buf, rlen, ff_found);
     }
 
     return len;
@@ -549,10 +549,10 @@ static bool setid3v1title(int fd, struct mp3entry *entry)
     int i, j;
     unsigned char* utf8;
 
-    if (-1 == lseek(fd, -128, SEEK_END))
+    if (-1 == fstream_card_lseek(fd, -128, SEEK_END))
         return false;
 
-    if (read(fd, buffer, sizeof buffer) != sizeof buffer)
+    if (fstream_card_read(fd, buffer, sizeof buffer) != sizeof buffer)
         return false;
 
     if (strncmp((char *)buffer, "TAG", 3))
@@ -641,21 +641,20 @@ static void setid3v2title(int fd, struct mp3entry *entry)
     int skip;
     bool global_unsynch = false;
     bool unsynch = false;
+    bool ff_found = false;
     int i, j;
     int rc;
 
-    global_ff_found = false;
-
     /* Bail out if the tag is shorter than 10 bytes */
     if(entry->id3v2len < 10)
         return;
 
     /* Read the ID3 tag version from the header */
-    if( -1 == lseek(fd, 0, SEEK_SET) ) {
+    if( -1 == fstream_card_lseek(fd, 0, SEEK_SET) ) {
         return;
     }
 
-    if( 10 != read(fd, header, 10) ) {
+    if( 10 != fstream_card_read(fd, header, 10) ) {
         return;
     }
 
@@ -692,7 +691,7 @@ static void setid3v2title(int fd, struct mp3entry *entry)
     /* Skip the extended header if it is present */
     if(global_flags & 0x40) {
         if(version == ID3_VER_2_3) {
-            if(10 != read(fd, header, 10))
+            if(10 != fstream_card_read(fd, header, 10))
                 return;
             /* The 2.3 extended header size doesn't include the header size
                field itself. Also, it is not unsynched. */
@@ -700,13 +699,13 @@ static void setid3v2title(int fd, struct mp3entry *entry)
                 bytes2int(header[0], header[1], header[2], header[3]) + 4;
 
             /* Skip the rest of the header */
-            if( -1 == lseek(fd, framelen - 10, SEEK_CUR) ) {
+            if( -1 == fstream_card_lseek(fd, framelen - 10, SEEK_CUR) ) {
                 return;
             }
         }
 
         if(version >= ID3_VER_2_4) {
-            if(4 != read(fd, header, 4))
+            if(4 != fstream_card_read(fd, header, 4))
                 return;
 
             /* The 2.4 extended header size does include the entire header,
@@ -714,7 +713,7 @@ static void setid3v2title(int fd, struct mp3entry *entry)
             framelen = unsync(header[0], header[1],
                               header[2], header[3]);
 
-            if( -1 == lseek(fd, framelen - 4, SEEK_CUR) ) {
+            if( -1 == fstream_card_lseek(fd, framelen - 4, SEEK_CUR) ) {
                 return;
             }
         }
@@ -735,9 +734,9 @@ static void setid3v2title(int fd, struct mp3entry *entry)
         /* Read frame header and check length */
         if(version >= ID3_VER_2_3) {
             if(global_unsynch && version <= ID3_VER_2_3)
-                rc = read_unsynched(fd, header, 10);
+                rc = read_unsynched(fd, header, 10, &ff_found);
             else
-                rc = read(fd, header, 10);
+                rc = fstream_card_read(fd, header, 10);
             if(rc != 10)
                 return;
             /* Adjust for the 10 bytes we read */
@@ -755,7 +754,7 @@ static void setid3v2title(int fd, struct mp3entry *entry)
                                      header[6], header[7]);
             }
         } else {
-            if(6 != read(fd, header, 6))
+            if(6 != fstream_card_read(fd, header, 6))
                 return;
             /* Adjust for the 6 bytes we read */
             size -= 6;
@@ -779,14 +778,14 @@ static void setid3v2title(int fd, struct mp3entry *entry)
 
             if (version >= ID3_VER_2_4) {
                 if(flags & 0x0040) { /* Grouping identity */
-                    if( -1 == lseek(fd, 1, SEEK_CUR) ) {    /* Skip 1 byte */
+                    if( -1 == fstream_card_lseek(fd, 1, SEEK_CUR) ) {    /* Skip 1 byte */
                         return;
                     }
                     framelen--;
                 }
             } else {
                 if(flags & 0x0020) { /* Grouping identity */
-                    if( -1 == lseek(fd, 1, SEEK_CUR) ) {    /* Skip 1 byte */
+                    if( -1 == fstream_card_lseek(fd, 1, SEEK_CUR) ) {    /* Skip 1 byte */
                         return;
                     }
                     framelen--;
@@ -797,7 +796,7 @@ static void setid3v2title(int fd, struct mp3entry *entry)
             {
                 /* Skip it */
                 size -= framelen;
-                if( -1 == lseek(fd, framelen, SEEK_CUR) ) {
+                if( -1 == fstream_card_lseek(fd, framelen, SEEK_CUR) ) {
                     return;
                 }
                 continue;
@@ -808,7 +807,7 @@ static void setid3v2title(int fd, struct mp3entry *entry)
 
             if (version >= ID3_VER_2_4) {
                 if(flags & 0x0001) { /* Data length indicator */
-                    if(4 != read(fd, tmp, 4))
+                    if(4 != fstream_card_read(fd, tmp, 4))
                         return;
 
                     /* We don't need the data length */
@@ -876,9 +875,9 @@ static void setid3v2title(int fd, struct mp3entry *entry)
                 tag = buffer + bufferpos;
 
                 if(global_unsynch && version <= ID3_VER_2_3)
-                    bytesread = read_unsynched(fd, tag, framelen);
+                    bytesread = read_unsynched(fd, tag, framelen, &ff_found);
                 else
-                    bytesread = read(fd, tag, framelen);
+                    bytesread = fstream_card_read(fd, tag, framelen);
 
                 if( bytesread != framelen )
                     return;
@@ -936,7 +935,7 @@ static void setid3v2title(int fd, struct mp3entry *entry)
 
                 /* Seek to the next frame */
                 if(framelen < totframelen) {
-                    if( -1 == lseek(fd, totframelen - framelen, SEEK_CUR) ) {
+                    if( -1 == fstream_card_lseek(fd, totframelen - framelen, SEEK_CUR) ) {
                         return;
                     }
                 }
@@ -949,10 +948,10 @@ static void setid3v2title(int fd, struct mp3entry *entry)
                skip it using the total size */
 
             if(global_unsynch && version <= ID3_VER_2_3) {
-                size -= skip_unsynched(fd, totframelen);
+                size -= skip_unsynched(fd, totframelen, &ff_found);
             } else {
                 size -= totframelen;
-                if( lseek(fd, totframelen, SEEK_CUR) == -1 )
+                if( fstream_card_lseek(fd, totframelen, SEEK_CUR) == -1 )
                     return;
             }
         }
@@ -972,14 +971,14 @@ int getid3v2len(int fd)
     int offset;
 
     /* Make sure file has a ID3 tag */
-    if((-1 == lseek(fd, 0, SEEK_SET)) ||
-       (read(fd, buf, 6) != 6) ||
+    if((-1 == fstream_card_lseek(fd, 0, SEEK_SET)) ||
+       (fstream_card_read(fd, buf, 6) != 6) ||
        (strncmp(buf, "ID3", strlen("ID3")) != 0))
         offset = 0;
 
     /* Now check what the ID3v2 size field says */
     else
-        if(read(fd, buf, 4) != 4)
+        if(fstream_card_read(fd, buf, 4) != 4)
             offset = 0;
         else
             offset = unsync(buf[0], buf[1], buf[2], buf[3]) + 10;
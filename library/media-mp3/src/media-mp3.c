@@ -61,7 +61,8 @@ typedef struct {
 /*----------------------------------------------------------------------------*/
 /*                            File Scoped Variables                           */
 /*----------------------------------------------------------------------------*/
-/* none */
+/* The stream the songs are played from. */
+static fstream_t *__stream;
 
 /*----------------------------------------------------------------------------*/
 /*                             Function Prototypes                            */
@@ -80,6 +81,12 @@ static media_status_t output_data( queue_handle_t idle,
 /*                             External Functions                             */
 /*----------------------------------------------------------------------------*/
 
+/** See media-mp3.h for details. */
+void media_mp3_init( fstream_t *stream )
+{
+    __stream = stream;
+}
+
 /** See media-interface.h for details. */
 media_status_t media_mp3_play( const char *filename,
                                const double gain,
@@ -107,7 +114,7 @@ media_status_t media_mp3_play( const char *filename,
 
     dsp_scale_factor = dsp_determine_scale_factor( peak, gain );
 
-    if( true != fstream_open(filename) ) {
+    if( true != fstream_open(__stream, filename) ) {
         rv = MI_ERROR_INVALID_FORMAT;
         goto error_0;
     }
@@ -148,7 +155,7 @@ error_1:
         (*free_fn)( node );
     }
 
-    fstream_close();
+    fstream_close( __stream );
 
 error_0:
 
@@ -186,7 +193,9 @@ media_status_t media_mp3_get_metadata( const char *filename,
         goto error_0;
     }
 
-    fd = open( filename, O_RDONLY );
+    /* Each call takes the card on its own, so playback isn't kept off the
+     * card for the whole tag. */
+    fd = fstream_card_open( filename );
     if( -1 == fd ) {
         rv = MI_ERROR_PARAMETER;
         goto error_0;
@@ -219,7 +228,7 @@ media_status_t media_mp3_get_metadata( const char *filename,
     metadata->gain.album_gain = entry.album_gain;
     metadata->gain.album_peak = entry.album_peak;
 
-    close( fd );
+    fstream_card_close( fd );
 error_0:
     return rv;
 }
@@ -257,17 +266,18 @@ static media_status_t decode_song( queue_handle_t idle,
         uint32_t get;
         uint32_t consumed;
 
-        if( false == (*command_fn)() ) {
+        /* The songs can't be seeked in, so the place isn't kept. */
+        if( false == (*command_fn)(0, NULL) ) {
             rv = MI_STOPPED_BY_REQUEST;
             goto early_exit;
         }
 
         get = 4096;
 
-        buffer = (uint8_t *) fstream_get_buffer( get, &got );
+        buffer = (uint8_t *) fstream_get_buffer( __stream, get, &got );
         if( 0 == got ) {
             rv = MI_ERROR_DECODE_ERROR;
-            fstream_release_buffer( 0 );
+            fstream_release_buffer( __stream, 0 );
             goto error;
         }
         if( get != got ) {
@@ -286,7 +296,7 @@ decode_more_with_this_buffer:
                  * a buffer without any data having been consumed. */
             } else if( !MAD_RECOVERABLE(stream.error) ) {
                 rv = MI_ERROR_DECODE_ERROR;
-                fstream_release_buffer( 0 );
+                fstream_release_buffer( __stream, 0 );
                 goto error;
             } else {
                 consumed = stream.next_frame - buffer;
@@ -306,7 +316,7 @@ decode_more_with_this_buffer:
             stream.error = MAD_ERROR_NONE;
         }
 
-        fstream_release_buffer( consumed );
+        fstream_release_buffer( __stream, consumed );
     }
 
 early_exit:
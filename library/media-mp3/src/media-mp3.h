@@ -18,8 +18,16 @@
 #ifndef __MEDIA_MP3_H__
 #define __MEDIA_MP3_H__
 
+#include <file-stream/file-stream.h>
 #include <media-interface/media-interface.h>
 
+/**
+ *  Sets the stream the songs are played from.
+ *
+ *  @param stream the playback stream
+ */
+void media_mp3_init( fstream_t *stream );
+
 /** See media-interface.h for details. */
 media_status_t media_mp3_play( const char *filename,
                                const double gain,
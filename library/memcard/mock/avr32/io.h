@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2009  Weston Schmidt
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+#ifndef __AVR32_IO_H__
+#define __AVR32_IO_H__
+
+#include <stdint.h>
+
+/*
+ *  The parts of the AVR32 part header block.c uses, so it builds on the
+ *  host against spi-model.c.  The PDCA registers are only written & read
+ *  by block.c - the model moves the bytes itself.
+ */
+
+#define AVR32_PDCA_CHANNEL_COUNT    15
+
+typedef struct {
+    uint32_t mar;
+    uint32_t psr;
+    uint32_t tcr;
+    uint32_t marr;
+    uint32_t tcrr;
+    uint32_t cr;
+    uint32_t mr;
+    uint32_t sr;
+    uint32_t ier;
+    uint32_t idr;
+    uint32_t imr;
+    uint32_t isr;
+} avr32_pdca_channel_t;
+
+typedef struct {
+    avr32_pdca_channel_t channel[AVR32_PDCA_CHANNEL_COUNT];
+} avr32_pdca_t;
+
+extern volatile avr32_pdca_t AVR32_PDCA;
+
+#define AVR32_PDCA_CR_TEN_MASK      0x00000001
+#define AVR32_PDCA_CR_TDIS_MASK     0x00000002
+#define AVR32_PDCA_CR_ECLR_MASK     0x00000100
+#define AVR32_PDCA_TRC_MASK         0x00000002
+
+/* The model calls the interrupt handlers as plain functions. */
+#define __interrupt__
+
+#endif
@@ -0,0 +1,494 @@
+/*
+ * Copyright (c) 2009  Weston Schmidt
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "block.h"
+#include "memcard.h"
+#include "memcard-private.h"
+#include "sector-cache.h"
+#include "fatfs/ff.h"
+#include "sd-emulator.h"
+
+/*----------------------------------------------------------------------------*/
+/*                                   Macros                                   */
+/*----------------------------------------------------------------------------*/
+#define SECTOR_SIZE             512
+
+/* As block.c, the blocks read with one READ_MULTIPLE_BLOCK command. */
+#define MULTIPLE_BLOCKS         128
+
+#define CALLBACK_MAX            3
+
+/*----------------------------------------------------------------------------*/
+/*                               Data Structures                              */
+/*----------------------------------------------------------------------------*/
+/* none */
+
+/*----------------------------------------------------------------------------*/
+/*                            File Scoped Variables                           */
+/*----------------------------------------------------------------------------*/
+static pthread_mutex_t __card_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t __ff_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int __image = -1;
+static uint32_t __sectors;
+static uint32_t __magic_insert_number;
+static mc_card_status_t __card_status = MC_CARD__REMOVED;
+static card_status_fct __callback_fns[CALLBACK_MAX];
+static FATFS __fs;
+
+static sd_emulator_timing_t __timing;
+static sd_emulator_stats_t __stats;
+
+static mc_status_t __error;
+static uint32_t __error_after;
+static uint32_t __error_count;
+
+/*----------------------------------------------------------------------------*/
+/*                             Function Prototypes                            */
+/*----------------------------------------------------------------------------*/
+static void __call_all( const mc_card_status_t status );
+static mc_status_t __command( const uint32_t lba, const uint32_t count,
+                              const uint32_t commands, const uint32_t sector_us );
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+/* See memcard.h for details. */
+mc_status_t mc_init( void* (*fast_malloc_fn)(size_t),
+                     void* (*malloc_fn)(size_t) )
+{
+    int32_t i;
+
+    if( (NULL == fast_malloc_fn) || (NULL == malloc_fn) ) {
+        return MC_ERROR_PARAMETER;
+    }
+
+    for( i = 0; i < CALLBACK_MAX; i++ ) {
+        __callback_fns[i] = NULL;
+    }
+
+    return sector_cache_init( malloc_fn );
+}
+
+/* See memcard.h for details. */
+mc_status_t mc_register( card_status_fct card_status_fn )
+{
+    int32_t i;
+
+    if( NULL == card_status_fn ) {
+        return MC_ERROR_PARAMETER;
+    }
+
+    for( i = 0; i < CALLBACK_MAX; i++ ) {
+        if( NULL == __callback_fns[i] ) {
+            __callback_fns[i] = card_status_fn;
+            return MC_RETURN_OK;
+        }
+    }
+
+    return MC_TOO_MANY_REGISTERED;
+}
+
+/* See memcard.h for details. */
+mc_status_t mc_cancel( card_status_fct card_status_fn )
+{
+    if( NULL != card_status_fn ) {
+        int32_t i;
+
+        for( i = 0; i < CALLBACK_MAX; i++ ) {
+            if( card_status_fn == __callback_fns[i] ) {
+                __callback_fns[i] = NULL;
+                return MC_RETURN_OK;
+            }
+        }
+    }
+
+    return MC_ERROR_PARAMETER;
+}
+
+/* See memcard.h for details. */
+mc_card_status_t mc_get_status( void )
+{
+    return __card_status;
+}
+
+/* See memcard.h for details. */
+mc_status_t mc_get_block_count( uint32_t *blocks )
+{
+    if( NULL == blocks ) {
+        return MC_ERROR_PARAMETER;
+    }
+
+    if( (MC_CARD__MOUNTED != __card_status) &&
+        (MC_CARD__MOUNTING != __card_status) )
+    {
+        return MC_NOT_MOUNTED;
+    }
+
+    *blocks = __sectors;
+
+    return MC_RETURN_OK;
+}
+
+/* See sd-emulator.h for details. */
+mc_status_t sd_emulator_insert( const char *image,
+                                const sd_emulator_timing_t *timing )
+{
+    struct stat st;
+    int fd;
+
+    if( NULL == image ) {
+        return MC_ERROR_PARAMETER;
+    }
+
+    sd_emulator_remove();
+    sd_emulator_set_timing( timing );
+
+    fd = open( image, O_RDWR );
+    if( fd < 0 ) {
+        return MC_UNUSABLE;
+    }
+    if( (0 != fstat(fd, &st)) || (st.st_size < SECTOR_SIZE) ) {
+        close( fd );
+        return MC_UNUSABLE;
+    }
+
+    pthread_mutex_lock( &__card_mutex );
+    __image = fd;
+    __sectors = (uint32_t) (st.st_size / SECTOR_SIZE);
+    __magic_insert_number++;
+    pthread_mutex_unlock( &__card_mutex );
+
+    /* The same steps the automount task takes for a card. */
+    __card_status = MC_CARD__INSERTED;
+    __call_all( __card_status );
+
+    __card_status = MC_CARD__MOUNTING;
+    __call_all( __card_status );
+
+    if( FR_OK == f_mount(0, &__fs) ) {
+        __card_status = MC_CARD__MOUNTED;
+    } else {
+        __card_status = MC_CARD__UNUSABLE;
+    }
+    __call_all( __card_status );
+
+    return (MC_CARD__MOUNTED == __card_status) ? MC_RETURN_OK : MC_UNUSABLE;
+}
+
+/* See sd-emulator.h for details. */
+void sd_emulator_remove( void )
+{
+    pthread_mutex_lock( &__card_mutex );
+    if( __image < 0 ) {
+        pthread_mutex_unlock( &__card_mutex );
+        return;
+    }
+
+    close( __image );
+    __image = -1;
+    __sectors = 0;
+    __magic_insert_number++;
+    pthread_mutex_unlock( &__card_mutex );
+
+    __card_status = MC_CARD__REMOVED;
+    __call_all( __card_status );
+}
+
+/* See sd-emulator.h for details. */
+mc_status_t sd_emulator_format( const char *image, const uint32_t sectors,
+                                const uint32_t cluster_size,
+                                const sd_emulator_timing_t *timing )
+{
+    mc_status_t status;
+    int fd;
+
+    if( (NULL == image) || (sectors < 128) ) {
+        return MC_ERROR_PARAMETER;
+    }
+
+    sd_emulator_remove();
+
+    /* Sparse, so only what is written takes up space. */
+    fd = open( image, O_RDWR | O_CREAT | O_TRUNC, 0644 );
+    if( fd < 0 ) {
+        return MC_UNUSABLE;
+    }
+    if( 0 != ftruncate(fd, (off_t) sectors * SECTOR_SIZE) ) {
+        close( fd );
+        return MC_UNUSABLE;
+    }
+    close( fd );
+
+    status = sd_emulator_insert( image, timing );
+    if( MC_RETURN_OK != status ) {
+        return status;
+    }
+
+    if( FR_OK != f_mkfs(0, 0, cluster_size) ) {
+        return MC_UNUSABLE;
+    }
+
+    return MC_RETURN_OK;
+}
+
+/* See sd-emulator.h for details. */
+void sd_emulator_set_timing( const sd_emulator_timing_t *timing )
+{
+    pthread_mutex_lock( &__card_mutex );
+    if( NULL == timing ) {
+        memset( &__timing, 0, sizeof(sd_emulator_timing_t) );
+    } else {
+        __timing = *timing;
+    }
+    pthread_mutex_unlock( &__card_mutex );
+}
+
+/* See sd-emulator.h for details. */
+void sd_emulator_inject_error( const mc_status_t error, const uint32_t after,
+                               const uint32_t count )
+{
+    pthread_mutex_lock( &__card_mutex );
+    __error = error;
+    __error_after = after;
+    __error_count = count;
+    pthread_mutex_unlock( &__card_mutex );
+}
+
+/* See sd-emulator.h for details. */
+void sd_emulator_get_stats( sd_emulator_stats_t *stats )
+{
+    if( NULL != stats ) {
+        pthread_mutex_lock( &__card_mutex );
+        *stats = __stats;
+        pthread_mutex_unlock( &__card_mutex );
+    }
+}
+
+/* See sd-emulator.h for details. */
+void sd_emulator_reset_stats( void )
+{
+    pthread_mutex_lock( &__card_mutex );
+    memset( &__stats, 0, sizeof(sd_emulator_stats_t) );
+    pthread_mutex_unlock( &__card_mutex );
+}
+
+/*----------------------------------------------------------------------------*/
+/*                           Library Only Functions                           */
+/*----------------------------------------------------------------------------*/
+/* See memcard-private.h for details. */
+mc_card_type_t mc_get_type( void )
+{
+    return (__image < 0) ? MCT_UNKNOWN : MCT_SDHC;
+}
+
+/* See memcard-private.h for details. */
+uint32_t mc_get_Nac_read( void )
+{
+    return 0;
+}
+
+/* See memcard-private.h for details. */
+uint32_t mc_get_Nac_write( void )
+{
+    return 0;
+}
+
+/* See memcard-private.h for details. */
+uint32_t mc_get_magic_insert_number( void )
+{
+    return __magic_insert_number;
+}
+
+/* See block.h for details. */
+mc_status_t block_init( void* (*fast_malloc_fn)(size_t) )
+{
+    return (NULL == fast_malloc_fn) ? MC_ERROR_PARAMETER : MC_RETURN_OK;
+}
+
+/* See block.h for details. */
+mc_status_t block_read( const uint32_t lba, uint8_t *buffer )
+{
+    return block_read_multiple( lba, buffer, 1 );
+}
+
+/* See block.h for details. */
+mc_status_t block_read_multiple( const uint32_t lba, uint8_t *buffer,
+                                 const uint32_t count )
+{
+    uint32_t commands;
+    mc_status_t status;
+
+    if( (NULL == buffer) || (0 == count) ) {
+        return MC_ERROR_PARAMETER;
+    }
+
+    commands = (count + MULTIPLE_BLOCKS - 1) / MULTIPLE_BLOCKS;
+
+    pthread_mutex_lock( &__card_mutex );
+    status = __command( lba, count, commands, __timing.read_us );
+    if( MC_RETURN_OK == status ) {
+        if( (ssize_t) (count * SECTOR_SIZE) !=
+            pread(__image, buffer, count * SECTOR_SIZE, (off_t) lba * SECTOR_SIZE) )
+        {
+            status = MC_ERROR_MODE;
+        } else {
+            __stats.sectors_read += count;
+        }
+    }
+    pthread_mutex_unlock( &__card_mutex );
+
+    return status;
+}
+
+/* See block.h for details. */
+mc_status_t block_write( const uint32_t lba, const uint8_t *buffer )
+{
+    mc_status_t status;
+
+    if( NULL == buffer ) {
+        return MC_ERROR_PARAMETER;
+    }
+
+    pthread_mutex_lock( &__card_mutex );
+    status = __command( lba, 1, 1, __timing.write_us );
+    if( MC_RETURN_OK == status ) {
+        if( SECTOR_SIZE != pwrite(__image, buffer, SECTOR_SIZE, (off_t) lba * SECTOR_SIZE) ) {
+            status = MC_ERROR_MODE;
+        } else {
+            __stats.sectors_written++;
+        }
+    }
+    pthread_mutex_unlock( &__card_mutex );
+
+    return status;
+}
+
+/* See block.h for details. */
+void block_isr_cancel( void )
+{
+}
+
+/*----------------------------------------------------------------------------*/
+/*                        FF Synchronization Functions                        */
+/*----------------------------------------------------------------------------*/
+/* The same as glue.c, FatFs calls for a card fail once it is removed. */
+int ff_cre_syncobj( BYTE vol, _SYNC_t *sobj )
+{
+    *sobj = mc_get_magic_insert_number();
+    return 1;
+}
+
+int ff_del_syncobj( _SYNC_t sobj )
+{
+    return 1;
+}
+
+int ff_req_grant( _SYNC_t sobj )
+{
+    pthread_mutex_lock( &__ff_mutex );
+    if( sobj != mc_get_magic_insert_number() ) {
+        pthread_mutex_unlock( &__ff_mutex );
+        return 0;
+    }
+
+    return 1;
+}
+
+void ff_rel_grant( _SYNC_t sobj )
+{
+    pthread_mutex_unlock( &__ff_mutex );
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             Internal Functions                             */
+/*----------------------------------------------------------------------------*/
+static void __call_all( const mc_card_status_t status )
+{
+    int32_t i;
+
+    for( i = 0; i < CALLBACK_MAX; i++ ) {
+        if( NULL != __callback_fns[i] ) {
+            (*__callback_fns[i])( status );
+        }
+    }
+}
+
+/**
+ *  Used to check a command can be carried out, failing it if an error is
+ *  being injected, & to add up (or wait for) the time it takes.
+ *
+ *  @note __card_mutex must be held.
+ *
+ *  @param lba the first sector of the command
+ *  @param count the number of sectors moved
+ *  @param commands the number of commands sent to the card for them
+ *  @param sector_us the time each sector takes
+ *
+ *  @return Status, as block_read()
+ */
+static mc_status_t __command( const uint32_t lba, const uint32_t count,
+                              const uint32_t commands, const uint32_t sector_us )
+{
+    uint64_t us;
+
+    if( (__image < 0) ||
+        ((MC_CARD__MOUNTING != __card_status) && (MC_CARD__MOUNTED != __card_status)) )
+    {
+        return MC_ERROR_MODE;
+    }
+
+    if( (__sectors < count) || ((__sectors - count) < lba) ) {
+        return MC_ERROR_PARAMETER;
+    }
+
+    __stats.commands += commands;
+
+    if( 0 < __error_count ) {
+        if( 0 < __error_after ) {
+            __error_after--;
+        } else {
+            __error_count--;
+            __stats.errors++;
+            return __error;
+        }
+    }
+
+    us = (uint64_t) commands * __timing.command_us + (uint64_t) count * sector_us;
+    __stats.busy_us += us;
+
+    if( (true == __timing.real_time) && (0 < us) ) {
+        struct timespec ts;
+
+        ts.tv_sec = us / 1000000;
+        ts.tv_nsec = (us % 1000000) * 1000;
+        nanosleep( &ts, NULL );
+    }
+
+    return MC_RETURN_OK;
+}
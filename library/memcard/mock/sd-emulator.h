@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2009  Weston Schmidt
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+#ifndef __SD_EMULATOR_H__
+#define __SD_EMULATOR_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "memcard.h"
+
+/*
+ *  A host build of the memcard library.  In place of block.c & the card
+ *  mounting in memcard.c a FAT disk image file plays the card, below the
+ *  real sector cache, fast seek, FatFs & avr32.c diskio.  The time each
+ *  command would take on a real card is added up (and optionally waited
+ *  for) so benchmarks get the same storage timing on every run.
+ *
+ *  glue.c & dirent.c are built on newlib's struct _reent, so they aren't
+ *  part of it - call FatFs (f_open(), f_read(), ...) directly instead.
+ */
+
+typedef struct {
+    uint32_t command_us;    /* From sending a command to the first data (Nac) */
+    uint32_t read_us;       /* Moving each 512 byte sector read */
+    uint32_t write_us;      /* Moving & programming each sector written */
+    bool real_time;         /* Sleep for the time as well as counting it */
+} sd_emulator_timing_t;
+
+typedef struct {
+    uint32_t commands;          /* READ_SINGLE, READ_MULTIPLE & WRITE commands */
+    uint32_t sectors_read;
+    uint32_t sectors_written;
+    uint32_t errors;            /* Commands failed by sd_emulator_inject_error() */
+    uint64_t busy_us;           /* The time the card took for the commands */
+} sd_emulator_stats_t;
+
+/**
+ *  Used to put a disk image file in the slot & mount it, as the automount
+ *  task would with a card.  Any card already in the slot is removed first.
+ *
+ *  @param image the disk image file, it is read & written in place
+ *  @param timing the time each command takes, NULL for no time at all
+ *
+ *  @return Status.
+ *      @retval MC_RETURN_OK        Success.
+ *      @retval MC_ERROR_PARAMETER  Invalid argument(s) passed.
+ *      @retval MC_UNUSABLE         The image couldn't be opened.
+ */
+mc_status_t sd_emulator_insert( const char *image,
+                                const sd_emulator_timing_t *timing );
+
+/**
+ *  Used to take the card out of the slot.  FatFs calls made for the card
+ *  fail from now on, as they do when a real card is pulled.
+ */
+void sd_emulator_remove( void );
+
+/**
+ *  Used to create an empty disk image file, insert it & format it with
+ *  f_mkfs() in the FDISK layout an SD card comes with.
+ *
+ *  @param image the disk image file to create, it is replaced if it exists
+ *  @param sectors the size of the card in 512 byte sectors
+ *  @param cluster_size the cluster size in bytes, 0 for FatFs to choose
+ *  @param timing the time each command takes, NULL for no time at all
+ *
+ *  @return Status.
+ *      @retval MC_RETURN_OK        Success.
+ *      @retval MC_ERROR_PARAMETER  Invalid argument(s) passed.
+ *      @retval MC_UNUSABLE         The image couldn't be created or formatted.
+ */
+mc_status_t sd_emulator_format( const char *image, const uint32_t sectors,
+                                const uint32_t cluster_size,
+                                const sd_emulator_timing_t *timing );
+
+/**
+ *  Used to change the time each command takes.
+ *
+ *  @param timing the time each command takes, NULL for no time at all
+ */
+void sd_emulator_set_timing( const sd_emulator_timing_t *timing );
+
+/**
+ *  Used to make reads & writes fail.  After the next after block reads &
+ *  writes succeed the count following them fail with error, without moving
+ *  any data.
+ *
+ *  @param error the status the failing reads & writes return
+ *  @param after the number of reads & writes to let through first
+ *  @param count the number to fail, 0 to stop failing them
+ */
+void sd_emulator_inject_error( const mc_status_t error, const uint32_t after,
+                               const uint32_t count );
+
+/**
+ *  Used to get the commands sent to the card so far.
+ *
+ *  @param stats the structure to fill in
+ */
+void sd_emulator_get_stats( sd_emulator_stats_t *stats );
+
+/**
+ *  Used to start counting the commands sent to the card from 0 again.
+ */
+void sd_emulator_reset_stats( void );
+
+#endif
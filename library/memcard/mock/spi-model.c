@@ -0,0 +1,544 @@
+/*
+ * Copyright (c) 2009  Weston Schmidt
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include <bsp/intc.h>
+#include <bsp/pdca.h>
+
+#include "block.h"
+#include "crc.h"
+#include "memcard.h"
+#include "memcard-constants.h"
+#include "memcard-private.h"
+#include "spi-model.h"
+
+/*----------------------------------------------------------------------------*/
+/*                                   Macros                                   */
+/*----------------------------------------------------------------------------*/
+#define SECTOR_SIZE     512
+
+/* block.c never queues more than two buffers per channel. */
+#define MAX_QUEUED      2
+
+/*----------------------------------------------------------------------------*/
+/*                               Data Structures                              */
+/*----------------------------------------------------------------------------*/
+typedef enum {
+    CS_IDLE,            /* 0xff */
+    CS_R1,              /* Ncr 0xff bytes & the R1 of a read */
+    CS_READ,            /* Streaming blocks */
+    CS_STOP_STUFF,      /* The stuff byte after STOP_TRANSMISSION */
+    CS_STOP_R1,         /* Ncr 0xff bytes & the R1 of the STOP */
+    CS_BUSY             /* 0x00 until the card is done */
+} card_state_t;
+
+typedef struct {
+    uint8_t *data;
+    uint32_t length;
+} queued_t;
+
+typedef struct {
+    uint8_t first;
+    queued_t rx[MAX_QUEUED];
+    uint32_t rx_count;
+    queued_t tx[MAX_QUEUED];
+    uint32_t tx_count;
+} transfer_t;
+
+/*----------------------------------------------------------------------------*/
+/*                            File Scoped Variables                           */
+/*----------------------------------------------------------------------------*/
+volatile avr32_pdca_t AVR32_PDCA;
+
+static pthread_mutex_t __mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t __started = PTHREAD_COND_INITIALIZER;
+static pthread_t __pdca;
+
+static intc_handler_t __handler;
+
+/* The transfer being queued by block.c, started by io_send(). */
+static transfer_t __transfer;
+static bool __armed;
+
+static spi_model_card_t __card;
+static spi_model_stats_t __stats;
+static uint32_t __read_transfers;
+
+/* The card.  The command being clocked in, & what it is sending - the
+ * blocks from __lba on, at __offset in the gap, start, data & CRC of the
+ * current one. */
+static card_state_t __state;
+static uint8_t __command[6];
+static uint32_t __command_length;
+static uint32_t __count;
+static bool __reading;
+static bool __multiple;
+static uint32_t __lba;
+static uint32_t __block;
+static uint32_t __offset;
+static uint32_t __gap;
+static uint16_t __crc;
+
+/*----------------------------------------------------------------------------*/
+/*                             Function Prototypes                            */
+/*----------------------------------------------------------------------------*/
+static void* __pdca_task( void *params );
+static void __clock_transfer( transfer_t *t );
+static uint8_t __clock( const uint8_t in );
+static uint8_t __card_out( void );
+static void __command_done( void );
+static void __start_block( void );
+static uint8_t __read_byte( void );
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+/* See spi-model.h for details. */
+void spi_model_init( void )
+{
+    spi_model_card_t card;
+
+    spi_model_default_card( &card );
+    spi_model_insert( &card );
+
+    pthread_create( &__pdca, NULL, __pdca_task, NULL );
+}
+
+/* See spi-model.h for details. */
+void spi_model_insert( const spi_model_card_t *card )
+{
+    pthread_mutex_lock( &__mutex );
+    __card = *card;
+    memset( &__stats, 0, sizeof(spi_model_stats_t) );
+    __state = CS_IDLE;
+    __command_length = 0;
+    __reading = false;
+    pthread_mutex_unlock( &__mutex );
+}
+
+/* See spi-model.h for details. */
+void spi_model_default_card( spi_model_card_t *card )
+{
+    memset( card, 0, sizeof(spi_model_card_t) );
+    card->ncr = 1;
+    card->respond = true;
+    card->gaps = NULL;
+    card->gap_count = 0;
+    card->bad_crc = -1;
+    card->stop_ncr = 1;
+    card->busy = 0;
+    card->nac_read = 1000;
+    card->nac_write = 1000;
+}
+
+/* See spi-model.h for details. */
+void spi_model_get_stats( spi_model_stats_t *stats )
+{
+    pthread_mutex_lock( &__mutex );
+    *stats = __stats;
+    stats->idle = ((CS_IDLE == __state) && (0 == __command_length));
+    pthread_mutex_unlock( &__mutex );
+}
+
+/* See spi-model.h for details. */
+uint8_t spi_model_data( const uint32_t lba, const uint32_t offset )
+{
+    /* Every value turns up, MC_BLOCK_START included. */
+    return (uint8_t) (lba * 37 + offset * 3 + (offset >> 8));
+}
+
+/*----------------------------------------------------------------------------*/
+/*                  The bsp, io.c & memcard.c calls block.c makes             */
+/*----------------------------------------------------------------------------*/
+bsp_status_t pdca_channel_init( const uint8_t channel,
+                                const uint8_t dest_pid,
+                                const uint8_t transfer_data_size )
+{
+    return BSP_RETURN_OK;
+}
+
+bsp_status_t pdca_queue_buffer( const uint8_t channel,
+                                volatile void *data,
+                                const uint16_t size )
+{
+    queued_t *q;
+    uint32_t *count;
+
+    if( PDCA_CHANNEL_ID_MC_RX == channel ) {
+        q = __transfer.rx;
+        count = &__transfer.rx_count;
+    } else if( PDCA_CHANNEL_ID_MC_TX == channel ) {
+        q = __transfer.tx;
+        count = &__transfer.tx_count;
+    } else {
+        return BSP_ERROR_PARAMETER;
+    }
+
+    pthread_mutex_lock( &__mutex );
+    if( MAX_QUEUED <= *count ) {
+        pthread_mutex_unlock( &__mutex );
+        return BSP_PDCA_QUEUE_FULL;
+    }
+    q[*count].data = (uint8_t *) data;
+    q[*count].length = size;
+    (*count)++;
+    pthread_mutex_unlock( &__mutex );
+
+    return BSP_RETURN_OK;
+}
+
+bsp_status_t pdca_isr_disable( const uint8_t channel, const pdca_isr_t isr )
+{
+    return BSP_RETURN_OK;
+}
+
+bsp_status_t intc_register_isr( const intc_handler_t handler,
+                                const intc_isr_t isr,
+                                const intc_level_t level )
+{
+    if( PDCA_GET_ISR_NAME(PDCA_CHANNEL_ID_MC_RX) == isr ) {
+        __handler = handler;
+    }
+    return BSP_RETURN_OK;
+}
+
+bool interrupts_save_and_disable( void )
+{
+    return true;
+}
+
+void interrupts_restore( const bool state )
+{
+}
+
+/* The first byte of every transfer is written by hand, which starts it. */
+bsp_status_t io_send( const uint8_t out )
+{
+    pthread_mutex_lock( &__mutex );
+    __transfer.first = out;
+    __armed = true;
+    pthread_cond_signal( &__started );
+    pthread_mutex_unlock( &__mutex );
+
+    return BSP_RETURN_OK;
+}
+
+void io_select( void )
+{
+}
+
+mc_card_status_t mc_get_status( void )
+{
+    return MC_CARD__MOUNTED;
+}
+
+mc_card_type_t mc_get_type( void )
+{
+    return MCT_SDHC;
+}
+
+uint32_t mc_get_Nac_read( void )
+{
+    return __card.nac_read;
+}
+
+uint32_t mc_get_Nac_write( void )
+{
+    return __card.nac_write;
+}
+
+uint32_t mc_get_magic_insert_number( void )
+{
+    return 0;
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             Internal functions                             */
+/*----------------------------------------------------------------------------*/
+/**
+ *  The PDCA - clocks each transfer once it is started, & then interrupts.
+ */
+static void* __pdca_task( void *params )
+{
+    while( 1 ) {
+        transfer_t t;
+        bool cancel;
+
+        pthread_mutex_lock( &__mutex );
+        while( false == __armed ) {
+            struct timespec stall;
+
+            clock_gettime( CLOCK_REALTIME, &stall );
+            stall.tv_sec += SPI_MODEL_STALL_MS / 1000;
+            if( (ETIMEDOUT == pthread_cond_timedwait(&__started, &__mutex, &stall)) &&
+                ((CS_IDLE != __state) || (true == __reading)) )
+            {
+                /* block.c is waiting for an interrupt that won't come. */
+                __stats.cancelled++;
+                pthread_mutex_unlock( &__mutex );
+                block_isr_cancel();
+                pthread_mutex_lock( &__mutex );
+            }
+        }
+        t = __transfer;
+        memset( &__transfer, 0, sizeof(transfer_t) );
+        __armed = false;
+
+        __clock_transfer( &t );
+        __read_transfers++;
+        cancel = (SPI_MODEL_MAX_TRANSFERS < __read_transfers);
+        if( true == cancel ) {
+            __stats.cancelled++;
+        }
+        pthread_mutex_unlock( &__mutex );
+
+        if( true == cancel ) {
+            block_isr_cancel();
+        } else {
+            (*__handler)();
+        }
+    }
+    return NULL;
+}
+
+/**
+ *  Clocks a transfer through the card - the first byte by hand & then the
+ *  queued transmit bytes, with what comes back going into the queued
+ *  receive buffers.  Called with __mutex held.
+ */
+static void __clock_transfer( transfer_t *t )
+{
+    uint32_t tx = 0;
+    uint32_t tx_at = 0;
+    uint32_t rx;
+    bool first = true;
+
+    __stats.transfers++;
+    if( 1 < t->rx_count ) {
+        __stats.chained++;
+    }
+
+    for( rx = 0; rx < t->rx_count; rx++ ) {
+        uint32_t i;
+
+        for( i = 0; i < t->rx[rx].length; i++ ) {
+            uint8_t in = 0xff;
+
+            if( true == first ) {
+                in = t->first;
+                first = false;
+            } else {
+                while( (tx < t->tx_count) && (t->tx[tx].length <= tx_at) ) {
+                    tx++;
+                    tx_at = 0;
+                }
+                if( tx < t->tx_count ) {
+                    in = t->tx[tx].data[tx_at++];
+                }
+            }
+            t->rx[rx].data[i] = __clock( in );
+            __stats.clocked++;
+        }
+    }
+}
+
+/**
+ *  Clocks a byte through the card.
+ *
+ *  @param in the byte sent to the card
+ *
+ *  @return the byte the card sent back
+ */
+static uint8_t __clock( const uint8_t in )
+{
+    uint8_t out;
+
+    out = __card_out();
+
+    /* Commands start 01, everything else sent is 0xff. */
+    if( (0 < __command_length) || (0x40 == (0xc0 & in)) ) {
+        __command[__command_length++] = in;
+        if( sizeof(__command) == __command_length ) {
+            __command_length = 0;
+            __command_done();
+        }
+    }
+
+    return out;
+}
+
+static uint8_t __card_out( void )
+{
+    uint8_t out;
+
+    switch( __state ) {
+        case CS_R1:
+            if( 0 < __count ) {
+                __count--;
+                return 0xff;
+            }
+            __state = CS_READ;
+            __start_block();
+            return 0x00;
+
+        case CS_READ:
+            return __read_byte();
+
+        case CS_STOP_STUFF:
+            /* Whatever the card was part way through sending, made to
+             * look like an R1 so it can't be taken for one. */
+            out = 0x7f & __read_byte();
+            __reading = false;
+            __state = CS_STOP_R1;
+            __count = __card.stop_ncr;
+            return out;
+
+        case CS_STOP_R1:
+            if( 0 < __count ) {
+                __count--;
+                return 0xff;
+            }
+            __state = CS_BUSY;
+            __count = __card.busy;
+            return 0x00;
+
+        case CS_BUSY:
+            if( 0 == __count ) {
+                __state = CS_IDLE;
+                return 0xff;
+            }
+            if( SPI_MODEL_BUSY_FOREVER != __count ) {
+                __count--;
+            }
+            return 0x00;
+
+        case CS_IDLE:
+        default:
+            break;
+    }
+    return 0xff;
+}
+
+static void __command_done( void )
+{
+    uint32_t argument;
+
+    __stats.commands++;
+
+    argument = ((uint32_t) __command[1] << 24) | ((uint32_t) __command[2] << 16)
+             | ((uint32_t) __command[3] << 8) | __command[4];
+
+    /* A command with a bad CRC isn't answered, like a missing card. */
+    if( (false == __card.respond) ||
+        (((crc7(__command, 5) << 1) | 0x01) != __command[5]) )
+    {
+        __state = CS_IDLE;
+        __reading = false;
+        return;
+    }
+
+    switch( 0x3f & __command[0] ) {
+        case MC_READ_SINGLE_BLOCK:
+        case MC_READ_MULTIPLE_BLOCK:
+            __multiple = (MC_READ_MULTIPLE_BLOCK == (0x3f & __command[0]));
+            __lba = argument;
+            __block = 0;
+            __reading = true;
+            __read_transfers = 0;
+            __count = __card.ncr;
+            __state = CS_R1;
+            break;
+
+        case MC_STOP_TRANSMISSION:
+            __stats.stops++;
+            __state = CS_STOP_STUFF;
+            break;
+
+        default:
+            __state = CS_IDLE;
+            __reading = false;
+            break;
+    }
+}
+
+static void __start_block( void )
+{
+    uint8_t data[SECTOR_SIZE];
+    uint32_t i;
+
+    __offset = 0;
+    __gap = 1;
+    if( (NULL != __card.gaps) && (0 < __card.gap_count) ) {
+        __gap = __card.gaps[__block % __card.gap_count];
+    }
+
+    for( i = 0; i < SECTOR_SIZE; i++ ) {
+        data[i] = spi_model_data( __lba, i );
+    }
+    __crc = crc16( data, SECTOR_SIZE );
+    if( (int32_t) __block == __card.bad_crc ) {
+        __crc ^= 0x0100;
+    }
+}
+
+/**
+ *  The next byte of the blocks being read - the Nac gap, the block start,
+ *  the data & the CRC, then the next block for a multiple block read.
+ */
+static uint8_t __read_byte( void )
+{
+    uint32_t at;
+
+    if( false == __reading ) {
+        return 0xff;
+    }
+
+    at = __offset++;
+    if( at < __gap ) {
+        return 0xff;
+    }
+    if( at == __gap ) {
+        return MC_BLOCK_START;
+    }
+
+    at -= __gap + 1;
+    if( at < SECTOR_SIZE ) {
+        return spi_model_data( __lba, at );
+    }
+    if( SECTOR_SIZE == at ) {
+        return (uint8_t) (__crc >> 8);
+    }
+
+    /* The last CRC byte ends the block. */
+    at = __crc & 0xff;
+    __lba++;
+    __block++;
+    if( true == __multiple ) {
+        __start_block();
+    } else {
+        __reading = false;
+        __state = CS_IDLE;
+    }
+    return (uint8_t) at;
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2009  Weston Schmidt
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+#ifndef __SPI_MODEL_H__
+#define __SPI_MODEL_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ *  A host model of the SPI bus, the PDCA & a card, under the real block.c.
+ *  The PDCA calls (pdca_queue_buffer() ...) & io_send() are taken by the
+ *  model, which clocks each transfer through the card a byte at a time on
+ *  its own thread, & then calls the interrupt handler block.c registered,
+ *  as the PDCA would.  The card answers READ_SINGLE_BLOCK,
+ *  READ_MULTIPLE_BLOCK & STOP_TRANSMISSION as scripted by
+ *  spi_model_card_t, so every gap & response time can be tried.
+ *
+ *  Build block.c with -I for this directory first, so <avr32/io.h> is the
+ *  host stand-in, & with the PDCA_CHANNEL_ID_MC_RX/TX &
+ *  MC_PDCA_RX/TX_PERIPHERAL_ID a board header would give it.
+ */
+
+/* Busy after STOP_TRANSMISSION until the read times out. */
+#define SPI_MODEL_BUSY_FOREVER  0xffffffff
+
+/* The transfers a read may take, & how long block.c may go without
+ * starting one, before the model gives up on it & cancels the read with
+ * block_isr_cancel(), as the card detect would. */
+#define SPI_MODEL_MAX_TRANSFERS 20000
+#define SPI_MODEL_STALL_MS      1000
+
+typedef struct {
+    uint32_t ncr;           /* 0xff bytes from a read command to its R1 */
+    bool respond;           /* false - no command ever gets an R1 */
+    const uint32_t *gaps;   /* The Nac 0xff bytes before each block, cycled */
+    uint32_t gap_count;     /* 0 - 1 byte before every block */
+    int32_t bad_crc;        /* The block sent with a wrong CRC, -1 for none */
+    uint32_t stop_ncr;      /* 0xff bytes from the STOP stuff byte to its R1 */
+    uint32_t busy;          /* Busy bytes after that R1 */
+    uint32_t nac_read;      /* What mc_get_Nac_read() returns */
+    uint32_t nac_write;     /* What mc_get_Nac_write() returns */
+} spi_model_card_t;
+
+typedef struct {
+    uint32_t commands;      /* Commands the card was sent */
+    uint32_t stops;         /* Of them, STOP_TRANSMISSION */
+    uint32_t transfers;     /* PDCA transfers, each ends in an interrupt */
+    uint32_t chained;       /* Of them, into two receive buffers */
+    uint32_t clocked;       /* Bytes clocked through the card */
+    uint32_t cancelled;     /* Reads cancelled for too many transfers or a stall */
+    bool idle;              /* The card has answered everything it was sent */
+} spi_model_stats_t;
+
+/**
+ *  Used to start the model.  Call it before block_init().
+ */
+void spi_model_init( void );
+
+/**
+ *  Used to put a card in the slot, in place of any card there, & to zero
+ *  the stats.
+ *
+ *  @param card how the card answers, copied
+ */
+void spi_model_insert( const spi_model_card_t *card );
+
+/**
+ *  Used to fill in the default card - it answers a command after 1 byte,
+ *  sends every block 1 byte after the last & is never busy.
+ *
+ *  @param card the card to fill in
+ */
+void spi_model_default_card( spi_model_card_t *card );
+
+/**
+ *  Used to get what the model has done since spi_model_insert().
+ *
+ *  @param stats the structure to fill in
+ */
+void spi_model_get_stats( spi_model_stats_t *stats );
+
+/**
+ *  Used to get a byte of the data on the card.
+ *
+ *  @param lba the block
+ *  @param offset the byte in the block, from 0 to 511
+ *
+ *  @return the byte
+ */
+uint8_t spi_model_data( const uint32_t lba, const uint32_t offset );
+
+#endif
@@ -41,6 +41,14 @@
 
 #define MIN( a, b )     ((a) < (b)) ? (a) : (b)
 
+/* The most blocks read with one READ_MULTIPLE_BLOCK command - a 64k
+ * cluster. */
+#define MC_MAX_MULTIPLE_BLOCKS  128
+
+/* The bytes clocked in past the end of a block to find the start of the
+ * next one, which is usually only a few bytes further on. */
+#define MC_MULTIPLE_LOOKAHEAD   16
+
 #define _D1(...)
 #define _D2(...)
 
@@ -64,6 +72,7 @@ typedef enum {
     BRS_BLOCK_START_FOUND,
     BRS_SENT_DATA,
     BRS_WAITING_UNTIL_NOT_BUSY,
+    BRS_STOP_SENT,
     BRS_SUCCESS,
     BRS_ERROR,
     BRS_TIMEOUT
@@ -71,6 +80,7 @@ typedef enum {
 
 typedef enum {
     CMD_READ,
+    CMD_READ_MULTIPLE,
     CMD_WRITE
 } command_type_t;
 
@@ -84,6 +94,17 @@ typedef struct {
     block_request_state_t state;
     uint32_t nac;
     command_type_t type;
+
+    /* A multiple block read is of blocks blocks into data, & is at block.
+     * The DMA puts direct bytes of a block straight into data, sent bytes
+     * go into buffer.  The CRCs are checked once the read is done, & stop
+     * is the STOP_TRANSMISSION command which ends it. */
+    uint32_t blocks;
+    uint32_t block;
+    uint32_t direct;
+    uint32_t sent;
+    uint8_t crcs[MC_MAX_MULTIPLE_BLOCKS][2];
+    uint8_t stop[MC_COMMAND_BUFFER_SIZE];
 } block_message_t;
 
 /*----------------------------------------------------------------------------*/
@@ -96,6 +117,10 @@ static queue_handle_t __complete;
 /*----------------------------------------------------------------------------*/
 /*                             Function Prototypes                            */
 /*----------------------------------------------------------------------------*/
+static void __build_command( uint8_t *command, const uint8_t index,
+                             const uint32_t argument );
+static mc_status_t __read_multiple( const uint32_t lba, uint8_t *buffer,
+                                    const uint32_t count );
 static void __block_isr_send_command( const uint8_t *send,
                                       uint8_t *receive,
                                       const size_t length,
@@ -103,6 +128,14 @@ static void __block_isr_send_command( const uint8_t *send,
 static uint32_t __block_isr_find_and_process_block_start( block_message_t *msg,
                                                           const uint8_t *start,
                                                           const size_t len );
+static void __block_isr_receive_chained( uint8_t *first,
+                                         const size_t first_length,
+                                         uint8_t *second,
+                                         const size_t second_length );
+static void __block_isr_take_multiple( block_message_t *msg,
+                                       const uint8_t *start, size_t len );
+static void __block_isr_next_multiple( block_message_t *msg );
+static bool __block_isr_read_multiple( block_message_t *msg );
 static void __block_isr_state_machine( void );
 static void __block_isr_disable_transfer( void );
 __attribute__((__interrupt__))
@@ -138,7 +171,6 @@ mc_status_t block_read( const uint32_t lba, uint8_t *buffer )
     mc_status_t status;
     uint32_t address = lba;
     block_message_t *msg;
-    int32_t i;
 
     card_status = mc_get_status();
 
@@ -158,20 +190,7 @@ mc_status_t block_read( const uint32_t lba, uint8_t *buffer )
 
     os_queue_receive( __idle, &msg, WAIT_FOREVER );
 
-    /* Fill with 0xff to start with. */
-    memset( &msg->command, 0xff, MC_COMMAND_BUFFER_SIZE );
-
-    /* Fill MC_Ncs bytes worth of data with 0xff.
-     * This is needed for the timing. */
-    i = MC_Ncs;
-
-    /* Calculate the command sequence */
-    msg->command[i++] = 0x40 | (0x3f & MC_READ_SINGLE_BLOCK);
-    msg->command[i++] = address >> 24;
-    msg->command[i++] = 0xff & (address >> 16);
-    msg->command[i++] = 0xff & (address >> 8);
-    msg->command[i++] = 0xff & address;
-    msg->command[i++] = (crc7(&msg->command[MC_Ncs], 5) << 1) | 0x01;
+    __build_command( msg->command, MC_READ_SINGLE_BLOCK, address );
 
     msg->data = buffer;
     msg->length = 0;
@@ -208,6 +227,37 @@ mc_status_t block_read( const uint32_t lba, uint8_t *buffer )
     return status;
 }
 
+/* See block.h for details. */
+mc_status_t block_read_multiple( const uint32_t lba, uint8_t *buffer,
+                                 const uint32_t count )
+{
+    uint32_t done;
+
+    if( (NULL == buffer) || (0 == count) ) {
+        return MC_ERROR_PARAMETER;
+    }
+
+    done = 0;
+    while( done < count ) {
+        mc_status_t status;
+        uint32_t blocks;
+
+        blocks = MIN( count - done, MC_MAX_MULTIPLE_BLOCKS );
+        if( 1 == blocks ) {
+            status = block_read( lba + done, &buffer[done * 512] );
+        } else {
+            status = __read_multiple( lba + done, &buffer[done * 512], blocks );
+        }
+
+        if( MC_RETURN_OK != status ) {
+            return status;
+        }
+        done += blocks;
+    }
+
+    return MC_RETURN_OK;
+}
+
 /* See block.h for details. */
 mc_status_t block_write( const uint32_t lba, const uint8_t *buffer )
 {
@@ -215,7 +265,6 @@ mc_status_t block_write( const uint32_t lba, const uint8_t *buffer )
     mc_status_t status;
     uint32_t address = lba;
     block_message_t *msg;
-    int32_t i;
     uint16_t crc;
 
     _D1( "%s( 0x%08x, buffer )\n", __FUNCTION__, lba );
@@ -237,20 +286,7 @@ mc_status_t block_write( const uint32_t lba, const uint8_t *buffer )
 
     os_queue_receive( __idle, &msg, WAIT_FOREVER );
 
-    /* Fill with 0xff to start with. */
-    memset( &msg->command, 0xff, MC_COMMAND_BUFFER_SIZE );
-
-    /* Fill MC_Ncs bytes worth of data with 0xff.
-     * This is needed for the timing. */
-    i = MC_Ncs;
-
-    /* Calculate the command sequence */
-    msg->command[i++] = 0x40 | (0x3f & MC_WRITE_SINGLE_BLOCK);
-    msg->command[i++] = address >> 24;
-    msg->command[i++] = 0xff & (address >> 16);
-    msg->command[i++] = 0xff & (address >> 8);
-    msg->command[i++] = 0xff & address;
-    msg->command[i++] = (crc7(&msg->command[MC_Ncs], 5) << 1) | 0x01;
+    __build_command( msg->command, MC_WRITE_SINGLE_BLOCK, address );
 
     msg->buffer[0] = MC_BLOCK_START;
     memcpy( &msg->buffer[1], buffer, 512 );
@@ -311,6 +347,113 @@ void block_isr_cancel( void )
 /*                             Internal functions                             */
 /*----------------------------------------------------------------------------*/
 
+/**
+ *  Used to build the bytes to send for a command, with the MC_Ncs bytes
+ *  before it & the MC_Ncr bytes for the response after it.
+ *
+ *  @param command the MC_COMMAND_BUFFER_SIZE bytes to fill in
+ *  @param index the command to send
+ *  @param argument the argument of the command
+ */
+static void __build_command( uint8_t *command, const uint8_t index,
+                             const uint32_t argument )
+{
+    int32_t i;
+
+    /* Fill with 0xff to start with. */
+    memset( command, 0xff, MC_COMMAND_BUFFER_SIZE );
+
+    /* Fill MC_Ncs bytes worth of data with 0xff.
+     * This is needed for the timing. */
+    i = MC_Ncs;
+
+    /* Calculate the command sequence */
+    command[i++] = 0x40 | (0x3f & index);
+    command[i++] = argument >> 24;
+    command[i++] = 0xff & (argument >> 16);
+    command[i++] = 0xff & (argument >> 8);
+    command[i++] = 0xff & argument;
+    command[i++] = (crc7(&command[MC_Ncs], 5) << 1) | 0x01;
+}
+
+/**
+ *  Used to read up to MC_MAX_MULTIPLE_BLOCKS blocks with a single
+ *  READ_MULTIPLE_BLOCK command, which is ended with STOP_TRANSMISSION
+ *  once the last block has been read.
+ *
+ *  @param lba The logical block address of the first block to read.
+ *  @param buffer A buffer to store the data read in.
+ *  @param count The number of blocks to read.
+ *
+ *  @return Status, as block_read_multiple()
+ */
+static mc_status_t __read_multiple( const uint32_t lba, uint8_t *buffer,
+                                    const uint32_t count )
+{
+    mc_card_status_t card_status;
+    mc_status_t status;
+    uint32_t address = lba;
+    block_message_t *msg;
+
+    card_status = mc_get_status();
+
+    if( (MC_CARD__MOUNTING != card_status) &&
+        (MC_CARD__MOUNTED != card_status) )
+    {
+        return MC_ERROR_MODE;
+    }
+
+    if( MCT_SDHC != mc_get_type() ) {
+        address <<= 9;
+    }
+
+    os_queue_receive( __idle, &msg, WAIT_FOREVER );
+
+    __build_command( msg->command, MC_READ_MULTIPLE_BLOCK, address );
+    __build_command( msg->stop, MC_STOP_TRANSMISSION, 0 );
+
+    msg->data = buffer;
+    msg->length = 0;
+    msg->nac = 0;
+    msg->crc_length = 0;
+    msg->type = CMD_READ_MULTIPLE;
+    msg->blocks = count;
+    msg->block = 0;
+    msg->direct = 0;
+    msg->sent = 0;
+
+    msg->state = BRS_COMMAND_SENT;
+    os_queue_send_to_back( __pending, &msg, WAIT_FOREVER );
+
+    __block_isr_send_command( msg->command, msg->command,
+                              MC_COMMAND_BUFFER_SIZE, true );
+
+    _D1( "Reading: 0x%08x, %d blocks\n", lba, count );
+    os_queue_receive( __complete, &msg, WAIT_FOREVER );
+    status = (BRS_SUCCESS == msg->state) ? MC_RETURN_OK : MC_ERROR_TIMEOUT;
+
+#if (1 == MC_CHECK_CRCS)
+    if( BRS_SUCCESS == msg->state ) {
+        uint32_t i;
+
+        for( i = 0; i < count; i++ ) {
+            uint16_t crc;
+
+            crc = ((0xff & msg->crcs[i][0]) << 8) | (0xff & msg->crcs[i][1]);
+            if( crc != crc16(&buffer[i * 512], 512) ) {
+                status = MC_CRC_FAILURE;
+                break;
+            }
+        }
+    }
+#endif
+
+    os_queue_send_to_back( __idle, &msg, WAIT_FOREVER );
+
+    _D1( "Got response: 0x%04x\n", status );
+    return status;
+}
+
 /**
  *  Used to send the command or data to/from the card.
  *
@@ -361,6 +504,234 @@ static void __block_isr_send_command( const uint8_t *send,
     tx->isr;
 }
 
+/**
+ *  Used to receive into two buffers with a single transfer, chained by the
+ *  DMA, so the card is clocked without a break between them.
+ *
+ *  @note ISR safe - no printf() calls.
+ *
+ *  @param first the buffer to receive the first bytes into
+ *  @param first_length the number of bytes to receive into first
+ *  @param second the buffer to receive the rest into
+ *  @param second_length the number of bytes to receive into second
+ */
+static void __block_isr_receive_chained( uint8_t *first,
+                                         const size_t first_length,
+                                         uint8_t *second,
+                                         const size_t second_length )
+{
+    volatile avr32_pdca_channel_t *rx, *tx;
+
+    pdca_queue_buffer( PDCA_CHANNEL_ID_MC_RX, first, first_length );
+    pdca_queue_buffer( PDCA_CHANNEL_ID_MC_RX, second, second_length );
+
+    /* As __block_isr_send_command(), the first byte is written by hand,
+     * so the writes are 1 less. */
+    if( 1 < first_length ) {
+        pdca_queue_buffer( PDCA_CHANNEL_ID_MC_TX,
+                           (uint8_t*) &memory_block_dummy_data[1],
+                           (first_length - 1) );
+    }
+    pdca_queue_buffer( PDCA_CHANNEL_ID_MC_TX,
+                       (uint8_t*) memory_block_dummy_data, second_length );
+
+    io_send( memory_block_dummy_data[0] );
+
+    rx = &AVR32_PDCA.channel[PDCA_CHANNEL_ID_MC_RX];
+    tx = &AVR32_PDCA.channel[PDCA_CHANNEL_ID_MC_TX];
+
+    /* The transfer is only complete once both buffers are. */
+    rx->ier = AVR32_PDCA_TRC_MASK;
+
+    rx->cr = AVR32_PDCA_CR_ECLR_MASK | AVR32_PDCA_CR_TEN_MASK;
+    tx->cr = AVR32_PDCA_CR_ECLR_MASK | AVR32_PDCA_CR_TEN_MASK;
+
+    rx->isr;
+    tx->isr;
+}
+
+/**
+ *  Used to process the bytes clocked in during a multiple block read - the
+ *  Nac bytes, the block starts, the data & the CRCs - up to the end of the
+ *  last block.  Anything after that is thrown away.
+ *
+ *  @note ISR safe - no printf() calls.
+ *
+ *  @param msg the message to process
+ *  @param start the bytes clocked in
+ *  @param len the number of bytes clocked in
+ */
+static void __block_isr_take_multiple( block_message_t *msg,
+                                       const uint8_t *start, size_t len )
+{
+    while( (0 < len) && (msg->block < msg->blocks) ) {
+        if( BRS_LOOKING_FOR_BLOCK == msg->state ) {
+            const uint8_t *block_start;
+
+            block_start = memchr( start, MC_BLOCK_START, len );
+            if( NULL == block_start ) {
+                msg->nac += len;
+                return;
+            }
+
+            block_start++;
+            len -= block_start - start;
+            start = block_start;
+
+            msg->length = 0;
+            msg->crc_length = 0;
+            msg->state = BRS_BLOCK_START_FOUND;
+        } else if( msg->length < 512 ) {
+            size_t copy;
+
+            copy = MIN( 512 - msg->length, len );
+            memcpy( &msg->data[msg->block * 512 + msg->length], start, copy );
+            msg->length += copy;
+            start += copy;
+            len -= copy;
+        } else {
+            msg->crcs[msg->block][msg->crc_length] = *start;
+            msg->crc_length++;
+            start++;
+            len--;
+
+            if( 2 == msg->crc_length ) {
+                msg->block++;
+                msg->nac = 0;
+                msg->state = BRS_LOOKING_FOR_BLOCK;
+            }
+        }
+    }
+}
+
+/**
+ *  Used to clock in the next part of a multiple block read.  Once the
+ *  start of a block has been found the rest of it goes straight into the
+ *  data, chained with its CRC & the start of the next block into the
+ *  buffer, so only the few bytes of a block found while looking for it
+ *  are copied.
+ *
+ *  @note ISR safe - no printf() calls.
+ *
+ *  @param msg the message to clock the next part of
+ */
+static void __block_isr_next_multiple( block_message_t *msg )
+{
+    uint32_t send;
+
+    msg->direct = 0;
+
+    if( BRS_LOOKING_FOR_BLOCK == msg->state ) {
+        /* A slow card gets polled a buffer at a time, like a single read. */
+        send = (0 == msg->nac) ? MC_MULTIPLE_LOOKAHEAD : MC_BLOCK_BUFFER_SIZE;
+    } else {
+        msg->direct = 512 - msg->length;
+        send = 2 - msg->crc_length;
+        if( (msg->block + 1) < msg->blocks ) {
+            send += MC_MULTIPLE_LOOKAHEAD;
+        }
+    }
+
+    msg->sent = send;
+    if( 0 < msg->direct ) {
+        __block_isr_receive_chained( &msg->data[msg->block * 512 + msg->length],
+                                     msg->direct, msg->buffer, send );
+    } else {
+        __block_isr_send_command( memory_block_dummy_data, msg->buffer,
+                                  send, false );
+    }
+}
+
+/**
+ *  Used to move a multiple block read on once the bytes asked for have
+ *  been clocked in.
+ *
+ *  @note ISR safe - no printf() calls.
+ *
+ *  @param msg the message to process
+ *
+ *  @return true if the read is done or is still going, false if it failed
+ */
+static bool __block_isr_read_multiple( block_message_t *msg )
+{
+    if( BRS_COMMAND_SENT == msg->state ) {
+        uint8_t *r1, *end;
+
+        end = &msg->command[MC_COMMAND_BUFFER_SIZE];
+
+        r1 = memchr( &msg->command[7], 0, (MC_COMMAND_BUFFER_SIZE-7) );
+        if( NULL == r1 ) {
+            return false;
+        }
+        msg->state = BRS_LOOKING_FOR_BLOCK;
+
+        r1++;
+        __block_isr_take_multiple( msg, r1, (end - r1) );
+        __block_isr_next_multiple( msg );
+    } else if( (BRS_LOOKING_FOR_BLOCK == msg->state) ||
+               (BRS_BLOCK_START_FOUND == msg->state) )
+    {
+        /* The DMA has put the rest of the block in place already. */
+        msg->length += msg->direct;
+        msg->direct = 0;
+
+        __block_isr_take_multiple( msg, msg->buffer, msg->sent );
+
+        if( msg->blocks == msg->block ) {
+            /* The card sends blocks until it is told to stop. */
+            msg->state = BRS_STOP_SENT;
+            __block_isr_send_command( msg->stop, msg->stop,
+                                      MC_COMMAND_BUFFER_SIZE, false );
+        } else {
+            /* Nac is in clock cycles, there are 8 clock cycles per
+             * byte, so divide by 8 (or shift right by 3) */
+            if( (BRS_LOOKING_FOR_BLOCK == msg->state) &&
+                (mc_get_Nac_read() < (msg->nac >> 3)) )
+            {
+                return false;
+            }
+            __block_isr_next_multiple( msg );
+        }
+    } else if( BRS_STOP_SENT == msg->state ) {
+        uint32_t i;
+
+        /* The byte after the command is a stuff byte, the R1 response
+         * follows it, & then the card is busy until it sends 0xff. */
+        for( i = MC_Ncs + 7; i < MC_COMMAND_BUFFER_SIZE; i++ ) {
+            if( 0 == (0x80 & msg->stop[i]) ) {
+                break;
+            }
+        }
+        if( MC_COMMAND_BUFFER_SIZE == i ) {
+            return false;
+        }
+
+        i++;
+        if( NULL != memchr(&msg->stop[i], 0xff, MC_COMMAND_BUFFER_SIZE - i) ) {
+            msg->state = BRS_SUCCESS;
+        } else {
+            msg->nac = 0;
+            msg->sent = MC_MULTIPLE_LOOKAHEAD;
+            msg->state = BRS_WAITING_UNTIL_NOT_BUSY;
+            __block_isr_send_command( memory_block_dummy_data, msg->buffer,
+                                      msg->sent, false );
+        }
+    } else if( BRS_WAITING_UNTIL_NOT_BUSY == msg->state ) {
+        if( NULL != memchr(msg->buffer, 0xff, msg->sent) ) {
+            msg->state = BRS_SUCCESS;
+        } else {
+            msg->nac += msg->sent;
+            if( mc_get_Nac_write() < (msg->nac >> 3) ) {
+                return false;
+            }
+            __block_isr_send_command( memory_block_dummy_data, msg->buffer,
+                                      msg->sent, false );
+        }
+    }
+
+    return true;
+}
+
 /**
  *  Used to process and find the start of a data block.
  *
@@ -447,7 +818,12 @@ static void __block_isr_state_machine( void )
             goto timeout_failure;
         }
 
-        if( CMD_READ == msg->type ) {
+        if( CMD_READ_MULTIPLE == msg->type ) {
+            if( false == __block_isr_read_multiple(msg) ) {
+                goto timeout_failure;
+            }
+            send_to_pending = (BRS_SUCCESS == msg->state) ? false : true;
+        } else if( CMD_READ == msg->type ) {
             if( BRS_COMMAND_SENT == msg->state ) {
                 uint8_t *r1, *end;
 
@@ -504,6 +880,15 @@ static void __block_isr_state_machine( void )
                     msg->crc[0] = msg->buffer[copy_length];
                     msg->crc[1] = msg->buffer[copy_length + 1];
                     msg->crc_length = 2;
+                } else {
+                    /* The block ended with the buffer, the CRC didn't. */
+                    if( 0 == msg->crc_length ) {
+                        msg->crc[0] = msg->buffer[0];
+                        msg->crc[1] = msg->buffer[1];
+                    } else {
+                        msg->crc[1] = msg->buffer[0];
+                    }
+                    msg->crc_length = 2;
                 }
 
                 msg->state = BRS_SUCCESS;
@@ -50,6 +50,26 @@ mc_status_t block_init( void* (*fast_malloc_fn)(size_t) );
  */
 mc_status_t block_read( const uint32_t lba, uint8_t *buffer );
 
+/**
+ *  Used to read consecutive 512 byte blocks of memory from the card with
+ *  as few READ_MULTIPLE_BLOCK commands as it takes, rather than a command
+ *  for each block.
+ *
+ *  @param lba The logical block address of the first block to read.
+ *  @param buffer A buffer to store the data read in, count * 512 bytes.
+ *  @param count The number of blocks to read.
+ *
+ *  @return Status
+ *      @retval MC_RETURN_OK        Success.
+ *      @retval MC_ERROR_PARAMETER  Invalid argument(s) passed.
+ *      @retval MC_ERROR_TIMEOUT    The card timed out during IO.
+ *      @retval MC_ERROR_MODE       The card is in a generic error state.
+ *      @retval MC_CRC_FAILURE      The data retrieved from the card failed the CRC
+ *                                      check - the card may not be present anymore.
+ */
+mc_status_t block_read_multiple( const uint32_t lba, uint8_t *buffer,
+                                 const uint32_t count );
+
 /**
  *  Used to write a 512 byte block of memory to a card.
  *
@@ -25,4 +25,24 @@
 #define MC_CHECK_CRCS   1
 #define CRC_FAST        1
 
+/* The number of 512 byte FAT & directory sectors cached, 0 to not cache
+ * any.  The cache comes from the malloc_fn passed to mc_init(), which is
+ * the external SDRAM on the board: the 16kB it takes would be a quarter of
+ * the 64kB of internal SRAM, which is kept for the task stacks & queues
+ * (the playback stack the decoders run on alone is 5000 words) & the block
+ * layer's DMA buffer.  A cached sector is only ever memcpy()ed out, so
+ * the slower SDRAM still beats re-reading it from the card by far. */
+#ifndef MC_SECTOR_CACHE_SIZE
+#define MC_SECTOR_CACHE_SIZE    32
+#endif
+
+/* The largest cluster link map (in DWORDs) taken from the heap for a file
+ * in more fragments than fit in FF_CLMT_ITEMS, 258 is 128 fragments.  Files
+ * in more fragments than this walk the FAT chain to seek. */
+#define MC_CLMT_MAX_ITEMS       258
+
+/* The link map is built the first time a seek would otherwise follow more
+ * than 1/MC_CLMT_WALK_RATIO of the file's clusters in the FAT. */
+#define MC_CLMT_WALK_RATIO      4
+
 #endif
@@ -84,6 +84,8 @@ struct dirent* readdir( DIR *dirp, struct dirent *_user_provided )
                 _user_provided->d_ino = 0;
                 _user_provided->d_size = file_info.fsize;
                 _user_provided->d_attr = 0;
+                _user_provided->d_mtime = (((unsigned long) file_info.fdate) << 16) |
+                                          ((unsigned long) file_info.ftime);
                 if( AM_RDO == (AM_RDO & file_info.fattrib) ) {
                     _user_provided->d_attr |= DT_READ_ONLY;
                 }
@@ -14,6 +14,7 @@ struct dirent {
     char d_name[DT_NAME_MAX+1];
     size_t d_size;
     unsigned char d_attr;
+    unsigned long d_mtime;  /* FAT date (upper 16 bits) & time (lower 16 bits) */
 };
 
 #ifndef _FATFS
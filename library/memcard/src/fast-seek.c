@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2009  Weston Schmidt
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdlib.h>
+
+#include "config.h"
+#include "fast-seek.h"
+#include "fatfs/ff.h"
+
+/*----------------------------------------------------------------------------*/
+/*                                   Macros                                   */
+/*----------------------------------------------------------------------------*/
+/* none */
+
+/*----------------------------------------------------------------------------*/
+/*                               Data Structures                              */
+/*----------------------------------------------------------------------------*/
+/* none */
+
+/*----------------------------------------------------------------------------*/
+/*                            File Scoped Variables                           */
+/*----------------------------------------------------------------------------*/
+/* none */
+
+/*----------------------------------------------------------------------------*/
+/*                             Function Prototypes                            */
+/*----------------------------------------------------------------------------*/
+static DWORD __clusters_walked( FIL *file, DWORD goal );
+static void __build_map( FF_FILE *slot );
+
+/*----------------------------------------------------------------------------*/
+/*                           Library Only Functions                           */
+/*----------------------------------------------------------------------------*/
+/* See fast-seek.h for details. */
+void fast_seek_open( FF_FILE *slot )
+{
+    /* f_open() leaves the file seeking through the FAT. */
+    slot->clmt_tried = (FA_WRITE == (FA_WRITE & slot->file.flag)) ? 1 : 0;
+}
+
+/* See fast-seek.h for details. */
+FRESULT fast_seek( FF_FILE *slot, DWORD goal )
+{
+    if( 0 == slot->clmt_tried ) {
+        DWORD walk;
+        DWORD clusters;
+
+        walk = __clusters_walked( &slot->file, goal );
+        clusters = slot->file.fsize / (slot->file.fs->csize * _MAX_SS);
+
+        if( (0 < walk) && (clusters <= (walk * MC_CLMT_WALK_RATIO)) ) {
+            __build_map( slot );
+        }
+    }
+
+    return f_lseek( &slot->file, goal );
+}
+
+/* See fast-seek.h for details. */
+void fast_seek_close( FF_FILE *slot )
+{
+    if( (NULL != slot->file.cltbl) && (slot->clmt != slot->file.cltbl) ) {
+        free( slot->file.cltbl );
+    }
+    slot->file.cltbl = NULL;
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             Internal Functions                             */
+/*----------------------------------------------------------------------------*/
+
+/**
+ *  Used to find out how many clusters f_lseek() follows in the FAT to get
+ *  to the goal without a link map.  It carries on from the current cluster
+ *  going forward, otherwise it starts again from the start of the file.
+ *
+ *  @param file the file to seek in
+ *  @param goal the offset to seek to
+ *
+ *  @return the number of clusters followed
+ */
+static DWORD __clusters_walked( FIL *file, DWORD goal )
+{
+    DWORD cluster_size;
+
+    cluster_size = file->fs->csize * _MAX_SS;
+
+    if( file->fsize < goal ) {
+        goal = file->fsize;
+    }
+
+    if( 0 == goal ) {
+        return 0;
+    }
+
+    if( (0 < file->fptr) &&
+        (((file->fptr - 1) / cluster_size) <= ((goal - 1) / cluster_size)) )
+    {
+        return ((goal - 1) / cluster_size) - ((file->fptr - 1) / cluster_size);
+    }
+
+    return (goal - 1) / cluster_size;
+}
+
+/**
+ *  Used to build the link map of a file, in the slot if it fits otherwise
+ *  from the heap.  The file is left seeking through the FAT if neither can
+ *  hold it.
+ *
+ *  @param slot the file to build the link map for
+ */
+static void __build_map( FF_FILE *slot )
+{
+    FRESULT result;
+    DWORD needed;
+    DWORD *map;
+
+    slot->clmt_tried = 1;
+
+    slot->clmt[0] = FF_CLMT_ITEMS;
+    slot->file.cltbl = slot->clmt;
+    result = f_lseek( &slot->file, CREATE_LINKMAP );
+    if( FR_OK == result ) {
+        return;
+    }
+
+    /* The map is only used once it has been built. */
+    slot->file.cltbl = NULL;
+    if( FR_NOT_ENOUGH_CORE != result ) {
+        return;
+    }
+
+    needed = slot->clmt[0];
+    if( MC_CLMT_MAX_ITEMS < needed ) {
+        return;
+    }
+
+    map = (DWORD *) malloc( needed * sizeof(DWORD) );
+    if( NULL == map ) {
+        return;
+    }
+
+    map[0] = needed;
+    slot->file.cltbl = map;
+    if( FR_OK != f_lseek(&slot->file, CREATE_LINKMAP) ) {
+        slot->file.cltbl = NULL;
+        free( map );
+    }
+}
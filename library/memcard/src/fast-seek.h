@@ -0,0 +1,55 @@
+/*
+ * Copyright (c) 2009  Weston Schmidt
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+#ifndef __FAST_SEEK_H__
+#define __FAST_SEEK_H__
+
+#include "fatfs/ff.h"
+
+/**
+ *  Used to set up the seeking of a file just opened with f_open().  Only
+ *  files opened read only use a cluster link map, FatFs can't grow a file
+ *  with one.
+ *
+ *  @param slot the file just opened
+ */
+void fast_seek_open( FF_FILE *slot );
+
+/**
+ *  Used to seek in a file like f_lseek().  The first time a seek would
+ *  follow a large part of the file's FAT chain the whole chain is put into
+ *  a cluster link map, so this & every later seek is done without reading
+ *  the FAT.  The map is kept in the slot, or taken from the heap for a file
+ *  in more fragments than fit.  Files in too many fragments for
+ *  MC_CLMT_MAX_ITEMS (or when the heap is empty) seek through the FAT.
+ *
+ *  @param slot the file to seek in
+ *  @param goal the offset from the start of the file to seek to
+ *
+ *  @return the result of f_lseek()
+ */
+FRESULT fast_seek( FF_FILE *slot, DWORD goal );
+
+/**
+ *  Used to free any link map taken from the heap, call it when the file
+ *  is closed.
+ *
+ *  @param slot the file being closed
+ */
+void fast_seek_close( FF_FILE *slot );
+
+#endif
@@ -6,6 +6,7 @@
 
 #include "../memcard.h"
 #include "../block.h"
+#include "../sector-cache.h"
 #include "diskio.h"
 
 /*----------------------------------------------------------------------------*/
@@ -67,13 +68,29 @@ DRESULT disk_read( BYTE drv, BYTE *buf, DWORD lba, BYTE sector_count )
         return RES_PARERR;
     }
 
-    while( 0 < sector_count ) {
+    /* File data, a sector or a run of them read with a single command.
+     * It isn't cached, it would only push the window sectors out. */
+    if( 1 == sector_count ) {
         if( MC_RETURN_OK != block_read(lba, buf) ) {
             return RES_ERROR;
         }
-        sector_count--;
-        lba += 512;
-        buf += 512;
+    } else if( MC_RETURN_OK != block_read_multiple(lba, buf, sector_count) ) {
+        return RES_ERROR;
+    }
+
+    return RES_OK;
+}
+
+DRESULT disk_read_window( BYTE drv, BYTE *buf, DWORD lba )
+{
+    if( (0 != drv) || (NULL == buf) ) {
+        return RES_PARERR;
+    }
+
+    /* The FAT & directory sectors FatFs moves its window over, which are
+     * read over & over, so they are cached. */
+    if( MC_RETURN_OK != sector_cache_read(lba, buf) ) {
+        return RES_ERROR;
     }
 
     return RES_OK;
@@ -93,7 +110,7 @@ DRESULT disk_ioctl( BYTE drv, BYTE ctrl, void *buf )
         case GET_SECTOR_COUNT:
         {
             uint32_t blocks;
-            if( MC_RETURN_OK == mc_get_block_count(&blocks) ) {
+            if( MC_RETURN_OK != mc_get_block_count(&blocks) ) {
                 return RES_ERROR;
             }
             *((DWORD*) buf) = (DWORD) blocks;
@@ -130,8 +147,9 @@ DRESULT disk_write( BYTE drv, const BYTE *buf, DWORD lba, BYTE sector_count )
         if( MC_RETURN_OK != block_write(lba, buf) ) {
             return RES_ERROR;
         }
+        sector_cache_write( lba, buf, 1 );
         sector_count--;
-        lba += 512;
+        lba++;
         buf += 512;
     }
 
@@ -30,6 +30,7 @@ int assign_drives (int, int);
 DSTATUS disk_initialize (BYTE);
 DSTATUS disk_status (BYTE);
 DRESULT disk_read (BYTE, BYTE*, DWORD, BYTE);
+DRESULT disk_read_window (BYTE, BYTE*, DWORD);	/* A FAT or directory sector into the window */
 #if	_READONLY == 0
 DRESULT disk_write (BYTE, const BYTE*, DWORD, BYTE);
 #endif
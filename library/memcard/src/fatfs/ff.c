@@ -710,7 +710,7 @@ FRESULT move_window (
 		}
 #endif
 		if (sector) {
-			if (disk_read(fs->drv, fs->win, sector, 1) != RES_OK)
+			if (disk_read_window(fs->drv, fs->win, sector) != RES_OK)
 				return FR_DISK_ERR;
 			fs->winsect = sector;
 		}
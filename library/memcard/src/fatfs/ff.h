@@ -157,10 +157,21 @@ typedef struct {
                              * of the directory listings. */
 } DIR;
 
+/* WTS: The number of cluster link map items kept with each open file, enough
+ * for a file in 16 fragments.  See fast-seek.h. */
+#define FF_CLMT_ITEMS   34
+
+/* WTS: An open file & the cluster link map used to seek in it. */
+typedef struct {
+    FIL file;                   /* Needs to be first so this is also a FIL */
+    BYTE clmt_tried;            /* Has the link map been built (or failed)? */
+    DWORD clmt[FF_CLMT_ITEMS];
+} FF_FILE;
+
 /* This is used to allocate memory for the newlib so that either structure
  * will fit in the same space. */
 typedef union {
-    FIL file;
+    FF_FILE file;
     DIR dir;
 } FF_SLOT;
 
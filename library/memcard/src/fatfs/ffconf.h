@@ -40,7 +40,9 @@
 /* To enable string functions, set _USE_STRFUNC to 1 or 2. */
 
 
+#ifndef _USE_MKFS	/* WTS: The host benchmarks format a RAM disk. */
 #define	_USE_MKFS		0	/* 0:Disable or 1:Enable */
+#endif
 /* To enable f_mkfs function, set _USE_MKFS to 1 and set _FS_READONLY to 0 */
 
 
@@ -48,7 +50,7 @@
 /* To enable f_forward function, set _USE_FORWARD to 1 and set _FS_TINY to 1. */
 
 
-#define	_USE_FASTSEEK	0	/* 0:Disable or 1:Enable */
+#define	_USE_FASTSEEK	1	/* 0:Disable or 1:Enable */
 /* To enable fast seek feature, set _USE_FASTSEEK to 1. */
 
 
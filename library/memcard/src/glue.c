@@ -29,6 +29,7 @@
 #include <newlib/reent-file-glue.h>
 
 #include "fatfs/ff.h"
+#include "fast-seek.h"
 #include "memcard-private.h"
 
 /*----------------------------------------------------------------------------*/
@@ -133,7 +134,8 @@ int _file_fstat_r( struct _reent *reent, int fd, struct stat *st )
     /* Fill in the structure with all we know. */
     st->st_size = file->fsize;
     st->st_mode = S_IFREG | S_IFBLK;
-    st->st_blksize = 512;
+    /* Reads of whole clusters go straight from the card to the caller. */
+    st->st_blksize = file->fs->csize * _MAX_SS;
 
     return 0;
 }
@@ -216,7 +218,7 @@ off_t _file_lseek_r( struct _reent *reent, int fd, off_t offset, int whence )
         return -1;
     }
 
-    switch( f_lseek(file, goal) ) {
+    switch( fast_seek((FF_FILE *) file, goal) ) {
         case FR_OK:
             return goal;
 
@@ -244,6 +246,8 @@ int _file_close_r( struct _reent *reent, int fd )
 
     r->active[fd] = false;
 
+    fast_seek_close( (FF_FILE *) file );
+
     switch( f_close(file) ) {
         case FR_OK:
             return 0;
@@ -351,6 +355,7 @@ int _open_r( struct _reent *reent, const char *name, int flags, int mode )
             DWORD goal;
 
             r->active[fd] = true;
+            fast_seek_open( (FF_FILE *) file );
 
             goal = 0;
             if( O_APPEND == (O_APPEND & flags) ) {
@@ -358,7 +363,7 @@ int _open_r( struct _reent *reent, const char *name, int flags, int mode )
             }
 
             /* Always seek since FA_OPEN_ALWAYS requires a seek to write. */
-            if( FR_OK != f_lseek(file, goal) ) {
+            if( FR_OK != fast_seek((FF_FILE *) file, goal) ) {
                 reent->_errno = EBADF;
                 return -1;
             }
@@ -32,6 +32,7 @@
 
 #include "config.h"
 #include "block.h"
+#include "sector-cache.h"
 #include "debug-helpers.h"
 #include "memcard.h"
 #include "memcard-private.h"
@@ -121,7 +122,8 @@ static bool __isr_card_present( void );
 /*                             External Functions                             */
 /*----------------------------------------------------------------------------*/
 /* See memcard.h for details. */
-mc_status_t mc_init( void* (*fast_malloc_fn)(size_t) )
+mc_status_t mc_init( void* (*fast_malloc_fn)(size_t),
+                     void* (*malloc_fn)(size_t) )
 {
     int32_t i;
 
@@ -136,6 +138,7 @@ mc_status_t mc_init( void* (*fast_malloc_fn)(size_t) )
     }
 
     block_init( fast_malloc_fn );
+    sector_cache_init( malloc_fn );
 
     io_disable();
 
@@ -46,6 +46,12 @@ typedef enum {
     MC_CARD__REMOVED
 } mc_card_status_t;
 
+typedef struct {
+    uint32_t hits;          /* Sectors read from the sector cache */
+    uint32_t misses;        /* Sectors read from the card */
+    uint32_t flushes;       /* Times the cache was emptied for a new card */
+} mc_cache_stats_t;
+
 /**
  *  Called with a status update for the memory card/slot.
  *
@@ -59,11 +65,17 @@ typedef void (*card_status_fct)( const mc_card_status_t status );
  *
  *  @note The SPI bus(es) controlling the card(s) must be initialized.
  *
+ *  @param fast_malloc_fn the allocator for the block transfer buffer the DMA
+ *                        works out of, this should be internal SRAM
+ *  @param malloc_fn the allocator for the sector cache, this may be slower
+ *                   external memory
+ *
  *  @return Status.
  *      @retval MC_RETURN_OK       Success.
  *      @retval MC_ERROR_PARAMETER Invalid argument(s) passed.
  */
-mc_status_t mc_init( void* (*fast_malloc_fn)(size_t) );
+mc_status_t mc_init( void* (*fast_malloc_fn)(size_t),
+                     void* (*malloc_fn)(size_t) );
 
 /**
  *  Used to register a callback notification when the status
@@ -113,4 +125,12 @@ mc_card_status_t mc_get_status( void );
  */
 mc_status_t mc_get_block_count( uint32_t *blocks );
 
+/**
+ *  Used to get the number of FAT & directory sector reads found in the
+ *  sector cache & read from the card since mc_init().
+ *
+ *  @param stats the structure to fill in
+ */
+void mc_get_cache_stats( mc_cache_stats_t *stats );
+
 #endif
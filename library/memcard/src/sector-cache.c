@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2009  Weston Schmidt
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "block.h"
+#include "config.h"
+#include "memcard.h"
+#include "memcard-private.h"
+#include "sector-cache.h"
+
+/*----------------------------------------------------------------------------*/
+/*                                   Macros                                   */
+/*----------------------------------------------------------------------------*/
+#define SECTOR_SIZE     512
+
+/*----------------------------------------------------------------------------*/
+/*                               Data Structures                              */
+/*----------------------------------------------------------------------------*/
+typedef struct {
+    uint32_t lba;
+    uint32_t last_used;     /* The tick it was last read at, for the LRU */
+    bool valid;
+} cache_entry_t;
+
+/*----------------------------------------------------------------------------*/
+/*                            File Scoped Variables                           */
+/*----------------------------------------------------------------------------*/
+#if (0 < MC_SECTOR_CACHE_SIZE)
+static cache_entry_t __entries[MC_SECTOR_CACHE_SIZE];
+static uint8_t *__data;
+static uint32_t __tick;
+
+/* The card the cache was filled from. */
+static uint32_t __magic_insert_number;
+#endif
+
+static mc_cache_stats_t __stats;
+
+/*----------------------------------------------------------------------------*/
+/*                             Function Prototypes                            */
+/*----------------------------------------------------------------------------*/
+#if (0 < MC_SECTOR_CACHE_SIZE)
+static cache_entry_t* __find( const uint32_t lba );
+static void __check_card( void );
+#endif
+
+/*----------------------------------------------------------------------------*/
+/*                             External Functions                             */
+/*----------------------------------------------------------------------------*/
+/* See memcard.h for details. */
+void mc_get_cache_stats( mc_cache_stats_t *stats )
+{
+    if( NULL != stats ) {
+        *stats = __stats;
+    }
+}
+
+/*----------------------------------------------------------------------------*/
+/*                           Library Only Functions                           */
+/*----------------------------------------------------------------------------*/
+/* See sector-cache.h for details. */
+mc_status_t sector_cache_init( void* (*malloc_fn)(size_t) )
+{
+    if( NULL == malloc_fn ) {
+        return MC_ERROR_PARAMETER;
+    }
+
+    memset( &__stats, 0, sizeof(mc_cache_stats_t) );
+
+#if (0 < MC_SECTOR_CACHE_SIZE)
+    memset( __entries, 0, sizeof(__entries) );
+    __tick = 0;
+    __magic_insert_number = mc_get_magic_insert_number();
+
+    /* Without the memory everything is read from the card. */
+    __data = (uint8_t *) (*malloc_fn)( MC_SECTOR_CACHE_SIZE * SECTOR_SIZE );
+#endif
+
+    return MC_RETURN_OK;
+}
+
+/* See sector-cache.h for details. */
+mc_status_t sector_cache_read( const uint32_t lba, uint8_t *buffer )
+{
+#if (0 < MC_SECTOR_CACHE_SIZE)
+    cache_entry_t *entry;
+    mc_status_t status;
+    uint32_t i;
+
+    if( NULL == __data ) {
+        __stats.misses++;
+        return block_read( lba, buffer );
+    }
+
+    __check_card();
+    __tick++;
+
+    entry = __find( lba );
+    if( NULL != entry ) {
+        __stats.hits++;
+        entry->last_used = __tick;
+        memcpy( buffer, &__data[(entry - __entries) * SECTOR_SIZE], SECTOR_SIZE );
+        return MC_RETURN_OK;
+    }
+
+    __stats.misses++;
+    status = block_read( lba, buffer );
+    if( MC_RETURN_OK != status ) {
+        return status;
+    }
+
+    /* An empty entry, or the least recently used one. */
+    entry = &__entries[0];
+    for( i = 0; i < MC_SECTOR_CACHE_SIZE; i++ ) {
+        if( false == __entries[i].valid ) {
+            entry = &__entries[i];
+            break;
+        }
+        if( __entries[i].last_used < entry->last_used ) {
+            entry = &__entries[i];
+        }
+    }
+
+    entry->lba = lba;
+    entry->last_used = __tick;
+    entry->valid = true;
+    memcpy( &__data[(entry - __entries) * SECTOR_SIZE], buffer, SECTOR_SIZE );
+
+    return MC_RETURN_OK;
+#else
+    __stats.misses++;
+    return block_read( lba, buffer );
+#endif
+}
+
+/* See sector-cache.h for details. */
+void sector_cache_write( const uint32_t lba, const uint8_t *buffer,
+                         const uint32_t count )
+{
+#if (0 < MC_SECTOR_CACHE_SIZE)
+    uint32_t i;
+
+    if( NULL == __data ) {
+        return;
+    }
+
+    __check_card();
+
+    for( i = 0; i < MC_SECTOR_CACHE_SIZE; i++ ) {
+        cache_entry_t *entry = &__entries[i];
+
+        if( (true == entry->valid) &&
+            (lba <= entry->lba) && (entry->lba < (lba + count)) )
+        {
+            memcpy( &__data[i * SECTOR_SIZE],
+                    &buffer[(entry->lba - lba) * SECTOR_SIZE], SECTOR_SIZE );
+        }
+    }
+#endif
+}
+
+/*----------------------------------------------------------------------------*/
+/*                             Internal Functions                             */
+/*----------------------------------------------------------------------------*/
+#if (0 < MC_SECTOR_CACHE_SIZE)
+/**
+ *  Used to find a sector in the cache.
+ *
+ *  @param lba the logical block address of the sector
+ *
+ *  @return the entry for the sector, NULL if it isn't cached
+ */
+static cache_entry_t* __find( const uint32_t lba )
+{
+    uint32_t i;
+
+    for( i = 0; i < MC_SECTOR_CACHE_SIZE; i++ ) {
+        if( (true == __entries[i].valid) && (lba == __entries[i].lba) ) {
+            return &__entries[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ *  Used to throw away everything cached once the card has been removed,
+ *  as the next card is a different card even if it looks the same.
+ */
+static void __check_card( void )
+{
+    uint32_t magic_insert_number;
+
+    magic_insert_number = mc_get_magic_insert_number();
+    if( __magic_insert_number != magic_insert_number ) {
+        __magic_insert_number = magic_insert_number;
+        memset( __entries, 0, sizeof(__entries) );
+        __tick = 0;
+        __stats.flushes++;
+    }
+}
+#endif
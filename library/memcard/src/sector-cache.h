@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2009  Weston Schmidt
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+#ifndef __SECTOR_CACHE_H__
+#define __SECTOR_CACHE_H__
+
+#include <stdint.h>
+
+#include "memcard.h"
+
+/**
+ *  Used to initialize the sector cache, which keeps the MC_SECTOR_CACHE_SIZE
+ *  sectors read most recently through it - the FAT & directory sectors
+ *  FatFs reads into its window (disk_read_window()), not file data.
+ *
+ *  @note The cache isn't locked, FatFs only calls the disk functions with
+ *        its own lock held.
+ *
+ *  @param malloc_fn the function used to allocate the cache
+ *
+ *  @return Status.
+ *      @retval MC_RETURN_OK       Success.
+ *      @retval MC_ERROR_PARAMETER Invalid argument(s) passed.
+ */
+mc_status_t sector_cache_init( void* (*malloc_fn)(size_t) );
+
+/**
+ *  Used to read a 512 byte sector from the cache, or from the card into
+ *  the cache if it isn't there.  Everything cached is thrown away once a
+ *  different card is inserted.
+ *
+ *  @param lba The logical block address of the sector to read.
+ *  @param buffer A buffer to store the data read in.
+ *
+ *  @return Status, as block_read()
+ */
+mc_status_t sector_cache_read( const uint32_t lba, uint8_t *buffer );
+
+/**
+ *  Used to keep the cache the same as the card when sectors are written
+ *  to it.
+ *
+ *  @param lba The logical block address of the first sector written.
+ *  @param buffer The data written.
+ *  @param count The number of sectors written.
+ */
+void sector_cache_write( const uint32_t lba, const uint8_t *buffer,
+                         const uint32_t count );
+
+#endif
@@ -0,0 +1,266 @@
+#include <CUnit/Basic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <freertos/os-mock.h>
+#include "block.h"
+#include "memcard.h"
+#include "spi-model.h"
+
+#define LBA             1000
+#define MAX_BLOCKS      300
+#define LOOKAHEAD       16      /* MC_MULTIPLE_LOOKAHEAD in block.c */
+#define BUFFER_SIZE     522     /* MC_BLOCK_BUFFER_SIZE */
+#define MAX_NCR         9       /* The R1 must be in the command buffer, */
+#define MAX_STOP_NCR    8       /* after the stuff byte for a STOP */
+
+static uint8_t buffer[MAX_BLOCKS * 512];
+
+/* Reads count blocks from the card & checks them against it, & that the
+ * card had answered everything by the time the read was done. */
+static mc_status_t read_blocks( const spi_model_card_t *card,
+                                const uint32_t count )
+{
+    spi_model_stats_t stats;
+    mc_status_t status;
+    uint32_t i;
+
+    spi_model_insert( card );
+    memset( buffer, 0, sizeof(buffer) );
+
+    status = block_read_multiple( LBA, buffer, count );
+    if( MC_RETURN_OK == status ) {
+        spi_model_get_stats( &stats );
+        CU_ASSERT( true == stats.idle );
+
+        for( i = 0; i < count * 512; i++ ) {
+            if( spi_model_data(LBA + i / 512, i % 512) != buffer[i] ) {
+                CU_FAIL( "The blocks are different from the card" );
+                break;
+            }
+        }
+    }
+    return status;
+}
+
+void test_read( void )
+{
+    spi_model_card_t card;
+    spi_model_stats_t stats;
+
+    spi_model_default_card( &card );
+    CU_ASSERT( MC_ERROR_PARAMETER == block_read_multiple(LBA, NULL, 8) );
+    CU_ASSERT( MC_ERROR_PARAMETER == block_read_multiple(LBA, buffer, 0) );
+
+    CU_ASSERT( MC_RETURN_OK == read_blocks(&card, 8) );
+    spi_model_get_stats( &stats );
+    CU_ASSERT( 2 == stats.commands );
+    CU_ASSERT( 1 == stats.stops );
+
+    /* The command, a transfer straight into each block & the STOP - only
+     * the bytes found with a block start are copied. */
+    CU_ASSERT( 8 + 2 == stats.transfers );
+    CU_ASSERT( 8 == stats.chained );
+
+    /* A single block is READ_SINGLE_BLOCK, without a STOP. */
+    CU_ASSERT( MC_RETURN_OK == read_blocks(&card, 1) );
+    spi_model_get_stats( &stats );
+    CU_ASSERT( 1 == stats.commands );
+    CU_ASSERT( 0 == stats.stops );
+
+    /* 128 blocks at most per command. */
+    CU_ASSERT( MC_RETURN_OK == read_blocks(&card, MAX_BLOCKS) );
+    spi_model_get_stats( &stats );
+    CU_ASSERT( 3 == stats.stops );
+    CU_ASSERT( 0 == stats.cancelled );
+}
+
+void test_first_block( void )
+{
+    spi_model_card_t card;
+    uint32_t ncr, gap;
+
+    /* The R1 anywhere in the command buffer, & the first block start, or
+     * some of its data, in the rest of the buffer or the next one. */
+    spi_model_default_card( &card );
+    card.gaps = &gap;
+    card.gap_count = 1;
+    for( ncr = 0; ncr <= MAX_NCR; ncr++ ) {
+        for( gap = 0; gap <= 2 * LOOKAHEAD; gap++ ) {
+            card.ncr = ncr;
+            if( MC_RETURN_OK != read_blocks(&card, 3) ) {
+                CU_FAIL( "First block" );
+                printf( "\n    ncr %u, gap %u\n", ncr, gap );
+                return;
+            }
+        }
+    }
+}
+
+void test_gaps( void )
+{
+    static const uint32_t big[] = { BUFFER_SIZE - 514, BUFFER_SIZE - 513,
+                                    BUFFER_SIZE - 512, BUFFER_SIZE - 2,
+                                    BUFFER_SIZE - 1, BUFFER_SIZE,
+                                    BUFFER_SIZE + 1, 3 * BUFFER_SIZE };
+    static const uint32_t mixed[] = { 1, LOOKAHEAD - 1, LOOKAHEAD, 2,
+                                      LOOKAHEAD + 1, 600, 0, BUFFER_SIZE };
+    spi_model_card_t card;
+    spi_model_stats_t stats;
+    uint32_t gap;
+    uint32_t i;
+
+    spi_model_default_card( &card );
+    card.gaps = &gap;
+    card.gap_count = 1;
+
+    /* Every place in the lookahead for the next block start, from right
+     * after the CRC, through the last byte of the lookahead, to just past
+     * it where the card has to be polled for it. */
+    for( gap = 0; gap <= LOOKAHEAD + 2; gap++ ) {
+        if( MC_RETURN_OK != read_blocks(&card, 6) ) {
+            CU_FAIL( "Small gap" );
+            printf( "\n    gap %u\n", gap );
+        }
+    }
+
+    /* Polled a buffer at a time, the start near either end of a buffer, &
+     * with a whole block & the start of the next in it. */
+    for( i = 0; i < sizeof(big) / sizeof(big[0]); i++ ) {
+        gap = big[i];
+        if( MC_RETURN_OK != read_blocks(&card, 6) ) {
+            CU_FAIL( "Big gap" );
+            printf( "\n    gap %u\n", gap );
+        }
+
+        /* A slow card is polled a buffer at a time, not a lookahead. */
+        spi_model_get_stats( &stats );
+        CU_ASSERT( stats.transfers <= 6 * (gap / BUFFER_SIZE + 3) + 2 );
+    }
+
+    card.gaps = mixed;
+    card.gap_count = sizeof(mixed) / sizeof(mixed[0]);
+    CU_ASSERT( MC_RETURN_OK == read_blocks(&card, 128) );
+    spi_model_get_stats( &stats );
+    CU_ASSERT( 1 == stats.stops );
+}
+
+void test_stop( void )
+{
+    static const uint32_t busy[] = { 0, 1, 5, LOOKAHEAD, 100, 1000 };
+    spi_model_card_t card;
+    uint32_t i;
+
+    /* The R1 anywhere after the stuff byte, then done at once, busy to
+     * the end of the command buffer or busy for a few lookaheads. */
+    spi_model_default_card( &card );
+    for( card.stop_ncr = 0; card.stop_ncr <= MAX_STOP_NCR; card.stop_ncr++ ) {
+        for( i = 0; i < sizeof(busy) / sizeof(busy[0]); i++ ) {
+            card.busy = busy[i];
+            if( MC_RETURN_OK != read_blocks(&card, 2) ) {
+                CU_FAIL( "Stop" );
+                printf( "\n    ncr %u, busy %u\n", card.stop_ncr, card.busy );
+            }
+        }
+    }
+
+    /* No R1 to the STOP. */
+    card.stop_ncr = MAX_STOP_NCR + 1;
+    card.busy = 0;
+    CU_ASSERT( MC_ERROR_TIMEOUT == read_blocks(&card, 2) );
+
+    /* Busy longer than Nac write. */
+    card.stop_ncr = 1;
+    card.busy = SPI_MODEL_BUSY_FOREVER;
+    card.nac_write = 10;
+    CU_ASSERT( MC_ERROR_TIMEOUT == read_blocks(&card, 2) );
+}
+
+void test_timeouts( void )
+{
+    spi_model_card_t card;
+    spi_model_stats_t stats;
+    uint32_t gap;
+
+    spi_model_default_card( &card );
+
+    /* No R1 to the read. */
+    card.respond = false;
+    CU_ASSERT( MC_ERROR_TIMEOUT == read_blocks(&card, 4) );
+    card.ncr = MAX_NCR + 1;
+    card.respond = true;
+    CU_ASSERT( MC_ERROR_TIMEOUT == read_blocks(&card, 4) );
+    card.ncr = 1;
+
+    /* A block later than Nac read, which is in bytes / 8. */
+    card.gaps = &gap;
+    card.gap_count = 1;
+    card.nac_read = 100;
+    gap = 700;
+    CU_ASSERT( MC_RETURN_OK == read_blocks(&card, 4) );
+    gap = 2000;
+    CU_ASSERT( MC_ERROR_TIMEOUT == read_blocks(&card, 4) );
+    spi_model_get_stats( &stats );
+    CU_ASSERT( 0 == stats.stops );
+    CU_ASSERT( 0 == stats.cancelled );
+
+    /* Everything works again after. */
+    spi_model_default_card( &card );
+    CU_ASSERT( MC_RETURN_OK == read_blocks(&card, 4) );
+}
+
+void test_crc( void )
+{
+    spi_model_card_t card;
+
+    spi_model_default_card( &card );
+    card.bad_crc = 2;
+    CU_ASSERT( MC_CRC_FAILURE == read_blocks(&card, 4) );
+
+    /* Past the blocks read it doesn't matter. */
+    card.bad_crc = 4;
+    CU_ASSERT( MC_RETURN_OK == read_blocks(&card, 4) );
+}
+
+void add_suites( CU_pSuite *suite )
+{
+    *suite = CU_add_suite( "Block Test", NULL, NULL );
+    CU_add_test( *suite, "Test Read       ", test_read );
+    CU_add_test( *suite, "Test First Block", test_first_block );
+    CU_add_test( *suite, "Test Gaps       ", test_gaps );
+    CU_add_test( *suite, "Test Stop       ", test_stop );
+    CU_add_test( *suite, "Test Timeouts   ", test_timeouts );
+    CU_add_test( *suite, "Test CRC        ", test_crc );
+}
+
+int main( int argc, char *argv[] )
+{
+    int rv = 1;
+    CU_pSuite suite = NULL;
+
+    MOCK_os_init();
+    MOCK_reset__os();
+
+    if( CUE_SUCCESS == CU_initialize_registry() ) {
+        add_suites( &suite );
+
+        spi_model_init();
+        if( (NULL != suite) && (MC_RETURN_OK == block_init(malloc)) ) {
+            CU_basic_set_mode( CU_BRM_VERBOSE );
+            CU_basic_run_tests();
+            printf( "\n" );
+            CU_basic_show_failures( CU_get_failure_list() );
+            printf( "\n\n" );
+            rv = CU_get_number_of_tests_failed();
+        }
+
+        CU_cleanup_registry();
+    }
+
+    /* The model's thread never exits, so the mock OS is left as is. */
+
+    if( 0 != rv ) {
+        return 1;
+    }
+    return CU_get_error();
+}
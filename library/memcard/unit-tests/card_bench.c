@@ -0,0 +1,232 @@
+/*
+ * Card benchmark - not a unit test, run it with "make bench".
+ *
+ * Formats a 1GB disk image in the SD emulator, fills it with a library of
+ * small tracks & one 40MB song, then puts it back in the slot so nothing
+ * is cached.  The card is then scanned the way the database reads tags,
+ * the song is streamed a cluster at a time & seeked around.  The time is
+ * what the emulator adds up for each command with CARD_TIMING, so every
+ * run gives the same numbers.  The results are written to stdout as JSON
+ * so runs can be compared.
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "memcard.h"
+#include "fatfs/ff.h"
+#include "fast-seek.h"
+#include "sd-emulator.h"
+
+#define IMAGE           "./card_bench.img"
+#define SECTORS         (2u * 1024u * 1024u)
+#define CLUSTER_SIZE    (32u * 1024u)
+#define ARTISTS         100
+#define ALBUMS          4
+#define TRACKS          12
+#define TRACK_SIZE      (8u * 1024u)
+#define SONG            "/SONG.FLA"
+#define SONG_SIZE       (40u * 1024u * 1024u)
+#define SEEKS           100
+
+/* Roughly the board: a 16MHz SPI clock moves a sector in 250us. */
+static const sd_emulator_timing_t card_timing = { 500, 250, 1000, false };
+
+static uint8_t cluster[CLUSTER_SIZE];
+static uint32_t files_scanned;
+static uint32_t random_state = 0x2545f491;
+
+static void fail( const char *what, const char *path )
+{
+    fprintf( stderr, "%s %s failed\n", what, path );
+    sd_emulator_remove();
+    unlink( IMAGE );
+    exit( 1 );
+}
+
+/* xorshift32, so every run seeks to the same places. */
+static uint32_t random_next( void )
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+static void write_file( const char *path, uint32_t size )
+{
+    FIL file;
+    UINT count;
+
+    if( FR_OK != f_open(&file, path, FA_WRITE | FA_CREATE_NEW) ) {
+        fail( "create", path );
+    }
+    while( 0 < size ) {
+        UINT length = (size < CLUSTER_SIZE) ? size : CLUSTER_SIZE;
+
+        if( (FR_OK != f_write(&file, cluster, length, &count)) || (length != count) ) {
+            fail( "write", path );
+        }
+        size -= length;
+    }
+    f_close( &file );
+}
+
+static void create_library( void )
+{
+    char path[64];
+    uint32_t artist;
+    uint32_t album;
+    uint32_t track;
+
+    f_mkdir( "/MUSIC" );
+    for( artist = 0; artist < ARTISTS; artist++ ) {
+        sprintf( path, "/MUSIC/ART%05u", artist );
+        f_mkdir( path );
+        for( album = 0; album < ALBUMS; album++ ) {
+            sprintf( path, "/MUSIC/ART%05u/ALB%05u", artist, album );
+            f_mkdir( path );
+            for( track = 0; track < TRACKS; track++ ) {
+                sprintf( path, "/MUSIC/ART%05u/ALB%05u/TRACK%03u.FLA",
+                         artist, album, track );
+                write_file( path, TRACK_SIZE );
+            }
+        }
+    }
+    write_file( SONG, SONG_SIZE );
+}
+
+/* Walks the card opening every file & reading its tags. */
+static void scan( char *path )
+{
+    size_t length = strlen( path );
+    FILINFO info;
+    DIR dir;
+
+    if( FR_OK != f_opendir(&dir, path) ) {
+        fail( "open", path );
+    }
+
+    while( (FR_OK == f_readdir(&dir, &info)) && ('\0' != info.fname[0]) ) {
+        sprintf( &path[length], "/%s", info.fname );
+        if( AM_DIR == (AM_DIR & info.fattrib) ) {
+            scan( path );
+        } else {
+            FIL file;
+            UINT count;
+
+            /* The FLAC marker, the STREAMINFO & the comments. */
+            if( FR_OK != f_open(&file, path, FA_READ | FA_OPEN_EXISTING) ) {
+                fail( "open", path );
+            }
+            f_read( &file, cluster, 4, &count );
+            f_read( &file, cluster, 38, &count );
+            f_read( &file, cluster, 2048, &count );
+            f_close( &file );
+            files_scanned++;
+        }
+        path[length] = '\0';
+    }
+}
+
+static void stream( void )
+{
+    FIL file;
+    UINT count;
+
+    if( FR_OK != f_open(&file, SONG, FA_READ | FA_OPEN_EXISTING) ) {
+        fail( "open", SONG );
+    }
+    do {
+        if( FR_OK != f_read(&file, cluster, CLUSTER_SIZE, &count) ) {
+            fail( "read", SONG );
+        }
+    } while( 0 < count );
+    f_close( &file );
+}
+
+static void seek( void )
+{
+    FF_SLOT slot;
+    UINT count;
+    uint32_t i;
+
+    if( FR_OK != f_open(&slot.file.file, SONG, FA_READ | FA_OPEN_EXISTING) ) {
+        fail( "open", SONG );
+    }
+    fast_seek_open( &slot.file );
+
+    /* A frame's worth from all over the song. */
+    for( i = 0; i < SEEKS; i++ ) {
+        if( (FR_OK != fast_seek(&slot.file, random_next() % SONG_SIZE)) ||
+            (FR_OK != f_read(&slot.file.file, cluster, 16 * 1024, &count)) )
+        {
+            fail( "seek", SONG );
+        }
+    }
+
+    fast_seek_close( &slot.file );
+    f_close( &slot.file.file );
+}
+
+static void run( const char *name, void (*fn)(void), bool last )
+{
+    sd_emulator_stats_t stats;
+    mc_cache_stats_t before;
+    mc_cache_stats_t after;
+
+    mc_get_cache_stats( &before );
+    sd_emulator_reset_stats();
+    (*fn)();
+    sd_emulator_get_stats( &stats );
+    mc_get_cache_stats( &after );
+
+    printf( "    {\n" );
+    printf( "      \"name\": \"%s\",\n", name );
+    printf( "      \"commands\": %u,\n", stats.commands );
+    printf( "      \"sectors_read\": %u,\n", stats.sectors_read );
+    printf( "      \"sector_cache_hits\": %u,\n", after.hits - before.hits );
+    printf( "      \"sector_cache_misses\": %u,\n", after.misses - before.misses );
+    printf( "      \"card_ms\": %.1f\n", stats.busy_us / 1000.0 );
+    printf( "    }%s\n", (true == last) ? "" : "," );
+}
+
+static void scan_all( void )
+{
+    char path[64] = "/MUSIC";
+
+    scan( path );
+}
+
+int main( int argc, char *argv[] )
+{
+    if( (MC_RETURN_OK != mc_init(malloc, malloc)) ||
+        (MC_RETURN_OK != sd_emulator_format(IMAGE, SECTORS, CLUSTER_SIZE, NULL)) )
+    {
+        fail( "format", IMAGE );
+    }
+    create_library();
+
+    /* Back in the slot, so the sector cache starts empty. */
+    if( MC_RETURN_OK != sd_emulator_insert(IMAGE, &card_timing) ) {
+        fail( "insert", IMAGE );
+    }
+
+    printf( "{\n" );
+    printf( "  \"cluster_size\": %u,\n", CLUSTER_SIZE );
+    printf( "  \"command_us\": %u,\n", card_timing.command_us );
+    printf( "  \"read_us\": %u,\n", card_timing.read_us );
+    printf( "  \"benchmarks\": [\n" );
+    run( "scan", scan_all, false );
+    run( "stream_40MB", stream, false );
+    run( "seek_100", seek, true );
+    printf( "  ],\n" );
+    printf( "  \"files_scanned\": %u\n", files_scanned );
+    printf( "}\n" );
+
+    sd_emulator_remove();
+    unlink( IMAGE );
+    return 0;
+}
@@ -0,0 +1,412 @@
+#include <CUnit/Basic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "block.h"
+#include "config.h"
+#include "memcard.h"
+#include "fatfs/ff.h"
+#include "fast-seek.h"
+#include "sd-emulator.h"
+
+#define IMAGE           "./emulator_test.img"
+#define SECTORS         (128 * 1024)    /* 64MB */
+#define CLUSTER_SIZE    4096
+#define FILE_NAME       "/TRACK.BIN"
+#define FILE_SIZE       300001
+#define COMMAND_US      800
+#define READ_US         40
+#define WRITE_US        250
+#define FRAG_NAME       "/FRAG.BIN"
+#define GAP_NAME        "/GAP.BIN"
+
+/* A fragmented file is in as many fragments as it has clusters, the link
+ * map needs 2 items for each & 2 more. */
+#define SLOT_FRAGMENTS  ((FF_CLMT_ITEMS - 2) / 2)
+#define HEAP_FRAGMENTS  ((MC_CLMT_MAX_ITEMS - 2) / 2)
+#define SEEK_READ       700
+
+#define MAP_NONE        0
+#define MAP_SLOT        1
+#define MAP_HEAP        2
+
+static const sd_emulator_timing_t timing = { COMMAND_US, READ_US, WRITE_US, false };
+
+static mc_card_status_t statuses[8];
+static uint32_t status_count;
+
+static uint8_t data[FILE_SIZE];
+static uint8_t buffer[FILE_SIZE];
+
+static void card_status( const mc_card_status_t status )
+{
+    if( status_count < sizeof(statuses) / sizeof(statuses[0]) ) {
+        statuses[status_count] = status;
+    }
+    status_count++;
+}
+
+static FRESULT read_file( const char *name, uint8_t *out, UINT *got )
+{
+    FIL file;
+    FRESULT result;
+
+    *got = 0;
+    result = f_open( &file, name, FA_READ | FA_OPEN_EXISTING );
+    if( FR_OK == result ) {
+        result = f_read( &file, out, FILE_SIZE, got );
+        f_close( &file );
+    }
+    return result;
+}
+
+static uint8_t fragment_byte( const uint32_t fragments, const uint32_t offset )
+{
+    return (uint8_t) (offset * 7 + (offset >> 9) + fragments);
+}
+
+/* Each cluster of the file is written between two of another file, which
+ * is then deleted, so no two of its clusters are next to each other. */
+static void write_fragmented( const uint32_t fragments )
+{
+    static uint8_t cluster[CLUSTER_SIZE];
+    static const uint8_t gap_cluster[CLUSTER_SIZE];
+    FIL file;
+    FIL gap;
+    UINT count;
+    uint32_t size;
+    uint32_t i;
+    uint32_t j;
+
+    size = fragments * CLUSTER_SIZE - 100;
+
+    CU_ASSERT_FATAL( FR_OK == f_open(&file, FRAG_NAME, FA_WRITE | FA_CREATE_ALWAYS) );
+    CU_ASSERT_FATAL( FR_OK == f_open(&gap, GAP_NAME, FA_WRITE | FA_CREATE_ALWAYS) );
+    for( i = 0; i < size; i += CLUSTER_SIZE ) {
+        for( j = 0; (j < CLUSTER_SIZE) && (i + j < size); j++ ) {
+            cluster[j] = fragment_byte( fragments, i + j );
+        }
+        CU_ASSERT( FR_OK == f_write(&file, cluster, j, &count) );
+        CU_ASSERT( j == count );
+        CU_ASSERT( FR_OK == f_write(&gap, gap_cluster, CLUSTER_SIZE, &count) );
+    }
+    CU_ASSERT( FR_OK == f_close(&gap) );
+    CU_ASSERT( FR_OK == f_close(&file) );
+    CU_ASSERT( FR_OK == f_unlink(GAP_NAME) );
+}
+
+/* Seeks with fast_seek() & with f_lseek() following the FAT chain, & checks
+ * both read the same as was written. */
+static void compare_seek( FF_FILE *fast, FIL *chain, const uint32_t fragments,
+                          const DWORD goal )
+{
+    static uint8_t chain_buffer[SEEK_READ];
+    UINT fast_count;
+    UINT chain_count;
+    UINT i;
+
+    CU_ASSERT( FR_OK == fast_seek(fast, goal) );
+    CU_ASSERT( FR_OK == f_lseek(chain, goal) );
+    CU_ASSERT( fast->file.fptr == chain->fptr );
+
+    CU_ASSERT( FR_OK == f_read(&fast->file, buffer, SEEK_READ, &fast_count) );
+    CU_ASSERT( FR_OK == f_read(chain, chain_buffer, SEEK_READ, &chain_count) );
+    CU_ASSERT( fast_count == chain_count );
+    CU_ASSERT( 0 == memcmp(buffer, chain_buffer, chain_count) );
+    for( i = 0; i < fast_count; i++ ) {
+        if( fragment_byte(fragments, goal + i) != buffer[i] ) {
+            CU_FAIL( "The data read is different from the data written" );
+            break;
+        }
+    }
+}
+
+/* Seeks all over a file in the given number of fragments & returns where
+ * its link map was kept. */
+static int seek_fragmented( const uint32_t fragments )
+{
+    FF_SLOT slot;
+    FIL chain;
+    DWORD size;
+    int map;
+    uint32_t i;
+
+    CU_ASSERT_FATAL( FR_OK == f_open(&slot.file.file, FRAG_NAME, FA_READ | FA_OPEN_EXISTING) );
+    CU_ASSERT_FATAL( FR_OK == f_open(&chain, FRAG_NAME, FA_READ | FA_OPEN_EXISTING) );
+    fast_seek_open( &slot.file );
+    size = chain.fsize;
+
+    /* The first seek walks the whole file, so the map is tried. */
+    compare_seek( &slot.file, &chain, fragments, size - SEEK_READ / 2 );
+    CU_ASSERT( 1 == slot.file.clmt_tried );
+    CU_ASSERT( 2 + 2 * fragments == slot.file.clmt[0] );
+
+    /* Across cluster boundaries, backwards, to the start & past the end. */
+    compare_seek( &slot.file, &chain, fragments, CLUSTER_SIZE - 1 );
+    compare_seek( &slot.file, &chain, fragments, CLUSTER_SIZE );
+    compare_seek( &slot.file, &chain, fragments, size / 2 );
+    compare_seek( &slot.file, &chain, fragments, 0 );
+    for( i = fragments; 3 < i; i -= 3 ) {
+        compare_seek( &slot.file, &chain, fragments, i * CLUSTER_SIZE - 300 );
+    }
+    compare_seek( &slot.file, &chain, fragments, size );
+    compare_seek( &slot.file, &chain, fragments, size + 1000 );
+
+    map = MAP_NONE;
+    if( slot.file.clmt == slot.file.file.cltbl ) {
+        map = MAP_SLOT;
+    } else if( NULL != slot.file.file.cltbl ) {
+        map = MAP_HEAP;
+    }
+
+    fast_seek_close( &slot.file );
+    CU_ASSERT( NULL == slot.file.file.cltbl );
+    CU_ASSERT( FR_OK == f_close(&slot.file.file) );
+    CU_ASSERT( FR_OK == f_close(&chain) );
+
+    return map;
+}
+
+void test_format( void )
+{
+    uint32_t blocks;
+    FATFS *fs;
+    DWORD free_clusters;
+
+    status_count = 0;
+    CU_ASSERT( MC_RETURN_OK == mc_register(card_status) );
+
+    CU_ASSERT( MC_ERROR_PARAMETER == sd_emulator_format(IMAGE, 10, 0, NULL) );
+    CU_ASSERT( MC_UNUSABLE == sd_emulator_insert("./missing.img", NULL) );
+    CU_ASSERT( MC_CARD__MOUNTED != mc_get_status() );
+
+    CU_ASSERT( MC_RETURN_OK == sd_emulator_format(IMAGE, SECTORS, CLUSTER_SIZE, &timing) );
+    CU_ASSERT( MC_CARD__MOUNTED == mc_get_status() );
+    CU_ASSERT( MC_RETURN_OK == mc_get_block_count(&blocks) );
+    CU_ASSERT( SECTORS == blocks );
+
+    /* The same steps as a card going into the slot. */
+    CU_ASSERT( 3 == status_count );
+    CU_ASSERT( MC_CARD__INSERTED == statuses[0] );
+    CU_ASSERT( MC_CARD__MOUNTING == statuses[1] );
+    CU_ASSERT( MC_CARD__MOUNTED == statuses[2] );
+
+    CU_ASSERT( FR_OK == f_getfree("/", &free_clusters, &fs) );
+    CU_ASSERT( CLUSTER_SIZE == fs->csize * 512 );
+    CU_ASSERT( (SECTORS / (CLUSTER_SIZE / 512)) * 9 / 10 < free_clusters );
+
+    CU_ASSERT( MC_RETURN_OK == mc_cancel(card_status) );
+}
+
+void test_files( void )
+{
+    sd_emulator_stats_t stats;
+    FIL file;
+    UINT count;
+    uint32_t i;
+
+    for( i = 0; i < FILE_SIZE; i++ ) {
+        data[i] = (uint8_t) (i * 7 + (i >> 9));
+    }
+
+    sd_emulator_reset_stats();
+    CU_ASSERT( FR_OK == f_open(&file, FILE_NAME, FA_WRITE | FA_CREATE_ALWAYS) );
+    CU_ASSERT( FR_OK == f_write(&file, data, FILE_SIZE, &count) );
+    CU_ASSERT( FILE_SIZE == count );
+    CU_ASSERT( FR_OK == f_close(&file) );
+
+    sd_emulator_get_stats( &stats );
+    CU_ASSERT( FILE_SIZE / 512 < stats.sectors_written );
+    CU_ASSERT( stats.sectors_written <= stats.commands );
+
+    /* Another card insertion, so nothing comes from the sector cache. */
+    CU_ASSERT( MC_RETURN_OK == sd_emulator_insert(IMAGE, &timing) );
+    memset( buffer, 0, FILE_SIZE );
+    CU_ASSERT( FR_OK == read_file(FILE_NAME, buffer, &count) );
+    CU_ASSERT( FILE_SIZE == count );
+    CU_ASSERT( 0 == memcmp(data, buffer, FILE_SIZE) );
+}
+
+void test_timing( void )
+{
+    sd_emulator_stats_t stats;
+    mc_cache_stats_t before;
+    mc_cache_stats_t after;
+    UINT count;
+
+    mc_get_cache_stats( &before );
+    sd_emulator_reset_stats();
+    CU_ASSERT( FR_OK == read_file(FILE_NAME, buffer, &count) );
+    mc_get_cache_stats( &after );
+    sd_emulator_get_stats( &stats );
+
+    /* The file data all comes from the card, whole clusters with one
+     * command, while the sector cache still has the FAT & directory. */
+    CU_ASSERT( FILE_SIZE / 512 <= stats.sectors_read );
+    CU_ASSERT( stats.commands < stats.sectors_read / 4 );
+    CU_ASSERT( (after.misses - before.misses) < stats.commands );
+    CU_ASSERT( (after.hits + after.misses) - (before.hits + before.misses) <
+               stats.commands );
+    CU_ASSERT( 0 == stats.sectors_written );
+    CU_ASSERT( stats.busy_us == (uint64_t) stats.commands * COMMAND_US +
+                                (uint64_t) stats.sectors_read * READ_US );
+
+    /* The time can also be left out. */
+    sd_emulator_set_timing( NULL );
+    sd_emulator_reset_stats();
+    CU_ASSERT( FR_OK == read_file(FILE_NAME, buffer, &count) );
+    sd_emulator_get_stats( &stats );
+    CU_ASSERT( 0 < stats.commands );
+    CU_ASSERT( 0 == stats.busy_us );
+    sd_emulator_set_timing( &timing );
+}
+
+void test_errors( void )
+{
+    sd_emulator_stats_t stats;
+    uint8_t sector[512];
+    UINT count;
+
+    /* Straight to the card. */
+    sd_emulator_reset_stats();
+    sd_emulator_inject_error( MC_CRC_FAILURE, 1, 2 );
+    CU_ASSERT( MC_RETURN_OK == block_read(0, sector) );
+    CU_ASSERT( MC_CRC_FAILURE == block_read(0, sector) );
+    CU_ASSERT( MC_CRC_FAILURE == block_write(0, sector) );
+    CU_ASSERT( MC_RETURN_OK == block_read(0, sector) );
+    CU_ASSERT( MC_ERROR_PARAMETER == block_read(SECTORS, sector) );
+    CU_ASSERT( MC_ERROR_PARAMETER == block_read_multiple(SECTORS - 1, buffer, 2) );
+    sd_emulator_get_stats( &stats );
+    CU_ASSERT( 2 == stats.errors );
+
+    /* Through FatFs, a new card so the reads can't come from the cache. */
+    CU_ASSERT( MC_RETURN_OK == sd_emulator_insert(IMAGE, &timing) );
+    sd_emulator_inject_error( MC_ERROR_TIMEOUT, 0, 1000 );
+    CU_ASSERT( FR_OK != read_file(FILE_NAME, buffer, &count) );
+    CU_ASSERT( 0 == count );
+
+    sd_emulator_inject_error( MC_ERROR_TIMEOUT, 0, 0 );
+    CU_ASSERT( FR_OK == read_file(FILE_NAME, buffer, &count) );
+    CU_ASSERT( FILE_SIZE == count );
+    CU_ASSERT( 0 == memcmp(data, buffer, FILE_SIZE) );
+}
+
+void test_removal( void )
+{
+    FF_SLOT slot;
+    UINT count;
+
+    CU_ASSERT( FR_OK == f_open(&slot.file.file, FILE_NAME, FA_READ | FA_OPEN_EXISTING) );
+    fast_seek_open( &slot.file );
+    CU_ASSERT( FR_OK == fast_seek(&slot.file, FILE_SIZE - 1000) );
+    CU_ASSERT( NULL != slot.file.file.cltbl );
+    CU_ASSERT( FR_OK == f_read(&slot.file.file, buffer, 100, &count) );
+    CU_ASSERT( 0 == memcmp(&data[FILE_SIZE - 1000], buffer, 100) );
+
+    sd_emulator_remove();
+    CU_ASSERT( MC_CARD__REMOVED == mc_get_status() );
+    CU_ASSERT( MC_ERROR_MODE == block_read(0, buffer) );
+    CU_ASSERT( FR_OK != f_read(&slot.file.file, buffer, 100, &count) );
+    CU_ASSERT( FR_OK != read_file(FILE_NAME, buffer, &count) );
+    fast_seek_close( &slot.file );
+
+    /* Everything works again once it is back. */
+    CU_ASSERT( MC_RETURN_OK == sd_emulator_insert(IMAGE, &timing) );
+    CU_ASSERT( FR_OK == read_file(FILE_NAME, buffer, &count) );
+    CU_ASSERT( 0 == memcmp(data, buffer, FILE_SIZE) );
+}
+
+void test_fast_seek( void )
+{
+    write_fragmented( SLOT_FRAGMENTS );
+    CU_ASSERT( MAP_SLOT == seek_fragmented(SLOT_FRAGMENTS) );
+
+    write_fragmented( HEAP_FRAGMENTS );
+    CU_ASSERT( MAP_HEAP == seek_fragmented(HEAP_FRAGMENTS) );
+
+    write_fragmented( HEAP_FRAGMENTS + 1 );
+    CU_ASSERT( MAP_NONE == seek_fragmented(HEAP_FRAGMENTS + 1) );
+}
+
+void test_lazy_map( void )
+{
+    FF_SLOT slot;
+    mc_cache_stats_t before;
+    mc_cache_stats_t after;
+    DWORD clusters;
+    DWORD below;
+    UINT count;
+
+    write_fragmented( HEAP_FRAGMENTS );
+    CU_ASSERT_FATAL( FR_OK == f_open(&slot.file.file, FRAG_NAME, FA_READ | FA_OPEN_EXISTING) );
+    fast_seek_open( &slot.file );
+    clusters = slot.file.file.fsize / CLUSTER_SIZE;
+    below = (clusters - 1) / MC_CLMT_WALK_RATIO;
+
+    /* Seeks that walk less than 1/MC_CLMT_WALK_RATIO of the clusters go
+     * through the FAT. */
+    CU_ASSERT( FR_OK == fast_seek(&slot.file, below * CLUSTER_SIZE + 1) );
+    CU_ASSERT( FR_OK == fast_seek(&slot.file, 2 * below * CLUSTER_SIZE + 1) );
+    CU_ASSERT( FR_OK == fast_seek(&slot.file, 0) );
+    CU_ASSERT( 0 == slot.file.clmt_tried );
+    CU_ASSERT( NULL == slot.file.file.cltbl );
+
+    /* One more cluster & the map is built. */
+    CU_ASSERT( FR_OK == fast_seek(&slot.file, (below + 1) * CLUSTER_SIZE + 1) );
+    CU_ASSERT( 1 == slot.file.clmt_tried );
+    CU_ASSERT( NULL != slot.file.file.cltbl );
+
+    /* After which seeking & reading don't need the FAT. */
+    mc_get_cache_stats( &before );
+    CU_ASSERT( FR_OK == fast_seek(&slot.file, 3 * CLUSTER_SIZE - 10) );
+    CU_ASSERT( FR_OK == f_read(&slot.file.file, buffer, SEEK_READ, &count) );
+    CU_ASSERT( FR_OK == fast_seek(&slot.file, (clusters - 1) * CLUSTER_SIZE - 10) );
+    CU_ASSERT( FR_OK == f_read(&slot.file.file, buffer, SEEK_READ, &count) );
+    mc_get_cache_stats( &after );
+    CU_ASSERT( before.hits + before.misses == after.hits + after.misses );
+    CU_ASSERT( fragment_byte(HEAP_FRAGMENTS, (clusters - 1) * CLUSTER_SIZE - 10) == buffer[0] );
+
+    fast_seek_close( &slot.file );
+    CU_ASSERT( FR_OK == f_close(&slot.file.file) );
+}
+
+void add_suites( CU_pSuite *suite )
+{
+    *suite = CU_add_suite( "SD Emulator Test", NULL, NULL );
+    CU_add_test( *suite, "Test Format     ", test_format );
+    CU_add_test( *suite, "Test Files      ", test_files );
+    CU_add_test( *suite, "Test Timing     ", test_timing );
+    CU_add_test( *suite, "Test Errors     ", test_errors );
+    CU_add_test( *suite, "Test Fast Seek  ", test_fast_seek );
+    CU_add_test( *suite, "Test Lazy Map   ", test_lazy_map );
+    CU_add_test( *suite, "Test Removal    ", test_removal );
+}
+
+int main( int argc, char *argv[] )
+{
+    int rv = 1;
+    CU_pSuite suite = NULL;
+
+    if( CUE_SUCCESS == CU_initialize_registry() ) {
+        add_suites( &suite );
+
+        if( (NULL != suite) && (MC_RETURN_OK == mc_init(malloc, malloc)) ) {
+            CU_basic_set_mode( CU_BRM_VERBOSE );
+            CU_basic_run_tests();
+            printf( "\n" );
+            CU_basic_show_failures( CU_get_failure_list() );
+            printf( "\n\n" );
+            rv = CU_get_number_of_tests_failed();
+        }
+
+        sd_emulator_remove();
+        unlink( IMAGE );
+        CU_cleanup_registry();
+    }
+
+    if( 0 != rv ) {
+        return 1;
+    }
+    return CU_get_error();
+}
@@ -0,0 +1,229 @@
+#include <CUnit/Basic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "block.h"
+#include "config.h"
+#include "memcard.h"
+#include "memcard-private.h"
+#include "sector-cache.h"
+
+#define SECTOR_SIZE     512
+#define FAILING_LBA     0xdead
+
+/* block_read() is backed by a card made of this pattern. */
+static uint32_t card_reads;
+static uint8_t card_version;
+static uint32_t magic_insert_number;
+
+static uint8_t sector[SECTOR_SIZE];
+static uint8_t cache_memory[MC_SECTOR_CACHE_SIZE * SECTOR_SIZE];
+
+static uint8_t card_byte( const uint32_t lba, const uint32_t offset )
+{
+    return (uint8_t) (lba * 7 + offset + card_version);
+}
+
+mc_status_t block_read( const uint32_t lba, uint8_t *buffer )
+{
+    uint32_t i;
+
+    card_reads++;
+    if( FAILING_LBA == lba ) {
+        return MC_ERROR_TIMEOUT;
+    }
+    for( i = 0; i < SECTOR_SIZE; i++ ) {
+        buffer[i] = card_byte( lba, i );
+    }
+    return MC_RETURN_OK;
+}
+
+uint32_t mc_get_magic_insert_number( void )
+{
+    return magic_insert_number;
+}
+
+static void* cache_malloc( size_t size )
+{
+    CU_ASSERT( sizeof(cache_memory) == size );
+    return cache_memory;
+}
+
+static void* no_malloc( size_t size )
+{
+    return NULL;
+}
+
+/* Reads a sector through the cache, checks it against the card & returns
+ * whether it had to come from the card. */
+static bool read_sector( const uint32_t lba )
+{
+    uint32_t reads = card_reads;
+    uint32_t i;
+
+    CU_ASSERT_FATAL( MC_RETURN_OK == sector_cache_read(lba, sector) );
+    for( i = 0; i < SECTOR_SIZE; i++ ) {
+        if( card_byte(lba, i) != sector[i] ) {
+            CU_FAIL( "The sector is different from the card" );
+            break;
+        }
+    }
+    return (reads != card_reads);
+}
+
+static void start( void )
+{
+    card_reads = 0;
+    card_version = 0;
+    CU_ASSERT_FATAL( MC_RETURN_OK == sector_cache_init(cache_malloc) );
+}
+
+void test_init( void )
+{
+    mc_cache_stats_t stats;
+
+    CU_ASSERT( MC_ERROR_PARAMETER == sector_cache_init(NULL) );
+
+    /* Without the memory everything comes from the card. */
+    card_reads = 0;
+    CU_ASSERT( MC_RETURN_OK == sector_cache_init(no_malloc) );
+    CU_ASSERT( true == read_sector(10) );
+    CU_ASSERT( true == read_sector(10) );
+    mc_get_cache_stats( &stats );
+    CU_ASSERT( 0 == stats.hits );
+    CU_ASSERT( 2 == stats.misses );
+    CU_ASSERT( 2 == card_reads );
+}
+
+void test_hit( void )
+{
+    mc_cache_stats_t stats;
+
+    start();
+    CU_ASSERT( true == read_sector(10) );
+    CU_ASSERT( false == read_sector(10) );
+    CU_ASSERT( true == read_sector(11) );
+    CU_ASSERT( false == read_sector(10) );
+    CU_ASSERT( false == read_sector(11) );
+    mc_get_cache_stats( &stats );
+    CU_ASSERT( 3 == stats.hits );
+    CU_ASSERT( 2 == stats.misses );
+    CU_ASSERT( 0 == stats.flushes );
+
+    /* A failed read is passed on & not cached. */
+    CU_ASSERT( MC_ERROR_TIMEOUT == sector_cache_read(FAILING_LBA, sector) );
+    CU_ASSERT( MC_ERROR_TIMEOUT == sector_cache_read(FAILING_LBA, sector) );
+    CU_ASSERT( 2 + 2 == card_reads );
+}
+
+void test_lru( void )
+{
+    uint32_t i;
+
+    /* Fill the cache, then use the first sector again so the second is
+     * the least recently used. */
+    start();
+    for( i = 0; i < MC_SECTOR_CACHE_SIZE; i++ ) {
+        CU_ASSERT( true == read_sector(100 + i) );
+    }
+    CU_ASSERT( false == read_sector(100) );
+
+    CU_ASSERT( true == read_sector(1000) );
+    CU_ASSERT( false == read_sector(100) );
+    CU_ASSERT( false == read_sector(1000) );
+    for( i = 2; i < MC_SECTOR_CACHE_SIZE; i++ ) {
+        CU_ASSERT( false == read_sector(100 + i) );
+    }
+    CU_ASSERT( true == read_sector(101) );
+
+    /* 101 came back in place of 100, the least recently used by then. */
+    CU_ASSERT( true == read_sector(100) );
+}
+
+void test_write_through( void )
+{
+    uint8_t written[3 * SECTOR_SIZE];
+    uint32_t i;
+
+    start();
+    CU_ASSERT( true == read_sector(20) );
+    CU_ASSERT( true == read_sector(22) );
+    CU_ASSERT( true == read_sector(30) );
+
+    /* Sectors 20 to 22 are written, the card has the new data & the
+     * cached sectors are updated without reading them again. */
+    card_version = 1;
+    for( i = 0; i < sizeof(written); i++ ) {
+        written[i] = card_byte( 20 + i / SECTOR_SIZE, i % SECTOR_SIZE );
+    }
+    sector_cache_write( 20, written, 3 );
+    CU_ASSERT( false == read_sector(20) );
+    CU_ASSERT( false == read_sector(22) );
+    CU_ASSERT( true == read_sector(21) );
+
+    /* Sectors not written are left as they were. */
+    card_version = 0;
+    CU_ASSERT( false == read_sector(30) );
+}
+
+void test_new_card( void )
+{
+    mc_cache_stats_t stats;
+
+    start();
+    CU_ASSERT( true == read_sector(40) );
+    CU_ASSERT( false == read_sector(40) );
+
+    /* A card with different data, which could look the same. */
+    magic_insert_number++;
+    card_version = 2;
+    CU_ASSERT( true == read_sector(40) );
+    CU_ASSERT( false == read_sector(40) );
+    mc_get_cache_stats( &stats );
+    CU_ASSERT( 1 == stats.flushes );
+
+    /* A write is the first call after the change. */
+    magic_insert_number++;
+    card_version = 3;
+    memset( sector, 0, sizeof(sector) );
+    sector_cache_write( 50, sector, 1 );
+    CU_ASSERT( true == read_sector(40) );
+    mc_get_cache_stats( &stats );
+    CU_ASSERT( 2 == stats.flushes );
+}
+
+void add_suites( CU_pSuite *suite )
+{
+    *suite = CU_add_suite( "Sector Cache Test", NULL, NULL );
+    CU_add_test( *suite, "Test Init         ", test_init );
+    CU_add_test( *suite, "Test Hit          ", test_hit );
+    CU_add_test( *suite, "Test LRU          ", test_lru );
+    CU_add_test( *suite, "Test Write Through", test_write_through );
+    CU_add_test( *suite, "Test New Card     ", test_new_card );
+}
+
+int main( int argc, char *argv[] )
+{
+    int rv = 1;
+    CU_pSuite suite = NULL;
+
+    if( CUE_SUCCESS == CU_initialize_registry() ) {
+        add_suites( &suite );
+
+        if( NULL != suite ) {
+            CU_basic_set_mode( CU_BRM_VERBOSE );
+            CU_basic_run_tests();
+            printf( "\n" );
+            CU_basic_show_failures( CU_get_failure_list() );
+            printf( "\n\n" );
+            rv = CU_get_number_of_tests_failed();
+        }
+
+        CU_cleanup_registry();
+    }
+
+    if( 0 != rv ) {
+        return 1;
+    }
+    return CU_get_error();
+}
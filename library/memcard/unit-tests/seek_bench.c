@@ -0,0 +1,300 @@
+/*
+ * Seek benchmark - not a unit test, run it with "make bench".
+ *
+ * Formats a 2GB FAT32 RAM disk with 32kB clusters & writes 40MB files to
+ * it in 1, 16, 40 & 640 fragments.  Each
+ * file is then seeked to every 5% of the way in, both through the FAT
+ * chain (f_lseek() as it was) & through fast_seek() as the glue does it.
+ * The sectors read from the disk are counted & the time the card would
+ * take is estimated at SECTOR_READ_US a sector.  The results are written
+ * to stdout as JSON so runs can be compared.
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "fatfs/ff.h"
+#include "fatfs/diskio.h"
+#include "fast-seek.h"
+
+#define SECTORS         (4u * 1024u * 1024u)
+#define CLUSTER_SIZE    (32u * 1024u)
+#define FILE_SIZE       (40u * 1024u * 1024u)
+#define STEP_PERCENT    5
+#define SECTOR_READ_US  500
+
+typedef struct {
+    const char *name;
+    const char *path;
+    uint32_t chunk;         /* The size written before the next file's turn */
+} bench_file_t;
+
+/* Each file is written in turns of chunk bytes with a filler file, so it
+ * ends up in FILE_SIZE / chunk fragments. */
+static const bench_file_t files[] = {
+    { "contiguous",     "/SONG1.FLA", FILE_SIZE },
+    { "16_fragments",   "/SONG2.FLA", 2560 * 1024 },
+    { "40_fragments",   "/SONG3.FLA", 1024 * 1024 },
+    { "640_fragments",  "/SONG4.FLA", 64 * 1024 },
+};
+
+static uint8_t *image;
+static uint64_t sectors_read;
+
+/*----------------------------------------------------------------------------*/
+/*                            RAM Disk for FatFs                              */
+/*----------------------------------------------------------------------------*/
+DSTATUS disk_initialize( BYTE drive )
+{
+    return 0;
+}
+
+DSTATUS disk_status( BYTE drive )
+{
+    return 0;
+}
+
+DRESULT disk_read( BYTE drive, BYTE *buffer, DWORD sector, BYTE count )
+{
+    memcpy( buffer, &image[(uint64_t) sector * 512], 512 * count );
+    sectors_read += count;
+    return RES_OK;
+}
+
+DRESULT disk_read_window( BYTE drive, BYTE *buffer, DWORD sector )
+{
+    return disk_read( drive, buffer, sector, 1 );
+}
+
+DRESULT disk_write( BYTE drive, const BYTE *buffer, DWORD sector, BYTE count )
+{
+    memcpy( &image[(uint64_t) sector * 512], buffer, 512 * count );
+    return RES_OK;
+}
+
+DRESULT disk_ioctl( BYTE drive, BYTE command, void *buffer )
+{
+    switch( command ) {
+        case GET_SECTOR_COUNT:
+            *((DWORD *) buffer) = SECTORS;
+            return RES_OK;
+        case GET_BLOCK_SIZE:
+            *((DWORD *) buffer) = 1;
+            return RES_OK;
+        case CTRL_SYNC:
+            return RES_OK;
+    }
+    return RES_PARERR;
+}
+
+DWORD get_fattime( void )
+{
+    return 0;
+}
+
+int ff_cre_syncobj( BYTE vol, _SYNC_t *sobj )
+{
+    return 1;
+}
+
+int ff_del_syncobj( _SYNC_t sobj )
+{
+    return 1;
+}
+
+int ff_req_grant( _SYNC_t sobj )
+{
+    return 1;
+}
+
+void ff_rel_grant( _SYNC_t sobj )
+{
+}
+
+/*----------------------------------------------------------------------------*/
+/*                                 Benchmark                                  */
+/*----------------------------------------------------------------------------*/
+static uint64_t now_ns( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void fail( const char *what, const char *path )
+{
+    fprintf( stderr, "%s %s failed\n", what, path );
+    exit( 1 );
+}
+
+static void write_files( void )
+{
+    static uint8_t data[64 * 1024];
+    FIL file;
+    FIL filler;
+    uint32_t i;
+
+    for( i = 0; i < sizeof(files) / sizeof(files[0]); i++ ) {
+        uint32_t written;
+
+        if( (FR_OK != f_open(&file, files[i].path, FA_WRITE | FA_CREATE_NEW)) ||
+            (FR_OK != f_open(&filler, "/FILLER", FA_WRITE | FA_OPEN_ALWAYS)) ||
+            (FR_OK != f_lseek(&filler, filler.fsize)) )
+        {
+            fail( "create", files[i].path );
+        }
+
+        for( written = 0; written < FILE_SIZE; written += sizeof(data) ) {
+            UINT count;
+
+            if( (FR_OK != f_write(&file, data, sizeof(data), &count)) ||
+                (sizeof(data) != count) )
+            {
+                fail( "write", files[i].path );
+            }
+
+            /* Take the next cluster so the file has to skip over it. */
+            if( 0 == ((written + sizeof(data)) % files[i].chunk) ) {
+                if( FR_OK != f_write(&filler, data, CLUSTER_SIZE, &count) ) {
+                    fail( "write", "/FILLER" );
+                }
+            }
+        }
+
+        f_close( &filler );
+        f_close( &file );
+    }
+}
+
+/* Seeks the file to goal, returning the sectors read & the time taken. */
+static void seek( FF_SLOT *slot, const char *path, DWORD goal, bool fast,
+                  bool reopen, uint64_t *reads, uint64_t *ns )
+{
+    FIL *file = &slot->file.file;
+    uint64_t begin;
+    FRESULT result;
+
+    if( true == reopen ) {
+        if( FR_OK != f_open(file, path, FA_READ | FA_OPEN_EXISTING) ) {
+            fail( "open", path );
+        }
+        fast_seek_open( &slot->file );
+    }
+
+    sectors_read = 0;
+    begin = now_ns();
+    if( true == fast ) {
+        result = fast_seek( &slot->file, goal );
+    } else {
+        result = f_lseek( file, goal );
+    }
+    *ns = now_ns() - begin;
+    *reads = sectors_read;
+
+    if( (FR_OK != result) || (goal != file->fptr) ) {
+        fail( "seek", path );
+    }
+}
+
+static void close_file( FF_SLOT *slot )
+{
+    fast_seek_close( &slot->file );
+    f_close( &slot->file.file );
+}
+
+static void print_seek( const char *name, uint64_t reads, uint64_t ns, bool last )
+{
+    printf( "          \"%s\": { \"sectors_read\": %llu, \"card_us\": %llu, "
+            "\"host_ns\": %llu }%s\n", name, (unsigned long long) reads,
+            (unsigned long long) reads * SECTOR_READ_US,
+            (unsigned long long) ns, (true == last) ? "" : "," );
+}
+
+static void run( const bench_file_t *bench, bool last )
+{
+    static FF_SLOT slot;
+    static FF_SLOT map_slot;
+    uint32_t percent;
+    uint32_t items;
+    uint64_t reads;
+    uint64_t ns;
+
+    /* Keep one open with its map built to time the seeks after the first. */
+    seek( &map_slot, bench->path, FILE_SIZE - 1, true, true, &reads, &ns );
+    if( NULL == map_slot.file.file.cltbl ) {
+        items = 0;
+    } else {
+        items = map_slot.file.file.cltbl[0];
+    }
+
+    printf( "    {\n" );
+    printf( "      \"file\": \"%s\",\n", bench->name );
+    printf( "      \"fragments\": %u,\n", FILE_SIZE / bench->chunk );
+    printf( "      \"link_map_items\": %u,\n", items );
+    printf( "      \"link_map_in\": \"%s\",\n",
+            (0 == items) ? "none" :
+            ((map_slot.file.clmt == map_slot.file.file.cltbl) ? "slot" : "heap") );
+    printf( "      \"seeks\": [\n" );
+
+    for( percent = 0; percent <= 100; percent += STEP_PERCENT ) {
+        DWORD goal = (DWORD) ((uint64_t) FILE_SIZE * percent / 100);
+
+        printf( "        {\n" );
+        printf( "          \"offset_percent\": %u,\n", percent );
+
+        /* A seek from the start of a file just opened. */
+        seek( &slot, bench->path, goal, false, true, &reads, &ns );
+        close_file( &slot );
+        print_seek( "fat_chain", reads, ns, false );
+
+        seek( &slot, bench->path, goal, true, true, &reads, &ns );
+        close_file( &slot );
+        print_seek( "fast_seek_first", reads, ns, false );
+
+        /* Seeking back from the end with the map already built. */
+        seek( &map_slot, bench->path, FILE_SIZE - 1, true, false, &reads, &ns );
+        seek( &map_slot, bench->path, goal, true, false, &reads, &ns );
+        print_seek( "fast_seek_later", reads, ns, true );
+
+        printf( "        }%s\n", (100 == percent) ? "" : "," );
+    }
+
+    printf( "      ]\n" );
+    printf( "    }%s\n", (true == last) ? "" : "," );
+    close_file( &map_slot );
+}
+
+int main( int argc, char *argv[] )
+{
+    static FATFS fs;
+    uint32_t count = sizeof(files) / sizeof(files[0]);
+    uint32_t i;
+
+    image = (uint8_t *) calloc( SECTORS, 512 );
+    if( NULL == image ) {
+        fail( "allocate", "image" );
+    }
+
+    f_mount( 0, &fs );
+    if( FR_OK != f_mkfs(0, 0, CLUSTER_SIZE) ) {
+        fail( "format", "image" );
+    }
+    write_files();
+
+    printf( "{\n" );
+    printf( "  \"cluster_size\": %u,\n", CLUSTER_SIZE );
+    printf( "  \"file_size\": %u,\n", FILE_SIZE );
+    printf( "  \"sector_read_us\": %u,\n", SECTOR_READ_US );
+    printf( "  \"files\": [\n" );
+    for( i = 0; i < count; i++ ) {
+        run( &files[i], (count - 1) == i );
+    }
+    printf( "  ]\n}\n" );
+
+    f_mount( 0, NULL );
+    free( image );
+    return 0;
+}
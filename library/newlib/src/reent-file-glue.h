@@ -26,7 +26,7 @@
 #include <linked-list/linked-list.h>
 
 #define REENT_GLUE_MAGIC        0x22221234
-#define REENT_GLUE_MAX_FILES    3
+#define REENT_GLUE_MAX_FILES    6
 
 struct reent_glue {
     struct _reent reent;    /* Needs to be first so we can re-cast this struct */
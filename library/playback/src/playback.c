@@ -32,6 +32,10 @@
 #define PB_COMMAND_MSG_MAX  10
 #define IDLE_QUEUE_SIZE     10
 
+/* Fast play listens to this much of the song, then moves on. */
+#define FAST_PLAY_LISTEN_MS 500
+#define FAST_PLAY_STEP_MS   5000
+
 #define PB_DEBUG 0
 
 #define _D1(...)
@@ -54,7 +58,9 @@ typedef enum {
     PB_CMD_INT__PLAY,
     PB_CMD_INT__RESUME,
     PB_CMD_INT__PAUSE,
-    PB_CMD_INT__STOP
+    PB_CMD_INT__STOP,
+    PB_CMD_INT__FAST_FORWARD,
+    PB_CMD_INT__FAST_REVERSE
 } pb_command_int_t;
 
 typedef struct {
@@ -79,13 +85,18 @@ static pb_command_msg_t __commands[PB_COMMAND_MSG_MAX];
 
 static uint16_t __tx_id = 0;
 
+/* The ms moved each time while fast playing, 0 when playing normally, &
+ * the place in the song the last move was to. */
+static int32_t __fast_play;
+static uint32_t __fast_play_from;
+
 /*----------------------------------------------------------------------------*/
 /*                             Function Prototypes                            */
 /*----------------------------------------------------------------------------*/
 static void __pb_task( void *params );
 static void __notify_and_return( const pb_status_t status,
                                  pb_command_msg_t *cmd );
-static bool __continue_decoding( void );
+static bool __continue_decoding( const uint32_t position, uint32_t *seek );
 
 /*----------------------------------------------------------------------------*/
 /*                             External Functions                             */
@@ -186,9 +197,11 @@ int32_t playback_command( const pb_command_t command,
     os_queue_receive( __cmd_idle, &cmd, WAIT_FOREVER );
 
     switch( command ) {
-        case PB_CMD__RESUME:    cmd_int = PB_CMD_INT__RESUME;   break;
-        case PB_CMD__PAUSE:     cmd_int = PB_CMD_INT__PAUSE;    break;
-        case PB_CMD__STOP:      cmd_int = PB_CMD_INT__STOP;     break;
+        case PB_CMD__RESUME:        cmd_int = PB_CMD_INT__RESUME;       break;
+        case PB_CMD__PAUSE:         cmd_int = PB_CMD_INT__PAUSE;        break;
+        case PB_CMD__STOP:          cmd_int = PB_CMD_INT__STOP;         break;
+        case PB_CMD__FAST_FORWARD:  cmd_int = PB_CMD_INT__FAST_FORWARD; break;
+        case PB_CMD__FAST_REVERSE:  cmd_int = PB_CMD_INT__FAST_REVERSE; break;
         default:
             return -1;
     }
@@ -225,6 +238,7 @@ static void __pb_task( void *params )
             }
 
             _D2( "Playing song: '%s'\n", cmd->filename );
+            __fast_play = 0;
             media_status = (*cmd->play_fn)( cmd->filename,
                                             cmd->gain, cmd->peak,
                                             __idle, IDLE_QUEUE_SIZE,
@@ -268,7 +282,7 @@ static void __notify_and_return( const pb_status_t status,
     os_queue_send_to_back( __cmd_idle, &cmd, WAIT_FOREVER );
 }
 
-static bool __continue_decoding( void )
+static bool __continue_decoding( const uint32_t position, uint32_t *seek )
 {
     pb_command_msg_t *cmd;
 
@@ -280,20 +294,54 @@ static bool __continue_decoding( void )
             os_queue_receive( __cmd_active, &cmd, WAIT_FOREVER );
             __notify_and_return( PB_STATUS__PAUSED, cmd );
             cmd = NULL;
+            __fast_play = 0;
 
             /* Wait for a resume, or error out & stop */
             os_queue_peek( __cmd_active, &cmd, WAIT_FOREVER );
-            if( PB_CMD_INT__RESUME == cmd->cmd ) {
+        }
+
+        switch( cmd->cmd ) {
+            case PB_CMD_INT__RESUME:
                 os_queue_receive( __cmd_active, &cmd, WAIT_FOREVER );
+                __fast_play = 0;
                 __notify_and_return( PB_STATUS__PLAYING, cmd );
-                cmd = NULL;
+                return true;
 
+            case PB_CMD_INT__FAST_FORWARD:
+            case PB_CMD_INT__FAST_REVERSE:
+                os_queue_receive( __cmd_active, &cmd, WAIT_FOREVER );
+                if( NULL == seek ) {
+                    /* The codec can't move in the song, keep playing. */
+                    __notify_and_return( PB_STATUS__PLAYING, cmd );
+                    return true;
+                }
+
+                __fast_play = FAST_PLAY_STEP_MS;
+                if( PB_CMD_INT__FAST_REVERSE == cmd->cmd ) {
+                    __fast_play = -FAST_PLAY_STEP_MS;
+                }
+                __fast_play_from = position;
+                __notify_and_return( PB_STATUS__FAST_PLAYING, cmd );
                 return true;
-            }
+
+            default:
+                break;
         }
 
         return false;
     }
 
+    /* Move on once enough of this part of the song has played. */
+    if( (0 != __fast_play) && (NULL != seek) &&
+        ((__fast_play_from + FAST_PLAY_LISTEN_MS) <= position) )
+    {
+        if( (__fast_play < 0) && (position < (uint32_t) -__fast_play) ) {
+            *seek = 0;
+        } else {
+            *seek = position + __fast_play;
+        }
+        __fast_play_from = *seek;
+    }
+
     return true;
 }
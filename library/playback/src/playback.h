@@ -24,11 +24,14 @@
 typedef enum {
     PB_CMD__RESUME,
     PB_CMD__PAUSE,
-    PB_CMD__STOP
+    PB_CMD__STOP,
+    PB_CMD__FAST_FORWARD,
+    PB_CMD__FAST_REVERSE
 } pb_command_t;
 
 typedef enum {
     PB_STATUS__PLAYING,
+    PB_STATUS__FAST_PLAYING,
     PB_STATUS__PAUSED,
     PB_STATUS__STOPPED,
     PB_STATUS__END_OF_SONG,
@@ -64,6 +67,10 @@ int32_t playback_play( const char *filename,
 /**
  *  Used to command the playback system.
  *
+ *  @note PB_CMD__FAST_FORWARD & PB_CMD__FAST_REVERSE play a little of
+ *        the song at a time, skipping through it until PB_CMD__RESUME.
+ *        If the song can't be skipped through, it just keeps playing.
+ *
  *  @param command the command to apply to the system
  *  @param cb_fn the callback to call with information
  *